@@ -0,0 +1,208 @@
+/*
+ * agent.c - Ship recorded session CSVs to a collector (POSIX)
+ *
+ * Streams each file as a session named after its basename, using the
+ * same block protocol as the recorders' --agent mode (see fleet.h).
+ * Files the collector already holds cost a single round trip, so it is
+ * safe to run repeatedly over an output directory.
+ *
+ * --clock instead measures this host's CLOCK_MONOTONIC against the
+ * collector's, the same exchange recorders run while streaming.
+ *
+ * Build: make agent (see Makefile)
+ * Usage: ./agent [-i agent_id] host[:port] session.csv [more.csv ...]
+ *        ./agent --clock [-n pings] host[:port]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fleet.h"
+
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t *rows;      /* byte offset of each data row */
+    long nrows;
+    char *metadata;    /* leading "# ..." lines */
+} CsvSource;
+
+static FleetAgent *current_agent = NULL;
+
+static long csv_available(void *ctx) {
+    return ((CsvSource *)ctx)->nrows;
+}
+
+static int csv_finished(void *ctx) {
+    (void)ctx;
+    return 1;
+}
+
+static long csv_format(void *ctx, long first, long count, char *buf, size_t cap, size_t *len) {
+    CsvSource *s = ctx;
+    size_t used = 0;
+    long i;
+    for (i = 0; i < count; i++) {
+        long r = first + i;
+        size_t from = s->rows[r];
+        size_t to = r + 1 < s->nrows ? s->rows[r + 1] : s->size;
+        if (used + (to - from) + 1 > cap) break;
+        memcpy(buf + used, s->data + from, to - from);
+        used += to - from;
+        if (buf[used - 1] != '\n') buf[used++] = '\n';
+    }
+    *len = used;
+    return i;
+}
+
+static int load_csv(const char *path, CsvSource *s) {
+    memset(s, 0, sizeof(*s));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    s->size = (size_t)st.st_size;
+    s->data = mmap(NULL, s->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (s->data == MAP_FAILED) return -1;
+
+    /* Metadata comments, then the column header, then rows */
+    size_t pos = 0, meta_end = 0;
+    int header_seen = 0;
+    size_t cap = 1024;
+    s->rows = malloc(cap * sizeof(size_t));
+    while (pos < s->size) {
+        const char *nl = memchr(s->data + pos, '\n', s->size - pos);
+        size_t next = nl ? (size_t)(nl - s->data) + 1 : s->size;
+        if (s->data[pos] == '#') {
+            meta_end = next;
+        } else if (!header_seen) {
+            header_seen = 1;
+        } else if (next - pos > 1) {
+            if ((size_t)s->nrows == cap) {
+                cap *= 2;
+                s->rows = realloc(s->rows, cap * sizeof(size_t));
+            }
+            s->rows[s->nrows++] = pos;
+        }
+        pos = next;
+    }
+
+    s->metadata = malloc(meta_end + 1);
+    memcpy(s->metadata, s->data, meta_end);
+    s->metadata[meta_end] = '\0';
+    return 0;
+}
+
+static void free_csv(CsvSource *s) {
+    munmap((void *)s->data, s->size);
+    free(s->rows);
+    free(s->metadata);
+}
+
+static int clock_probe(const char *addr, int count) {
+    FleetClock c;
+    if (fleet_clock_probe(addr, count, fleet_now_ms, &c) != 0) {
+        fprintf(stderr, "Error: clock probe of %s failed\n", addr);
+        return 1;
+    }
+    char buf[512];
+    fleet_format_clock(&c, addr, buf, sizeof(buf));
+    fputs(buf, stdout);
+    return 0;
+}
+
+static void signal_handler(int sig) {
+    (void)sig;
+    if (current_agent) current_agent->stop = 1;
+}
+
+int main(int argc, char *argv[]) {
+    char agent_id[256];
+    if (gethostname(agent_id, sizeof(agent_id)) != 0) strcpy(agent_id, "agent");
+    agent_id[sizeof(agent_id) - 1] = '\0';
+    char *dot = strchr(agent_id, '.');
+    if (dot) *dot = '\0';
+
+    int argi = 1;
+    if (argi < argc && !strcmp(argv[argi], "--clock")) {
+        int count = 4 * FLEET_SYNC_WINDOW;
+        argi++;
+        if (argi + 1 < argc && !strcmp(argv[argi], "-n")) {
+            count = atoi(argv[argi + 1]);
+            argi += 2;
+        }
+        if (argi >= argc || count < 1) {
+            fprintf(stderr, "Usage: %s --clock [-n pings] host[:port]\n", argv[0]);
+            return 1;
+        }
+        return clock_probe(argv[argi], count);
+    }
+    if (argi + 1 < argc && !strcmp(argv[argi], "-i")) {
+        snprintf(agent_id, sizeof(agent_id), "%s", argv[argi + 1]);
+        argi += 2;
+    }
+    if (argc - argi < 2) {
+        fprintf(stderr, "Usage: %s [-i agent_id] host[:port] session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+    const char *addr = argv[argi++];
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, signal_handler);
+    signal(SIGTERM, signal_handler);
+
+    int failures = 0;
+    for (; argi < argc; argi++) {
+        const char *path = argv[argi];
+        CsvSource src;
+        if (load_csv(path, &src) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", path);
+            failures++;
+            continue;
+        }
+
+        char session[256];
+        char pathcopy[1024];
+        snprintf(pathcopy, sizeof(pathcopy), "%s", path);
+        snprintf(session, sizeof(session), "%s", basename(pathcopy));
+        char *ext = strrchr(session, '.');
+        if (ext && !strcmp(ext, ".csv")) *ext = '\0';
+
+        FleetAgent a;
+        memset(&a, 0, sizeof(a));
+        a.addr = addr;
+        a.agent_id = agent_id;
+        a.session = session;
+        a.metadata = src.metadata;
+        a.src.available = csv_available;
+        a.src.format = csv_format;
+        a.src.finished = csv_finished;
+        a.src.ctx = &src;
+        a.quiet = 1;
+
+        current_agent = &a;
+        int rc = fleet_agent_run(&a);
+        current_agent = NULL;
+
+        if (rc == 0) {
+            fprintf(stderr, "%s: %ld rows acknowledged (%ld blocks sent)\n",
+                    path, a.acked, a.blocks_sent);
+        } else {
+            fprintf(stderr, "%s: interrupted at seq %ld of %ld\n", path, a.acked, src.nrows);
+            failures++;
+        }
+        free_csv(&src);
+        if (a.stop) break;
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * baseline.c - Train and test a per-user typing baseline (POSIX)
+ *
+ * Replays sessions through baseline.h exactly as the recorder does live:
+ * each window of digraphs is scored against the model and, unless it is
+ * anomalous, learned into it. Prints one CSV row per window:
+ *
+ *   session,window,seq,scored,score,anomalous
+ *
+ * seq is the last key press of the window; score is empty while the
+ * model knows too few of the window's digraphs.
+ *
+ * Build: make baseline (see Makefile)
+ * Usage: ./baseline [-n] model.ktb session.csv [more.csv ...]
+ *        -n scores without learning (to test other typists' sessions)
+ *           and opens the model read-only; it must already exist.
+ *        Otherwise model.ktb is created if it does not exist.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "session.h"
+#include "baseline.h"
+
+int main(int argc, char *argv[]) {
+    int frozen = 0, argi = 1;
+    if (argi < argc && !strcmp(argv[argi], "-n")) {
+        frozen = 1;
+        argi++;
+    }
+    if (argc - argi < 2) {
+        fprintf(stderr, "Usage: %s [-n] model.ktb session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    Baseline b;
+    if (baseline_open(&b, argv[argi], frozen) != 0) {
+        fprintf(stderr, "Error: cannot open model %s\n", argv[argi]);
+        return 1;
+    }
+
+    int failures = 0;
+    long windows = 0, anomalous = 0;
+    printf("session,window,seq,scored,score,anomalous\n");
+    for (argi++; argi < argc; argi++) {
+        Session s;
+        if (session_load(argv[argi], &s) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", argv[argi]);
+            failures++;
+            continue;
+        }
+        b.have_prev = 0;
+        b.npending = b.scored = 0;
+        b.z2 = 0;
+        long n = 0;
+        for (size_t i = 0; i < s.count; i++) {
+            const SessionEvent *e = &s.events[i];
+            if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+            BaselineWindow w;
+            if (!baseline_key_down(&b, e->character, e->timestamp_ms, &w)) continue;
+            printf("%s,%ld,%lld,%d,", argv[argi], ++n, (long long)e->seq, w.scored);
+            if (isnan(w.score)) printf(",0\n");
+            else printf("%.3f,%d\n", w.score, w.anomalous);
+            windows++;
+            anomalous += w.anomalous;
+        }
+        session_free(&s);
+    }
+    fprintf(stderr, "%ld windows, %ld anomalous; model: %u digraphs, %llu learned, %u sessions\n",
+            windows, anomalous, b.hdr->used, (unsigned long long)b.hdr->learned, b.hdr->sessions);
+    baseline_close(&b);
+    return failures ? 1 : 0;
+}
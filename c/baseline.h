@@ -0,0 +1,225 @@
+/*
+ * baseline.h - Per-user digraph timing baseline with live anomaly scoring (POSIX)
+ *
+ * The model is a fixed-size open-addressing table of digraphs (two
+ * consecutive key presses), each holding a running count, mean and
+ * variance of log press-to-press latency. It lives in a file mapped
+ * MAP_SHARED, so opening it is instant, updates are stores into the
+ * mapping, and the kernel writes them back; no keystrokes are kept.
+ *
+ * Scoring works on tumbling windows of BASELINE_WINDOW digraphs. Each
+ * digraph the model has seen at least BASELINE_MIN_COUNT times gets a
+ * z-score (clamped to +-BASELINE_Z_CLAMP); a window's score is the RMS of
+ * its z-scores, about 1 for the enrolled typist. Scores above
+ * BASELINE_THRESHOLD mark the window anomalous. A window's digraphs are
+ * learned into the model only when it is not anomalous, so an intruder
+ * does not become the baseline, nor take up its slots; counts saturate
+ * at BASELINE_MAX_WEIGHT so the model keeps tracking slow drift. Every
+ * call is O(1).
+ *
+ * Model file layout (native byte order, not meant to move between hosts):
+ *
+ *   "KTBL" | u32 version | u32 slots | u32 used | u64 digraphs learned |
+ *   u32 sessions | u32 0
+ *   slots x { u64 digraph hash | u32 count | f32 mean | f32 M2 | u32 0 }
+ *
+ * Used by terminal_macos.c (--baseline) and baseline.c.
+ */
+
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define BASELINE_MAGIC "KTBL"
+#define BASELINE_VERSION 1
+#define BASELINE_SLOTS 8192         /* power of two; filled to at most 3/4 */
+#define BASELINE_WINDOW 50
+#define BASELINE_MIN_COUNT 10
+#define BASELINE_MAX_WEIGHT 500
+#define BASELINE_Z_CLAMP 6.0
+#define BASELINE_THRESHOLD 1.5
+#define BASELINE_PAUSE_MS 1000.0    /* longer gaps are not digraphs, as in session_stats */
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t slots;
+    uint32_t used;
+    uint64_t learned;
+    uint32_t sessions;
+    uint32_t reserved;
+} BaselineHeader;
+
+typedef struct {
+    uint64_t key;               /* 0 = empty */
+    uint32_t count;
+    float mean;
+    float m2;
+    uint32_t reserved;
+} BaselineSlot;
+
+typedef struct {
+    double score;               /* RMS z-score, NAN while too few digraphs are known */
+    int scored;                 /* digraphs in the window the model could score */
+    int anomalous;
+} BaselineWindow;
+
+typedef struct {
+    BaselineHeader *hdr;
+    BaselineSlot *slots;
+    size_t size;
+
+    /* current window */
+    char prev[16];
+    double prev_ms;
+    int have_prev;
+    struct {
+        uint64_t key;
+        float x;
+    } pending[BASELINE_WINDOW];
+    int npending;
+    int scored;
+    double z2;
+    int frozen;                 /* score only, never learn */
+} Baseline;
+
+/*
+ * Maps the model at path, creating an empty one if it does not exist.
+ * A frozen model is mapped read-only and must exist; opening it leaves
+ * the file untouched, session count included.
+ */
+static inline int baseline_open(Baseline *b, const char *path, int frozen) {
+    memset(b, 0, sizeof(*b));
+    b->size = sizeof(BaselineHeader) + BASELINE_SLOTS * sizeof(BaselineSlot);
+    b->frozen = frozen;
+    int fd = frozen ? open(path, O_RDONLY) : open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) return -1;
+    struct stat st;
+    int fresh = fstat(fd, &st) == 0 && st.st_size == 0;
+    if ((fresh && (frozen || ftruncate(fd, (off_t)b->size) != 0)) ||
+        (!fresh && (size_t)st.st_size != b->size)) {
+        close(fd);
+        return -1;
+    }
+    void *p = mmap(NULL, b->size, frozen ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return -1;
+    b->hdr = p;
+    b->slots = (BaselineSlot *)(b->hdr + 1);
+    if (fresh) {
+        memcpy(b->hdr->magic, BASELINE_MAGIC, 4);
+        b->hdr->version = BASELINE_VERSION;
+        b->hdr->slots = BASELINE_SLOTS;
+    } else if (memcmp(b->hdr->magic, BASELINE_MAGIC, 4) != 0 || b->hdr->version != BASELINE_VERSION ||
+               b->hdr->slots != BASELINE_SLOTS) {
+        munmap(p, b->size);
+        return -1;
+    }
+    if (!frozen) b->hdr->sessions++;
+    return 0;
+}
+
+static inline void baseline_close(Baseline *b) {
+    if (!b->hdr) return;
+    if (!b->frozen) msync(b->hdr, b->size, MS_SYNC);
+    munmap(b->hdr, b->size);
+    b->hdr = NULL;
+}
+
+static inline uint64_t baseline_hash(const char *a, const char *c) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)a; *p; p++) h = (h ^ *p) * 1099511628211ULL;
+    h = (h ^ ' ') * 1099511628211ULL;
+    for (const unsigned char *p = (const unsigned char *)c; *p; p++) h = (h ^ *p) * 1099511628211ULL;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h ? h : 1;
+}
+
+/* The digraph's slot, NULL if the model has not learned it */
+static inline const BaselineSlot *baseline_find(const Baseline *b, uint64_t key) {
+    for (uint32_t i = (uint32_t)key & (BASELINE_SLOTS - 1);; i = (i + 1) & (BASELINE_SLOTS - 1)) {
+        const BaselineSlot *s = &b->slots[i];
+        if (s->key == key) return s;
+        if (s->key == 0) return NULL;
+    }
+}
+
+/* The digraph's slot, claiming an empty one if there is room; NULL if full */
+static inline BaselineSlot *baseline_slot(Baseline *b, uint64_t key) {
+    for (uint32_t i = (uint32_t)key & (BASELINE_SLOTS - 1);; i = (i + 1) & (BASELINE_SLOTS - 1)) {
+        BaselineSlot *s = &b->slots[i];
+        if (s->key == key) return s;
+        if (s->key == 0) {
+            if (b->frozen || b->hdr->used >= BASELINE_SLOTS / 4 * 3) return NULL;
+            s->key = key;
+            b->hdr->used++;
+            return s;
+        }
+    }
+}
+
+static inline void baseline_learn(Baseline *b, BaselineSlot *s, float x) {
+    uint32_t n = s->count < BASELINE_MAX_WEIGHT ? s->count + 1 : BASELINE_MAX_WEIGHT;
+    float delta = x - s->mean;
+    s->mean += delta / (float)n;
+    s->m2 += delta * (x - s->mean);
+    if (s->count == BASELINE_MAX_WEIGHT) s->m2 *= (float)(n - 1) / (float)n;
+    s->count = n;
+    b->hdr->learned++;
+}
+
+/*
+ * Feeds one non-repeat key press. Returns 1 and fills w when it completes
+ * a window.
+ */
+static inline int baseline_key_down(Baseline *b, const char *character, double ms, BaselineWindow *w) {
+    int had_prev = b->have_prev && ms - b->prev_ms <= BASELINE_PAUSE_MS;
+    char prev[16];
+    memcpy(prev, b->prev, sizeof(prev));
+    snprintf(b->prev, sizeof(b->prev), "%s", character);
+    double gap = ms - b->prev_ms;
+    b->prev_ms = ms;
+    b->have_prev = 1;
+    if (!had_prev || gap <= 0) return 0;
+
+    float x = (float)log(gap);
+    uint64_t key = baseline_hash(prev, character);
+    const BaselineSlot *s = baseline_find(b, key);
+    if (s && s->count >= BASELINE_MIN_COUNT) {
+        double sd = sqrt(s->m2 / (double)(s->count - 1));
+        double z = (x - s->mean) / (sd > 0.05 ? sd : 0.05);
+        if (z > BASELINE_Z_CLAMP) z = BASELINE_Z_CLAMP;
+        if (z < -BASELINE_Z_CLAMP) z = -BASELINE_Z_CLAMP;
+        b->z2 += z * z;
+        b->scored++;
+    }
+    b->pending[b->npending].key = key;
+    b->pending[b->npending].x = x;
+    if (++b->npending < BASELINE_WINDOW) return 0;
+
+    w->scored = b->scored;
+    w->score = b->scored >= BASELINE_WINDOW / 2 ? sqrt(b->z2 / b->scored) : NAN;
+    w->anomalous = w->score > BASELINE_THRESHOLD;
+    if (!w->anomalous && !b->frozen) {
+        for (int i = 0; i < b->npending; i++) {
+            BaselineSlot *slot = baseline_slot(b, b->pending[i].key);
+            if (slot) baseline_learn(b, slot, b->pending[i].x);
+        }
+    }
+    b->npending = 0;
+    b->scored = 0;
+    b->z2 = 0;
+    return 1;
+}
+
+#endif /* BASELINE_H */
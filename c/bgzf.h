@@ -0,0 +1,364 @@
+/*
+ * bgzf.h - Seekable block-gzip (BGZF) output with parallel compression (POSIX)
+ *
+ * The output is a series of independent gzip members holding at most
+ * 0xff00 bytes of input each, in the layout htslib calls BGZF: every
+ * member carries a "BC" extra field with its compressed size, and the
+ * file ends with the standard empty EOF member. Plain gunzip reads it as
+ * one stream; with the "<file>.gzi" index written next to it, any
+ * uncompressed offset is one block read away.
+ *
+ * bgzf_open() returns an ordinary FILE * (fopencookie/funopen), so code
+ * that writes CSV with fputs/fprintf works unchanged. Full blocks are
+ * compressed by a pool of worker threads while the caller keeps writing;
+ * the caller's thread writes finished blocks out in order. On Linux,
+ * fopencookie() needs _GNU_SOURCE defined before the first include.
+ *
+ * Index file layout (.gzi, as written by `bgzip -i`, little-endian):
+ *
+ *   u64 count | count x { u64 compressed offset | u64 uncompressed offset }
+ *
+ * one entry per block boundary after the first block. A virtual offset is
+ * compressed block offset << 16 | offset within the uncompressed block.
+ *
+ * Used by terminal_macos.c (.csv.gz output) and bgzf.c.
+ */
+
+#ifndef BGZF_H
+#define BGZF_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#define BGZF_BLOCK_DATA 0xff00      /* input bytes per member */
+#define BGZF_MAX_BLOCK 65536        /* member size limit, header included */
+#define BGZF_HEADER 18
+#define BGZF_FOOTER 8
+#define BGZF_SLOTS_PER_THREAD 4
+
+static const unsigned char BGZF_EOF[28] = {
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43,
+    0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+enum { BGZF_FREE = 0, BGZF_FILLED = 1, BGZF_DONE = 2 };
+
+typedef struct {
+    unsigned char in[BGZF_BLOCK_DATA];
+    size_t in_len;
+    unsigned char out[BGZF_MAX_BLOCK];
+    size_t out_len;
+    int state;
+} BgzfSlot;
+
+typedef struct {
+    uint64_t coffset, uoffset;
+} BgzfIndexEntry;
+
+typedef struct {
+    FILE *f;
+    char *gzi_path;
+    int level;
+    int threads;
+    BgzfSlot *slots;
+    uint64_t nslots;
+    uint64_t fill_seq;      /* block the caller is filling */
+    uint64_t next_job;      /* next filled block for a worker */
+    uint64_t write_seq;     /* next block to write out */
+    pthread_mutex_t mu;
+    pthread_cond_t cv;
+    pthread_t *tids;
+    int stop;
+    uint64_t coffset, uoffset;
+    BgzfIndexEntry *index;
+    size_t index_len, index_cap;
+    int error;
+} Bgzf;
+
+static inline void bgzf_put16(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static inline void bgzf_put32(unsigned char *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+/* Compresses one slot into a complete gzip member */
+static inline void bgzf_compress(z_stream *zs, BgzfSlot *s) {
+    static const unsigned char header[BGZF_HEADER - 2] = {
+        0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+    };
+    memcpy(s->out, header, sizeof(header));
+
+    deflateReset(zs);
+    zs->next_in = s->in;
+    zs->avail_in = (uInt)s->in_len;
+    zs->next_out = s->out + BGZF_HEADER;
+    zs->avail_out = BGZF_MAX_BLOCK - BGZF_HEADER - BGZF_FOOTER;
+    size_t body;
+    if (deflate(zs, Z_FINISH) == Z_STREAM_END) {
+        body = BGZF_MAX_BLOCK - BGZF_HEADER - BGZF_FOOTER - zs->avail_out;
+    } else {
+        /* Incompressible: one stored deflate block always fits */
+        unsigned char *p = s->out + BGZF_HEADER;
+        p[0] = 1;
+        bgzf_put16(p + 1, (uint32_t)s->in_len);
+        bgzf_put16(p + 3, (uint32_t)~s->in_len & 0xffff);
+        memcpy(p + 5, s->in, s->in_len);
+        body = 5 + s->in_len;
+    }
+
+    unsigned char *tail = s->out + BGZF_HEADER + body;
+    bgzf_put32(tail, (uint32_t)crc32(0, s->in, (uInt)s->in_len));
+    bgzf_put32(tail + 4, (uint32_t)s->in_len);
+    s->out_len = BGZF_HEADER + body + BGZF_FOOTER;
+    bgzf_put16(s->out + 16, (uint32_t)(s->out_len - 1));
+}
+
+static inline void *bgzf_worker(void *arg) {
+    Bgzf *z = arg;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    deflateInit2(&zs, z->level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+
+    pthread_mutex_lock(&z->mu);
+    for (;;) {
+        while (z->next_job == z->fill_seq && !z->stop) pthread_cond_wait(&z->cv, &z->mu);
+        if (z->next_job == z->fill_seq) break;
+        BgzfSlot *s = &z->slots[z->next_job++ % z->nslots];
+        pthread_mutex_unlock(&z->mu);
+        bgzf_compress(&zs, s);
+        pthread_mutex_lock(&z->mu);
+        s->state = BGZF_DONE;
+        pthread_cond_broadcast(&z->cv);
+    }
+    pthread_mutex_unlock(&z->mu);
+    deflateEnd(&zs);
+    return NULL;
+}
+
+static inline void bgzf_index_add(Bgzf *z) {
+    if (z->index_len == z->index_cap) {
+        z->index_cap = z->index_cap ? z->index_cap * 2 : 256;
+        z->index = realloc(z->index, z->index_cap * sizeof(BgzfIndexEntry));
+    }
+    z->index[z->index_len].coffset = z->coffset;
+    z->index[z->index_len].uoffset = z->uoffset;
+    z->index_len++;
+}
+
+/*
+ * Writes finished blocks in order. With all set, waits until every
+ * submitted block is out; otherwise until the slot to fill next is free.
+ * Called with the lock held.
+ */
+static inline void bgzf_drain(Bgzf *z, int all) {
+    for (;;) {
+        BgzfSlot *s = &z->slots[z->write_seq % z->nslots];
+        if (z->write_seq < z->fill_seq && s->state == BGZF_DONE) {
+            pthread_mutex_unlock(&z->mu);
+            if (fwrite(s->out, 1, s->out_len, z->f) != s->out_len) z->error = 1;
+            z->coffset += s->out_len;
+            z->uoffset += s->in_len;
+            bgzf_index_add(z);
+            pthread_mutex_lock(&z->mu);
+            s->state = BGZF_FREE;
+            s->in_len = 0;
+            z->write_seq++;
+            continue;
+        }
+        if (all ? z->write_seq == z->fill_seq
+                : z->slots[z->fill_seq % z->nslots].state == BGZF_FREE) break;
+        pthread_cond_wait(&z->cv, &z->mu);
+    }
+}
+
+static inline void bgzf_submit(Bgzf *z) {
+    pthread_mutex_lock(&z->mu);
+    z->slots[z->fill_seq % z->nslots].state = BGZF_FILLED;
+    z->fill_seq++;
+    pthread_cond_broadcast(&z->cv);
+    bgzf_drain(z, 0);
+    pthread_mutex_unlock(&z->mu);
+}
+
+static inline ssize_t bgzf_cookie_write(void *cookie, const char *buf, size_t size) {
+    Bgzf *z = cookie;
+    size_t done = 0;
+    while (done < size) {
+        BgzfSlot *s = &z->slots[z->fill_seq % z->nslots];
+        size_t n = BGZF_BLOCK_DATA - s->in_len;
+        if (n > size - done) n = size - done;
+        memcpy(s->in + s->in_len, buf + done, n);
+        s->in_len += n;
+        done += n;
+        if (s->in_len == BGZF_BLOCK_DATA) bgzf_submit(z);
+    }
+    return z->error ? 0 : (ssize_t)size;
+}
+
+static inline int bgzf_write_index(const Bgzf *z) {
+    FILE *f = fopen(z->gzi_path, "wb");
+    if (!f) return -1;
+    unsigned char e[16];
+    memset(e, 0, sizeof(e));
+    for (int i = 0; i < 8; i++) e[i] = (unsigned char)((uint64_t)z->index_len >> (8 * i));
+    fwrite(e, 1, 8, f);
+    for (size_t k = 0; k < z->index_len; k++) {
+        for (int i = 0; i < 8; i++) {
+            e[i] = (unsigned char)(z->index[k].coffset >> (8 * i));
+            e[8 + i] = (unsigned char)(z->index[k].uoffset >> (8 * i));
+        }
+        fwrite(e, 1, 16, f);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static inline int bgzf_cookie_close(void *cookie) {
+    Bgzf *z = cookie;
+    if (z->slots[z->fill_seq % z->nslots].in_len > 0) bgzf_submit(z);
+
+    pthread_mutex_lock(&z->mu);
+    bgzf_drain(z, 1);
+    z->stop = 1;
+    pthread_cond_broadcast(&z->cv);
+    pthread_mutex_unlock(&z->mu);
+    for (int i = 0; i < z->threads; i++) pthread_join(z->tids[i], NULL);
+
+    if (fwrite(BGZF_EOF, 1, sizeof(BGZF_EOF), z->f) != sizeof(BGZF_EOF)) z->error = 1;
+    if (fclose(z->f) != 0) z->error = 1;
+    if (bgzf_write_index(z) != 0) z->error = 1;
+
+    int error = z->error;
+    pthread_mutex_destroy(&z->mu);
+    pthread_cond_destroy(&z->cv);
+    free(z->tids);
+    free(z->slots);
+    free(z->index);
+    free(z->gzi_path);
+    free(z);
+    return error ? -1 : 0;
+}
+
+#ifdef __APPLE__
+static inline int bgzf_funopen_write(void *cookie, const char *buf, int size) {
+    return bgzf_cookie_write(cookie, buf, (size_t)size) == size ? size : -1;
+}
+#endif
+
+/*
+ * Opens path for BGZF output with the given number of compression
+ * threads (at least 1) and zlib level. fclose() flushes the last block
+ * and writes the EOF member and <path>.gzi.
+ */
+static inline FILE *bgzf_open(const char *path, int threads, int level) {
+    Bgzf *z = calloc(1, sizeof(Bgzf));
+    z->f = fopen(path, "wb");
+    if (!z->f) {
+        free(z);
+        return NULL;
+    }
+    size_t n = strlen(path);
+    z->gzi_path = malloc(n + 5);
+    memcpy(z->gzi_path, path, n);
+    memcpy(z->gzi_path + n, ".gzi", 5);
+    z->level = level;
+    z->threads = threads > 0 ? threads : 1;
+    z->nslots = (uint64_t)z->threads * BGZF_SLOTS_PER_THREAD;
+    z->slots = calloc(z->nslots, sizeof(BgzfSlot));
+    pthread_mutex_init(&z->mu, NULL);
+    pthread_cond_init(&z->cv, NULL);
+    z->tids = calloc((size_t)z->threads, sizeof(pthread_t));
+    for (int i = 0; i < z->threads; i++) pthread_create(&z->tids[i], NULL, bgzf_worker, z);
+
+#ifdef __APPLE__
+    FILE *f = funopen(z, NULL, bgzf_funopen_write, NULL, bgzf_cookie_close);
+#else
+    cookie_io_functions_t io = { NULL, bgzf_cookie_write, NULL, bgzf_cookie_close };
+    FILE *f = fopencookie(z, "w", io);
+#endif
+    if (f) setvbuf(f, NULL, _IOFBF, BGZF_BLOCK_DATA);
+    return f;
+}
+
+/* ---- Reading ---- */
+
+/* Loads a .gzi index, prepending the implicit first block (0, 0) */
+static inline int bgzf_index_load(const char *path, BgzfIndexEntry **entries, size_t *count) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    unsigned char e[16];
+    if (fread(e, 1, 8, f) != 8) {
+        fclose(f);
+        return -1;
+    }
+    uint64_t n = 0;
+    for (int i = 7; i >= 0; i--) n = (n << 8) | e[i];
+    BgzfIndexEntry *ix = malloc((size_t)(n + 1) * sizeof(BgzfIndexEntry));
+    ix[0].coffset = ix[0].uoffset = 0;
+    for (uint64_t k = 1; k <= n; k++) {
+        if (fread(e, 1, 16, f) != 16) {
+            free(ix);
+            fclose(f);
+            return -1;
+        }
+        ix[k].coffset = ix[k].uoffset = 0;
+        for (int i = 7; i >= 0; i--) {
+            ix[k].coffset = (ix[k].coffset << 8) | e[i];
+            ix[k].uoffset = (ix[k].uoffset << 8) | e[8 + i];
+        }
+    }
+    fclose(f);
+    *entries = ix;
+    *count = (size_t)n + 1;
+    return 0;
+}
+
+/* Virtual offset (block offset << 16 | offset in block) of an uncompressed offset */
+static inline uint64_t bgzf_virtual_offset(const BgzfIndexEntry *ix, size_t count, uint64_t uoffset) {
+    size_t lo = 0, hi = count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ix[mid].uoffset <= uoffset) lo = mid;
+        else hi = mid;
+    }
+    return ix[lo].coffset << 16 | (uoffset - ix[lo].uoffset);
+}
+
+/*
+ * Reads and inflates the member at coffset into out, which must hold
+ * BGZF_BLOCK_DATA bytes. Returns the uncompressed length, or -1; *next
+ * is set to the offset of the following member.
+ */
+static inline long bgzf_read_block(FILE *f, uint64_t coffset, unsigned char *out, uint64_t *next) {
+    unsigned char block[BGZF_MAX_BLOCK];
+    if (fseeko(f, (off_t)coffset, SEEK_SET) != 0 || fread(block, 1, BGZF_HEADER, f) != BGZF_HEADER)
+        return -1;
+    if (block[0] != 0x1f || block[1] != 0x8b || block[12] != 'B' || block[13] != 'C') return -1;
+    size_t size = ((size_t)block[16] | ((size_t)block[17] << 8)) + 1;
+    if (size < BGZF_HEADER + BGZF_FOOTER ||
+        fread(block + BGZF_HEADER, 1, size - BGZF_HEADER, f) != size - BGZF_HEADER)
+        return -1;
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    inflateInit2(&zs, -15);
+    zs.next_in = block + BGZF_HEADER;
+    zs.avail_in = (uInt)(size - BGZF_HEADER - BGZF_FOOTER);
+    zs.next_out = out;
+    zs.avail_out = BGZF_BLOCK_DATA;
+    int rc = inflate(&zs, Z_FINISH);
+    long len = (long)(BGZF_BLOCK_DATA - zs.avail_out);
+    inflateEnd(&zs);
+    if (rc != Z_STREAM_END) return -1;
+    if (next) *next = coffset + size;
+    return len;
+}
+
+#endif /* BGZF_H */
@@ -0,0 +1,377 @@
+/*
+ * bootstrap.c - Bootstrap confidence intervals for cohort timing quantiles (POSIX)
+ *
+ * Groups sessions into cohorts by a metadata key (-g, e.g. platform; all
+ * sessions form one cohort without it) and reports, per cohort, a
+ * quantile (-q, default the median) of one timing series, with a
+ * percentile bootstrap confidence interval, and its difference from the
+ * reference cohort (-r, default the first one seen) with an interval of
+ * its own. Series are defined as in session_stats:
+ *   dwell    key_down -> key_up of the same key
+ *   flight   previous key_up -> key_down
+ *   digraph  key_down -> next key_down, gaps over -p ms left out
+ *
+ * Keystrokes within a session are not independent, so replicates resample
+ * whole sessions with replacement and pool their values; a cohort of a
+ * single session falls back to resampling its values. Each replicate
+ * draws from a counter-based generator keyed by (seed, replicate, cohort,
+ * draw), so results do not depend on the thread count. Replicates are
+ * spread over one worker per core, each with its own draw counts.
+ *
+ * Replicates are never pooled or sorted: every session's values are
+ * sorted once, and a replicate's quantile is found by bisecting over the
+ * cohort's sorted values, counting the values at or below each candidate
+ * in the drawn sessions with binary searches weighted by how often each
+ * was drawn. That is O(log values x drawn sessions x log session length)
+ * per replicate instead of O(values).
+ *
+ * Prints CSV: cohort,sessions,values,estimate_ms,ci_lo_ms,ci_hi_ms,
+ * diff_ms,diff_lo_ms,diff_hi_ms (the diff fields are empty for the
+ * reference).
+ *
+ * Build: make bootstrap (see Makefile)
+ * Usage: ./bootstrap [-m dwell|flight|digraph] [-q quantile] [-B replicates] [-c level] [-g key]
+ *                    [-r cohort] [-s seed] [-p ms] [-@ threads] session.csv [more.csv ...]
+ *        defaults: flight, 0.5, 2000 replicates, level 0.95. A "-"
+ *        argument reads further paths from stdin, one per line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "session.h"
+
+enum { SERIES_DWELL, SERIES_FLIGHT, SERIES_DIGRAPH };
+
+typedef struct {
+    char *path;
+    double *v;                  /* the session's series, NULL if unreadable */
+    size_t n;
+    char cohort[64];
+} Result;
+
+typedef struct {
+    char name[64];
+    size_t *members;            /* indices into results */
+    size_t sessions, cap;
+    size_t values;
+    double *sorted;             /* every value of the cohort, ascending */
+    double *stat;               /* [replicates] */
+} Cohort;
+
+typedef struct {
+    /* loading */
+    Result *results;
+    size_t count;
+    int series;
+    double pause_ms;
+    const char *group_key;
+    /* replicates */
+    Cohort *cohorts;
+    size_t ncohorts;
+    size_t replicates;
+    double quantile;
+    uint64_t seed;
+    size_t next;                /* claimed with __atomic_fetch_add */
+} Work;
+
+static int value_cmp(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void extract(const Session *s, int series, double pause_ms, double *down_at, Result *r) {
+    r->v = malloc((s->count + 1) * sizeof(double));
+    r->n = 0;
+    for (int k = 0; k < 65536; k++) down_at[k] = NAN;
+    double last_up = NAN, prev_t = NAN;
+    for (size_t i = 0; i < s->count; i++) {
+        const SessionEvent *e = &s->events[i];
+        int k = e->keycode & 0xFFFF;
+        double t = e->timestamp_ms;
+        if (e->type == SESSION_KEY_UP) {
+            if (series == SERIES_DWELL && !isnan(down_at[k])) r->v[r->n++] = t - down_at[k];
+            down_at[k] = NAN;
+            last_up = t;
+            continue;
+        }
+        if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+        down_at[k] = t;
+        if (series == SERIES_FLIGHT && !isnan(last_up)) r->v[r->n++] = t - last_up;
+        if (series == SERIES_DIGRAPH && !isnan(prev_t) && t - prev_t <= pause_ms) r->v[r->n++] = t - prev_t;
+        prev_t = t;
+    }
+}
+
+static void *load_worker(void *arg) {
+    Work *w = arg;
+    double *down_at = malloc(65536 * sizeof(double));
+    for (;;) {
+        size_t i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED);
+        if (i >= w->count) break;
+        Result *r = &w->results[i];
+        Session s;
+        if (session_load(r->path, &s) != 0) continue;
+        extract(&s, w->series, w->pause_ms, down_at, r);
+        qsort(r->v, r->n, sizeof(double), value_cmp);
+        if (!w->group_key || !session_meta(&s, w->group_key, r->cohort, sizeof(r->cohort)))
+            snprintf(r->cohort, sizeof(r->cohort), "%s", w->group_key ? "unknown" : "all");
+        session_free(&s);
+    }
+    free(down_at);
+    return NULL;
+}
+
+/* Counter-based draw: the splitmix64 finalizer over a key and a counter */
+static inline uint64_t counter_random(uint64_t key, uint64_t counter) {
+    uint64_t z = key + counter * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform index below n without division (Lemire) */
+static inline size_t draw_index(uint64_t r, size_t n) {
+    return (size_t)(((unsigned __int128)r * n) >> 64);
+}
+
+/* Values of a sorted series at most x */
+static inline size_t count_le(const double *v, size_t n, double x) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (v[mid] <= x) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/*
+ * The k-th smallest value of a replicate, given how many times each
+ * member session was drawn: bisect over the cohort's sorted values,
+ * counting each drawn session with a binary search. Same answer as
+ * pooling the replicate and running session_quantile on it.
+ */
+static double replicate_select(const Cohort *co, const Result *results, const uint32_t *times,
+                               const size_t *drawn, size_t ndrawn, size_t k) {
+    size_t lo = 0, hi = co->values - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t le = 0;
+        for (size_t j = 0; j < ndrawn; j++) {
+            const Result *r = &results[co->members[drawn[j]]];
+            le += times[drawn[j]] * count_le(r->v, r->n, co->sorted[mid]);
+        }
+        if (le > k) hi = mid;
+        else lo = mid + 1;
+    }
+    return co->sorted[lo];
+}
+
+static void *replicate_worker(void *arg) {
+    Work *w = arg;
+    size_t most = 1;
+    for (size_t c = 0; c < w->ncohorts; c++) {
+        const Cohort *co = &w->cohorts[c];
+        size_t need = co->sessions == 1 ? co->values : co->sessions;
+        if (need > most) most = need;
+    }
+    uint32_t *times = calloc(most, sizeof(uint32_t));
+    size_t *drawn = malloc(most * sizeof(size_t));
+    for (;;) {
+        size_t rep = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED);
+        if (rep >= w->replicates) break;
+        for (size_t c = 0; c < w->ncohorts; c++) {
+            Cohort *co = &w->cohorts[c];
+            uint64_t key = counter_random(w->seed, rep * 0x10000 + c);
+            if (co->sessions == 1) {
+                /* Resample values: count draws per rank, then walk the ranks */
+                const Result *r = &w->results[co->members[0]];
+                for (size_t j = 0; j < r->n; j++) times[draw_index(counter_random(key, j), r->n)]++;
+                size_t k = (size_t)(w->quantile * (double)r->n), seen = 0, i = 0;
+                if (k >= r->n) k = r->n - 1;
+                while ((seen += times[i]) <= k) i++;
+                co->stat[rep] = r->v[i];
+                memset(times, 0, r->n * sizeof(uint32_t));
+                continue;
+            }
+            size_t ndrawn = 0, n = 0;
+            for (size_t j = 0; j < co->sessions; j++) {
+                size_t m = draw_index(counter_random(key, j), co->sessions);
+                if (times[m]++ == 0) drawn[ndrawn++] = m;
+                n += w->results[co->members[m]].n;
+            }
+            size_t k = (size_t)(w->quantile * (double)n);
+            co->stat[rep] = replicate_select(co, w->results, times, drawn, ndrawn, k < n ? k : n - 1);
+            for (size_t j = 0; j < ndrawn; j++) times[drawn[j]] = 0;
+        }
+    }
+    free(times);
+    free(drawn);
+    return NULL;
+}
+
+static void add_path(Result **list, size_t *count, size_t *cap, const char *path) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *list = realloc(*list, *cap * sizeof(Result));
+    }
+    memset(&(*list)[*count], 0, sizeof(Result));
+    (*list)[(*count)++].path = strdup(path);
+}
+
+/* Percentile interval of n replicate values, skipping NANs */
+static void interval(const double *v, size_t n, double level, double *scratch, double *lo, double *hi) {
+    size_t m = 0;
+    for (size_t i = 0; i < n; i++)
+        if (!isnan(v[i])) scratch[m++] = v[i];
+    *lo = session_quantile(scratch, m, (1.0 - level) / 2.0);
+    *hi = session_quantile(scratch, m, 1.0 - (1.0 - level) / 2.0);
+}
+
+/* The quantile over all of a cohort's values, as session_quantile picks it */
+static double estimate(const Cohort *co, double quantile) {
+    size_t k = (size_t)(quantile * (double)co->values);
+    return co->sorted[k < co->values ? k : co->values - 1];
+}
+
+int main(int argc, char *argv[]) {
+    int series = SERIES_FLIGHT;
+    double quantile = 0.5, level = 0.95, pause_ms = 1000.0;
+    size_t replicates = 2000;
+    const char *group_key = NULL, *reference = NULL;
+    uint64_t seed = 1;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int argi = 1, bad = 0;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        const char *v = argv[argi + 1];
+        if (!strcmp(argv[argi], "-m")) {
+            if (!strcmp(v, "dwell")) series = SERIES_DWELL;
+            else if (!strcmp(v, "flight")) series = SERIES_FLIGHT;
+            else if (!strcmp(v, "digraph")) series = SERIES_DIGRAPH;
+            else bad = 1;
+        } else if (!strcmp(argv[argi], "-q")) quantile = atof(v);
+        else if (!strcmp(argv[argi], "-B")) replicates = strtoull(v, NULL, 10);
+        else if (!strcmp(argv[argi], "-c")) level = atof(v);
+        else if (!strcmp(argv[argi], "-g")) group_key = v;
+        else if (!strcmp(argv[argi], "-r")) reference = v;
+        else if (!strcmp(argv[argi], "-s")) seed = strtoull(v, NULL, 10);
+        else if (!strcmp(argv[argi], "-p")) pause_ms = atof(v);
+        else if (!strcmp(argv[argi], "-@")) threads = atoi(v);
+        else break;
+        argi += 2;
+    }
+    if (argi >= argc || bad || threads < 1 || replicates < 1 || quantile < 0 || quantile > 1 ||
+        level <= 0 || level >= 1) {
+        fprintf(stderr, "Usage: %s [-m dwell|flight|digraph] [-q quantile] [-B replicates] [-c level] [-g key]\n"
+                        "       [-r cohort] [-s seed] [-p ms] [-@ threads] session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    Result *results = NULL;
+    size_t count = 0, cap = 0;
+    for (; argi < argc; argi++) {
+        if (strcmp(argv[argi], "-") != 0) {
+            add_path(&results, &count, &cap, argv[argi]);
+            continue;
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0]) add_path(&results, &count, &cap, line);
+        }
+    }
+
+    Work work = { results, count, series, pause_ms, group_key, NULL, 0, replicates, quantile, seed, 0 };
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, load_worker, &work);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+
+    /* Cohorts in order of first appearance */
+    int failures = 0;
+    Cohort *cohorts = NULL;
+    size_t ncohorts = 0;
+    for (size_t i = 0; i < count; i++) {
+        Result *r = &results[i];
+        if (!r->v) {
+            fprintf(stderr, "Error: cannot read %s\n", r->path);
+            failures++;
+            continue;
+        }
+        if (r->n == 0) continue;
+        size_t c = 0;
+        while (c < ncohorts && strcmp(cohorts[c].name, r->cohort) != 0) c++;
+        if (c == ncohorts) {
+            cohorts = realloc(cohorts, (ncohorts + 1) * sizeof(Cohort));
+            memset(&cohorts[c], 0, sizeof(Cohort));
+            snprintf(cohorts[c].name, sizeof(cohorts[c].name), "%s", r->cohort);
+            ncohorts++;
+        }
+        Cohort *co = &cohorts[c];
+        if (co->sessions == co->cap) {
+            co->cap = co->cap ? co->cap * 2 : 64;
+            co->members = realloc(co->members, co->cap * sizeof(size_t));
+        }
+        co->members[co->sessions++] = i;
+        co->values += r->n;
+    }
+    size_t ref = 0;
+    while (reference && ref < ncohorts && strcmp(cohorts[ref].name, reference) != 0) ref++;
+    if (ncohorts == 0 || ref == ncohorts) {
+        fprintf(stderr, ncohorts ? "Error: no cohort named %s\n" : "Error: no values in the input\n", reference);
+        return 1;
+    }
+
+    for (size_t c = 0; c < ncohorts; c++) {
+        Cohort *co = &cohorts[c];
+        co->stat = malloc(replicates * sizeof(double));
+        co->sorted = malloc(co->values * sizeof(double));
+        size_t n = 0;
+        for (size_t j = 0; j < co->sessions; j++) {
+            const Result *r = &results[co->members[j]];
+            memcpy(co->sorted + n, r->v, r->n * sizeof(double));
+            n += r->n;
+        }
+        qsort(co->sorted, n, sizeof(double), value_cmp);
+    }
+    work.cohorts = cohorts;
+    work.ncohorts = ncohorts;
+    work.next = 0;
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, replicate_worker, &work);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+
+    printf("cohort,sessions,values,estimate_ms,ci_lo_ms,ci_hi_ms,diff_ms,diff_lo_ms,diff_hi_ms\n");
+    double ref_estimate = estimate(&cohorts[ref], quantile);
+    double *diff = malloc(replicates * sizeof(double)), *scratch = malloc(replicates * sizeof(double));
+    for (size_t c = 0; c < ncohorts; c++) {
+        const Cohort *co = &cohorts[c];
+        double est = estimate(co, quantile), lo, hi;
+        interval(co->stat, replicates, level, scratch, &lo, &hi);
+        printf("%s,%zu,%zu,%.3f,%.3f,%.3f", co->name, co->sessions, co->values, est, lo, hi);
+        if (c == ref) {
+            printf(",,,\n");
+            continue;
+        }
+        for (size_t b = 0; b < replicates; b++) diff[b] = co->stat[b] - cohorts[ref].stat[b];
+        interval(diff, replicates, level, scratch, &lo, &hi);
+        printf(",%.3f,%.3f,%.3f\n", est - ref_estimate, lo, hi);
+    }
+    free(diff);
+    free(scratch);
+
+    for (size_t c = 0; c < ncohorts; c++) {
+        free(cohorts[c].members);
+        free(cohorts[c].stat);
+        free(cohorts[c].sorted);
+    }
+    free(cohorts);
+    for (size_t i = 0; i < count; i++) {
+        free(results[i].v);
+        free(results[i].path);
+    }
+    free(results);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,427 @@
+/*
+ * collector.c - Central collector for fleet agents (POSIX)
+ *
+ * Accepts agent connections (see fleet.h) and appends their event blocks
+ * to <dir>/<agent_id>/<session>.csv, a regular session CSV. The last
+ * stored seq is recovered from the file itself, so a restarted collector
+ * resumes every agent without duplicates. Clock offset estimates reported
+ * by the agent are kept next to it in <session>.clock.
+ *
+ * An agent that comes back for a session another connection still holds
+ * takes it over: that connection lost its agent without a FIN (the agent
+ * has only one per session), so it is shut down and the new one waits for
+ * its lock. TCP keepalive also ends such half-open connections when the
+ * agent does not return.
+ *
+ * Build: make collector (see Makefile)
+ * Usage: ./collector [-p port] [-b bind_addr] [-d dir] [-s] [-D ms]
+ *        -s fsyncs every block before acknowledging it.
+ *        -D delays every PING by ms before answering (for testing the
+ *           clock offset error bound with an asymmetric path).
+ *        Press Ctrl+C to stop.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "fleet.h"
+
+#define MAX_CONNECTIONS 256
+#define DEFAULT_DIR "output/collector"
+#define TAKEOVER_MS 5000        /* wait for a taken-over session's lock */
+#define KEEPALIVE_IDLE_S 60     /* idle time before the first keepalive probe */
+#define KEEPALIVE_INTERVAL_S 10
+#define KEEPALIVE_PROBES 6
+
+static const char *data_dir = DEFAULT_DIR;
+static int sync_blocks = 0;
+static int ping_delay_ms = 0;
+static int active_connections = 0;
+static pthread_mutex_t conn_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct Connection {
+    int fd;
+    char peer[64];
+    char agent_id[160], session[160];   /* empty until HELLO */
+    struct Connection *next;            /* in connections, under conn_lock */
+} Connection;
+
+static Connection *connections = NULL;
+
+/* Agent ids and session names become path components */
+static int valid_name(const char *s) {
+    if (!s[0] || s[0] == '.' || strlen(s) > 128) return 0;
+    for (; *s; s++) {
+        char c = *s;
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+              (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.'))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Drops a partially written trailing row and returns the seq of the last
+ * complete one (0 if the file holds only the header).
+ */
+static long recover_last_seq(int fd) {
+    off_t size = lseek(fd, 0, SEEK_END);
+    if (size <= 0) return 0;
+
+    char tail[1024];
+    off_t start = size > (off_t)sizeof(tail) ? size - (off_t)sizeof(tail) : 0;
+    ssize_t n = pread(fd, tail, (size_t)(size - start), start);
+    if (n <= 0) return 0;
+
+    ssize_t end = n;
+    while (end > 0 && tail[end - 1] != '\n') end--;
+    if (end < n && ftruncate(fd, start + end) != 0) return -1;
+    if (end == 0) return 0;
+
+    ssize_t line = end - 1;
+    while (line > 0 && tail[line - 1] != '\n') line--;
+    if (tail[line] < '0' || tail[line] > '9') return 0;
+    return strtol(tail + line, NULL, 10);
+}
+
+/* Writes the metadata and column header into a new session file */
+static int write_session_header(int fd, const char *metadata) {
+    static const char columns[] =
+        "seq,timestamp_ms,event_timestamp_ms,event_type,keycode,scancode,character,modifiers,is_repeat\n";
+    size_t mlen = strlen(metadata);
+    if (mlen && write(fd, metadata, mlen) != (ssize_t)mlen) return -1;
+    if (mlen && metadata[mlen - 1] != '\n' && write(fd, "\n", 1) != 1) return -1;
+    if (write(fd, columns, sizeof(columns) - 1) != (ssize_t)(sizeof(columns) - 1)) return -1;
+    return 0;
+}
+
+static int open_session(const char *agent_id, const char *session, const char *metadata,
+                        long *stored) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", data_dir, agent_id);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/%s/%s.csv", data_dir, agent_id, session);
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return -1;
+
+    /* A connection being taken over lets go once its thread sees the shutdown */
+    for (int waited = 0; flock(fd, LOCK_EX | LOCK_NB) != 0; waited += 50) {
+        if (waited >= TAKEOVER_MS) {
+            close(fd);
+            return -1;
+        }
+        struct timespec ts = { 0, 50 * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+
+    if (lseek(fd, 0, SEEK_END) == 0) {
+        if (write_session_header(fd, metadata) < 0) {
+            close(fd);
+            return -1;
+        }
+        *stored = 0;
+    } else {
+        *stored = recover_last_seq(fd);
+        if (*stored < 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    lseek(fd, 0, SEEK_END);
+    return fd;
+}
+
+/* The artificial delay sits on the agent -> collector path only */
+static int answer_ping(int fd, const unsigned char *ping) {
+    if (ping_delay_ms > 0) {
+        struct timespec ts = { ping_delay_ms / 1000, (long)(ping_delay_ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+    return fleet_send_pong(fd, ping, fleet_now_ms());
+}
+
+/*
+ * Replaces <session>.clock with the agent's latest estimate; offset maps
+ * the session's timestamp_ms onto this host's CLOCK_MONOTONIC ms.
+ */
+static void write_clock(const char *agent_id, const char *session, const char *peer,
+                        const FleetClock *c) {
+    char path[1024], tmp[1040], buf[512];
+    snprintf(path, sizeof(path), "%s/%s/%s.clock", data_dir, agent_id, session);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return;
+    fleet_format_clock(c, "collector", buf, sizeof(buf));
+    fprintf(f, "# clock_agent=%s\n", peer);
+    fputs(buf, f);
+    fclose(f);
+    rename(tmp, path);
+}
+
+/*
+ * Claims agent_id/session for c, shutting down any other connection that
+ * still holds it; returns how many were taken over.
+ */
+static int take_over(Connection *c, const char *agent_id, const char *session) {
+    int taken = 0;
+    pthread_mutex_lock(&conn_lock);
+    for (Connection *o = connections; o; o = o->next) {
+        if (o == c || strcmp(o->agent_id, agent_id) || strcmp(o->session, session)) continue;
+        shutdown(o->fd, SHUT_RDWR);
+        o->agent_id[0] = '\0';
+        taken++;
+    }
+    snprintf(c->agent_id, sizeof(c->agent_id), "%s", agent_id);
+    snprintf(c->session, sizeof(c->session), "%s", session);
+    pthread_mutex_unlock(&conn_lock);
+    return taken;
+}
+
+/* Lets the kernel notice an agent that vanished without closing */
+static void keep_alive(int fd) {
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    int idle = KEEPALIVE_IDLE_S, interval = KEEPALIVE_INTERVAL_S, probes = KEEPALIVE_PROBES;
+#if defined(TCP_KEEPIDLE)
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+#elif defined(TCP_KEEPALIVE)
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPALIVE, &idle, sizeof(idle));
+#endif
+#ifdef TCP_KEEPINTVL
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+#endif
+#ifdef TCP_KEEPCNT
+    setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+#endif
+    (void)idle; (void)interval; (void)probes;
+}
+
+/* Returns a pointer past the first n lines of buf */
+static const char *skip_lines(const char *p, const char *end, long n) {
+    while (n > 0 && p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        if (!nl) return end;
+        p = nl + 1;
+        n--;
+    }
+    return p;
+}
+
+static void *connection_thread(void *arg) {
+    Connection *c = arg;
+    unsigned char *frame = malloc(FLEET_MAX_FRAME);
+    char *raw = malloc(FLEET_RAW_MAX);
+    int out = -1;
+    long stored = 0;
+    long rows = 0;
+    char agent_id[160] = "", session[160] = "";
+
+    if (!frame || !raw) goto done;
+
+    uint32_t len;
+    int type;
+    while ((type = fleet_recv_frame(c->fd, frame, FLEET_MAX_FRAME - 1, &len)) == FLEET_PING) {
+        /* Clock probes need no session */
+        if (len != 8 || answer_ping(c->fd, frame) < 0) goto done;
+    }
+    if (type != FLEET_HELLO) goto done;
+    frame[len] = '\0';
+
+    /* HELLO: agent id, session, metadata as consecutive C strings */
+    const char *p = (const char *)frame, *end = p + len;
+    const char *a_id = p;
+    p += strnlen(p, (size_t)(end - p)) + 1;
+    if (p >= end) goto done;
+    const char *sess = p;
+    p += strnlen(p, (size_t)(end - p)) + 1;
+    const char *meta = p < end ? p : "";
+
+    if (!valid_name(a_id) || !valid_name(sess)) {
+        fprintf(stderr, "collector: %s: rejected session name\n", c->peer);
+        goto done;
+    }
+    snprintf(agent_id, sizeof(agent_id), "%s", a_id);
+    snprintf(session, sizeof(session), "%s", sess);
+
+    if (take_over(c, agent_id, session))
+        fprintf(stderr, "collector: %s/%s taken over by %s\n", agent_id, session, c->peer);
+    out = open_session(agent_id, session, meta, &stored);
+    if (out < 0) {
+        fprintf(stderr, "collector: %s: cannot open session %s/%s\n", c->peer, agent_id, session);
+        goto done;
+    }
+    if (fleet_send_u64(c->fd, FLEET_RESUME, (uint64_t)stored) < 0) goto done;
+    fprintf(stderr, "collector: %s/%s from %s, resuming after seq %ld\n",
+            agent_id, session, c->peer, stored);
+
+    for (;;) {
+        type = fleet_recv_frame(c->fd, frame, FLEET_MAX_FRAME, &len);
+        if (type == FLEET_PING && len == 8) {
+            if (answer_ping(c->fd, frame) < 0) break;
+            continue;
+        }
+        if (type == FLEET_CLOCK && len == 32) {
+            FleetClock clk;
+            fleet_parse_clock(frame, &clk);
+            write_clock(agent_id, session, c->peer, &clk);
+            continue;
+        }
+        if (type != FLEET_BLOCK || len < 16) break;
+
+        long first = (long)fleet_get_u64(frame);
+        long count = (long)fleet_get_u32(frame + 8);
+        uLongf rawlen = fleet_get_u32(frame + 12);
+        if (rawlen > FLEET_RAW_MAX || first < 1) break;
+
+        if (uncompress((Bytef *)raw, &rawlen, frame + 16, len - 16) != Z_OK) break;
+
+        /* The agent fell a ring behind and skipped rows it no longer has */
+        if (first > stored + 1) {
+            fprintf(stderr, "collector: %s/%s lost seq %ld..%ld at the agent\n",
+                    agent_id, session, stored + 1, first - 1);
+            stored = first - 1;
+        }
+
+        /* Rows up to `stored` were already written by an earlier connection */
+        long last = first + count - 1;
+        if (last > stored) {
+            const char *from = skip_lines(raw, raw + rawlen, stored - first + 1);
+            size_t n = (size_t)(raw + rawlen - from);
+            if (write(out, from, n) != (ssize_t)n) break;
+            if (sync_blocks) fsync(out);
+            rows += last - stored;
+            stored = last;
+        }
+        if (fleet_send_u64(c->fd, FLEET_ACK, (uint64_t)stored) < 0) break;
+    }
+
+    fprintf(stderr, "collector: %s/%s closed at seq %ld (+%ld rows)\n",
+            agent_id, session, stored, rows);
+
+done:
+    if (out >= 0) close(out);  /* releases the flock */
+    pthread_mutex_lock(&conn_lock);
+    for (Connection **l = &connections; *l; l = &(*l)->next) {
+        if (*l == c) {
+            *l = c->next;
+            break;
+        }
+    }
+    active_connections--;
+    pthread_mutex_unlock(&conn_lock);
+    close(c->fd);
+    free(frame);
+    free(raw);
+    free(c);
+    return NULL;
+}
+
+static int listen_on(const char *bind_addr, const char *port) {
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(bind_addr, port, &hints, &res) != 0) return -1;
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, res->ai_addr, res->ai_addrlen) != 0 || listen(fd, 64) != 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int main(int argc, char *argv[]) {
+    const char *port = FLEET_DEFAULT_PORT;
+    const char *bind_addr = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            port = argv[++i];
+        } else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            bind_addr = argv[++i];
+        } else if (!strcmp(argv[i], "-d") && i + 1 < argc) {
+            data_dir = argv[++i];
+        } else if (!strcmp(argv[i], "-s")) {
+            sync_blocks = 1;
+        } else if (!strcmp(argv[i], "-D") && i + 1 < argc) {
+            ping_delay_ms = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [-p port] [-b bind_addr] [-d dir] [-s] [-D ms]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    mkdir(data_dir, 0755);
+
+    int lfd = listen_on(bind_addr, port);
+    if (lfd < 0) {
+        fprintf(stderr, "Error: cannot listen on port %s\n", port);
+        return 1;
+    }
+
+    fprintf(stderr, "Collector listening on port %s - Ctrl+C to stop\n", port);
+    fprintf(stderr, "Output: %s/\n", data_dir);
+
+    for (;;) {
+        struct sockaddr_storage ss;
+        socklen_t slen = sizeof(ss);
+        int fd = accept(lfd, (struct sockaddr *)&ss, &slen);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+
+        Connection *c = calloc(1, sizeof(*c));
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        getnameinfo((struct sockaddr *)&ss, slen, c->peer, sizeof(c->peer),
+                    NULL, 0, NI_NUMERICHOST);
+        keep_alive(fd);
+
+        pthread_mutex_lock(&conn_lock);
+        int full = active_connections >= MAX_CONNECTIONS;
+        if (!full) {
+            active_connections++;
+            c->next = connections;
+            connections = c;
+        }
+        pthread_mutex_unlock(&conn_lock);
+        if (full) {
+            close(fd);
+            free(c);
+            continue;
+        }
+
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, connection_thread, c) != 0) {
+            pthread_mutex_lock(&conn_lock);
+            connections = c->next;
+            active_connections--;
+            pthread_mutex_unlock(&conn_lock);
+            close(fd);
+            free(c);
+            continue;
+        }
+        pthread_detach(tid);
+    }
+
+    close(lfd);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * csv2parquet.c - Convert session CSVs to Parquet (portable C)
+ *
+ * Streams each CSV row by row into parquet.h, so memory stays bounded by
+ * one row group regardless of session length. Timestamps become integer
+ * microseconds (timestamp_us, event_timestamp_us); the "# key=value"
+ * metadata lines become Parquet key/value metadata.
+ *
+ * Build: make csv2parquet (see Makefile)
+ * Usage: ./csv2parquet [-g rows] session.csv [more.csv ...]
+ *        Writes session.parquet next to each input.
+ *        -g rows   rows per row group (default 65536)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "parquet.h"
+
+#define META_MAX 65536
+
+/*
+ * Splits a data row into its 9 columns in place. The character column is
+ * taken as everything between the 6th comma and the 2nd-to-last one, so a
+ * literal "," key does not shift the columns after it.
+ */
+static int split_row(char *line, char *cols[9]) {
+    line[strcspn(line, "\r\n")] = '\0';
+    char *p = line;
+    for (int i = 0; i < 6; i++) {
+        cols[i] = p;
+        p = strchr(p, ',');
+        if (!p) return -1;
+        *p++ = '\0';
+    }
+    char *last = strrchr(p, ',');
+    if (!last) return -1;
+    *last = '\0';
+    char *mods = strrchr(p, ',');
+    if (!mods) return -1;
+    *mods = '\0';
+    cols[6] = p;
+    cols[7] = mods + 1;
+    cols[8] = last + 1;
+    return 0;
+}
+
+static int convert(const char *in_path, uint32_t group_rows) {
+    char out_path[1024];
+    snprintf(out_path, sizeof(out_path), "%s", in_path);
+    char *ext = strrchr(out_path, '.');
+    if (ext && !strcmp(ext, ".csv")) *ext = '\0';
+    strncat(out_path, ".parquet", sizeof(out_path) - strlen(out_path) - 1);
+
+    FILE *f = fopen(in_path, "r");
+    if (!f) {
+        fprintf(stderr, "Error: cannot open %s\n", in_path);
+        return -1;
+    }
+
+    /* Metadata lines up to the column header */
+    static char metadata[META_MAX];
+    char line[4096];
+    size_t meta_len = 0;
+    int header_seen = 0;
+    metadata[0] = '\0';
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] != '#') {
+            header_seen = !strncmp(line, "seq,", 4);
+            break;
+        }
+        size_t n = strlen(line);
+        if (meta_len + n < sizeof(metadata)) {
+            memcpy(metadata + meta_len, line, n + 1);
+            meta_len += n;
+        }
+    }
+    if (!header_seen) {
+        fprintf(stderr, "Error: %s is not a session CSV\n", in_path);
+        fclose(f);
+        return -1;
+    }
+
+    ParquetWriter w;
+    if (parquet_open(&w, out_path, metadata, group_rows) != 0) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", out_path);
+        fclose(f);
+        return -1;
+    }
+
+    unsigned long rows = 0, skipped = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char *cols[9];
+        if (split_row(line, cols) != 0) {
+            skipped++;
+            continue;
+        }
+        ParquetEvent e;
+        e.seq = strtoll(cols[0], NULL, 10);
+        e.timestamp_us = llround(strtod(cols[1], NULL) * 1000.0);
+        e.event_timestamp_us = llround(strtod(cols[2], NULL) * 1000.0);
+        e.event_type = cols[3];
+        e.keycode = (int32_t)strtol(cols[4], NULL, 10);
+        e.scancode = (int32_t)strtol(cols[5], NULL, 10);
+        e.character = cols[6];
+        e.modifiers = cols[7];
+        e.is_repeat = atoi(cols[8]);
+        parquet_add(&w, &e);
+        rows++;
+    }
+    fclose(f);
+
+    if (parquet_close(&w) != 0) {
+        fprintf(stderr, "Error: failed writing %s\n", out_path);
+        return -1;
+    }
+    fprintf(stderr, "%s: %lu rows", out_path, rows);
+    if (skipped) fprintf(stderr, " (%lu malformed rows skipped)", skipped);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    uint32_t group_rows = PARQUET_ROW_GROUP;
+    int argi = 1;
+    if (argi + 1 < argc && !strcmp(argv[argi], "-g")) {
+        group_rows = (uint32_t)atoi(argv[argi + 1]);
+        argi += 2;
+    }
+    if (argi >= argc || group_rows == 0) {
+        fprintf(stderr, "Usage: %s [-g rows] session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    for (; argi < argc; argi++) {
+        if (convert(argv[argi], group_rows) != 0) failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * csv2sqlite.c - Bulk-load session CSVs into one SQLite database (POSIX)
+ *
+ * Every session becomes a row in `sessions` (plus its "# key=value" lines
+ * in `metadata`) and its events go to `events`, keyed by session id:
+ *
+ *   sessions(id, name, source, content_hash, events, imported_utc)
+ *   metadata(session_id, key, value)
+ *   events(session_id, seq, timestamp_ms, event_timestamp_ms, event_type,
+ *          keycode, scancode, character, modifiers, is_repeat)
+ *
+ * Loading is built for throughput: the CSV is mapped and parsed in place,
+ * text columns are bound without copying, one prepared INSERT is reused
+ * for every row, each block of rows is a single transaction, and the
+ * journal and fsyncs are off for the duration of the load. An import of
+ * at least REINDEX_SHARE of the rows already stored (estimated from the
+ * file sizes) drops the events indexes first and rebuilds them once at
+ * the end; smaller appends keep them and update them in place, which
+ * costs less than re-sorting the whole table. A session whose content
+ * hash is already in the database is skipped.
+ *
+ * Without a journal there is no ROLLBACK, so a file is checked for the
+ * CSV column header before anything is inserted, and a session that
+ * fails part way is deleted again with its metadata and events, leaving
+ * the file free to be imported later.
+ *
+ * Build: make csv2sqlite (see Makefile)
+ * Usage: ./csv2sqlite [-b rows] sessions.db session.csv [more.csv ...]
+ *        -b rows   rows per transaction (default 65536)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sqlite3.h>
+#include "session.h"
+
+#define BLOCK_ROWS 65536
+#define ROW_BYTES 48            /* a typical CSV row, for sizing an import */
+#define REINDEX_SHARE 0.25
+
+static const char *SCHEMA =
+    "CREATE TABLE IF NOT EXISTS sessions ("
+    " id INTEGER PRIMARY KEY,"
+    " name TEXT NOT NULL,"
+    " source TEXT NOT NULL,"
+    " content_hash TEXT NOT NULL UNIQUE,"
+    " events INTEGER NOT NULL DEFAULT 0,"
+    " imported_utc TEXT NOT NULL);"
+    "CREATE TABLE IF NOT EXISTS metadata ("
+    " session_id INTEGER NOT NULL REFERENCES sessions(id),"
+    " key TEXT NOT NULL,"
+    " value TEXT,"
+    " PRIMARY KEY (session_id, key));"
+    "CREATE TABLE IF NOT EXISTS events ("
+    " session_id INTEGER NOT NULL REFERENCES sessions(id),"
+    " seq INTEGER NOT NULL,"
+    " timestamp_ms REAL NOT NULL,"
+    " event_timestamp_ms REAL,"
+    " event_type TEXT NOT NULL,"
+    " keycode INTEGER,"
+    " scancode INTEGER,"
+    " character TEXT,"
+    " modifiers TEXT,"
+    " is_repeat INTEGER);";
+
+static const char *DROP_INDEXES =
+    "DROP INDEX IF EXISTS events_session_seq;"
+    "DROP INDEX IF EXISTS events_session_time;"
+    "DROP INDEX IF EXISTS events_character;";
+
+static const char *CREATE_INDEXES =
+    "CREATE INDEX IF NOT EXISTS events_session_seq ON events(session_id, seq);"
+    "CREATE INDEX IF NOT EXISTS events_session_time ON events(session_id, timestamp_ms);"
+    "CREATE INDEX IF NOT EXISTS events_character ON events(character);";
+
+static int exec(sqlite3 *db, const char *sql) {
+    char *err = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &err) != SQLITE_OK) {
+        fprintf(stderr, "Error: %s\n", err ? err : sqlite3_errmsg(db));
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+/* Column boundaries of one data row; the character column may be "," */
+static int split_row(const char *p, const char *end, const char *col[9], int len[9]) {
+    for (int i = 0; i < 6; i++) {
+        const char *c = memchr(p, ',', (size_t)(end - p));
+        if (!c) return -1;
+        col[i] = p;
+        len[i] = (int)(c - p);
+        p = c + 1;
+    }
+    const char *last = end, *mods = NULL;
+    while (last > p && last[-1] != ',') last--;
+    if (last <= p) return -1;
+    for (mods = last - 1; mods > p && mods[-1] != ','; mods--) {}
+    if (mods <= p) return -1;
+    col[6] = p;
+    len[6] = (int)(mods - 1 - p);
+    col[7] = mods;
+    len[7] = (int)(last - 1 - mods);
+    col[8] = last;
+    len[8] = (int)(end - last);
+    return 0;
+}
+
+/* Offset just past the metadata and column header, or -1 if there is none */
+static long find_header(const char *data, size_t size) {
+    const char *p = data, *end = data + size;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *next = nl ? nl + 1 : end;
+        if (*p != '#') return end - p >= 4 && !memcmp(p, "seq,", 4) ? next - data : -1;
+        p = next;
+    }
+    return -1;
+}
+
+/* Removes a partly imported session; autocommit, outside any transaction */
+static void purge_session(sqlite3 *db, sqlite3_int64 session_id) {
+    char sql[256];
+    snprintf(sql, sizeof(sql),
+             "DELETE FROM events WHERE session_id = %lld;"
+             "DELETE FROM metadata WHERE session_id = %lld;"
+             "DELETE FROM sessions WHERE id = %lld;",
+             (long long)session_id, (long long)session_id, (long long)session_id);
+    exec(db, sql);
+}
+
+static int load_session(sqlite3 *db, sqlite3_stmt *ins_session, sqlite3_stmt *ins_meta,
+                        sqlite3_stmt *ins_event, sqlite3_stmt *set_count,
+                        const char *path, int block_rows) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        if (fd >= 0) close(fd);
+        fprintf(stderr, "Error: cannot read %s\n", path);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map %s\n", path);
+        return -1;
+    }
+
+    if (find_header(data, size) < 0) {
+        munmap((void *)data, size);
+        fprintf(stderr, "Error: %s is not a session CSV (no seq,... header)\n", path);
+        return -1;
+    }
+
+    char hash[17], name[256], pathcopy[1024], stamp[32];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)session_hash64(data, size, 0));
+    snprintf(pathcopy, sizeof(pathcopy), "%s", path);
+    snprintf(name, sizeof(name), "%s", basename(pathcopy));
+    char *ext = strrchr(name, '.');
+    if (ext) *ext = '\0';
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    exec(db, "BEGIN");
+    sqlite3_bind_text(ins_session, 1, name, -1, SQLITE_STATIC);
+    sqlite3_bind_text(ins_session, 2, path, -1, SQLITE_STATIC);
+    sqlite3_bind_text(ins_session, 3, hash, -1, SQLITE_STATIC);
+    sqlite3_bind_text(ins_session, 4, stamp, -1, SQLITE_STATIC);
+    int rc = sqlite3_step(ins_session);
+    sqlite3_reset(ins_session);
+    if (rc == SQLITE_CONSTRAINT) {
+        exec(db, "COMMIT");     /* nothing was written */
+        munmap((void *)data, size);
+        fprintf(stderr, "%s: already imported (%s)\n", path, hash);
+        return 0;
+    }
+    if (rc != SQLITE_DONE) {
+        fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+        exec(db, "COMMIT");
+        munmap((void *)data, size);
+        return -1;
+    }
+    sqlite3_int64 session_id = sqlite3_last_insert_rowid(db);
+
+    const char *p = data, *end = data + size;
+    int header_seen = 0;
+    long rows = 0, skipped = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *le = nl ? nl : end;
+        const char *next = nl ? nl + 1 : end;
+        if (le > p && le[-1] == '\r') le--;
+
+        if (!header_seen) {
+            const char *eq = memchr(p, '=', (size_t)(le - p));
+            if (*p == '#' && eq) {
+                const char *k = p + 1;
+                while (k < eq && *k == ' ') k++;
+                sqlite3_bind_int64(ins_meta, 1, session_id);
+                sqlite3_bind_text(ins_meta, 2, k, (int)(eq - k), SQLITE_STATIC);
+                sqlite3_bind_text(ins_meta, 3, eq + 1, (int)(le - eq - 1), SQLITE_STATIC);
+                sqlite3_step(ins_meta);
+                sqlite3_reset(ins_meta);
+            } else if (*p != '#') {
+                header_seen = 1;
+            }
+            p = next;
+            continue;
+        }
+
+        const char *col[9];
+        int len[9];
+        if (le == p || split_row(p, le, col, len) != 0) {
+            if (le > p) skipped++;
+            p = next;
+            continue;
+        }
+        const char *q;
+        sqlite3_bind_int64(ins_event, 1, session_id);
+        q = col[0];
+        sqlite3_bind_int64(ins_event, 2, (sqlite3_int64)session_parse_num(&q, le));
+        q = col[1];
+        sqlite3_bind_double(ins_event, 3, session_parse_num(&q, le));
+        q = col[2];
+        sqlite3_bind_double(ins_event, 4, session_parse_num(&q, le));
+        sqlite3_bind_text(ins_event, 5, col[3], len[3], SQLITE_STATIC);
+        q = col[4];
+        sqlite3_bind_int(ins_event, 6, (int)session_parse_num(&q, le));
+        q = col[5];
+        sqlite3_bind_int(ins_event, 7, (int)session_parse_num(&q, le));
+        sqlite3_bind_text(ins_event, 8, col[6], len[6], SQLITE_STATIC);
+        sqlite3_bind_text(ins_event, 9, col[7], len[7], SQLITE_STATIC);
+        sqlite3_bind_int(ins_event, 10, len[8] > 0 && col[8][0] == '1');
+        if (sqlite3_step(ins_event) != SQLITE_DONE) {
+            fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+            sqlite3_reset(ins_event);
+            exec(db, "COMMIT");
+            purge_session(db, session_id);
+            munmap((void *)data, size);
+            return -1;
+        }
+        sqlite3_reset(ins_event);
+        p = next;
+
+        if (++rows % block_rows == 0) {
+            exec(db, "COMMIT");
+            exec(db, "BEGIN");
+        }
+    }
+    munmap((void *)data, size);
+
+    sqlite3_bind_int64(set_count, 1, rows);
+    sqlite3_bind_int64(set_count, 2, session_id);
+    sqlite3_step(set_count);
+    sqlite3_reset(set_count);
+    exec(db, "COMMIT");
+
+    fprintf(stderr, "%s: %ld events as session %lld", path, rows, (long long)session_id);
+    if (skipped) fprintf(stderr, " (%ld malformed rows skipped)", skipped);
+    fprintf(stderr, "\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int block_rows = BLOCK_ROWS;
+    int argi = 1;
+    if (argi + 1 < argc && !strcmp(argv[argi], "-b")) {
+        block_rows = atoi(argv[argi + 1]);
+        argi += 2;
+    }
+    if (argc - argi < 2 || block_rows <= 0) {
+        fprintf(stderr, "Usage: %s [-b rows] sessions.db session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    sqlite3 *db;
+    int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX;
+    if (sqlite3_open_v2(argv[argi], &db, flags, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Error: cannot open %s: %s\n", argv[argi], sqlite3_errmsg(db));
+        return 1;
+    }
+    argi++;
+
+    /* Bulk-load settings; a crash mid-load can corrupt the database */
+    if (exec(db, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF;"
+                 "PRAGMA temp_store=MEMORY; PRAGMA cache_size=-262144;"
+                 "PRAGMA locking_mode=EXCLUSIVE;") != 0 ||
+        exec(db, SCHEMA) != 0) {
+        sqlite3_close(db);
+        return 1;
+    }
+
+    /* Rebuild the indexes only for an import that is large next to the table */
+    sqlite3_int64 stored = 0;
+    sqlite3_stmt *q;
+    if (sqlite3_prepare_v2(db, "SELECT COALESCE(SUM(events), 0) FROM sessions", -1, &q, NULL) == SQLITE_OK) {
+        if (sqlite3_step(q) == SQLITE_ROW) stored = sqlite3_column_int64(q, 0);
+        sqlite3_finalize(q);
+    }
+    double incoming = 0;
+    for (int i = argi; i < argc; i++) {
+        struct stat st;
+        if (stat(argv[i], &st) == 0) incoming += (double)st.st_size / ROW_BYTES;
+    }
+    int rebuild = incoming >= REINDEX_SHARE * (double)stored;
+    if (rebuild && exec(db, DROP_INDEXES) != 0) {
+        sqlite3_close(db);
+        return 1;
+    }
+
+    sqlite3_stmt *ins_session, *ins_meta, *ins_event, *set_count;
+    sqlite3_prepare_v2(db, "INSERT INTO sessions(name, source, content_hash, imported_utc) "
+                           "VALUES (?, ?, ?, ?)", -1, &ins_session, NULL);
+    sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO metadata VALUES (?, ?, ?)", -1, &ins_meta, NULL);
+    sqlite3_prepare_v2(db, "INSERT INTO events VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)", -1,
+                       &ins_event, NULL);
+    sqlite3_prepare_v2(db, "UPDATE sessions SET events = ? WHERE id = ?", -1, &set_count, NULL);
+
+    int failures = 0;
+    for (; argi < argc; argi++) {
+        if (load_session(db, ins_session, ins_meta, ins_event, set_count, argv[argi], block_rows) != 0)
+            failures++;
+    }
+
+    sqlite3_finalize(ins_session);
+    sqlite3_finalize(ins_meta);
+    sqlite3_finalize(ins_event);
+    sqlite3_finalize(set_count);
+
+    if (rebuild) fprintf(stderr, "Building indexes...\n");
+    if (exec(db, CREATE_INDEXES) != 0) failures++;  /* no-op for kept indexes */
+    exec(db, "PRAGMA journal_mode=DELETE; PRAGMA synchronous=FULL;");
+    sqlite3_close(db);
+    return failures ? 1 : 0;
+}
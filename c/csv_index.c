@@ -0,0 +1,123 @@
+/*
+ * csv_index.c - Build sparse offset indexes and slice session CSVs (POSIX)
+ *
+ * "build" scans each CSV once and writes <file>.idx next to it (see
+ * csv_index.h). "slice" prints the metadata header plus the rows inside a
+ * seq or timestamp_ms range, seeking via the index instead of scanning.
+ * A missing or stale index is rebuilt first.
+ *
+ * Build: make csv_index (see Makefile)
+ * Usage: ./csv_index build [-n stride] session.csv [more.csv ...]
+ *        ./csv_index slice session.csv --ms FROM TO
+ *        ./csv_index slice session.csv --seq FROM TO
+ *        Ranges are inclusive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "csv_index.h"
+
+static int build_one(const char *path, uint32_t stride, CsvIndex *ix) {
+    char idx_path[1024];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+    if (csv_index_build(path, stride, ix) != 0) {
+        fprintf(stderr, "Error: cannot index %s\n", path);
+        csv_index_free(ix);
+        return -1;
+    }
+    if (csv_index_write(ix, idx_path) != 0) {
+        fprintf(stderr, "Error: cannot write %s\n", idx_path);
+        csv_index_free(ix);
+        return -1;
+    }
+    return 0;
+}
+
+static int cmd_build(int argc, char *argv[]) {
+    uint32_t stride = CSV_INDEX_STRIDE;
+    int argi = 0;
+    if (argi + 1 < argc && !strcmp(argv[argi], "-n")) {
+        stride = (uint32_t)atoi(argv[argi + 1]);
+        argi += 2;
+    }
+    if (argi >= argc || stride == 0) {
+        fprintf(stderr, "Usage: csv_index build [-n stride] session.csv [more.csv ...]\n");
+        return 1;
+    }
+
+    int failures = 0;
+    for (; argi < argc; argi++) {
+        CsvIndex ix;
+        if (build_one(argv[argi], stride, &ix) != 0) {
+            failures++;
+            continue;
+        }
+        fprintf(stderr, "%s: %llu entries (every %u rows)\n", argv[argi],
+                (unsigned long long)ix.count, ix.stride);
+        csv_index_free(&ix);
+    }
+    return failures ? 1 : 0;
+}
+
+static int cmd_slice(int argc, char *argv[]) {
+    if (argc != 4 || (strcmp(argv[1], "--ms") && strcmp(argv[1], "--seq"))) {
+        fprintf(stderr, "Usage: csv_index slice session.csv --ms|--seq FROM TO\n");
+        return 1;
+    }
+    const char *path = argv[0];
+    int by_seq = !strcmp(argv[1], "--seq");
+    int64_t from, to;
+    if (by_seq) {
+        from = strtoll(argv[2], NULL, 10);
+        to = strtoll(argv[3], NULL, 10);
+    } else {
+        from = llround(atof(argv[2]) * 1000.0);
+        to = llround(atof(argv[3]) * 1000.0);
+    }
+
+    char idx_path[1024];
+    snprintf(idx_path, sizeof(idx_path), "%s.idx", path);
+    CsvIndex ix;
+    if (csv_index_load(idx_path, &ix) != 0 || !csv_index_fresh(&ix, path)) {
+        csv_index_free(&ix);
+        fprintf(stderr, "Indexing %s...\n", path);
+        if (build_one(path, CSV_INDEX_STRIDE, &ix) != 0) return 1;
+    }
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "Error: cannot open %s\n", path);
+        csv_index_free(&ix);
+        return 1;
+    }
+
+    /* Metadata and column header */
+    char line[4096];
+    while (ftello(f) < (off_t)ix.data_start && fgets(line, sizeof(line), f)) {
+        fputs(line, stdout);
+    }
+
+    fseeko(f, (off_t)csv_index_seek(&ix, by_seq, from), SEEK_SET);
+    while (fgets(line, sizeof(line), f)) {
+        int64_t seq, ts_us;
+        if (csv_row_key(line, &seq, &ts_us) != 0) continue;
+        int64_t key = by_seq ? seq : ts_us;
+        if (key < from) continue;
+        if (key > to) break;
+        fputs(line, stdout);
+    }
+
+    fclose(f);
+    csv_index_free(&ix);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && !strcmp(argv[1], "build")) return cmd_build(argc - 2, argv + 2);
+    if (argc >= 3 && !strcmp(argv[1], "slice")) return cmd_slice(argc - 2, argv + 2);
+
+    fprintf(stderr, "Usage: %s build [-n stride] session.csv [more.csv ...]\n", argv[0]);
+    fprintf(stderr, "       %s slice session.csv --ms|--seq FROM TO\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,250 @@
+/*
+ * csv_index.h - Sparse offset index for session CSVs (POSIX)
+ *
+ * A sidecar "<file>.idx" holds the byte offset, seq and timestamp of
+ * every Nth data row of a CSV written by write_csv(). Seeking to a seq or
+ * time range is then one binary search plus a read of at most N rows
+ * before the range starts.
+ *
+ * Index file layout (little-endian):
+ *
+ *   "KTIX" | u32 version | u32 stride | u32 reserved
+ *   u64 csv size | i64 csv mtime | u64 offset of first data row | u64 count
+ *   count x { u64 offset | i64 seq | i64 timestamp in microseconds }
+ *
+ * The CSV size and mtime let readers detect a stale index.
+ *
+ * Used by csv_index.c.
+ */
+
+#ifndef CSV_INDEX_H
+#define CSV_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#define CSV_INDEX_MAGIC "KTIX"
+#define CSV_INDEX_VERSION 1
+#define CSV_INDEX_STRIDE 1024
+#define CSV_INDEX_HEADER 48
+#define CSV_INDEX_ENTRY 24
+
+typedef struct {
+    uint64_t offset;
+    int64_t seq;
+    int64_t ts_us;
+} CsvIndexEntry;
+
+typedef struct {
+    uint32_t stride;
+    uint64_t csv_size;
+    int64_t csv_mtime;
+    uint64_t data_start;
+    uint64_t count;
+    CsvIndexEntry *entries;
+} CsvIndex;
+
+static inline void csv_index_put64(unsigned char *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static inline uint64_t csv_index_get64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+/* Parses the seq and timestamp_ms columns at the start of a data row */
+static inline int csv_row_key(const char *line, int64_t *seq, int64_t *ts_us) {
+    char *end;
+    *seq = strtoll(line, &end, 10);
+    if (end == line || *end != ',') return -1;
+    double ms = strtod(end + 1, &end);
+    if (*end != ',') return -1;
+    *ts_us = llround(ms * 1000.0);
+    return 0;
+}
+
+/* Scans the CSV once, keeping every stride-th row */
+static inline int csv_index_build(const char *path, uint32_t stride, CsvIndex *ix) {
+    memset(ix, 0, sizeof(*ix));
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    struct stat st;
+    if (fstat(fileno(f), &st) != 0) {
+        fclose(f);
+        return -1;
+    }
+    ix->stride = stride ? stride : CSV_INDEX_STRIDE;
+    ix->csv_size = (uint64_t)st.st_size;
+    ix->csv_mtime = (int64_t)st.st_mtime;
+
+    size_t cap = 1024;
+    ix->entries = malloc(cap * sizeof(CsvIndexEntry));
+
+    static char buf[1 << 20];
+    char line[256];
+    size_t line_len = 0;
+    uint64_t pos = 0, line_start = 0;
+    uint64_t rows = 0;
+    int in_header = 1;
+    size_t n;
+
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        size_t i = 0;
+        while (i < n) {
+            char *nl = memchr(buf + i, '\n', n - i);
+            size_t end = nl ? (size_t)(nl - buf) : n;
+
+            /* Only the first bytes of a line are needed to classify it */
+            size_t take = end - i;
+            if (line_len + take >= sizeof(line)) take = sizeof(line) - 1 - line_len;
+            memcpy(line + line_len, buf + i, take);
+            line_len += take;
+
+            if (!nl) {
+                pos += n - i;
+                break;
+            }
+            line[line_len] = '\0';
+            uint64_t next = pos + (end - i) + 1;
+
+            if (in_header) {
+                if (line[0] != '#' && strncmp(line, "seq,", 4) == 0) {
+                    in_header = 0;
+                    ix->data_start = next;
+                }
+            } else if (line_len > 0) {
+                if (rows % ix->stride == 0) {
+                    CsvIndexEntry e;
+                    e.offset = line_start;
+                    if (csv_row_key(line, &e.seq, &e.ts_us) == 0) {
+                        if (ix->count == cap) {
+                            cap *= 2;
+                            ix->entries = realloc(ix->entries, cap * sizeof(CsvIndexEntry));
+                        }
+                        ix->entries[ix->count++] = e;
+                    }
+                }
+                rows++;
+            }
+
+            pos = next;
+            line_start = next;
+            line_len = 0;
+            i = end + 1;
+        }
+    }
+    fclose(f);
+    if (in_header) {
+        free(ix->entries);
+        ix->entries = NULL;
+        ix->count = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static inline int csv_index_write(const CsvIndex *ix, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    unsigned char hdr[CSV_INDEX_HEADER] = {0};
+    memcpy(hdr, CSV_INDEX_MAGIC, 4);
+    hdr[4] = CSV_INDEX_VERSION;
+    hdr[8] = (unsigned char)ix->stride;
+    hdr[9] = (unsigned char)(ix->stride >> 8);
+    hdr[10] = (unsigned char)(ix->stride >> 16);
+    hdr[11] = (unsigned char)(ix->stride >> 24);
+    csv_index_put64(hdr + 16, ix->csv_size);
+    csv_index_put64(hdr + 24, (uint64_t)ix->csv_mtime);
+    csv_index_put64(hdr + 32, ix->data_start);
+    csv_index_put64(hdr + 40, ix->count);
+    fwrite(hdr, 1, sizeof(hdr), f);
+
+    for (uint64_t i = 0; i < ix->count; i++) {
+        unsigned char e[CSV_INDEX_ENTRY];
+        csv_index_put64(e, ix->entries[i].offset);
+        csv_index_put64(e + 8, (uint64_t)ix->entries[i].seq);
+        csv_index_put64(e + 16, (uint64_t)ix->entries[i].ts_us);
+        fwrite(e, 1, sizeof(e), f);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+static inline int csv_index_load(const char *path, CsvIndex *ix) {
+    memset(ix, 0, sizeof(*ix));
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    unsigned char hdr[CSV_INDEX_HEADER];
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+        memcmp(hdr, CSV_INDEX_MAGIC, 4) != 0 || hdr[4] != CSV_INDEX_VERSION) {
+        fclose(f);
+        return -1;
+    }
+    ix->stride = (uint32_t)hdr[8] | ((uint32_t)hdr[9] << 8) |
+                 ((uint32_t)hdr[10] << 16) | ((uint32_t)hdr[11] << 24);
+    ix->csv_size = csv_index_get64(hdr + 16);
+    ix->csv_mtime = (int64_t)csv_index_get64(hdr + 24);
+    ix->data_start = csv_index_get64(hdr + 32);
+    ix->count = csv_index_get64(hdr + 40);
+
+    ix->entries = malloc((ix->count ? ix->count : 1) * sizeof(CsvIndexEntry));
+    for (uint64_t i = 0; i < ix->count; i++) {
+        unsigned char e[CSV_INDEX_ENTRY];
+        if (fread(e, 1, sizeof(e), f) != sizeof(e)) {
+            free(ix->entries);
+            ix->entries = NULL;
+            fclose(f);
+            return -1;
+        }
+        ix->entries[i].offset = csv_index_get64(e);
+        ix->entries[i].seq = (int64_t)csv_index_get64(e + 8);
+        ix->entries[i].ts_us = (int64_t)csv_index_get64(e + 16);
+    }
+    fclose(f);
+    return 0;
+}
+
+/* 1 if the index still describes the CSV at path */
+static inline int csv_index_fresh(const CsvIndex *ix, const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && (uint64_t)st.st_size == ix->csv_size &&
+           (int64_t)st.st_mtime == ix->csv_mtime;
+}
+
+static inline void csv_index_free(CsvIndex *ix) {
+    free(ix->entries);
+    ix->entries = NULL;
+    ix->count = 0;
+}
+
+/*
+ * Byte offset to start reading from so that no row with key >= target
+ * is skipped: the last indexed row whose key is below the target.
+ */
+static inline uint64_t csv_index_seek(const CsvIndex *ix, int by_seq, int64_t target) {
+    uint64_t lo = 0, hi = ix->count;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        int64_t key = by_seq ? ix->entries[mid].seq : ix->entries[mid].ts_us;
+        if (key < target) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo == 0 ? ix->data_start : ix->entries[lo - 1].offset;
+}
+
+static inline uint64_t csv_index_seek_seq(const CsvIndex *ix, int64_t seq) {
+    return csv_index_seek(ix, 1, seq);
+}
+
+static inline uint64_t csv_index_seek_ms(const CsvIndex *ix, double ms) {
+    return csv_index_seek(ix, 0, llround(ms * 1000.0));
+}
+
+#endif /* CSV_INDEX_H */
@@ -0,0 +1,239 @@
+/*
+ * dashboard.h - Live metrics over HTTP and Server-Sent Events (POSIX)
+ *
+ * A single thread serves, on 127.0.0.1 only:
+ *   GET /         a static page that renders the stream
+ *   GET /events   text/event-stream, one "data: <metrics_json>" message
+ *                 every interval_ms
+ *
+ * The snapshot is taken once per push and the same bytes go to every
+ * subscriber, so the capture path only ever pays for metrics.h updates,
+ * however many viewers are connected. Sockets are non-blocking; a
+ * viewer that cannot take a whole message is disconnected rather than
+ * buffered for.
+ *
+ * Used by terminal_macos.c (--dashboard).
+ */
+
+#ifndef DASHBOARD_H
+#define DASHBOARD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "metrics.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  /* macOS: callers ignore SIGPIPE instead */
+#endif
+
+#define DASHBOARD_INTERVAL_MS 500
+#define DASHBOARD_MAX_CLIENTS 32
+#define DASHBOARD_REQUEST_MAX 2048
+
+static const char DASHBOARD_PAGE[] =
+    "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>Keyboard timing</title>\n"
+    "<style>body{font:14px system-ui,sans-serif;margin:2em;color:#222}"
+    "table{border-collapse:collapse}td,th{padding:4px 14px;text-align:right}"
+    "th{text-align:left;font-weight:normal;color:#666}#kpm{font-size:48px}"
+    "#state{color:#999}</style></head><body>\n"
+    "<div><span id=\"kpm\">-</span> keys/min <span id=\"state\">connecting</span></div>\n"
+    "<table><tr><th></th><td>n</td><td>p50 ms</td><td>p90 ms</td><td>p99 ms</td></tr>\n"
+    "<tr><th>dwell</th><td id=\"dn\"></td><td id=\"d50\"></td><td id=\"d90\"></td><td id=\"d99\"></td></tr>\n"
+    "<tr><th>flight</th><td id=\"fn\"></td><td id=\"f50\"></td><td id=\"f90\"></td><td id=\"f99\"></td></tr>\n"
+    "</table>\n<p>events <b id=\"events\">0</b> &middot; dropped <b id=\"dropped\">0</b>"
+    " &middot; held <b id=\"held\"></b></p>\n"
+    "<script>\n"
+    "const $=id=>document.getElementById(id),v=x=>x===null?'-':x;\n"
+    "const es=new EventSource('/events');\n"
+    "es.onopen=()=>$('state').textContent='';\n"
+    "es.onerror=()=>$('state').textContent='disconnected';\n"
+    "es.onmessage=m=>{const s=JSON.parse(m.data);\n"
+    " $('kpm').textContent=s.kpm;$('events').textContent=s.events;$('dropped').textContent=s.dropped;\n"
+    " $('held').textContent=s.held.join(' ')||'none';\n"
+    " for(const[k,p]of[['d',s.dwell],['f',s.flight]]){$(k+'n').textContent=p.n;\n"
+    "  $(k+'50').textContent=v(p.p50);$(k+'90').textContent=v(p.p90);$(k+'99').textContent=v(p.p99);}};\n"
+    "</script></body></html>\n";
+
+typedef struct {
+    int fd;
+    int streaming;                  /* past the headers of /events */
+    size_t len;
+    char req[DASHBOARD_REQUEST_MAX];
+} DashboardClient;
+
+typedef struct {
+    int port;
+    Metrics *metrics;
+    double (*clock_ms)(void);       /* session clock for the snapshots */
+    double interval_ms;             /* 0 = DASHBOARD_INTERVAL_MS */
+    volatile int stop;
+
+    int listen_fd;
+    int nclients;
+    DashboardClient clients[DASHBOARD_MAX_CLIENTS];
+} Dashboard;
+
+static inline double dashboard_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Binds 127.0.0.1:port. Returns 0, or -1 with errno set. */
+static inline int dashboard_open(Dashboard *d) {
+    d->nclients = 0;
+    d->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (d->listen_fd < 0) return -1;
+    int one = 1;
+    setsockopt(d->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((unsigned short)d->port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(d->listen_fd, (struct sockaddr *)&sa, sizeof(sa)) != 0 || listen(d->listen_fd, 16) != 0) {
+        int err = errno;
+        close(d->listen_fd);
+        d->listen_fd = -1;
+        errno = err;
+        return -1;
+    }
+    fcntl(d->listen_fd, F_SETFL, fcntl(d->listen_fd, F_GETFL) | O_NONBLOCK);
+    return 0;
+}
+
+static inline void dashboard_drop(Dashboard *d, int i) {
+    close(d->clients[i].fd);
+    d->clients[i] = d->clients[--d->nclients];
+}
+
+/* Sends all of buf or nothing useful; the caller drops the client on -1 */
+static inline int dashboard_send(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Answers a complete request. Returns 1 to keep the client as a subscriber. */
+static inline int dashboard_respond(int fd, const char *req) {
+    char head[256];
+    if (!strncmp(req, "GET /events ", 12)) {
+        static const char sse[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+                                  "Cache-Control: no-cache\r\nConnection: keep-alive\r\n\r\n"
+                                  "retry: 1000\n\n";
+        return dashboard_send(fd, sse, sizeof(sse) - 1) == 0;
+    }
+    if (!strncmp(req, "GET / ", 6)) {
+        int n = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: text/html; charset=utf-8\r\n"
+                         "Content-Length: %zu\r\nConnection: close\r\n\r\n", sizeof(DASHBOARD_PAGE) - 1);
+        if (dashboard_send(fd, head, (size_t)n) == 0) dashboard_send(fd, DASHBOARD_PAGE, sizeof(DASHBOARD_PAGE) - 1);
+        return 0;
+    }
+    static const char missing[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    dashboard_send(fd, missing, sizeof(missing) - 1);
+    return 0;
+}
+
+static inline void dashboard_accept(Dashboard *d) {
+    for (;;) {
+        int fd = accept(d->listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        if (d->nclients == DASHBOARD_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        DashboardClient *c = &d->clients[d->nclients++];
+        c->fd = fd;
+        c->streaming = 0;
+        c->len = 0;
+    }
+}
+
+/* Reads from client i. Returns 0 to keep it, -1 once it should be dropped. */
+static inline int dashboard_read(Dashboard *d, int i) {
+    DashboardClient *c = &d->clients[i];
+    char scratch[512];
+    char *dst = c->streaming ? scratch : c->req + c->len;
+    size_t cap = c->streaming ? sizeof(scratch) : sizeof(c->req) - 1 - c->len;
+    if (cap == 0) return -1;  /* oversized request */
+    ssize_t n = recv(c->fd, dst, cap, 0);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    if (n == 0) return -1;
+    if (c->streaming) return 0;  /* subscribers have nothing more to say */
+    c->len += (size_t)n;
+    c->req[c->len] = '\0';
+    if (!strstr(c->req, "\r\n\r\n")) return 0;
+    if (!dashboard_respond(c->fd, c->req)) return -1;
+    c->streaming = 1;
+    return 0;
+}
+
+static inline void dashboard_push(Dashboard *d) {
+    static char msg[8192];
+    size_t n = 6;
+    memcpy(msg, "data: ", 6);
+    n += metrics_json(d->metrics, d->clock_ms(), msg + n, sizeof(msg) - n - 2);
+    msg[n++] = '\n';
+    msg[n++] = '\n';
+    for (int i = d->nclients - 1; i >= 0; i--) {
+        if (d->clients[i].streaming && dashboard_send(d->clients[i].fd, msg, n) != 0) dashboard_drop(d, i);
+    }
+}
+
+/*
+ * Serves until d->stop is set. A slow subscriber whose socket buffer is
+ * full loses its connection; the page's EventSource reconnects by itself.
+ */
+static inline void dashboard_run(Dashboard *d) {
+    double interval = d->interval_ms > 0 ? d->interval_ms : DASHBOARD_INTERVAL_MS;
+    double next = dashboard_now_ms() + interval;
+    struct pollfd pfds[DASHBOARD_MAX_CLIENTS + 1];
+    while (!d->stop) {
+        pfds[0].fd = d->listen_fd;
+        pfds[0].events = POLLIN;
+        for (int i = 0; i < d->nclients; i++) {
+            pfds[i + 1].fd = d->clients[i].fd;
+            pfds[i + 1].events = POLLIN;
+            pfds[i + 1].revents = 0;
+        }
+        int polled = d->nclients;
+        double wait = next - dashboard_now_ms();
+        int pr = poll(pfds, (nfds_t)polled + 1, wait > 0 ? (int)wait + 1 : 0);
+        if (pr < 0 && errno != EINTR) break;
+        if (pr > 0) {
+            for (int i = polled - 1; i >= 0; i--) {
+                if (pfds[i + 1].revents && dashboard_read(d, i) != 0) dashboard_drop(d, i);
+            }
+            if (pfds[0].revents & POLLIN) dashboard_accept(d);
+        }
+        if (dashboard_now_ms() >= next) {
+            dashboard_push(d);
+            next += interval;
+            if (next < dashboard_now_ms()) next = dashboard_now_ms() + interval;
+        }
+    }
+    while (d->nclients > 0) dashboard_drop(d, d->nclients - 1);
+    close(d->listen_fd);
+    d->listen_fd = -1;
+}
+
+#endif /* DASHBOARD_H */
@@ -0,0 +1,538 @@
+/*
+ * fleet.h - Agent/collector wire protocol over TCP (POSIX)
+ *
+ * Agents stream sealed blocks of CSV event rows to a central collector.
+ * Every frame is a 12-byte header followed by its payload, all integers
+ * in network byte order:
+ *
+ *   u32 magic "KTF1" | u32 type | u32 payload length
+ *
+ *   HELLO   agent -> collector   agent id, session name, metadata lines
+ *                                (three NUL-terminated strings)
+ *   RESUME  collector -> agent   u64 last seq already stored
+ *   BLOCK   agent -> collector   u64 first seq, u32 row count,
+ *                                u32 raw length, zlib-compressed rows
+ *   ACK     collector -> agent   u64 last seq stored
+ *   PING    agent -> collector   u64 t1 (agent clock, ns)
+ *   PONG    collector -> agent   u64 t1, u64 t2 receive, u64 t3 send
+ *                                (collector CLOCK_MONOTONIC, ns)
+ *   CLOCK   agent -> collector   i64 offset ns, u64 error ns,
+ *                                i64 drift ppb, u64 samples
+ *
+ * The agent never buffers blocks itself: rows stay in the source (the
+ * recorder's event array or a CSV file) until acknowledged, and at most
+ * FLEET_WINDOW blocks are in flight. After a reconnect the collector
+ * answers HELLO with RESUME and the agent re-seals from that seq, so no
+ * row is stored twice. The one gap allowed is a BLOCK starting past the
+ * next seq: the agent's ring source overwrote those rows before they
+ * could be sent.
+ *
+ * PING/PONG is an NTP-style exchange that relates the agent's session
+ * clock to the collector's monotonic clock: collector time = agent time
+ * + offset, within +/- error. PING is also accepted before HELLO, which
+ * is how `agent --clock` probes a collector.
+ *
+ * Used by collector.c, agent.c and terminal_macos.c (--agent).
+ */
+
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <zlib.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  /* macOS: callers ignore SIGPIPE instead */
+#endif
+
+#define FLEET_MAGIC 0x4B544631u  /* "KTF1" */
+#define FLEET_DEFAULT_PORT "7450"
+
+#define FLEET_BLOCK_EVENTS 512   /* rows per sealed block */
+#define FLEET_WINDOW 8           /* unacknowledged blocks in flight */
+#define FLEET_FLUSH_MS 1000      /* seal a partial block after this long */
+#define FLEET_ROW_MAX 256        /* upper bound of one formatted CSV row */
+#define FLEET_RAW_MAX (FLEET_BLOCK_EVENTS * FLEET_ROW_MAX)
+#define FLEET_MAX_FRAME (1u << 20)
+#define FLEET_DRAIN_MS 5000      /* default wait for final acks on exit */
+#define FLEET_SYNC_MS 250        /* interval between PINGs */
+#define FLEET_SYNC_WINDOW 8      /* PINGs per min-RTT filter window */
+
+enum {
+    FLEET_HELLO = 1,
+    FLEET_RESUME = 2,
+    FLEET_BLOCK = 3,
+    FLEET_ACK = 4,
+    FLEET_PING = 5,
+    FLEET_PONG = 6,
+    FLEET_CLOCK = 7,
+};
+
+static inline double fleet_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static inline void fleet_put_u32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static inline uint32_t fleet_get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+           ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static inline void fleet_put_u64(unsigned char *p, uint64_t v) {
+    fleet_put_u32(p, (uint32_t)(v >> 32));
+    fleet_put_u32(p + 4, (uint32_t)v);
+}
+
+static inline uint64_t fleet_get_u64(const unsigned char *p) {
+    return ((uint64_t)fleet_get_u32(p) << 32) | fleet_get_u32(p + 4);
+}
+
+static inline int fleet_write_all(int fd, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static inline int fleet_read_all(int fd, void *buf, size_t len) {
+    char *p = buf;
+    while (len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) return -1;  /* peer closed */
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static inline int fleet_send_frame(int fd, uint32_t type, const void *payload, uint32_t len) {
+    unsigned char hdr[12];
+    fleet_put_u32(hdr, FLEET_MAGIC);
+    fleet_put_u32(hdr + 4, type);
+    fleet_put_u32(hdr + 8, len);
+    if (fleet_write_all(fd, hdr, sizeof(hdr)) < 0) return -1;
+    return len ? fleet_write_all(fd, payload, len) : 0;
+}
+
+/* Reads one frame into buf (capacity cap). Returns the type, or -1. */
+static inline int fleet_recv_frame(int fd, void *buf, uint32_t cap, uint32_t *len) {
+    unsigned char hdr[12];
+    if (fleet_read_all(fd, hdr, sizeof(hdr)) < 0) return -1;
+    if (fleet_get_u32(hdr) != FLEET_MAGIC) return -1;
+    *len = fleet_get_u32(hdr + 8);
+    if (*len > cap) return -1;
+    if (*len && fleet_read_all(fd, buf, *len) < 0) return -1;
+    return (int)fleet_get_u32(hdr + 4);
+}
+
+static inline int fleet_send_u64(int fd, uint32_t type, uint64_t v) {
+    unsigned char p[8];
+    fleet_put_u64(p, v);
+    return fleet_send_frame(fd, type, p, sizeof(p));
+}
+
+/*
+ * Clock offset estimator. Of every FLEET_SYNC_WINDOW exchanges only the
+ * one with the smallest round trip is kept, since queueing delay only
+ * ever adds to it; a least-squares line through the kept samples gives
+ * the offset and drift. The error bound is half the best round trip.
+ */
+typedef struct {
+    double win_t, win_offset, win_rtt;
+    int win_n;
+
+    double t0, n, st, so, stt, sto;  /* fit over kept samples */
+
+    double offset_ms;    /* collector - agent, at the latest sample */
+    double error_ms;
+    double drift_ppm;
+    long samples;
+} FleetClock;
+
+/* t1/t4 on the agent clock, t2/t3 on the collector clock, all in ms */
+static inline int fleet_clock_sample(FleetClock *c, double t1, double t2, double t3, double t4) {
+    double rtt = (t4 - t1) - (t3 - t2);
+    double offset = ((t2 - t1) + (t3 - t4)) / 2.0;
+    if (rtt < 0) rtt = 0;
+    c->samples++;
+
+    if (c->win_n == 0 || rtt < c->win_rtt) {
+        c->win_t = t4;
+        c->win_offset = offset;
+        c->win_rtt = rtt;
+    }
+    if (c->n == 0) {
+        /* Provisional estimate until the first window closes */
+        c->offset_ms = c->win_offset;
+        c->error_ms = c->win_rtt / 2.0;
+    }
+    if (++c->win_n < FLEET_SYNC_WINDOW) return 0;
+
+    if (c->n == 0) c->t0 = c->win_t;
+    double t = c->win_t - c->t0;
+    c->n += 1;
+    c->st += t;
+    c->so += c->win_offset;
+    c->stt += t * t;
+    c->sto += t * c->win_offset;
+
+    double denom = c->n * c->stt - c->st * c->st;
+    double slope = (c->n > 1 && denom > 0) ? (c->n * c->sto - c->st * c->so) / denom : 0;
+    double icept = (c->so - slope * c->st) / c->n;
+    c->offset_ms = icept + slope * t;
+    c->error_ms = c->win_rtt / 2.0;
+    c->drift_ppm = slope * 1e6;
+    c->win_n = 0;
+    return 1;
+}
+
+static inline int fleet_send_ping(int fd, double t1_ms) {
+    return fleet_send_u64(fd, FLEET_PING, (uint64_t)(t1_ms * 1e6));
+}
+
+/* Answers a PING payload; t2_ms is when it was received */
+static inline int fleet_send_pong(int fd, const unsigned char *ping, double t2_ms) {
+    unsigned char p[24];
+    memcpy(p, ping, 8);
+    fleet_put_u64(p + 8, (uint64_t)(t2_ms * 1e6));
+    fleet_put_u64(p + 16, (uint64_t)(fleet_now_ms() * 1e6));
+    return fleet_send_frame(fd, FLEET_PONG, p, sizeof(p));
+}
+
+static inline int fleet_clock_pong(FleetClock *c, const unsigned char *pong, double t4_ms) {
+    return fleet_clock_sample(c, (double)fleet_get_u64(pong) / 1e6,
+                              (double)fleet_get_u64(pong + 8) / 1e6,
+                              (double)fleet_get_u64(pong + 16) / 1e6, t4_ms);
+}
+
+static inline int fleet_send_clock(int fd, const FleetClock *c) {
+    unsigned char p[32];
+    fleet_put_u64(p, (uint64_t)(int64_t)(c->offset_ms * 1e6));
+    fleet_put_u64(p + 8, (uint64_t)(c->error_ms * 1e6));
+    fleet_put_u64(p + 16, (uint64_t)(int64_t)(c->drift_ppm * 1e3));
+    fleet_put_u64(p + 24, (uint64_t)c->samples);
+    return fleet_send_frame(fd, FLEET_CLOCK, p, sizeof(p));
+}
+
+static inline void fleet_parse_clock(const unsigned char *p, FleetClock *c) {
+    c->offset_ms = (double)(int64_t)fleet_get_u64(p) / 1e6;
+    c->error_ms = (double)fleet_get_u64(p + 8) / 1e6;
+    c->drift_ppm = (double)(int64_t)fleet_get_u64(p + 16) / 1e3;
+    c->samples = (long)fleet_get_u64(p + 24);
+}
+
+/* "# clock_*" metadata lines describing an estimate */
+static inline int fleet_format_clock(const FleetClock *c, const char *reference,
+                                     char *buf, size_t len) {
+    return snprintf(buf, len,
+                    "# clock_reference=%s\n"
+                    "# clock_offset_ms=%.3f\n"
+                    "# clock_error_ms=%.3f\n"
+                    "# clock_drift_ppm=%.3f\n"
+                    "# clock_samples=%ld\n",
+                    reference, c->offset_ms, c->error_ms, c->drift_ppm, c->samples);
+}
+
+/* Splits "host:port" (port optional) into its parts. */
+static inline void fleet_split_addr(const char *addr, char *host, size_t hlen,
+                                    char *port, size_t plen) {
+    const char *colon = strrchr(addr, ':');
+    size_t n = colon ? (size_t)(colon - addr) : strlen(addr);
+    if (n >= hlen) n = hlen - 1;
+    memcpy(host, addr, n);
+    host[n] = '\0';
+    snprintf(port, plen, "%s", colon ? colon + 1 : FLEET_DEFAULT_PORT);
+}
+
+static inline int fleet_connect(const char *addr) {
+    char host[256], port[32];
+    fleet_split_addr(addr, host, sizeof(host), port, sizeof(port));
+
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host[0] ? host : NULL, port, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return -1;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+    return fd;
+}
+
+/*
+ * Row source for an agent. Rows are numbered by seq starting at 1;
+ * available() returns the highest seq that may be read, format() writes
+ * rows first+1 .. first+count as CSV lines and returns how many fit.
+ * finished() turns true once available() will not grow any more.
+ *
+ * A source with ring > 0 keeps only its newest rows, the row after
+ * available() overwriting the one ring rows before it. Rows that were
+ * overwritten before they were sent are skipped and reported as lost.
+ */
+typedef struct {
+    long (*available)(void *ctx);
+    long (*format)(void *ctx, long first, long count, char *buf, size_t cap, size_t *len);
+    int (*finished)(void *ctx);
+    void *ctx;
+    long ring;               /* rows the source keeps; 0 = all of them */
+} FleetSource;
+
+typedef struct {
+    const char *addr;        /* collector host:port */
+    const char *agent_id;
+    const char *session;
+    const char *metadata;    /* "# key=value\n" lines for a new session */
+    FleetSource src;
+    double (*clock_ms)(void);  /* session clock for PING; NULL disables sync */
+    double drain_ms;         /* give up this long after finished(); 0 = never */
+    volatile int stop;
+    int quiet;
+
+    /* Progress, written by the agent thread only */
+    long acked;
+    long blocks_sent;
+    long reconnects;
+    long lost;               /* rows overwritten in a ring source before sending */
+    FleetClock clock;
+} FleetAgent;
+
+static inline int fleet_hello(FleetAgent *a, int fd, long *resume) {
+    size_t la = strlen(a->agent_id) + 1;
+    size_t ls = strlen(a->session) + 1;
+    size_t lm = strlen(a->metadata) + 1;
+    if (la + ls + lm > FLEET_MAX_FRAME) return -1;
+
+    char *p = malloc(la + ls + lm);
+    if (!p) return -1;
+    memcpy(p, a->agent_id, la);
+    memcpy(p + la, a->session, ls);
+    memcpy(p + la + ls, a->metadata, lm);
+    int rc = fleet_send_frame(fd, FLEET_HELLO, p, (uint32_t)(la + ls + lm));
+    free(p);
+    if (rc < 0) return -1;
+
+    unsigned char buf[8];
+    uint32_t len;
+    if (fleet_recv_frame(fd, buf, sizeof(buf), &len) != FLEET_RESUME || len != 8) return -1;
+    *resume = (long)fleet_get_u64(buf);
+    return 0;
+}
+
+/*
+ * Streams the source to the collector until every row is acknowledged,
+ * reconnecting with backoff. Returns 0 when done, -1 if stopped or the
+ * drain deadline passed with rows still unacknowledged.
+ */
+static inline int fleet_agent_run(FleetAgent *a) {
+    uLong zcap = compressBound(FLEET_RAW_MAX);
+    char *raw = malloc(FLEET_RAW_MAX);
+    unsigned char *frame = malloc(16 + zcap);
+    if (!raw || !frame) {
+        free(raw);
+        free(frame);
+        return -1;
+    }
+
+    double backoff = 250;
+    double drain_start = 0;
+    int result = -1;
+
+    while (!a->stop) {
+        int fd = fleet_connect(a->addr);
+        long resume = 0;
+        if (fd >= 0 && fleet_hello(a, fd, &resume) == 0) {
+            if (!a->quiet)
+                fprintf(stderr, "\nagent: connected to %s, resuming after seq %ld\n",
+                        a->addr, resume);
+            backoff = 250;
+            a->acked = resume;
+
+            long sent = resume;
+            long inflight[FLEET_WINDOW];
+            int head = 0, nflight = 0;
+            double last_seal = fleet_now_ms();
+            double next_ping = last_seal;
+
+            for (;;) {
+                int done = a->src.finished(a->src.ctx);
+                long avail = a->src.available(a->src.ctx);
+                double now = fleet_now_ms();
+
+                if (done && a->acked >= avail) {
+                    result = 0;
+                    break;
+                }
+                if (done && drain_start == 0) drain_start = now;
+                if (a->stop || (done && a->drain_ms > 0 && now - drain_start > a->drain_ms))
+                    break;
+
+                /*
+                 * In a ring, row sent + 1 is safe to read while the writer
+                 * has not started on row sent + 1 + ring
+                 */
+                if (a->src.ring && avail - sent >= a->src.ring) {
+                    long skip_to = avail - a->src.ring + 1;
+                    if (!a->quiet)
+                        fprintf(stderr, "\nagent: fell a ring behind, lost seq %ld..%ld\n",
+                                sent + 1, skip_to);
+                    a->lost += skip_to - sent;
+                    sent = skip_to;
+                }
+
+                /* Seal full blocks, or a partial one once it is old enough */
+                long pending = avail - sent;
+                if (pending <= 0) last_seal = now;
+                while (nflight < FLEET_WINDOW && pending > 0 &&
+                       (pending >= FLEET_BLOCK_EVENTS || done ||
+                        now - last_seal >= FLEET_FLUSH_MS)) {
+                    long want = pending < FLEET_BLOCK_EVENTS ? pending : FLEET_BLOCK_EVENTS;
+                    size_t rawlen = 0;
+                    long count = a->src.format(a->src.ctx, sent, want, raw, FLEET_RAW_MAX, &rawlen);
+                    if (count <= 0) break;
+                    if (a->src.ring) {
+                        /* Overwritten while formatting: drop it, the next pass skips */
+                        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                        if (a->src.available(a->src.ctx) - sent >= a->src.ring) break;
+                    }
+
+                    uLongf zlen = zcap;
+                    if (compress2(frame + 16, &zlen, (const Bytef *)raw, rawlen, Z_BEST_SPEED) != Z_OK)
+                        break;
+                    fleet_put_u64(frame, (uint64_t)(sent + 1));
+                    fleet_put_u32(frame + 8, (uint32_t)count);
+                    fleet_put_u32(frame + 12, (uint32_t)rawlen);
+                    if (fleet_send_frame(fd, FLEET_BLOCK, frame, (uint32_t)(16 + zlen)) < 0)
+                        goto reconnect;
+
+                    sent += count;
+                    pending -= count;
+                    inflight[(head + nflight) % FLEET_WINDOW] = sent;
+                    nflight++;
+                    a->blocks_sent++;
+                    last_seal = now;
+                }
+
+                if (a->clock_ms && now >= next_ping) {
+                    if (fleet_send_ping(fd, a->clock_ms()) < 0) goto reconnect;
+                    next_ping = now + FLEET_SYNC_MS;
+                }
+
+                /* Wait for acks; a full window is the backpressure signal */
+                struct pollfd pfd = { .fd = fd, .events = POLLIN };
+                int pr = poll(&pfd, 1, 100);
+                if (pr < 0 && errno != EINTR) goto reconnect;
+                if (pr > 0) {
+                    unsigned char buf[24];
+                    uint32_t len;
+                    int type = fleet_recv_frame(fd, buf, sizeof(buf), &len);
+                    if (type == FLEET_ACK && len == 8) {
+                        a->acked = (long)fleet_get_u64(buf);
+                        while (nflight > 0 && inflight[head] <= a->acked) {
+                            head = (head + 1) % FLEET_WINDOW;
+                            nflight--;
+                        }
+                    } else if (type == FLEET_PONG && len == 24 && a->clock_ms) {
+                        if (fleet_clock_pong(&a->clock, buf, a->clock_ms()) &&
+                            fleet_send_clock(fd, &a->clock) < 0)
+                            goto reconnect;
+                    } else {
+                        goto reconnect;
+                    }
+                }
+            }
+            close(fd);
+            break;
+
+        reconnect:
+            if (!a->quiet)
+                fprintf(stderr, "\nagent: connection to %s lost at seq %ld\n", a->addr, a->acked);
+        }
+        if (fd >= 0) close(fd);
+        a->reconnects++;
+
+        double now = fleet_now_ms();
+        if (a->src.finished(a->src.ctx)) {
+            if (drain_start == 0) drain_start = now;
+            if (a->drain_ms > 0 && now - drain_start > a->drain_ms) break;
+        }
+        struct timespec ts = { (time_t)(backoff / 1000), (long)((long)backoff % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+        backoff = backoff * 2 > 5000 ? 5000 : backoff * 2;
+    }
+
+    free(raw);
+    free(frame);
+    return result;
+}
+
+/*
+ * Measures the offset of clock_ms() against a collector with `count`
+ * exchanges FLEET_SYNC_MS apart, without opening a session.
+ */
+static inline int fleet_clock_probe(const char *addr, int count, double (*clock_ms)(void),
+                                    FleetClock *c) {
+    int fd = fleet_connect(addr);
+    if (fd < 0) return -1;
+    memset(c, 0, sizeof(*c));
+
+    for (int i = 0; i < count; i++) {
+        unsigned char buf[24];
+        uint32_t len;
+        if (fleet_send_ping(fd, clock_ms()) < 0 ||
+            fleet_recv_frame(fd, buf, sizeof(buf), &len) != FLEET_PONG || len != 24) {
+            close(fd);
+            return -1;
+        }
+        fleet_clock_pong(c, buf, clock_ms());
+        struct timespec ts = { 0, FLEET_SYNC_MS * 1000000L };
+        if (i + 1 < count) nanosleep(&ts, NULL);
+    }
+    close(fd);
+    return 0;
+}
+
+#endif /* FLEET_H */
@@ -0,0 +1,157 @@
+/*
+ * focus.h - Which application each keystroke went to
+ *
+ * The recorders attribute every event to a small context id: 0 for
+ * unknown, otherwise an index into a table of application names that
+ * is interned as focus moves.
+ * How the current pid is learned is up to the platform:
+ * terminal_windows.c is told by a foreground-change hook, and
+ * terminal_macos.c takes the target pid an annotated event tap reports.
+ * Either way the capture path stamps each event with the pid, and a
+ * thread of its own follows those pids through a FocusLog, naming each
+ * pid once through the pid cache below, so no hook or tap callback makes
+ * a system call for it.
+ *
+ * The table is written once per session, next to the recording, as
+ * <output>.focus.csv: metadata lines naming each context, then one row
+ * per focus change giving the first seq typed into it:
+ *
+ *   # context.1=Terminal
+ *   # context.2=Safari
+ *   seq,context
+ *   1,1
+ *   240,2
+ *
+ * Used by terminal_macos.c and terminal_windows.c (--focus), and tested
+ * by focus_test.c (make test).
+ */
+
+#ifndef FOCUS_H
+#define FOCUS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FOCUS_MAX 1024              /* contexts per session; later ones map to 0 */
+#define FOCUS_NAME_MAX 64
+#define FOCUS_PID_SLOTS 512         /* power of two */
+
+typedef struct {
+    int count;                      /* contexts 1 .. count are in use */
+    char names[FOCUS_MAX][FOCUS_NAME_MAX];
+
+    /* pid -> context, open addressing; pid 0 marks an empty slot */
+    int32_t pids[FOCUS_PID_SLOTS];
+    uint16_t pid_contexts[FOCUS_PID_SLOTS];
+} FocusTable;
+
+static inline void focus_init(FocusTable *t) {
+    memset(t, 0, sizeof(*t));
+}
+
+/* The context id of an application name, adding it if it is new */
+static inline uint16_t focus_intern(FocusTable *t, const char *name) {
+    if (!name || !*name) return 0;
+    for (int i = 1; i <= t->count; i++) {
+        if (!strncmp(t->names[i - 1], name, FOCUS_NAME_MAX - 1)) return (uint16_t)i;
+    }
+    if (t->count == FOCUS_MAX) return 0;
+    snprintf(t->names[t->count], FOCUS_NAME_MAX, "%s", name);
+    return (uint16_t)++t->count;
+}
+
+/* Slot of pid in the cache: either holding it or empty */
+static inline int focus_pid_slot(const FocusTable *t, int32_t pid) {
+    uint32_t h = (uint32_t)pid * 2654435761u;
+    for (int i = 0; i < FOCUS_PID_SLOTS; i++) {
+        int s = (int)((h + (uint32_t)i) & (FOCUS_PID_SLOTS - 1));
+        if (t->pids[s] == pid || t->pids[s] == 0) return s;
+    }
+    return -1;
+}
+
+/*
+ * Context of pid, calling resolve(pid, name, len) to name the process
+ * the first time a pid is seen. A pid reused by another program within
+ * one session keeps its first name.
+ */
+static inline uint16_t focus_pid_context(FocusTable *t, int32_t pid,
+                                         int (*resolve)(int32_t pid, char *name, size_t len)) {
+    if (pid <= 0) return 0;
+    int s = focus_pid_slot(t, pid);
+    if (s >= 0 && t->pids[s] == pid) return t->pid_contexts[s];
+    char name[FOCUS_NAME_MAX];
+    uint16_t ctx = resolve(pid, name, sizeof(name)) == 0 ? focus_intern(t, name) : 0;
+    if (s >= 0) {
+        t->pids[s] = pid;
+        t->pid_contexts[s] = ctx;
+    }
+    return ctx;
+}
+
+/* Focus changes in seq order: from seq[i] on, keys went to contexts[i] */
+typedef struct {
+    int32_t pid;                    /* of the last event followed, -1 before the first */
+    uint16_t context;
+    int *seq;
+    uint16_t *contexts;
+    size_t n, cap;
+} FocusLog;
+
+static inline void focus_log_init(FocusLog *l) {
+    memset(l, 0, sizeof(*l));
+    l->pid = -1;
+}
+
+static inline void focus_log_free(FocusLog *l) {
+    free(l->seq);
+    free(l->contexts);
+    focus_log_init(l);
+}
+
+/*
+ * Follows one event, in seq order, to the process it was sent to. A pid
+ * is resolved only when it differs from the previous event's, and a row
+ * is logged only when the context changes. Returns -1 if out of memory.
+ */
+static inline int focus_log_event(FocusTable *t, FocusLog *l, int seq, int32_t pid,
+                                  int (*resolve)(int32_t pid, char *name, size_t len)) {
+    if (pid == l->pid && l->n) return 0;
+    l->pid = pid;
+    uint16_t ctx = focus_pid_context(t, pid, resolve);
+    if (l->n && ctx == l->context) return 0;
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 64;
+        int *seq_grown = realloc(l->seq, cap * sizeof(int));
+        if (seq_grown) l->seq = seq_grown;
+        uint16_t *ctx_grown = realloc(l->contexts, cap * sizeof(uint16_t));
+        if (ctx_grown) l->contexts = ctx_grown;
+        if (!seq_grown || !ctx_grown) return -1;
+        l->cap = cap;
+    }
+    l->seq[l->n] = seq;
+    l->contexts[l->n++] = ctx;
+    l->context = ctx;
+    return 0;
+}
+
+/*
+ * Writes <path> with the context table and the column header; the
+ * caller then adds one "seq,context" row per change. Returns the open
+ * file or NULL.
+ */
+static inline FILE *focus_open(const char *path, const FocusTable *t) {
+    FILE *f = fopen(path, "w");
+    if (!f) return NULL;
+    for (int i = 1; i <= t->count; i++) {
+        fprintf(f, "# context.%d=", i);
+        for (const char *c = t->names[i - 1]; *c; c++) fputc(*c == '\n' || *c == '\r' ? ' ' : *c, f);
+        fputc('\n', f);
+    }
+    fputs("seq,context\n", f);
+    return f;
+}
+
+#endif /* FOCUS_H */
@@ -0,0 +1,171 @@
+/*
+ * focus_test.c - Unit tests for focus.h (POSIX)
+ *
+ * Exercises the context table, the pid cache and the attribution log
+ * the recorders use for --focus, with a fake process table standing in
+ * for proc_name() / OpenProcess(), and checks the .focus.csv layout.
+ *
+ * Build: make test (see Makefile)
+ * Usage: ./focus_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "focus.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                              \
+        }                                                                            \
+    } while (0)
+
+static FocusTable table;
+static int resolves = 0;
+
+/* Fake processes: 100 and 101 are both Terminal, 200 is Safari, others unknown */
+static int fake_resolve(int32_t pid, char *name, size_t len) {
+    resolves++;
+    if (pid == 100 || pid == 101) snprintf(name, len, "Terminal");
+    else if (pid == 200) snprintf(name, len, "Safari");
+    else if (pid == 300) snprintf(name, len, "Bad\nName");
+    else return -1;
+    return 0;
+}
+
+static void test_intern(void) {
+    focus_init(&table);
+    CHECK(focus_intern(&table, NULL) == 0);
+    CHECK(focus_intern(&table, "") == 0);
+    CHECK(focus_intern(&table, "Terminal") == 1);
+    CHECK(focus_intern(&table, "Safari") == 2);
+    CHECK(focus_intern(&table, "Terminal") == 1);
+    CHECK(table.count == 2);
+
+    /* Names are cut to FOCUS_NAME_MAX - 1 and still match themselves */
+    char longname[200];
+    memset(longname, 'x', sizeof(longname) - 1);
+    longname[sizeof(longname) - 1] = '\0';
+    uint16_t id = focus_intern(&table, longname);
+    CHECK(id == 3);
+    CHECK(strlen(table.names[id - 1]) == FOCUS_NAME_MAX - 1);
+    CHECK(focus_intern(&table, longname) == id);
+
+    /* A full table maps new names to unknown */
+    char name[32];
+    for (int i = table.count; i < FOCUS_MAX; i++) {
+        snprintf(name, sizeof(name), "app%d", i);
+        CHECK(focus_intern(&table, name) == (uint16_t)(i + 1));
+    }
+    CHECK(focus_intern(&table, "one too many") == 0);
+    CHECK(focus_intern(&table, "Safari") == 2);
+}
+
+static void test_pid_cache(void) {
+    focus_init(&table);
+    resolves = 0;
+    CHECK(focus_pid_context(&table, 0, fake_resolve) == 0);
+    CHECK(focus_pid_context(&table, -5, fake_resolve) == 0);
+    CHECK(resolves == 0);
+
+    CHECK(focus_pid_context(&table, 100, fake_resolve) == 1);
+    CHECK(focus_pid_context(&table, 100, fake_resolve) == 1);
+    CHECK(resolves == 1);
+
+    /* Another process of the same application shares its context */
+    CHECK(focus_pid_context(&table, 101, fake_resolve) == 1);
+    CHECK(focus_pid_context(&table, 200, fake_resolve) == 2);
+    CHECK(resolves == 3);
+
+    /* A pid that cannot be named stays unknown and is not asked again */
+    CHECK(focus_pid_context(&table, 999, fake_resolve) == 0);
+    CHECK(focus_pid_context(&table, 999, fake_resolve) == 0);
+    CHECK(resolves == 4);
+
+    /* Colliding pids (same slot modulo the table) keep their own contexts */
+    int32_t a = 200 + FOCUS_PID_SLOTS * 7;
+    CHECK(focus_pid_context(&table, a, fake_resolve) == 0);
+    CHECK(focus_pid_context(&table, 200, fake_resolve) == 2);
+}
+
+static void test_log(void) {
+    focus_init(&table);
+    FocusLog log;
+    focus_log_init(&log);
+    resolves = 0;
+
+    /* seq: pid */
+    static const struct { int seq; int32_t pid; } events[] = {
+        { 1, 0 }, { 2, 0 },                 /* before anything is named */
+        { 3, 100 }, { 4, 100 }, { 5, 100 },
+        { 6, 101 },                         /* another Terminal: no change */
+        { 7, 200 }, { 8, 200 },
+        { 9, 100 },
+        { 10, 999 }, { 11, 999 },           /* unnamed process */
+        { 12, 200 },
+    };
+    for (size_t i = 0; i < sizeof(events) / sizeof(events[0]); i++)
+        CHECK(focus_log_event(&table, &log, events[i].seq, events[i].pid, fake_resolve) == 0);
+
+    static const int want_seq[] = { 1, 3, 7, 9, 10, 12 };
+    static const uint16_t want_ctx[] = { 0, 1, 2, 1, 0, 2 };
+    CHECK(log.n == sizeof(want_seq) / sizeof(want_seq[0]));
+    for (size_t i = 0; i < log.n && i < sizeof(want_seq) / sizeof(want_seq[0]); i++) {
+        CHECK(log.seq[i] == want_seq[i]);
+        CHECK(log.contexts[i] == want_ctx[i]);
+    }
+    /* Each pid was named once, however often focus went back to it */
+    CHECK(resolves == 4);
+
+    /* The log grows past its first allocation */
+    for (int i = 0; i < 1000; i++)
+        CHECK(focus_log_event(&table, &log, 100 + i, i % 2 ? 200 : 100, fake_resolve) == 0);
+    CHECK(log.n == 6 + 1000);
+    CHECK(log.seq[log.n - 1] == 1099 && log.contexts[log.n - 1] == 2);
+    focus_log_free(&log);
+    CHECK(log.n == 0 && log.seq == NULL);
+}
+
+static void test_file(void) {
+    focus_init(&table);
+    focus_pid_context(&table, 100, fake_resolve);
+    focus_pid_context(&table, 300, fake_resolve);
+
+    char path[] = "/tmp/focus_test_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+    if (fd < 0) return;
+    close(fd);
+    FILE *f = focus_open(path, &table);
+    CHECK(f != NULL);
+    if (!f) return;
+    fprintf(f, "1,1\n");
+    fclose(f);
+
+    char text[256];
+    f = fopen(path, "r");
+    size_t n = f ? fread(text, 1, sizeof(text) - 1, f) : 0;
+    if (f) fclose(f);
+    text[n] = '\0';
+    unlink(path);
+    /* A newline in a process name must not break the metadata line */
+    CHECK(!strcmp(text, "# context.1=Terminal\n# context.2=Bad Name\nseq,context\n1,1\n"));
+}
+
+int main(void) {
+    test_intern();
+    test_pid_cache();
+    test_log();
+    test_file();
+    if (failures) {
+        fprintf(stderr, "focus_test: %d checks failed\n", failures);
+        return 1;
+    }
+    fprintf(stderr, "focus_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * hand_load.c - Finger and hand load of recorded sessions (POSIX)
+ *
+ * Places every key press on the keyboard of keyboard_geometry.h for the
+ * chosen layout and prints one block of key=value lines per session,
+ * in the style of session_stats:
+ *   sfb_pct          same-finger bigrams: consecutive presses of different
+ *                    keys by the same finger (thumbs excluded)
+ *   alternation_pct  consecutive presses on opposite hands (thumbs excluded)
+ *   travel_mm        finger travel, each finger moving from the key it
+ *                    last pressed (its home key at first) to the next one
+ *   rowN_pct, left/right/thumb_pct, and per finger its share of presses
+ *   and dwell (key_down -> key_up) and flight (previous key_up -> its
+ *   key_down) percentiles.
+ * Bigrams span at most -p ms; auto-repeat is ignored; characters the
+ * layout does not place are counted as unmapped and skipped.
+ *
+ * Sessions are processed in one pass each, on one worker thread per core,
+ * and printed in argument order. Each worker keeps its dwell and flight
+ * samples in buffers that grow as needed and are reused across sessions.
+ *
+ * Build: make hand_load (see Makefile)
+ * Usage: ./hand_load [-l layout] [-p ms] [-@ threads] session.csv [more.csv ...]
+ *        layouts: qwerty (default), dvorak, colemak. A "-" argument reads
+ *        further paths from stdin, one per line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "session.h"
+#include "keyboard_geometry.h"
+
+typedef struct {
+    char *path;
+    char *text;                 /* the session's block, NULL if unreadable */
+} Result;
+
+typedef struct {
+    const KeyboardLayout *layout;
+    double pause_ms;
+    Result *results;
+    size_t count;
+    size_t next;                /* claimed with __atomic_fetch_add */
+} Work;
+
+typedef struct {
+    double *v;
+    size_t n, cap;
+} Series;
+
+/* Per worker: the last key_down of each keycode, and the samples of each finger */
+typedef struct {
+    double down_at[65536];
+    Series dwell[FINGER_COUNT], flight[FINGER_COUNT];
+} Scratch;
+
+static void series_add(Series *s, double x) {
+    if (s->n == s->cap) {
+        size_t cap = s->cap ? s->cap * 2 : 256;
+        double *v = realloc(s->v, cap * sizeof(double));
+        if (!v) return;
+        s->v = v;
+        s->cap = cap;
+    }
+    s->v[s->n++] = x;
+}
+
+static void analyze(const Session *s, const KeyboardLayout *layout, double pause_ms, Scratch *sc,
+                    FILE *out) {
+    Series *dwell = sc->dwell, *flight = sc->flight;
+    double *down_at = sc->down_at;
+    for (int f = 0; f < FINGER_COUNT; f++) dwell[f].n = flight[f].n = 0;
+    for (int k = 0; k < 65536; k++) down_at[k] = NAN;
+
+    int at[FINGER_COUNT];
+    for (int f = 0; f < FINGER_COUNT; f++) at[f] = geometry_home[f];
+    size_t presses = 0, mapped = 0, bigrams = 0, sfb = 0, hand_pairs = 0, alternations = 0;
+    size_t per_finger[FINGER_COUNT] = {0}, per_row[5] = {0}, per_hand[3] = {0};
+    double travel = 0, last_up = NAN, prev_t = NAN;
+    int prev_key = -1;
+
+    for (size_t i = 0; i < s->count; i++) {
+        const SessionEvent *e = &s->events[i];
+        int kc = e->keycode & 0xFFFF;
+        int key = geometry_lookup(layout, e->character);
+        if (e->type == SESSION_KEY_UP) {
+            if (key >= 0 && !isnan(down_at[kc]))
+                series_add(&dwell[geometry_keys[key].finger], e->timestamp_ms - down_at[kc]);
+            down_at[kc] = NAN;
+            last_up = e->timestamp_ms;
+            continue;
+        }
+        if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+        presses++;
+        down_at[kc] = e->timestamp_ms;
+        if (key < 0) {
+            prev_key = -1;
+            continue;
+        }
+        mapped++;
+
+        Finger f = geometry_keys[key].finger;
+        Hand h = geometry_hand(key);
+        per_finger[f]++;
+        per_row[geometry_keys[key].row]++;
+        per_hand[h]++;
+        travel += geometry_distance(at[f], key);
+        at[f] = key;
+        if (!isnan(last_up) && e->timestamp_ms - last_up <= pause_ms)
+            series_add(&flight[f], e->timestamp_ms - last_up);
+
+        if (prev_key >= 0 && e->timestamp_ms - prev_t <= pause_ms) {
+            bigrams++;
+            Hand ph = geometry_hand(prev_key);
+            if (h != HAND_THUMB && ph != HAND_THUMB) {
+                hand_pairs++;
+                alternations += h != ph;
+                sfb += key != prev_key && geometry_keys[prev_key].finger == f;
+            }
+        }
+        prev_key = key;
+        prev_t = e->timestamp_ms;
+    }
+
+#define PCT(a, b) ((b) ? 100.0 * (double)(a) / (double)(b) : 0.0)
+    fprintf(out, "layout=%s\n", layout->name);
+    fprintf(out, "keystrokes=%zu\n", presses);
+    fprintf(out, "mapped_pct=%.2f\n", PCT(mapped, presses));
+    fprintf(out, "bigrams=%zu\n", bigrams);
+    fprintf(out, "sfb_pct=%.2f\n", PCT(sfb, hand_pairs));
+    fprintf(out, "alternation_pct=%.2f\n", PCT(alternations, hand_pairs));
+    fprintf(out, "travel_mm=%.0f\n", travel * GEOMETRY_KEY_MM);
+    fprintf(out, "travel_mm_per_key=%.2f\n", mapped ? travel * GEOMETRY_KEY_MM / (double)mapped : 0.0);
+    for (int r = 0; r < 5; r++) fprintf(out, "row%d_pct=%.2f\n", r, PCT(per_row[r], mapped));
+    fprintf(out, "left_pct=%.2f\n", PCT(per_hand[HAND_LEFT], mapped));
+    fprintf(out, "right_pct=%.2f\n", PCT(per_hand[HAND_RIGHT], mapped));
+    fprintf(out, "thumb_pct=%.2f\n", PCT(per_hand[HAND_THUMB], mapped));
+    for (int f = 0; f < FINGER_COUNT; f++) {
+        if (f == FINGER_LT) continue;   /* the space bar is struck with the right thumb */
+        const char *name = geometry_finger_names[f];
+        fprintf(out, "%s_pct=%.2f\n", name, PCT(per_finger[f], mapped));
+        fprintf(out, "%s_dwell_p50_ms=%.3f\n", name, session_quantile(dwell[f].v, dwell[f].n, 0.50));
+        fprintf(out, "%s_dwell_p90_ms=%.3f\n", name, session_quantile(dwell[f].v, dwell[f].n, 0.90));
+        fprintf(out, "%s_flight_p50_ms=%.3f\n", name, session_quantile(flight[f].v, flight[f].n, 0.50));
+        fprintf(out, "%s_flight_p90_ms=%.3f\n", name, session_quantile(flight[f].v, flight[f].n, 0.90));
+    }
+#undef PCT
+}
+
+static void *worker(void *arg) {
+    Work *w = arg;
+    Scratch *sc = calloc(1, sizeof(Scratch));
+    if (!sc) return NULL;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED);
+        if (i >= w->count) break;
+        Result *r = &w->results[i];
+        Session s;
+        if (session_load(r->path, &s) != 0) continue;
+        size_t len;
+        FILE *out = open_memstream(&r->text, &len);
+        analyze(&s, w->layout, w->pause_ms, sc, out);
+        fclose(out);
+        session_free(&s);
+    }
+    for (int f = 0; f < FINGER_COUNT; f++) {
+        free(sc->dwell[f].v);
+        free(sc->flight[f].v);
+    }
+    free(sc);
+    return NULL;
+}
+
+static void add_path(Result **list, size_t *count, size_t *cap, const char *path) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *list = realloc(*list, *cap * sizeof(Result));
+    }
+    (*list)[*count].path = strdup(path);
+    (*list)[(*count)++].text = NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const KeyboardLayout *layout = &geometry_layouts[0];
+    double pause_ms = 1000.0;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        if (!strcmp(argv[argi], "-l")) layout = geometry_layout(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-p")) pause_ms = atof(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-@")) threads = atoi(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi >= argc || !layout || threads < 1) {
+        fprintf(stderr, "Usage: %s [-l layout] [-p ms] [-@ threads] session.csv [more.csv ...]\n", argv[0]);
+        fprintf(stderr, "       layouts:");
+        for (int i = 0; i < GEOMETRY_LAYOUT_COUNT; i++) fprintf(stderr, " %s", geometry_layouts[i].name);
+        fprintf(stderr, "\n");
+        return 1;
+    }
+
+    Result *results = NULL;
+    size_t count = 0, cap = 0;
+    for (; argi < argc; argi++) {
+        if (strcmp(argv[argi], "-") != 0) {
+            add_path(&results, &count, &cap, argv[argi]);
+            continue;
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0]) add_path(&results, &count, &cap, line);
+        }
+    }
+
+    Work work = { layout, pause_ms, results, count, 0 };
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, worker, &work);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+
+    int failures = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i].text) {
+            printf("session=%s\n%s\n", results[i].path, results[i].text);
+        } else {
+            fprintf(stderr, "Error: cannot read %s\n", results[i].path);
+            failures++;
+        }
+        free(results[i].text);
+        free(results[i].path);
+    }
+    free(results);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,133 @@
+/*
+ * heavy_hitters.c - Most frequent keys, digraphs and chords in bounded memory (POSIX)
+ *
+ * Builds, merges and prints the fixed-size summaries of sketch.h. Each
+ * session is summarized on its own and merged in, the same way summaries
+ * from different machines combine, so "add" can be re-run on new
+ * sessions and "merge" can fold in .kts files written by the recorder.
+ *
+ * Build: make heavy_hitters (see Makefile)
+ * Usage: ./heavy_hitters add summary.kts session.csv [more.csv ...]
+ *        ./heavy_hitters merge summary.kts part.kts [more.kts ...]
+ *        ./heavy_hitters show [-n count] summary.kts
+ *        add and merge update summary.kts if it exists.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "session.h"
+#include "sketch.h"
+
+static void format_mods(uint16_t m, char *buf, size_t len) {
+    snprintf(buf, len, "%s%s%s%s", m & SESSION_MOD_SHIFT ? "shift+" : "",
+             m & SESSION_MOD_CTRL ? "ctrl+" : "", m & SESSION_MOD_ALT ? "alt+" : "",
+             m & SESSION_MOD_CMD ? "cmd+" : "");
+    size_t n = strlen(buf);
+    if (n) buf[n - 1] = '\0';
+}
+
+/* Loads summary.kts into s, or starts empty if it does not exist yet */
+static int open_summary(const char *path, Sketch *s) {
+    if (access(path, F_OK) != 0) {
+        sketch_init(s);
+        return 0;
+    }
+    if (sketch_load(s, path) != 0) {
+        fprintf(stderr, "Error: %s is not a summary file\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int save_summary(const Sketch *s, const char *path) {
+    if (sketch_save(s, path) != 0) {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return 1;
+    }
+    fprintf(stderr, "%s: %llu items, ~%.0f distinct\n", path,
+            (unsigned long long)s->total, sketch_distinct(s));
+    return 0;
+}
+
+static int cmd_add(int argc, char *argv[]) {
+    static Sketch total, part;
+    if (open_summary(argv[0], &total) != 0) return 1;
+
+    int failures = 0;
+    char mods[32];
+    for (int i = 1; i < argc; i++) {
+        Session s;
+        if (session_load(argv[i], &s) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", argv[i]);
+            failures++;
+            continue;
+        }
+        sketch_init(&part);
+        for (size_t k = 0; k < s.count; k++) {
+            const SessionEvent *e = &s.events[k];
+            if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+            format_mods(e->modifiers, mods, sizeof(mods));
+            sketch_key_down(&part, e->character, mods, e->timestamp_ms);
+        }
+        sketch_merge(&total, &part);
+        session_free(&s);
+    }
+    return save_summary(&total, argv[0]) || failures;
+}
+
+static int cmd_merge(int argc, char *argv[]) {
+    static Sketch total, part;
+    if (open_summary(argv[0], &total) != 0) return 1;
+
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        if (sketch_load(&part, argv[i]) != 0) {
+            fprintf(stderr, "Error: %s is not a summary file\n", argv[i]);
+            failures++;
+            continue;
+        }
+        sketch_merge(&total, &part);
+    }
+    return save_summary(&total, argv[0]) || failures;
+}
+
+static int cmd_show(int argc, char *argv[]) {
+    int count = 20, argi = 0;
+    if (argc >= 3 && !strcmp(argv[0], "-n")) {
+        count = atoi(argv[1]);
+        argi = 2;
+    }
+    if (argi >= argc) {
+        fprintf(stderr, "Usage: heavy_hitters show [-n count] summary.kts\n");
+        return 1;
+    }
+    static Sketch s;
+    if (sketch_load(&s, argv[argi]) != 0) {
+        fprintf(stderr, "Error: %s is not a summary file\n", argv[argi]);
+        return 1;
+    }
+
+    SketchHeavy top[SKETCH_TOPK];
+    int n = sketch_top(&s, top);
+    if (count > n) count = n;
+    printf("items: %llu  distinct: ~%.0f  error bound: +%.0f\n", (unsigned long long)s.total,
+           sketch_distinct(&s), exp(1.0) * (double)s.total / SKETCH_WIDTH);
+    for (int i = 0; i < count; i++) {
+        printf("%-24s %10llu  %5.2f%%\n", top[i].item, (unsigned long long)top[i].count,
+               s.total ? 100.0 * (double)top[i].count / (double)s.total : 0.0);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 4 && !strcmp(argv[1], "add")) return cmd_add(argc - 2, argv + 2);
+    if (argc >= 4 && !strcmp(argv[1], "merge")) return cmd_merge(argc - 2, argv + 2);
+    if (argc >= 3 && !strcmp(argv[1], "show")) return cmd_show(argc - 2, argv + 2);
+
+    fprintf(stderr, "Usage: %s add summary.kts session.csv [more.csv ...]\n", argv[0]);
+    fprintf(stderr, "       %s merge summary.kts part.kts [more.kts ...]\n", argv[0]);
+    fprintf(stderr, "       %s show [-n count] summary.kts\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,197 @@
+/*
+ * keyboard_geometry.h - Physical key positions, fingers and layouts
+ *
+ * GEOMETRY_ANSI_KEYS lists the keys of an ANSI row-staggered board with
+ * their row (0 = number row, 4 = space bar row), horizontal centre and
+ * width in key widths (19.05 mm) and the finger that strikes them in
+ * standard touch typing. Layouts (GEOMETRY_LAYOUTS) say which characters sit on which
+ * key, unshifted and shifted. Everything is expanded at compile time
+ * from these X-macro tables, into per-layout ASCII lookup arrays, so
+ * lookups are one array index and a new layout is one more list.
+ *
+ * Characters are the CSV character column, which is portable across
+ * recorders, unlike keycodes: single characters as typed, or names such
+ * as "space" and "shift_l".
+ *
+ * Used by hand_load.c, layout_opt.c and session_render.c.
+ */
+
+#ifndef KEYBOARD_GEOMETRY_H
+#define KEYBOARD_GEOMETRY_H
+
+#include <string.h>
+#include <math.h>
+
+#define GEOMETRY_KEY_MM 19.05
+
+typedef enum {
+    FINGER_LP, FINGER_LR, FINGER_LM, FINGER_LI, FINGER_LT,
+    FINGER_RT, FINGER_RI, FINGER_RM, FINGER_RR, FINGER_RP,
+    FINGER_COUNT
+} Finger;
+
+static const char *const geometry_finger_names[FINGER_COUNT] = {
+    "l_pinky", "l_ring", "l_middle", "l_index", "l_thumb",
+    "r_thumb", "r_index", "r_middle", "r_ring", "r_pinky",
+};
+
+typedef enum { HAND_LEFT, HAND_RIGHT, HAND_THUMB } Hand;
+
+/* X(id, row, x, width, finger) */
+#define GEOMETRY_ANSI_KEYS(X) \
+    X(GK_GRAVE, 0, 0.5, 1.0, FINGER_LP)        X(GK_1, 0, 1.5, 1.0, FINGER_LP) \
+    X(GK_2, 0, 2.5, 1.0, FINGER_LR)            X(GK_3, 0, 3.5, 1.0, FINGER_LM) \
+    X(GK_4, 0, 4.5, 1.0, FINGER_LI)            X(GK_5, 0, 5.5, 1.0, FINGER_LI) \
+    X(GK_6, 0, 6.5, 1.0, FINGER_RI)            X(GK_7, 0, 7.5, 1.0, FINGER_RI) \
+    X(GK_8, 0, 8.5, 1.0, FINGER_RM)            X(GK_9, 0, 9.5, 1.0, FINGER_RR) \
+    X(GK_0, 0, 10.5, 1.0, FINGER_RP)           X(GK_MINUS, 0, 11.5, 1.0, FINGER_RP) \
+    X(GK_EQUAL, 0, 12.5, 1.0, FINGER_RP)       X(GK_BACKSPACE, 0, 14.0, 2.0, FINGER_RP) \
+    X(GK_TAB, 1, 0.75, 1.5, FINGER_LP)         X(GK_Q, 1, 2.0, 1.0, FINGER_LP) \
+    X(GK_W, 1, 3.0, 1.0, FINGER_LR)            X(GK_E, 1, 4.0, 1.0, FINGER_LM) \
+    X(GK_R, 1, 5.0, 1.0, FINGER_LI)            X(GK_T, 1, 6.0, 1.0, FINGER_LI) \
+    X(GK_Y, 1, 7.0, 1.0, FINGER_RI)            X(GK_U, 1, 8.0, 1.0, FINGER_RI) \
+    X(GK_I, 1, 9.0, 1.0, FINGER_RM)            X(GK_O, 1, 10.0, 1.0, FINGER_RR) \
+    X(GK_P, 1, 11.0, 1.0, FINGER_RP)           X(GK_LBRACKET, 1, 12.0, 1.0, FINGER_RP) \
+    X(GK_RBRACKET, 1, 13.0, 1.0, FINGER_RP)    X(GK_BACKSLASH, 1, 14.25, 1.5, FINGER_RP) \
+    X(GK_CAPSLOCK, 2, 0.875, 1.75, FINGER_LP)  X(GK_A, 2, 2.25, 1.0, FINGER_LP) \
+    X(GK_S, 2, 3.25, 1.0, FINGER_LR)           X(GK_D, 2, 4.25, 1.0, FINGER_LM) \
+    X(GK_F, 2, 5.25, 1.0, FINGER_LI)           X(GK_G, 2, 6.25, 1.0, FINGER_LI) \
+    X(GK_H, 2, 7.25, 1.0, FINGER_RI)           X(GK_J, 2, 8.25, 1.0, FINGER_RI) \
+    X(GK_K, 2, 9.25, 1.0, FINGER_RM)           X(GK_L, 2, 10.25, 1.0, FINGER_RR) \
+    X(GK_SEMICOLON, 2, 11.25, 1.0, FINGER_RP)  X(GK_QUOTE, 2, 12.25, 1.0, FINGER_RP) \
+    X(GK_RETURN, 2, 13.875, 2.25, FINGER_RP) \
+    X(GK_SHIFT_L, 3, 1.125, 2.25, FINGER_LP)   X(GK_Z, 3, 2.75, 1.0, FINGER_LP) \
+    X(GK_X, 3, 3.75, 1.0, FINGER_LR)           X(GK_C, 3, 4.75, 1.0, FINGER_LM) \
+    X(GK_V, 3, 5.75, 1.0, FINGER_LI)           X(GK_B, 3, 6.75, 1.0, FINGER_LI) \
+    X(GK_N, 3, 7.75, 1.0, FINGER_RI)           X(GK_M, 3, 8.75, 1.0, FINGER_RI) \
+    X(GK_COMMA, 3, 9.75, 1.0, FINGER_RM)       X(GK_PERIOD, 3, 10.75, 1.0, FINGER_RR) \
+    X(GK_SLASH, 3, 11.75, 1.0, FINGER_RP)      X(GK_SHIFT_R, 3, 13.625, 2.75, FINGER_RP) \
+    X(GK_SPACE, 4, 7.0, 6.25, FINGER_RT)
+
+#define GEOMETRY_KEY_ID(id, row, x, width, finger) id,
+typedef enum { GEOMETRY_ANSI_KEYS(GEOMETRY_KEY_ID) GK_COUNT } GeometryKey;
+#undef GEOMETRY_KEY_ID
+
+typedef struct {
+    const char *name;
+    int row;
+    double x;
+    double width;
+    Finger finger;
+} KeyGeometry;
+
+#define GEOMETRY_KEY_ENTRY(id, row, x, width, finger) { #id, row, x, width, finger },
+static const KeyGeometry geometry_keys[GK_COUNT] = { GEOMETRY_ANSI_KEYS(GEOMETRY_KEY_ENTRY) };
+#undef GEOMETRY_KEY_ENTRY
+
+/* Where each finger rests between strokes */
+static const GeometryKey geometry_home[FINGER_COUNT] = {
+    GK_A, GK_S, GK_D, GK_F, GK_SPACE, GK_SPACE, GK_J, GK_K, GK_L, GK_SEMICOLON,
+};
+
+/* Keys whose names the recorders write instead of a character, on every layout */
+#define GEOMETRY_NAMED_KEYS(X) \
+    X("space", GK_SPACE) X("return", GK_RETURN) X("tab", GK_TAB) \
+    X("backspace", GK_BACKSPACE) X("capslock", GK_CAPSLOCK) \
+    X("shift_l", GK_SHIFT_L) X("shift_r", GK_SHIFT_R)
+
+/* Layouts: X(key, unshifted, shifted) for every key that types a character */
+#define GEOMETRY_NUMBER_ROW(X) \
+    X(GK_GRAVE, '`', '~') X(GK_1, '1', '!') X(GK_2, '2', '@') X(GK_3, '3', '#') \
+    X(GK_4, '4', '$') X(GK_5, '5', '%') X(GK_6, '6', '^') X(GK_7, '7', '&') \
+    X(GK_8, '8', '*') X(GK_9, '9', '(') X(GK_0, '0', ')')
+
+#define GEOMETRY_LAYOUT_QWERTY(X) GEOMETRY_NUMBER_ROW(X) \
+    X(GK_MINUS, '-', '_')                      X(GK_EQUAL, '=', '+') \
+    X(GK_Q, 'q', 'Q') X(GK_W, 'w', 'W') X(GK_E, 'e', 'E') X(GK_R, 'r', 'R') \
+    X(GK_T, 't', 'T') X(GK_Y, 'y', 'Y') X(GK_U, 'u', 'U') X(GK_I, 'i', 'I') \
+    X(GK_O, 'o', 'O') X(GK_P, 'p', 'P') X(GK_LBRACKET, '[', '{') \
+    X(GK_RBRACKET, ']', '}')                   X(GK_BACKSLASH, '\\', '|') \
+    X(GK_A, 'a', 'A') X(GK_S, 's', 'S') X(GK_D, 'd', 'D') X(GK_F, 'f', 'F') \
+    X(GK_G, 'g', 'G') X(GK_H, 'h', 'H') X(GK_J, 'j', 'J') X(GK_K, 'k', 'K') \
+    X(GK_L, 'l', 'L') X(GK_SEMICOLON, ';', ':') X(GK_QUOTE, '\'', '"') \
+    X(GK_Z, 'z', 'Z') X(GK_X, 'x', 'X') X(GK_C, 'c', 'C') X(GK_V, 'v', 'V') \
+    X(GK_B, 'b', 'B') X(GK_N, 'n', 'N') X(GK_M, 'm', 'M') X(GK_COMMA, ',', '<') \
+    X(GK_PERIOD, '.', '>') X(GK_SLASH, '/', '?')
+
+#define GEOMETRY_LAYOUT_DVORAK(X) GEOMETRY_NUMBER_ROW(X) \
+    X(GK_MINUS, '[', '{')                      X(GK_EQUAL, ']', '}') \
+    X(GK_Q, '\'', '"') X(GK_W, ',', '<') X(GK_E, '.', '>') X(GK_R, 'p', 'P') \
+    X(GK_T, 'y', 'Y') X(GK_Y, 'f', 'F') X(GK_U, 'g', 'G') X(GK_I, 'c', 'C') \
+    X(GK_O, 'r', 'R') X(GK_P, 'l', 'L') X(GK_LBRACKET, '/', '?') \
+    X(GK_RBRACKET, '=', '+')                   X(GK_BACKSLASH, '\\', '|') \
+    X(GK_A, 'a', 'A') X(GK_S, 'o', 'O') X(GK_D, 'e', 'E') X(GK_F, 'u', 'U') \
+    X(GK_G, 'i', 'I') X(GK_H, 'd', 'D') X(GK_J, 'h', 'H') X(GK_K, 't', 'T') \
+    X(GK_L, 'n', 'N') X(GK_SEMICOLON, 's', 'S') X(GK_QUOTE, '-', '_') \
+    X(GK_Z, ';', ':') X(GK_X, 'q', 'Q') X(GK_C, 'j', 'J') X(GK_V, 'k', 'K') \
+    X(GK_B, 'x', 'X') X(GK_N, 'b', 'B') X(GK_M, 'm', 'M') X(GK_COMMA, 'w', 'W') \
+    X(GK_PERIOD, 'v', 'V') X(GK_SLASH, 'z', 'Z')
+
+#define GEOMETRY_LAYOUT_COLEMAK(X) GEOMETRY_NUMBER_ROW(X) \
+    X(GK_MINUS, '-', '_')                      X(GK_EQUAL, '=', '+') \
+    X(GK_Q, 'q', 'Q') X(GK_W, 'w', 'W') X(GK_E, 'f', 'F') X(GK_R, 'p', 'P') \
+    X(GK_T, 'g', 'G') X(GK_Y, 'j', 'J') X(GK_U, 'l', 'L') X(GK_I, 'u', 'U') \
+    X(GK_O, 'y', 'Y') X(GK_P, ';', ':') X(GK_LBRACKET, '[', '{') \
+    X(GK_RBRACKET, ']', '}')                   X(GK_BACKSLASH, '\\', '|') \
+    X(GK_A, 'a', 'A') X(GK_S, 'r', 'R') X(GK_D, 's', 'S') X(GK_F, 't', 'T') \
+    X(GK_G, 'd', 'D') X(GK_H, 'h', 'H') X(GK_J, 'n', 'N') X(GK_K, 'e', 'E') \
+    X(GK_L, 'i', 'I') X(GK_SEMICOLON, 'o', 'O') X(GK_QUOTE, '\'', '"') \
+    X(GK_Z, 'z', 'Z') X(GK_X, 'x', 'X') X(GK_C, 'c', 'C') X(GK_V, 'v', 'V') \
+    X(GK_B, 'b', 'B') X(GK_N, 'k', 'K') X(GK_M, 'm', 'M') X(GK_COMMA, ',', '<') \
+    X(GK_PERIOD, '.', '>') X(GK_SLASH, '/', '?')
+
+/* X(name, list) for every layout; the first is the default */
+#define GEOMETRY_LAYOUTS(X) \
+    X(qwerty, GEOMETRY_LAYOUT_QWERTY) \
+    X(dvorak, GEOMETRY_LAYOUT_DVORAK) \
+    X(colemak, GEOMETRY_LAYOUT_COLEMAK)
+
+/* ASCII -> key + 1 (0 = not on the layout), one array per layout */
+#define GEOMETRY_ASCII_ENTRY(key, lower, upper) [(unsigned char)(lower)] = (key) + 1, \
+                                                [(unsigned char)(upper)] = (key) + 1,
+#define GEOMETRY_ASCII_TABLE(name, list) \
+    static const unsigned char geometry_ascii_##name[128] = { list(GEOMETRY_ASCII_ENTRY) };
+GEOMETRY_LAYOUTS(GEOMETRY_ASCII_TABLE)
+#undef GEOMETRY_ASCII_TABLE
+#undef GEOMETRY_ASCII_ENTRY
+
+typedef struct {
+    const char *name;
+    const unsigned char *ascii;
+} KeyboardLayout;
+
+#define GEOMETRY_LAYOUT_ENTRY(name, list) { #name, geometry_ascii_##name },
+static const KeyboardLayout geometry_layouts[] = { GEOMETRY_LAYOUTS(GEOMETRY_LAYOUT_ENTRY) };
+#undef GEOMETRY_LAYOUT_ENTRY
+
+#define GEOMETRY_LAYOUT_COUNT (int)(sizeof(geometry_layouts) / sizeof(geometry_layouts[0]))
+
+static inline const KeyboardLayout *geometry_layout(const char *name) {
+    for (int i = 0; i < GEOMETRY_LAYOUT_COUNT; i++)
+        if (!strcmp(geometry_layouts[i].name, name)) return &geometry_layouts[i];
+    return NULL;
+}
+
+/* Key for a character column value, or -1 if the layout does not place it */
+static inline int geometry_lookup(const KeyboardLayout *l, const char *character) {
+    unsigned char c = (unsigned char)character[0];
+    if (c && !character[1]) return c < 128 && l->ascii[c] ? l->ascii[c] - 1 : -1;
+#define GEOMETRY_NAMED_MATCH(name, key) if (!strcmp(character, name)) return key;
+    GEOMETRY_NAMED_KEYS(GEOMETRY_NAMED_MATCH)
+#undef GEOMETRY_NAMED_MATCH
+    return -1;
+}
+
+static inline Hand geometry_hand(int key) {
+    Finger f = geometry_keys[key].finger;
+    return f == FINGER_LT || f == FINGER_RT ? HAND_THUMB : f < FINGER_LT ? HAND_LEFT : HAND_RIGHT;
+}
+
+/* Centre-to-centre distance in key widths */
+static inline double geometry_distance(int a, int b) {
+    double dx = geometry_keys[a].x - geometry_keys[b].x;
+    double dy = (double)(geometry_keys[a].row - geometry_keys[b].row);
+    return sqrt(dx * dx + dy * dy);
+}
+
+#endif /* KEYBOARD_GEOMETRY_H */
@@ -0,0 +1,207 @@
+/*
+ * latency_context.c - Explain delivery latency spikes with system context (POSIX)
+ *
+ * Reads each session together with the <session>.sysctx.csv the recorder
+ * wrote next to it (--sysctx, see sysctx.h) and asks which conditions
+ * came with slow delivery.
+ *
+ * Delivery latency is timestamp_ms - event_timestamp_ms. The two come
+ * from different clocks, so only its excess over the session's minimum
+ * is meaningful; this assumes the clocks do not drift apart by more than
+ * a millisecond or so over one recording. Events whose excess is above
+ * the -q quantile (default 0.99) are spikes. Each event belongs to the
+ * sample interval it happened in, and an interval with a spike is a
+ * spike interval.
+ *
+ * Prints CSV, one row per session and condition:
+ *
+ *   session,metric,intervals,spike_intervals,mean_spike,mean_calm,spearman
+ *
+ * mean_spike and mean_calm average the condition over spike and other
+ * intervals; spearman is the rank correlation of the condition with the
+ * interval's worst excess latency. With -l, lists the spikes instead,
+ * each with the conditions of its interval:
+ *
+ *   session,seq,timestamp_ms,excess_ms,cpu_mhz,load1,runq_ms,major_faults,mem_pressure
+ *
+ * Build: make latency_context (see Makefile)
+ * Usage: ./latency_context [-q quantile] [-l] session.csv [more.csv ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "session.h"
+#include "sysctx.h"
+
+typedef struct {
+    double value;
+    size_t index;
+} Ranked;
+
+static int ranked_cmp(const void *a, const void *b) {
+    double x = ((const Ranked *)a)->value, y = ((const Ranked *)b)->value;
+    return x < y ? -1 : x > y;
+}
+
+/* Replaces v[0..n) by its ranks, ties sharing their mean rank */
+static void rank(double *v, size_t n, Ranked *tmp) {
+    for (size_t i = 0; i < n; i++) {
+        tmp[i].value = v[i];
+        tmp[i].index = i;
+    }
+    qsort(tmp, n, sizeof(Ranked), ranked_cmp);
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        while (j + 1 < n && tmp[j + 1].value == tmp[i].value) j++;
+        double r = (double)(i + j) / 2.0 + 1.0;
+        for (size_t k = i; k <= j; k++) v[tmp[k].index] = r;
+        i = j + 1;
+    }
+}
+
+/* Spearman's rho of x and y (both overwritten), NAN if undefined */
+static double spearman(double *x, double *y, size_t n, Ranked *tmp) {
+    if (n < 3) return NAN;
+    rank(x, n, tmp);
+    rank(y, n, tmp);
+    double mean = (double)(n + 1) / 2.0, sxy = 0, sxx = 0, syy = 0;
+    for (size_t i = 0; i < n; i++) {
+        sxy += (x[i] - mean) * (y[i] - mean);
+        sxx += (x[i] - mean) * (x[i] - mean);
+        syy += (y[i] - mean) * (y[i] - mean);
+    }
+    return sxx > 0 && syy > 0 ? sxy / sqrt(sxx * syy) : NAN;
+}
+
+static void print_num(double v) {
+    if (isnan(v)) printf(",");
+    else printf(",%.3f", v);
+}
+
+static int analyze(const char *path, double q, int list) {
+    Session s;
+    if (session_load(path, &s) != 0) {
+        fprintf(stderr, "Error: cannot read %s\n", path);
+        return -1;
+    }
+    char ctx_path[1100];
+    snprintf(ctx_path, sizeof(ctx_path), "%s.sysctx.csv", path);
+    SysSample *samples;
+    long nsamples = sysctx_load(ctx_path, &samples);
+    if (nsamples < 0) {
+        fprintf(stderr, "Error: cannot read %s (record with --sysctx)\n", ctx_path);
+        session_free(&s);
+        return -1;
+    }
+
+    /* Excess delivery latency of every key event, and its interval */
+    double *excess = malloc((s.count + 1) * sizeof(double));
+    long *interval = malloc((s.count + 1) * sizeof(long));
+    double *sorted = malloc((s.count + 1) * sizeof(double));
+    double base = INFINITY;
+    size_t n = 0;
+    long j = 0;
+    for (size_t i = 0; i < s.count; i++) {
+        const SessionEvent *e = &s.events[i];
+        if (e->type == SESSION_OTHER || e->event_timestamp_ms <= 0) continue;
+        while (j < nsamples && samples[j].timestamp_ms < e->timestamp_ms) j++;
+        excess[n] = e->timestamp_ms - e->event_timestamp_ms;
+        interval[n] = j < nsamples ? j : -1;
+        if (excess[n] < base) base = excess[n];
+        n++;
+    }
+    for (size_t i = 0; i < n; i++) sorted[i] = excess[i] -= base;
+    double threshold = n ? session_quantile(sorted, n, q) : 0;
+
+    /* Worst excess per interval; NAN where nothing was typed */
+    double *worst = malloc((nsamples + 1) * sizeof(double));
+    for (long k = 0; k < nsamples; k++) worst[k] = NAN;
+    size_t spikes = 0;
+    for (size_t i = 0, k = 0; i < s.count; i++) {
+        const SessionEvent *e = &s.events[i];
+        if (e->type == SESSION_OTHER || e->event_timestamp_ms <= 0) continue;
+        long iv = interval[k];
+        if (iv >= 0 && (isnan(worst[iv]) || excess[k] > worst[iv])) worst[iv] = excess[k];
+        if (excess[k] > threshold && excess[k] > 0) {
+            spikes++;
+            if (list) {
+                printf("%s,%lld,%.3f,%.3f", path, (long long)e->seq, e->timestamp_ms, excess[k]);
+                for (int m = 0; m < SYSCTX_FIELDS; m++) print_num(iv >= 0 ? samples[iv].v[m] : NAN);
+                printf("\n");
+            }
+        }
+        k++;
+    }
+
+    if (!list) {
+        double *x = malloc((nsamples + 1) * sizeof(double));
+        double *y = malloc((nsamples + 1) * sizeof(double));
+        Ranked *tmp = malloc((nsamples + 1) * sizeof(Ranked));
+        for (int m = 0; m < SYSCTX_FIELDS; m++) {
+            size_t used = 0, spike_intervals = 0;
+            double spike_sum = 0, calm_sum = 0;
+            for (long k = 0; k < nsamples; k++) {
+                double v = samples[k].v[m];
+                if (isnan(worst[k]) || isnan(v)) continue;
+                x[used] = v;
+                y[used] = worst[k];
+                used++;
+                if (worst[k] > threshold && worst[k] > 0) {
+                    spike_intervals++;
+                    spike_sum += v;
+                } else {
+                    calm_sum += v;
+                }
+            }
+            printf("%s,%s,%zu,%zu", path, sysctx_names[m], used, spike_intervals);
+            print_num(spike_intervals ? spike_sum / spike_intervals : NAN);
+            print_num(used > spike_intervals ? calm_sum / (used - spike_intervals) : NAN);
+            print_num(spearman(x, y, used, tmp));
+            printf("\n");
+        }
+        free(x);
+        free(y);
+        free(tmp);
+    }
+    fprintf(stderr, "%s: %zu events, %zu spikes over %.3f ms excess, %ld samples\n",
+            path, n, spikes, threshold, nsamples);
+
+    free(worst);
+    free(sorted);
+    free(interval);
+    free(excess);
+    free(samples);
+    session_free(&s);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    double q = 0.99;
+    int list = 0;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "-l")) {
+            list = 1;
+            argi++;
+            continue;
+        }
+        if (argi + 1 >= argc) break;
+        if (!strcmp(argv[argi], "-q")) q = atof(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi >= argc || q <= 0 || q >= 1) {
+        fprintf(stderr, "Usage: %s [-q quantile] [-l] session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    if (list) printf("session,seq,timestamp_ms,excess_ms,cpu_mhz,load1,runq_ms,major_faults,mem_pressure\n");
+    else printf("session,metric,intervals,spike_intervals,mean_spike,mean_calm,spearman\n");
+    int failures = 0;
+    for (; argi < argc; argi++) {
+        if (analyze(argv[argi], q, list) != 0) failures++;
+    }
+    return failures ? 1 : 0;
+}
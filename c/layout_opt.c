@@ -0,0 +1,349 @@
+/*
+ * layout_opt.c - Search for keyboard layouts that minimize typing time (POSIX)
+ *
+ * Builds two tables from recorded sessions typed on layout -l:
+ *   F[a][b]  how often character b follows character a (dense 128 x 128,
+ *            shifted characters folded to their key's unshifted one)
+ *   T[p][q]  mean press-to-press time from key position p to q, measured
+ *            from every digraph typed on those keys. Sparse pairs are
+ *            shrunk towards the mean of their class (same key, same
+ *            finger, same hand, other hand, thumb), so every pair of
+ *            positions has a cost.
+ * A layout's predicted time is sum F[a][b] * T[pos a][pos b]. Simulated
+ * annealing then swaps the 30 characters of the alpha block (the keys
+ * from Q to P, A to ;, Z to /) to minimize it, one independent chain per
+ * core with its own seed derived from -s, and the best layout wins. Pairs slower
+ * than -p ms are pauses, not digraphs, and are left out.
+ *
+ * This is a quadratic assignment problem: a swap changes every term
+ * involving either character, so the swap delta is O(characters in use)
+ * rather than O(1). With ~30 characters in use a candidate took about
+ * 225 ns on a thread with a core to itself, so the default run is a few
+ * seconds per core. The figure printed at the end is wall time per
+ * thread: with more threads than cores (hyper-threads included) it grows
+ * by the oversubscription, e.g. ~800 ns for 4 threads on one core.
+ *
+ * Build: make layout_opt (see Makefile)
+ * Usage: ./layout_opt [-l layout] [-i iterations] [-s seed] [-@ threads] [-p ms]
+ *                    session.csv [more.csv ...]
+ *        -l is the layout the sessions were typed on (default qwerty),
+ *        -i the annealing steps per thread (default 20000000). The same
+ *        seed (default 1) and thread count give the same layout. A "-"
+ *        argument reads further paths from stdin, one per line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include "session.h"
+#include "keyboard_geometry.h"
+
+#define CHARS 128
+#define SHRINK 5.0              /* pseudo-count of the class mean in T */
+#define T_START 2.0             /* annealing temperature, ms per digraph */
+#define T_END 0.001
+
+enum { PAIR_SAME_KEY, PAIR_SAME_FINGER, PAIR_SAME_HAND, PAIR_OTHER_HAND, PAIR_THUMB, PAIR_CLASSES };
+
+static const char *const pair_class_names[PAIR_CLASSES] = {
+    "same_key", "same_finger", "same_hand", "other_hand", "thumb",
+};
+
+/* The alpha block, the positions the search may rearrange */
+static const GeometryKey alpha_keys[] = {
+    GK_Q, GK_W, GK_E, GK_R, GK_T, GK_Y, GK_U, GK_I, GK_O, GK_P,
+    GK_A, GK_S, GK_D, GK_F, GK_G, GK_H, GK_J, GK_K, GK_L, GK_SEMICOLON,
+    GK_Z, GK_X, GK_C, GK_V, GK_B, GK_N, GK_M, GK_COMMA, GK_PERIOD, GK_SLASH,
+};
+#define ALPHA (int)(sizeof(alpha_keys) / sizeof(alpha_keys[0]))
+
+static double F[CHARS][CHARS];
+static double T[GK_COUNT][GK_COUNT];
+
+/* Characters with any digraph, so the delta loops only touch those */
+static int used[CHARS], nused;
+
+static int pair_class(int p, int q) {
+    Hand hp = geometry_hand(p), hq = geometry_hand(q);
+    if (p == q) return PAIR_SAME_KEY;
+    if (hp == HAND_THUMB || hq == HAND_THUMB) return PAIR_THUMB;
+    if (geometry_keys[p].finger == geometry_keys[q].finger) return PAIR_SAME_FINGER;
+    return hp == hq ? PAIR_SAME_HAND : PAIR_OTHER_HAND;
+}
+
+/* Key -> unshifted character, one array per layout, from the same tables */
+#define UNSHIFTED_ENTRY(key, lower, upper) [key] = (lower),
+#define UNSHIFTED_TABLE(name, list) static const char unshifted_##name[GK_COUNT] = { list(UNSHIFTED_ENTRY) };
+GEOMETRY_LAYOUTS(UNSHIFTED_TABLE)
+#undef UNSHIFTED_TABLE
+#undef UNSHIFTED_ENTRY
+#define UNSHIFTED_PTR(name, list) unshifted_##name,
+static const char *const unshifted[] = { GEOMETRY_LAYOUTS(UNSHIFTED_PTR) };
+#undef UNSHIFTED_PTR
+
+/* The character a press stands for: the unshifted character of its key */
+static int fold(const KeyboardLayout *l, const char *character) {
+    int key = geometry_lookup(l, character);
+    if (key == GK_SPACE) return ' ';
+    if (key == GK_RETURN) return '\n';
+    if (key == GK_TAB) return '\t';
+    return key >= 0 && unshifted[l - geometry_layouts][key] ? unshifted[l - geometry_layouts][key] : -1;
+}
+
+/* Position of every character under a layout, -1 if unplaced */
+static void layout_positions(const KeyboardLayout *l, int *pos) {
+    for (int c = 0; c < CHARS; c++) pos[c] = -1;
+    for (int k = 0; k < GK_COUNT; k++)
+        if (unshifted[l - geometry_layouts][k]) pos[(unsigned char)unshifted[l - geometry_layouts][k]] = k;
+    pos[' '] = GK_SPACE;
+    pos['\n'] = GK_RETURN;
+    pos['\t'] = GK_TAB;
+}
+
+/* Predicted time of the digraphs in F under pos; weight gets how many it could place */
+static double layout_cost(const int *pos, double *weight) {
+    double cost = 0, w = 0;
+    for (int i = 0; i < nused; i++) {
+        int a = used[i];
+        if (pos[a] < 0) continue;
+        for (int j = 0; j < nused; j++) {
+            int b = used[j];
+            if (pos[b] < 0) continue;
+            cost += F[a][b] * T[pos[a]][pos[b]];
+            w += F[a][b];
+        }
+    }
+    if (weight) *weight = w;
+    return cost;
+}
+
+/* Change in cost if characters x and y traded positions */
+static double swap_delta(const int *pos, int x, int y) {
+    int px = pos[x], py = pos[y];
+    double d = 0;
+    for (int i = 0; i < nused; i++) {
+        int c = used[i], pc = pos[c];
+        if (c == x || c == y || pc < 0) continue;
+        d += F[x][c] * (T[py][pc] - T[px][pc]) + F[c][x] * (T[pc][py] - T[pc][px])
+           + F[y][c] * (T[px][pc] - T[py][pc]) + F[c][y] * (T[pc][px] - T[pc][py]);
+    }
+    d += F[x][y] * (T[py][px] - T[px][py]) + F[y][x] * (T[px][py] - T[py][px])
+       + F[x][x] * (T[py][py] - T[px][px]) + F[y][y] * (T[px][px] - T[py][py]);
+    return d;
+}
+
+typedef struct {
+    const int *start;           /* source layout positions */
+    const int *movable;         /* characters on the alpha block */
+    int nmovable;
+    long iterations;
+    double digraphs;          /* sum of F, to scale the temperature */
+    uint64_t seed;
+    int best[CHARS];
+    double best_cost;
+} Chain;
+
+/* splitmix64 finalizer: a well-mixed, nonzero xorshift state per chain */
+static uint64_t chain_seed(uint64_t seed, int chain) {
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL * (uint64_t)(chain + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+static uint64_t xorshift(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static void *anneal(void *arg) {
+    Chain *ch = arg;
+    int pos[CHARS];
+    memcpy(pos, ch->start, sizeof(pos));
+    uint64_t rng = ch->seed;
+
+    /* Start from a random arrangement of the alpha block */
+    for (int i = ch->nmovable - 1; i > 0; i--) {
+        int j = (int)(xorshift(&rng) % (uint64_t)(i + 1));
+        int a = ch->movable[i], b = ch->movable[j], t = pos[a];
+        pos[a] = pos[b];
+        pos[b] = t;
+    }
+    double cost = layout_cost(pos, NULL);
+    memcpy(ch->best, pos, sizeof(pos));
+    ch->best_cost = cost;
+
+    double scale = ch->digraphs, cool = pow(T_END / T_START, 1.0 / (double)ch->iterations);
+    double temp = T_START;
+    for (long it = 0; it < ch->iterations; it++, temp *= cool) {
+        uint64_t r = xorshift(&rng);
+        int x = ch->movable[r % (uint64_t)ch->nmovable];
+        int y = ch->movable[(r >> 32) % (uint64_t)ch->nmovable];
+        if (x == y) continue;
+        double d = swap_delta(pos, x, y);
+        if (d > 0 && exp(-d / (temp * scale)) * 4294967296.0 < (double)(xorshift(&rng) >> 32)) continue;
+        int t = pos[x];
+        pos[x] = pos[y];
+        pos[y] = t;
+        cost += d;
+        if (cost < ch->best_cost) {
+            ch->best_cost = cost;
+            memcpy(ch->best, pos, sizeof(pos));
+        }
+    }
+    ch->best_cost = layout_cost(ch->best, NULL);    /* drop accumulated rounding */
+    return NULL;
+}
+
+static void print_layout(const int *pos) {
+    char at[GK_COUNT];
+    memset(at, ' ', sizeof(at));
+    for (int c = 33; c < CHARS; c++)
+        if (pos[c] >= 0) at[pos[c]] = (char)c;
+    for (int row = 0; row < 3; row++) {
+        printf("  %*s", row, "");
+        for (int i = 0; i < 10; i++) printf("%c ", at[alpha_keys[row * 10 + i]]);
+        printf("\n");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const KeyboardLayout *layout = &geometry_layouts[0];
+    long iterations = 20000000;
+    uint64_t seed = 1;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    double pause_ms = 1000.0;
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        if (!strcmp(argv[argi], "-l")) layout = geometry_layout(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-i")) iterations = atol(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-s")) seed = strtoull(argv[argi + 1], NULL, 10);
+        else if (!strcmp(argv[argi], "-@")) threads = atoi(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-p")) pause_ms = atof(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi >= argc || !layout || threads < 1 || iterations < 1) {
+        fprintf(stderr, "Usage: %s [-l layout] [-i iterations] [-s seed] [-@ threads] [-p ms] session.csv [...]\n", argv[0]);
+        return 1;
+    }
+
+    /* Aggregate digraph counts by character and latencies by key position */
+    int source[CHARS];
+    layout_positions(layout, source);
+    static double lat_sum[GK_COUNT][GK_COUNT], lat_n[GK_COUNT][GK_COUNT];
+    double class_sum[PAIR_CLASSES] = {0}, class_n[PAIR_CLASSES] = {0};
+    int failures = 0;
+    long sessions = 0;
+    for (; argi < argc; argi++) {
+        char line[4096];
+        const char *path = argv[argi];
+        int from_stdin = !strcmp(path, "-");
+        while (!from_stdin || (fgets(line, sizeof(line), stdin) && (line[strcspn(line, "\r\n")] = '\0', 1))) {
+            if (from_stdin) path = line;
+            Session s;
+            if (session_load(path, &s) != 0) {
+                fprintf(stderr, "Error: cannot read %s\n", path);
+                failures++;
+            } else {
+                int prev = -1;
+                double prev_t = 0;
+                for (size_t i = 0; i < s.count; i++) {
+                    const SessionEvent *e = &s.events[i];
+                    if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+                    int c = fold(layout, e->character);
+                    double dt = e->timestamp_ms - prev_t;
+                    if (c >= 0 && prev >= 0 && dt > 0 && dt <= pause_ms) {
+                        F[prev][c] += 1;
+                        int p = source[prev], q = source[c];
+                        if (p >= 0 && q >= 0) {
+                            lat_sum[p][q] += dt;
+                            lat_n[p][q] += 1;
+                            class_sum[pair_class(p, q)] += dt;
+                            class_n[pair_class(p, q)] += 1;
+                        }
+                    }
+                    prev = c;
+                    prev_t = e->timestamp_ms;
+                }
+                session_free(&s);
+                sessions++;
+            }
+            if (!from_stdin) break;
+        }
+    }
+
+    double all_sum = 0, all_n = 0;
+    for (int k = 0; k < PAIR_CLASSES; k++) {
+        all_sum += class_sum[k];
+        all_n += class_n[k];
+    }
+    if (all_n == 0) {
+        fprintf(stderr, "Error: no digraphs on the %s layout in the input\n", layout->name);
+        return 1;
+    }
+    fprintf(stderr, "%ld sessions, %.0f digraphs; class means:", sessions, all_n);
+    double class_mean[PAIR_CLASSES];
+    for (int k = 0; k < PAIR_CLASSES; k++) {
+        class_mean[k] = class_n[k] > 0 ? class_sum[k] / class_n[k] : all_sum / all_n;
+        fprintf(stderr, " %s=%.1f", pair_class_names[k], class_mean[k]);
+    }
+    fprintf(stderr, " ms\n");
+    for (int p = 0; p < GK_COUNT; p++)
+        for (int q = 0; q < GK_COUNT; q++)
+            T[p][q] = (lat_sum[p][q] + SHRINK * class_mean[pair_class(p, q)]) / (lat_n[p][q] + SHRINK);
+
+    double digraphs = 0;
+    for (int a = 0; a < CHARS; a++) {
+        double row = 0;
+        for (int b = 0; b < CHARS; b++) row += F[a][b] + F[b][a];
+        if (row > 0) used[nused++] = a;
+        for (int b = 0; b < CHARS; b++) digraphs += F[a][b];
+    }
+
+    /* Characters the search may move: those on the alpha block of the source layout */
+    int movable[ALPHA], nmovable = ALPHA;
+    for (int i = 0; i < ALPHA; i++) movable[i] = unshifted[layout - geometry_layouts][alpha_keys[i]];
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    Chain *chains = calloc((size_t)threads, sizeof(Chain));
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) {
+        chains[t] = (Chain){ source, movable, nmovable, iterations, digraphs,
+                             chain_seed(seed, t), {0}, 0 };
+        pthread_create(&tids[t], NULL, anneal, &chains[t]);
+    }
+    int best = 0;
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        if (chains[t].best_cost < chains[best].best_cost) best = t;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    fprintf(stderr, "%ld candidates in %.2f s (%.1f ns each per thread)\n", iterations * threads, secs,
+            secs * 1e9 / (double)iterations);
+
+    /* Predicted ms per digraph, for the known layouts and the best found */
+    printf("predicted ms per digraph:\n");
+    for (int i = 0; i < GEOMETRY_LAYOUT_COUNT; i++) {
+        int pos[CHARS];
+        double weight;
+        layout_positions(&geometry_layouts[i], pos);
+        double cost = layout_cost(pos, &weight);
+        printf("  %-8s %.2f\n", geometry_layouts[i].name, weight > 0 ? cost / weight : 0.0);
+    }
+    printf("  %-8s %.2f (%+.2f%% vs %s)\n", "best", chains[best].best_cost / digraphs,
+           100.0 * (chains[best].best_cost / layout_cost(source, NULL) - 1.0), layout->name);
+    print_layout(chains[best].best);
+
+    free(chains);
+    free(tids);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * metrics.h - Rolling live metrics for a recorder
+ *
+ * Pre-aggregated state the capture callback updates in O(1) per event and
+ * a reader thread turns into a JSON snapshot whenever it likes:
+ *   kpm       non-repeat key presses in the last 60 s (per-second ring)
+ *   dwell     key_down -> key_up, and flight, previous key_up -> key_down,
+ *             as HDR-style histograms: log-linear buckets with
+ *             METRICS_SUB_BUCKETS per power of two (under 4% error) from
+ *             10 us up, kept in METRICS_SLOTS slots of METRICS_SLOT_S
+ *             seconds, so percentiles cover the last minute
+ *   keys      per-key dwell count and mean over the whole recording
+ *   held      keys down right now, by name
+ *   dropped   events the recorder could not keep
+ *
+ * There is one writer (the capture thread), so an update is a plain
+ * load, add and atomic store: readers never see a torn value and the
+ * callback never pays for a locked read-modify-write. A slot is cleared
+ * by the writer when time moves into it, so a snapshot taken
+ * concurrently may be off by the events of that instant but never
+ * blocks or slows capture. MSVC gets the same from volatile fields,
+ * which it orders under its default /volatile:ms.
+ *
+ * Used by terminal_macos.c (--dashboard, --tui) and terminal_windows.c
+ * (--tui) through dashboard.h and tui.h.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define METRICS_SHARED volatile
+#define METRICS_GET(p) (*(p))
+#define METRICS_SET(p, v) (*(p) = (v))
+#else
+#define METRICS_SHARED
+#define METRICS_GET(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define METRICS_SET(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#endif
+#define METRICS_ADD(p, v) METRICS_SET((p), METRICS_GET(p) + (v))
+
+#define METRICS_SUB_BITS 5
+#define METRICS_SUB_BUCKETS (1 << METRICS_SUB_BITS)
+#define METRICS_BUCKETS 512         /* up to ~20 s at 10 us units */
+#define METRICS_UNIT_US 10.0
+#define METRICS_SLOTS 6
+#define METRICS_SLOT_S 10
+#define METRICS_KPM_S 60
+#define METRICS_KEYS 256            /* keycodes tracked for dwell and held */
+#define METRICS_UP INT64_MIN
+
+typedef struct {
+    METRICS_SHARED int64_t epoch;   /* slot index it holds, -1 when empty */
+    METRICS_SHARED uint32_t dwell[METRICS_BUCKETS];
+    METRICS_SHARED uint32_t flight[METRICS_BUCKETS];
+} MetricsSlot;
+
+typedef struct {
+    MetricsSlot slots[METRICS_SLOTS];
+    METRICS_SHARED int64_t kpm_epoch[METRICS_KPM_S];
+    METRICS_SHARED uint32_t kpm[METRICS_KPM_S];
+    METRICS_SHARED int64_t down_us[METRICS_KEYS];  /* METRICS_UP when up */
+    char names[METRICS_KEYS][8];
+    METRICS_SHARED uint32_t dwell_n[METRICS_KEYS];
+    METRICS_SHARED uint64_t dwell_us[METRICS_KEYS];
+    double last_up;                 /* writer only */
+    METRICS_SHARED uint64_t events;
+    METRICS_SHARED uint64_t dropped;
+} Metrics;
+
+static inline void metrics_init(Metrics *m) {
+    memset((void *)m, 0, sizeof(*m));
+    for (int i = 0; i < METRICS_SLOTS; i++) m->slots[i].epoch = -1;
+    for (int i = 0; i < METRICS_KPM_S; i++) m->kpm_epoch[i] = -1;
+    for (int k = 0; k < METRICS_KEYS; k++) m->down_us[k] = METRICS_UP;
+    m->last_up = NAN;
+}
+
+static inline int metrics_msb(uint64_t v) {
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i;
+    _BitScanReverse64(&i, v);
+    return (int)i;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static inline int metrics_bucket(double ms) {
+    uint64_t v = ms > 0 ? (uint64_t)(ms * 1000.0 / METRICS_UNIT_US) : 0;
+    if (v < 2 * METRICS_SUB_BUCKETS) return (int)v;
+    int msb = metrics_msb(v), shift = msb - METRICS_SUB_BITS;
+    int b = (shift + 1) * METRICS_SUB_BUCKETS + (int)((v >> shift) - METRICS_SUB_BUCKETS);
+    return b < METRICS_BUCKETS ? b : METRICS_BUCKETS - 1;
+}
+
+/* Midpoint of a bucket, in ms */
+static inline double metrics_bucket_ms(int b) {
+    if (b < 2 * METRICS_SUB_BUCKETS) return (b + 0.5) * METRICS_UNIT_US / 1000.0;
+    int shift = b / METRICS_SUB_BUCKETS - 1;
+    double lo = (double)((uint64_t)(METRICS_SUB_BUCKETS + b % METRICS_SUB_BUCKETS) << shift);
+    return (lo + (double)(1ULL << shift) / 2.0) * METRICS_UNIT_US / 1000.0;
+}
+
+/* The slot for time ms, cleared first if it held an older period */
+static inline MetricsSlot *metrics_slot(Metrics *m, double ms) {
+    int64_t epoch = (int64_t)(ms / 1000.0) / METRICS_SLOT_S;
+    MetricsSlot *s = &m->slots[epoch % METRICS_SLOTS];
+    if (s->epoch != epoch) {
+        METRICS_SET(&s->epoch, -1);
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            METRICS_SET(&s->dwell[b], 0);
+            METRICS_SET(&s->flight[b], 0);
+        }
+        METRICS_SET(&s->epoch, epoch);
+    }
+    return s;
+}
+
+static inline void metrics_key_down(Metrics *m, int keycode, const char *name, double ms, int is_repeat) {
+    METRICS_ADD(&m->events, 1);
+    if (is_repeat) return;
+    MetricsSlot *s = metrics_slot(m, ms);
+    if (!isnan(m->last_up)) METRICS_ADD(&s->flight[metrics_bucket(ms - m->last_up)], 1);
+
+    int64_t second = (int64_t)(ms / 1000.0);
+    int i = (int)(second % METRICS_KPM_S);
+    if (m->kpm_epoch[i] != second) {
+        METRICS_SET(&m->kpm[i], 0);
+        METRICS_SET(&m->kpm_epoch[i], second);
+    }
+    METRICS_ADD(&m->kpm[i], 1);
+
+    if (keycode >= 0 && keycode < METRICS_KEYS) {
+        snprintf(m->names[keycode], sizeof(m->names[keycode]), "%s", name);
+        METRICS_SET(&m->down_us[keycode], (int64_t)(ms * 1000.0));
+    }
+}
+
+static inline void metrics_key_up(Metrics *m, int keycode, double ms) {
+    METRICS_ADD(&m->events, 1);
+    m->last_up = ms;
+    if (keycode < 0 || keycode >= METRICS_KEYS) return;
+    int64_t down = m->down_us[keycode];
+    if (down == METRICS_UP) return;
+    METRICS_SET(&m->down_us[keycode], METRICS_UP);
+    double dwell = ms - (double)down / 1000.0;
+    MetricsSlot *s = metrics_slot(m, ms);
+    METRICS_ADD(&s->dwell[metrics_bucket(dwell)], 1);
+    if (dwell > 0) METRICS_ADD(&m->dwell_us[keycode], (uint64_t)(dwell * 1000.0));
+    METRICS_ADD(&m->dwell_n[keycode], 1);
+}
+
+static inline void metrics_drop(Metrics *m) {
+    METRICS_ADD(&m->dropped, 1);
+}
+
+/* p-quantiles of a summed histogram, n gets the count */
+static inline void metrics_percentiles(const uint32_t *h, const double *ps, double *out, int np, uint64_t *n) {
+    uint64_t total = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) total += h[b];
+    *n = total;
+    for (int i = 0; i < np; i++) {
+        uint64_t rank = (uint64_t)(ps[i] * (double)total), seen = 0;
+        out[i] = NAN;
+        for (int b = 0; b < METRICS_BUCKETS && total; b++) {
+            seen += h[b];
+            if (seen > rank) {
+                out[i] = metrics_bucket_ms(b);
+                break;
+            }
+        }
+    }
+}
+
+/* Sums the slots of the last minute at now_ms into dwell and flight */
+static inline void metrics_window(Metrics *m, double now_ms, uint32_t *dwell, uint32_t *flight) {
+    memset(dwell, 0, METRICS_BUCKETS * sizeof(*dwell));
+    memset(flight, 0, METRICS_BUCKETS * sizeof(*flight));
+    int64_t epoch = (int64_t)(now_ms / 1000.0) / METRICS_SLOT_S;
+    for (int i = 0; i < METRICS_SLOTS; i++) {
+        const MetricsSlot *s = &m->slots[i];
+        int64_t e = METRICS_GET(&s->epoch);
+        if (e < 0 || e > epoch || e <= epoch - METRICS_SLOTS) continue;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            dwell[b] += METRICS_GET(&s->dwell[b]);
+            flight[b] += METRICS_GET(&s->flight[b]);
+        }
+    }
+}
+
+/*
+ * Key presses in each of the METRICS_KPM_S seconds up to now_ms, oldest
+ * first. Returns their sum, the keys per minute.
+ */
+static inline uint64_t metrics_kpm(Metrics *m, double now_ms, uint32_t *per_second) {
+    int64_t second = (int64_t)(now_ms / 1000.0);
+    uint64_t kpm = 0;
+    for (int j = 0; j < METRICS_KPM_S; j++) {
+        int64_t want = second - (METRICS_KPM_S - 1) + j;
+        uint32_t c = 0;
+        if (want >= 0) {
+            int i = (int)(want % METRICS_KPM_S);
+            if (METRICS_GET(&m->kpm_epoch[i]) == want) c = METRICS_GET(&m->kpm[i]);
+        }
+        if (per_second) per_second[j] = c;
+        kpm += c;
+    }
+    return kpm;
+}
+
+/*
+ * Writes the state at time now_ms as one line of JSON into buf. Returns
+ * its length (truncated to len - 1 like snprintf).
+ */
+static inline size_t metrics_json(Metrics *m, double now_ms, char *buf, size_t len) {
+    static const double ps[3] = { 0.50, 0.90, 0.99 };
+    uint32_t dwell[METRICS_BUCKETS], flight[METRICS_BUCKETS];
+    metrics_window(m, now_ms, dwell, flight);
+    uint64_t kpm = metrics_kpm(m, now_ms, NULL);
+
+    double dq[3], fq[3];
+    uint64_t dn, fn;
+    metrics_percentiles(dwell, ps, dq, 3, &dn);
+    metrics_percentiles(flight, ps, fq, 3, &fn);
+    size_t n = (size_t)snprintf(buf, len, "{\"t_ms\":%.0f,\"events\":%llu,\"dropped\":%llu,\"kpm\":%llu",
+                                now_ms, (unsigned long long)METRICS_GET(&m->events),
+                                (unsigned long long)METRICS_GET(&m->dropped),
+                                (unsigned long long)kpm);
+#define METRICS_PUT(...) \
+    do { if (n < len) n += (size_t)snprintf(buf + n, len - n, __VA_ARGS__); } while (0)
+    const char *names[2] = { "dwell", "flight" };
+    const double *qs[2] = { dq, fq };
+    uint64_t counts[2] = { dn, fn };
+    for (int s = 0; s < 2; s++) {
+        METRICS_PUT(",\"%s\":{\"n\":%llu", names[s], (unsigned long long)counts[s]);
+        for (int i = 0; i < 3; i++) {
+            if (isnan(qs[s][i])) METRICS_PUT(",\"p%.0f\":null", ps[i] * 100);
+            else METRICS_PUT(",\"p%.0f\":%.1f", ps[i] * 100, qs[s][i]);
+        }
+        METRICS_PUT("}");
+    }
+    METRICS_PUT(",\"held\":[");
+    int first = 1;
+    for (int k = 0; k < METRICS_KEYS; k++) {
+        if (METRICS_GET(&m->down_us[k]) == METRICS_UP) continue;
+        char name[sizeof(m->names[k])];
+        memcpy(name, m->names[k], sizeof(name));
+        name[sizeof(name) - 1] = '\0';
+        METRICS_PUT("%s\"", first ? "" : ",");
+        for (const char *c = name; *c; c++) {
+            if (*c == '"' || *c == '\\') METRICS_PUT("\\%c", *c);
+            else if ((unsigned char)*c >= 0x20) METRICS_PUT("%c", *c);
+        }
+        METRICS_PUT("\"");
+        first = 0;
+    }
+    METRICS_PUT("]}");
+#undef METRICS_PUT
+    return n < len ? n : len - 1;
+}
+
+#endif /* METRICS_H */
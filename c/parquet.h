@@ -0,0 +1,752 @@
+/*
+ * parquet.h - Streaming Parquet writer for key events (portable C)
+ *
+ * Writes the session schema straight to a Parquet file, one row group at
+ * a time, so memory stays bounded by the row group size however long the
+ * session is. Columns (all REQUIRED):
+ *
+ *   seq                 INT64       DELTA_BINARY_PACKED
+ *   timestamp_us        INT64       DELTA_BINARY_PACKED  (timestamp_ms * 1000)
+ *   event_timestamp_us  INT64       DELTA_BINARY_PACKED
+ *   event_type          BYTE_ARRAY  RLE_DICTIONARY (UTF8)
+ *   keycode, scancode   INT32       PLAIN
+ *   character           BYTE_ARRAY  RLE_DICTIONARY (UTF8)
+ *   modifiers           BYTE_ARRAY  RLE_DICTIONARY (UTF8)
+ *   is_repeat           BOOLEAN     PLAIN
+ *
+ * Each column chunk is a dictionary page (dictionary columns only) plus
+ * one data page, compressed with a built-in Snappy encoder, and carries
+ * min/max statistics. The "# key=value" metadata lines become the file's
+ * key/value metadata. Footer structures are Thrift compact protocol.
+ *
+ * Used by terminal_macos.c, terminal_windows.c (.parquet output) and
+ * csv2parquet.c.
+ */
+
+#ifndef PARQUET_H
+#define PARQUET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define PARQUET_ROW_GROUP 65536     /* default rows per row group */
+#define PARQUET_COLUMNS 9
+#define PARQUET_STAT_MAX 64         /* longest string kept as min/max */
+#define PARQUET_CREATED_BY "keyboard-timing parquet.h"
+
+/* Parquet enums */
+enum { PQ_BOOLEAN = 0, PQ_INT32 = 1, PQ_INT64 = 2, PQ_BYTE_ARRAY = 6 };
+enum { PQ_PLAIN = 0, PQ_RLE = 3, PQ_DELTA_BINARY_PACKED = 5, PQ_RLE_DICTIONARY = 8 };
+enum { PQ_DATA_PAGE = 0, PQ_DICTIONARY_PAGE = 2 };
+enum { PQ_SNAPPY = 1 };
+
+/* Thrift compact protocol types */
+enum { TC_I16 = 4, TC_I32 = 5, TC_I64 = 6, TC_BINARY = 8, TC_LIST = 9, TC_STRUCT = 12 };
+
+typedef struct {
+    int64_t seq;
+    int64_t timestamp_us;
+    int64_t event_timestamp_us;
+    const char *event_type;
+    int32_t keycode;
+    int32_t scancode;
+    const char *character;
+    const char *modifiers;
+    int is_repeat;
+} ParquetEvent;
+
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+} ParquetBuf;
+
+/* Where one column chunk landed, kept for the footer */
+typedef struct {
+    uint64_t dict_offset;       /* 0 when the column has no dictionary */
+    uint64_t data_offset;
+    uint64_t uncompressed;
+    uint64_t compressed;
+    int has_stats;
+    unsigned char min[PARQUET_STAT_MAX], max[PARQUET_STAT_MAX];
+    uint32_t min_len, max_len;
+} ParquetChunk;
+
+typedef struct {
+    const char *name;
+    int type;
+    int encoding;
+    /* Row group values: numbers, or dictionary indices */
+    int64_t *values;
+    uint32_t *indices;
+    /* Dictionary of the current row group */
+    char *arena;
+    size_t arena_len, arena_cap;
+    uint32_t *entry_off, *entry_len;
+    uint32_t entries, entries_cap;
+    uint32_t *slots;            /* open addressing, entry + 1 */
+    uint32_t nslots;
+} ParquetColumn;
+
+typedef struct {
+    FILE *f;
+    uint64_t pos;
+    char *metadata;
+    uint32_t group_rows;
+    uint32_t rows;              /* rows buffered in the current group */
+    uint64_t total_rows;
+    ParquetColumn cols[PARQUET_COLUMNS];
+    ParquetChunk *chunks;       /* PARQUET_COLUMNS per finished group */
+    uint64_t *group_rows_done;
+    uint32_t groups, groups_cap;
+    ParquetBuf page, comp, hdr;
+    int error;
+} ParquetWriter;
+
+/* ---- Buffers and Thrift compact encoding ---- */
+
+static inline void pq_reserve(ParquetBuf *b, size_t n) {
+    if (b->len + n <= b->cap) return;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + n) cap *= 2;
+    b->data = realloc(b->data, cap);
+    b->cap = cap;
+}
+
+static inline void pq_put(ParquetBuf *b, const void *p, size_t n) {
+    pq_reserve(b, n);
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static inline void pq_byte(ParquetBuf *b, unsigned c) {
+    pq_reserve(b, 1);
+    b->data[b->len++] = (unsigned char)c;
+}
+
+static inline void pq_le(ParquetBuf *b, uint64_t v, int bytes) {
+    pq_reserve(b, (size_t)bytes);
+    for (int i = 0; i < bytes; i++) b->data[b->len++] = (unsigned char)(v >> (8 * i));
+}
+
+static inline void pq_varint(ParquetBuf *b, uint64_t v) {
+    while (v >= 0x80) {
+        pq_byte(b, (unsigned)(v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    pq_byte(b, (unsigned)v);
+}
+
+static inline void pq_zigzag(ParquetBuf *b, int64_t v) {
+    pq_varint(b, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static inline void tc_field(ParquetBuf *b, int *last, int id, int type) {
+    if (id > *last && id - *last <= 15) {
+        pq_byte(b, (unsigned)(((id - *last) << 4) | type));
+    } else {
+        pq_byte(b, (unsigned)type);
+        pq_zigzag(b, id);
+    }
+    *last = id;
+}
+
+static inline void tc_i32(ParquetBuf *b, int *last, int id, int32_t v) {
+    tc_field(b, last, id, TC_I32);
+    pq_zigzag(b, v);
+}
+
+static inline void tc_i64(ParquetBuf *b, int *last, int id, int64_t v) {
+    tc_field(b, last, id, TC_I64);
+    pq_zigzag(b, v);
+}
+
+static inline void tc_binary(ParquetBuf *b, const void *p, size_t n) {
+    pq_varint(b, n);
+    pq_put(b, p, n);
+}
+
+static inline void tc_bin(ParquetBuf *b, int *last, int id, const void *p, size_t n) {
+    tc_field(b, last, id, TC_BINARY);
+    tc_binary(b, p, n);
+}
+
+static inline void tc_str(ParquetBuf *b, int *last, int id, const char *s) {
+    tc_bin(b, last, id, s, strlen(s));
+}
+
+static inline void tc_list(ParquetBuf *b, int *last, int id, int elem, uint32_t n) {
+    tc_field(b, last, id, TC_LIST);
+    if (n < 15) {
+        pq_byte(b, (n << 4) | (unsigned)elem);
+    } else {
+        pq_byte(b, 0xF0u | (unsigned)elem);
+        pq_varint(b, n);
+    }
+}
+
+static inline void tc_stop(ParquetBuf *b) {
+    pq_byte(b, 0);
+}
+
+/* ---- Snappy (raw format, greedy single-probe matcher) ---- */
+
+static inline void pq_snappy_literal(ParquetBuf *out, const unsigned char *p, size_t n) {
+    while (n > 0) {
+        size_t len = n > 65536 ? 65536 : n;
+        size_t l = len - 1;
+        if (l < 60) {
+            pq_byte(out, (unsigned)(l << 2));
+        } else if (l < 256) {
+            pq_byte(out, 60 << 2);
+            pq_byte(out, (unsigned)l);
+        } else {
+            pq_byte(out, 61 << 2);
+            pq_le(out, l, 2);
+        }
+        pq_put(out, p, len);
+        p += len;
+        n -= len;
+    }
+}
+
+static inline void pq_snappy_copy(ParquetBuf *out, size_t offset, size_t len) {
+    while (len > 0) {
+        size_t n = len > 64 ? 64 : len;
+        if (n >= 4 && n <= 11 && offset < 2048) {
+            pq_byte(out, 1u | (unsigned)((n - 4) << 2) | (unsigned)((offset >> 8) << 5));
+            pq_byte(out, (unsigned)(offset & 0xFF));
+        } else {
+            pq_byte(out, 2u | (unsigned)((n - 1) << 2));
+            pq_le(out, offset, 2);
+        }
+        len -= n;
+    }
+}
+
+static inline uint32_t pq_load32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void pq_snappy(ParquetBuf *out, const unsigned char *in, size_t n) {
+    static uint32_t table[1 << 14];
+    out->len = 0;
+    pq_varint(out, n);
+
+    /* 64 KB fragments keep every offset within a 2-byte copy */
+    for (size_t frag = 0; frag < n; frag += 65536) {
+        const unsigned char *base = in + frag;
+        size_t len = n - frag < 65536 ? n - frag : 65536;
+        memset(table, 0, sizeof(table));
+        size_t i = 0, lit = 0;
+        while (len >= 4 && i + 4 <= len) {
+            uint32_t h = (pq_load32(base + i) * 0x1E35A7BDu) >> 18;
+            uint32_t cand = table[h];
+            table[h] = (uint32_t)i + 1;
+            if (cand == 0 || pq_load32(base + cand - 1) != pq_load32(base + i)) {
+                i++;
+                continue;
+            }
+            size_t from = cand - 1, m = 4;
+            while (i + m < len && base[from + m] == base[i + m]) m++;
+            pq_snappy_literal(out, base + lit, i - lit);
+            pq_snappy_copy(out, i - from, m);
+            i += m;
+            lit = i;
+        }
+        pq_snappy_literal(out, base + lit, len - lit);
+    }
+}
+
+/* ---- Value encodings ---- */
+
+/* Little-endian bit packing; count * width must be a multiple of 8 */
+static inline void pq_bitpack(ParquetBuf *b, const uint64_t *v, int count, int width) {
+    size_t bytes = (size_t)count * (size_t)width / 8;
+    pq_reserve(b, bytes);
+    unsigned char *out = b->data + b->len;
+    memset(out, 0, bytes);
+    size_t bit = 0;
+    for (int i = 0; i < count; i++) {
+        uint64_t x = v[i];
+        for (int k = 0; k < width; k++, bit++) {
+            if ((x >> k) & 1) out[bit >> 3] |= (unsigned char)(1u << (bit & 7));
+        }
+    }
+    b->len += bytes;
+}
+
+static inline int pq_bit_width(uint64_t v) {
+    int w = 0;
+    while (v) {
+        w++;
+        v >>= 1;
+    }
+    return w;
+}
+
+/* DELTA_BINARY_PACKED: blocks of 128 deltas in 4 miniblocks of 32 */
+static inline void pq_encode_delta(ParquetBuf *b, const int64_t *v, uint32_t n) {
+    pq_varint(b, 128);
+    pq_varint(b, 4);
+    pq_varint(b, n);
+    pq_zigzag(b, n ? v[0] : 0);
+
+    for (uint32_t i = 1; i < n; i += 128) {
+        uint32_t m = n - i < 128 ? n - i : 128;
+        int64_t deltas[128];
+        int64_t min = INT64_MAX;
+        for (uint32_t k = 0; k < m; k++) {
+            deltas[k] = (int64_t)((uint64_t)v[i + k] - (uint64_t)v[i + k - 1]);
+            if (deltas[k] < min) min = deltas[k];
+        }
+        pq_zigzag(b, min);
+
+        uint64_t packed[128] = {0};
+        int widths[4] = {0};
+        for (uint32_t k = 0; k < m; k++) {
+            packed[k] = (uint64_t)deltas[k] - (uint64_t)min;
+            int w = pq_bit_width(packed[k]);
+            if (w > widths[k / 32]) widths[k / 32] = w;
+        }
+        for (int j = 0; j < 4; j++) pq_byte(b, (unsigned)widths[j]);
+        for (uint32_t j = 0; j * 32 < m; j++) pq_bitpack(b, packed + j * 32, 32, widths[j]);
+    }
+}
+
+static inline void pq_flush_literals(ParquetBuf *b, const uint32_t *idx, size_t n, int width) {
+    if (n == 0) return;
+    size_t groups = (n + 7) / 8;
+    pq_varint(b, (groups << 1) | 1);
+    for (size_t g = 0; g < groups; g++) {
+        uint64_t tmp[8] = {0};
+        for (size_t k = 0; k < 8 && g * 8 + k < n; k++) tmp[k] = idx[g * 8 + k];
+        pq_bitpack(b, tmp, 8, width);
+    }
+}
+
+/* RLE / bit-packed hybrid: runs of 8+ equal values become RLE runs */
+static inline void pq_encode_rle(ParquetBuf *b, const uint32_t *idx, size_t n, int width) {
+    size_t i = 0, lit = 0;
+    while (i < n) {
+        size_t r = 1;
+        while (i + r < n && idx[i + r] == idx[i]) r++;
+        if (r >= 8) {
+            /* Literal runs are whole groups of 8; borrow from the run to align */
+            size_t pad = (8 - (i - lit) % 8) % 8;
+            if (r - pad >= 8) {
+                i += pad;
+                r -= pad;
+                pq_flush_literals(b, idx + lit, i - lit, width);
+                pq_varint(b, (uint64_t)r << 1);
+                pq_le(b, idx[i], (width + 7) / 8);
+                i += r;
+                lit = i;
+                continue;
+            }
+        }
+        i += r;
+    }
+    pq_flush_literals(b, idx + lit, n - lit, width);
+}
+
+/* ---- Dictionary ---- */
+
+static inline uint32_t pq_hash(const char *s, size_t n) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < n; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static inline void pq_dict_grow(ParquetColumn *c) {
+    uint32_t nslots = c->nslots ? c->nslots * 2 : 1024;
+    free(c->slots);
+    c->slots = calloc(nslots, sizeof(uint32_t));
+    c->nslots = nslots;
+    for (uint32_t e = 0; e < c->entries; e++) {
+        uint32_t h = pq_hash(c->arena + c->entry_off[e], c->entry_len[e]) & (nslots - 1);
+        while (c->slots[h]) h = (h + 1) & (nslots - 1);
+        c->slots[h] = e + 1;
+    }
+}
+
+static inline uint32_t pq_dict_add(ParquetColumn *c, const char *s) {
+    size_t n = strlen(s);
+    if ((c->entries + 1) * 2 > c->nslots) pq_dict_grow(c);
+    uint32_t h = pq_hash(s, n) & (c->nslots - 1);
+    while (c->slots[h]) {
+        uint32_t e = c->slots[h] - 1;
+        if (c->entry_len[e] == n && !memcmp(c->arena + c->entry_off[e], s, n)) return e;
+        h = (h + 1) & (c->nslots - 1);
+    }
+
+    if (c->entries == c->entries_cap) {
+        c->entries_cap = c->entries_cap ? c->entries_cap * 2 : 256;
+        c->entry_off = realloc(c->entry_off, c->entries_cap * sizeof(uint32_t));
+        c->entry_len = realloc(c->entry_len, c->entries_cap * sizeof(uint32_t));
+    }
+    if (c->arena_len + n > c->arena_cap) {
+        while (c->arena_len + n > c->arena_cap) c->arena_cap = c->arena_cap ? c->arena_cap * 2 : 4096;
+        c->arena = realloc(c->arena, c->arena_cap);
+    }
+    memcpy(c->arena + c->arena_len, s, n);
+    c->entry_off[c->entries] = (uint32_t)c->arena_len;
+    c->entry_len[c->entries] = (uint32_t)n;
+    c->arena_len += n;
+    c->slots[h] = c->entries + 1;
+    return c->entries++;
+}
+
+static inline int pq_bytes_cmp(const void *a, size_t an, const void *b, size_t bn) {
+    int r = memcmp(a, b, an < bn ? an : bn);
+    return r ? r : (an > bn) - (an < bn);
+}
+
+/* ---- Pages and row groups ---- */
+
+static inline void pq_write(ParquetWriter *w, const void *p, size_t n) {
+    if (n && fwrite(p, 1, n, w->f) != n) w->error = 1;
+    w->pos += n;
+}
+
+/* Compresses w->page and writes it after its page header */
+static inline void pq_write_page(ParquetWriter *w, int page_type, uint32_t num_values,
+                                 int encoding, ParquetChunk *ck) {
+    pq_snappy(&w->comp, w->page.data, w->page.len);
+
+    ParquetBuf *h = &w->hdr;
+    int last = 0, sub = 0;
+    h->len = 0;
+    tc_i32(h, &last, 1, page_type);
+    tc_i32(h, &last, 2, (int32_t)w->page.len);
+    tc_i32(h, &last, 3, (int32_t)w->comp.len);
+    if (page_type == PQ_DATA_PAGE) {
+        tc_field(h, &last, 5, TC_STRUCT);
+        tc_i32(h, &sub, 1, (int32_t)num_values);
+        tc_i32(h, &sub, 2, encoding);
+        tc_i32(h, &sub, 3, PQ_RLE);
+        tc_i32(h, &sub, 4, PQ_RLE);
+    } else {
+        tc_field(h, &last, 7, TC_STRUCT);
+        tc_i32(h, &sub, 1, (int32_t)num_values);
+        tc_i32(h, &sub, 2, encoding);
+    }
+    tc_stop(h);
+    tc_stop(h);
+
+    pq_write(w, h->data, h->len);
+    pq_write(w, w->comp.data, w->comp.len);
+    ck->uncompressed += h->len + w->page.len;
+    ck->compressed += h->len + w->comp.len;
+}
+
+static inline void pq_flush_column(ParquetWriter *w, ParquetColumn *c, ParquetChunk *ck) {
+    uint32_t n = w->rows;
+    memset(ck, 0, sizeof(*ck));
+    ParquetBuf *p = &w->page;
+
+    if (c->encoding == PQ_RLE_DICTIONARY) {
+        uint32_t lo = 0, hi = 0;
+        p->len = 0;
+        for (uint32_t e = 0; e < c->entries; e++) {
+            const char *s = c->arena + c->entry_off[e];
+            uint32_t len = c->entry_len[e];
+            pq_le(p, len, 4);
+            pq_put(p, s, len);
+            if (pq_bytes_cmp(s, len, c->arena + c->entry_off[lo], c->entry_len[lo]) < 0) lo = e;
+            if (pq_bytes_cmp(s, len, c->arena + c->entry_off[hi], c->entry_len[hi]) > 0) hi = e;
+        }
+        if (c->entries && c->entry_len[lo] <= PARQUET_STAT_MAX && c->entry_len[hi] <= PARQUET_STAT_MAX) {
+            ck->has_stats = 1;
+            ck->min_len = c->entry_len[lo];
+            ck->max_len = c->entry_len[hi];
+            memcpy(ck->min, c->arena + c->entry_off[lo], ck->min_len);
+            memcpy(ck->max, c->arena + c->entry_off[hi], ck->max_len);
+        }
+        ck->dict_offset = w->pos;
+        pq_write_page(w, PQ_DICTIONARY_PAGE, c->entries, PQ_PLAIN, ck);
+
+        int width = pq_bit_width(c->entries > 1 ? c->entries - 1 : 1);
+        p->len = 0;
+        pq_byte(p, (unsigned)width);
+        pq_encode_rle(p, c->indices, n, width);
+    } else {
+        int64_t lo = c->values[0], hi = c->values[0];
+        for (uint32_t i = 1; i < n; i++) {
+            if (c->values[i] < lo) lo = c->values[i];
+            if (c->values[i] > hi) hi = c->values[i];
+        }
+        int bytes = c->type == PQ_INT64 ? 8 : c->type == PQ_INT32 ? 4 : 1;
+        ck->has_stats = 1;
+        ck->min_len = ck->max_len = (uint32_t)bytes;
+        for (int k = 0; k < bytes; k++) {
+            ck->min[k] = (unsigned char)((uint64_t)lo >> (8 * k));
+            ck->max[k] = (unsigned char)((uint64_t)hi >> (8 * k));
+        }
+
+        p->len = 0;
+        if (c->encoding == PQ_DELTA_BINARY_PACKED) {
+            pq_encode_delta(p, c->values, n);
+        } else if (c->type == PQ_BOOLEAN) {
+            for (uint32_t i = 0; i < n; i += 8) {
+                uint64_t tmp[8] = {0};
+                for (uint32_t k = 0; k < 8 && i + k < n; k++) tmp[k] = c->values[i + k] != 0;
+                pq_bitpack(p, tmp, 8, 1);
+            }
+        } else {
+            for (uint32_t i = 0; i < n; i++) pq_le(p, (uint64_t)c->values[i], 4);
+        }
+    }
+
+    ck->data_offset = w->pos;
+    pq_write_page(w, PQ_DATA_PAGE, n, c->encoding, ck);
+
+    /* Next row group starts a fresh dictionary */
+    c->entries = 0;
+    c->arena_len = 0;
+    if (c->slots) memset(c->slots, 0, c->nslots * sizeof(uint32_t));
+}
+
+static inline void pq_flush_group(ParquetWriter *w) {
+    if (w->rows == 0) return;
+    if (w->groups == w->groups_cap) {
+        w->groups_cap = w->groups_cap ? w->groups_cap * 2 : 16;
+        w->chunks = realloc(w->chunks, (size_t)w->groups_cap * PARQUET_COLUMNS * sizeof(ParquetChunk));
+        w->group_rows_done = realloc(w->group_rows_done, w->groups_cap * sizeof(uint64_t));
+    }
+    ParquetChunk *ck = w->chunks + (size_t)w->groups * PARQUET_COLUMNS;
+    for (int i = 0; i < PARQUET_COLUMNS; i++) pq_flush_column(w, &w->cols[i], &ck[i]);
+    w->group_rows_done[w->groups++] = w->rows;
+    w->total_rows += w->rows;
+    w->rows = 0;
+}
+
+/* ---- Footer ---- */
+
+static inline void pq_footer_schema(ParquetBuf *b, int *last, const ParquetWriter *w) {
+    tc_list(b, last, 2, TC_STRUCT, PARQUET_COLUMNS + 1);
+
+    int s = 0;
+    tc_str(b, &s, 4, "schema");
+    tc_i32(b, &s, 5, PARQUET_COLUMNS);
+    tc_stop(b);
+
+    for (int i = 0; i < PARQUET_COLUMNS; i++) {
+        const ParquetColumn *c = &w->cols[i];
+        s = 0;
+        tc_i32(b, &s, 1, c->type);
+        tc_i32(b, &s, 3, 0);    /* REQUIRED */
+        tc_str(b, &s, 4, c->name);
+        if (c->type == PQ_BYTE_ARRAY) {
+            tc_i32(b, &s, 6, 0);    /* UTF8 */
+            int lt = 0;
+            tc_field(b, &s, 10, TC_STRUCT);
+            tc_field(b, &lt, 1, TC_STRUCT);     /* STRING */
+            tc_stop(b);
+            tc_stop(b);
+        }
+        tc_stop(b);
+    }
+}
+
+static inline void pq_footer_chunk(ParquetBuf *b, const ParquetColumn *c, const ParquetChunk *ck,
+                                   uint64_t rows) {
+    int last = 0, m = 0;
+    tc_i64(b, &last, 2, (int64_t)(ck->dict_offset ? ck->dict_offset : ck->data_offset));
+    tc_field(b, &last, 3, TC_STRUCT);
+
+    tc_i32(b, &m, 1, c->type);
+    if (c->encoding == PQ_RLE_DICTIONARY) {
+        tc_list(b, &m, 2, TC_I32, 2);
+        pq_zigzag(b, PQ_PLAIN);
+        pq_zigzag(b, PQ_RLE_DICTIONARY);
+    } else {
+        tc_list(b, &m, 2, TC_I32, 1);
+        pq_zigzag(b, c->encoding);
+    }
+    tc_list(b, &m, 3, TC_BINARY, 1);
+    tc_binary(b, c->name, strlen(c->name));
+    tc_i32(b, &m, 4, PQ_SNAPPY);
+    tc_i64(b, &m, 5, (int64_t)rows);
+    tc_i64(b, &m, 6, (int64_t)ck->uncompressed);
+    tc_i64(b, &m, 7, (int64_t)ck->compressed);
+    tc_i64(b, &m, 9, (int64_t)ck->data_offset);
+    if (ck->dict_offset) tc_i64(b, &m, 11, (int64_t)ck->dict_offset);
+    if (ck->has_stats) {
+        int st = 0;
+        tc_field(b, &m, 12, TC_STRUCT);
+        tc_i64(b, &st, 3, 0);   /* null_count */
+        tc_bin(b, &st, 5, ck->max, ck->max_len);
+        tc_bin(b, &st, 6, ck->min, ck->min_len);
+        tc_stop(b);
+    }
+    tc_stop(b);     /* ColumnMetaData */
+    tc_stop(b);     /* ColumnChunk */
+}
+
+/* Next "# key=value" line at *p; returns 0 when there are no more */
+static inline int pq_next_meta(const char **p, const char **k, size_t *klen,
+                               const char **v, size_t *vlen) {
+    while (*p && **p) {
+        const char *line = *p;
+        size_t n = strcspn(line, "\n");
+        *p = line[n] ? line + n + 1 : line + n;
+        if (n && line[n - 1] == '\r') n--;
+        const char *eq = memchr(line, '=', n);
+        if (line[0] != '#' || !eq) continue;
+        *k = line + 1;
+        while (*k < eq && **k == ' ') (*k)++;
+        *klen = (size_t)(eq - *k);
+        *v = eq + 1;
+        *vlen = (size_t)(line + n - *v);
+        return 1;
+    }
+    return 0;
+}
+
+static inline void pq_footer(ParquetBuf *b, const ParquetWriter *w) {
+    int last = 0;
+    b->len = 0;
+    tc_i32(b, &last, 1, 1);
+    pq_footer_schema(b, &last, w);
+    tc_i64(b, &last, 3, (int64_t)w->total_rows);
+
+    tc_list(b, &last, 4, TC_STRUCT, w->groups);
+    for (uint32_t g = 0; g < w->groups; g++) {
+        const ParquetChunk *ck = w->chunks + (size_t)g * PARQUET_COLUMNS;
+        uint64_t uncompressed = 0, compressed = 0;
+        int r = 0;
+        tc_list(b, &r, 1, TC_STRUCT, PARQUET_COLUMNS);
+        for (int i = 0; i < PARQUET_COLUMNS; i++) {
+            pq_footer_chunk(b, &w->cols[i], &ck[i], w->group_rows_done[g]);
+            uncompressed += ck[i].uncompressed;
+            compressed += ck[i].compressed;
+        }
+        tc_i64(b, &r, 2, (int64_t)uncompressed);
+        tc_i64(b, &r, 3, (int64_t)w->group_rows_done[g]);
+        tc_i64(b, &r, 5, (int64_t)(ck[0].dict_offset ? ck[0].dict_offset : ck[0].data_offset));
+        tc_i64(b, &r, 6, (int64_t)compressed);
+        tc_field(b, &r, 7, TC_I16);
+        pq_zigzag(b, (int64_t)g);
+        tc_stop(b);
+    }
+
+    /* "# key=value" lines */
+    uint32_t nkv = 0;
+    const char *p = w->metadata, *k, *v;
+    size_t klen, vlen;
+    while (pq_next_meta(&p, &k, &klen, &v, &vlen)) nkv++;
+    if (nkv) {
+        tc_list(b, &last, 5, TC_STRUCT, nkv);
+        p = w->metadata;
+        while (pq_next_meta(&p, &k, &klen, &v, &vlen)) {
+            int kv = 0;
+            tc_field(b, &kv, 1, TC_BINARY);
+            tc_binary(b, k, klen);
+            tc_field(b, &kv, 2, TC_BINARY);
+            tc_binary(b, v, vlen);
+            tc_stop(b);
+        }
+    }
+    tc_str(b, &last, 6, PARQUET_CREATED_BY);
+
+    /* TypeDefinedOrder for every column, so min/max statistics are used */
+    tc_list(b, &last, 7, TC_STRUCT, PARQUET_COLUMNS);
+    for (int i = 0; i < PARQUET_COLUMNS; i++) {
+        int u = 0;
+        tc_field(b, &u, 1, TC_STRUCT);
+        tc_stop(b);
+        tc_stop(b);
+    }
+    tc_stop(b);
+}
+
+/* ---- Public API ---- */
+
+/*
+ * Opens path for writing. metadata holds "# key=value" lines (may be
+ * NULL); group_rows is the row group size, 0 for PARQUET_ROW_GROUP.
+ */
+static inline int parquet_open(ParquetWriter *w, const char *path, const char *metadata,
+                               uint32_t group_rows) {
+    static const struct { const char *name; int type, encoding; } schema[PARQUET_COLUMNS] = {
+        { "seq", PQ_INT64, PQ_DELTA_BINARY_PACKED },
+        { "timestamp_us", PQ_INT64, PQ_DELTA_BINARY_PACKED },
+        { "event_timestamp_us", PQ_INT64, PQ_DELTA_BINARY_PACKED },
+        { "event_type", PQ_BYTE_ARRAY, PQ_RLE_DICTIONARY },
+        { "keycode", PQ_INT32, PQ_PLAIN },
+        { "scancode", PQ_INT32, PQ_PLAIN },
+        { "character", PQ_BYTE_ARRAY, PQ_RLE_DICTIONARY },
+        { "modifiers", PQ_BYTE_ARRAY, PQ_RLE_DICTIONARY },
+        { "is_repeat", PQ_BOOLEAN, PQ_PLAIN },
+    };
+
+    memset(w, 0, sizeof(*w));
+    w->f = fopen(path, "wb");
+    if (!w->f) return -1;
+    w->group_rows = group_rows ? group_rows : PARQUET_ROW_GROUP;
+    if (metadata) {
+        size_t n = strlen(metadata);
+        w->metadata = malloc(n + 1);
+        memcpy(w->metadata, metadata, n + 1);
+    }
+    for (int i = 0; i < PARQUET_COLUMNS; i++) {
+        ParquetColumn *c = &w->cols[i];
+        c->name = schema[i].name;
+        c->type = schema[i].type;
+        c->encoding = schema[i].encoding;
+        if (c->encoding == PQ_RLE_DICTIONARY) c->indices = malloc(w->group_rows * sizeof(uint32_t));
+        else c->values = malloc(w->group_rows * sizeof(int64_t));
+    }
+    pq_write(w, "PAR1", 4);
+    return 0;
+}
+
+static inline void parquet_add(ParquetWriter *w, const ParquetEvent *e) {
+    uint32_t r = w->rows;
+    ParquetColumn *c = w->cols;
+    c[0].values[r] = e->seq;
+    c[1].values[r] = e->timestamp_us;
+    c[2].values[r] = e->event_timestamp_us;
+    c[3].indices[r] = pq_dict_add(&c[3], e->event_type);
+    c[4].values[r] = e->keycode;
+    c[5].values[r] = e->scancode;
+    c[6].indices[r] = pq_dict_add(&c[6], e->character);
+    c[7].indices[r] = pq_dict_add(&c[7], e->modifiers);
+    c[8].values[r] = e->is_repeat != 0;
+    if (++w->rows == w->group_rows) pq_flush_group(w);
+}
+
+/* Flushes the last row group, writes the footer and closes. 0 on success. */
+static inline int parquet_close(ParquetWriter *w) {
+    pq_flush_group(w);
+    pq_footer(&w->page, w);
+    pq_write(w, w->page.data, w->page.len);
+    unsigned char tail[8];
+    for (int i = 0; i < 4; i++) tail[i] = (unsigned char)(w->page.len >> (8 * i));
+    memcpy(tail + 4, "PAR1", 4);
+    pq_write(w, tail, sizeof(tail));
+    if (fclose(w->f) != 0) w->error = 1;
+
+    for (int i = 0; i < PARQUET_COLUMNS; i++) {
+        ParquetColumn *c = &w->cols[i];
+        free(c->values);
+        free(c->indices);
+        free(c->arena);
+        free(c->entry_off);
+        free(c->entry_len);
+        free(c->slots);
+    }
+    free(w->chunks);
+    free(w->group_rows_done);
+    free(w->metadata);
+    free(w->page.data);
+    free(w->comp.data);
+    free(w->hdr.data);
+    return w->error ? -1 : 0;
+}
+
+#endif /* PARQUET_H */
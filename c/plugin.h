@@ -0,0 +1,78 @@
+/*
+ * plugin.h - Stable ABI for in-process analyzer plugins
+ *
+ * A plugin is a shared object exporting one symbol, KT_PLUGIN_SYMBOL:
+ *
+ *   #include "plugin.h"
+ *   static void *open_(const char *args, const char *metadata) { ... }
+ *   static void batch(void *state, const KtEvent *ev, size_t n) { ... }
+ *   static void close_(void *state) { ... }
+ *   const KtPlugin kt_plugin = {
+ *       KT_PLUGIN_ABI, sizeof(KtEvent), "my-detector", open_, batch, close_,
+ *   };
+ *
+ *   cc -O2 -shared -fPIC -o my_detector.so my_detector.c
+ *
+ * open() runs once per recording, before capture starts, with the text
+ * after '=' in "--plugin path.so=args" (or "") and the session's
+ * "# key=value" metadata lines; a NULL return refuses the session.
+ * batch() then receives the events in order, in batches of 1 or more,
+ * on a thread of the plugin's own. The events point straight into the
+ * host's ring buffer: they are read-only and only valid during the call.
+ * close() runs once at the end, on the same thread, also after the host
+ * has dropped the plugin for falling behind.
+ *
+ * Only this header is part of the ABI. The layout of KtEvent and the
+ * meaning of its fields change only together with KT_PLUGIN_ABI, and
+ * the host refuses plugins built against another version.
+ *
+ * Hosted by plugin_host.h, used by terminal_macos.c (--plugin) and
+ * plugin_run.c.
+ */
+
+#ifndef KT_PLUGIN_H
+#define KT_PLUGIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define KT_PLUGIN_ABI 1
+#define KT_PLUGIN_SYMBOL "kt_plugin"
+
+/* Same values as the SESSION_* constants of session.h */
+enum {
+    KT_KEY_DOWN = 0,
+    KT_KEY_UP = 1,
+    KT_OTHER = 2,
+};
+
+enum {
+    KT_MOD_SHIFT = 1,
+    KT_MOD_CTRL = 2,
+    KT_MOD_ALT = 4,
+    KT_MOD_CMD = 8,
+};
+
+/* One key event, 48 bytes, native byte order */
+typedef struct {
+    int64_t seq;                    /* 1-based, as in the CSV */
+    double timestamp_ms;            /* session clock */
+    double event_timestamp_ms;      /* OS event clock */
+    int32_t keycode;
+    int32_t scancode;
+    uint8_t type;                   /* KT_KEY_DOWN, KT_KEY_UP or KT_OTHER */
+    uint8_t is_repeat;
+    uint16_t modifiers;             /* KT_MOD_* */
+    char character[12];             /* NUL-terminated, as in the CSV */
+} KtEvent;
+
+typedef struct {
+    uint32_t abi;                   /* KT_PLUGIN_ABI */
+    uint32_t event_size;            /* sizeof(KtEvent) */
+    const char *name;
+    void *(*open)(const char *args, const char *metadata);
+    void (*batch)(void *state, const KtEvent *events, size_t count);
+    void (*close)(void *state);     /* may be NULL */
+} KtPlugin;
+
+#endif /* KT_PLUGIN_H */
@@ -0,0 +1,265 @@
+/*
+ * plugin_host.h - Load plugin.h analyzers and feed them events (POSIX)
+ *
+ * The producer (the tap callback, or plugin_run's reader) copies each
+ * event once into a ring of PLUGIN_RING KtEvents and publishes it with a
+ * release store; that is all it ever does for plugins. Every plugin has
+ * a thread and a cursor of its own and is handed contiguous spans of
+ * the ring itself, so a slow plugin delays neither capture nor the
+ * others.
+ *
+ * Each batch() call is timed in thread CPU time. A plugin is dropped,
+ * and gets no more events, when
+ *   - over a PLUGIN_WINDOW_MS window it used more than budget of one
+ *     core (live only; 0 disables the check), or
+ *   - the producer lapped it: it fell PLUGIN_RING events behind and the
+ *     events it had not read yet are gone.
+ * In lossless mode (replay) the producer waits for the slowest plugin
+ * instead of lapping it, and the end waits for every plugin to finish.
+ * Live, a plugin still busy PLUGIN_DRAIN_MS after the last event is
+ * abandoned so the recorder can save and exit.
+ *
+ * Plugins run in-process: the budget guards the recorder's time, not
+ * its memory, and a plugin that crashes takes the recorder with it.
+ *
+ * Used by terminal_macos.c (--plugin) and plugin_run.c.
+ */
+
+#ifndef PLUGIN_HOST_H
+#define PLUGIN_HOST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "plugin.h"
+
+#define PLUGIN_MAX 8
+#define PLUGIN_RING (1 << 16)       /* events, power of two */
+#define PLUGIN_BATCH_MAX 4096
+#define PLUGIN_POLL_US 10000
+#define PLUGIN_WINDOW_MS 2000.0
+#define PLUGIN_DRAIN_MS 5000.0      /* wait at the end before abandoning one */
+#define PLUGIN_BUDGET 0.05          /* default share of one core, live */
+
+typedef struct PluginHost PluginHost;
+
+typedef struct {
+    PluginHost *host;
+    char path[1024];
+    void *dl;
+    const KtPlugin *api;
+    void *state;
+    pthread_t tid;
+    uint64_t cursor;                /* next event to deliver */
+    int dropped;
+    int done;                       /* its thread has returned */
+    char reason[160];               /* why it was dropped */
+
+    /* Accounting, written by the plugin's thread */
+    uint64_t delivered, batches;
+    double cpu_ms;
+} PluginSlot;
+
+struct PluginHost {
+    KtEvent ring[PLUGIN_RING];
+    uint64_t head;                  /* events published */
+    double budget;                  /* share of one core; 0 = unlimited */
+    int lossless;                   /* producer waits instead of lapping */
+    int finished;
+    int n;
+    PluginSlot plugins[PLUGIN_MAX];
+};
+
+static inline double plugin_cpu_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static inline double plugin_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static inline void plugin_host_init(PluginHost *h, double budget, int lossless) {
+    h->head = 0;
+    h->budget = budget;
+    h->lossless = lossless;
+    h->finished = 0;
+    h->n = 0;
+}
+
+/*
+ * Loads "path.so[=args]" and opens it for a session with the given
+ * metadata. Returns 0, 1 if the plugin's open() refused the session, or
+ * -1 if it cannot be loaded at all; both with a message in err.
+ */
+static inline int plugin_load(PluginHost *h, const char *spec, const char *metadata,
+                              char *err, size_t errlen) {
+    if (h->n == PLUGIN_MAX) {
+        snprintf(err, errlen, "at most %d plugins", PLUGIN_MAX);
+        return -1;
+    }
+    PluginSlot *p = &h->plugins[h->n];
+    memset(p, 0, sizeof(*p));
+    p->host = h;
+    snprintf(p->path, sizeof(p->path), "%s", spec);
+    const char *args = "";
+    char *eq = strchr(p->path, '=');
+    if (eq) {
+        *eq = '\0';
+        args = spec + (eq - p->path) + 1;
+    }
+
+    p->dl = dlopen(p->path, RTLD_NOW | RTLD_LOCAL);
+    if (!p->dl) {
+        snprintf(err, errlen, "%s", dlerror());
+        return -1;
+    }
+    p->api = (const KtPlugin *)dlsym(p->dl, KT_PLUGIN_SYMBOL);
+    if (!p->api) {
+        snprintf(err, errlen, "%s: no %s symbol", p->path, KT_PLUGIN_SYMBOL);
+    } else if (p->api->abi != KT_PLUGIN_ABI || p->api->event_size != sizeof(KtEvent)) {
+        snprintf(err, errlen, "%s: built for plugin ABI %u, host has %d",
+                 p->path, p->api->abi, KT_PLUGIN_ABI);
+    } else if (!p->api->batch || !p->api->open) {
+        snprintf(err, errlen, "%s: open and batch are required", p->path);
+    } else if (!(p->state = p->api->open(args, metadata ? metadata : ""))) {
+        snprintf(err, errlen, "%s: plugin refused the session", p->path);
+        dlclose(p->dl);
+        return 1;
+    } else {
+        h->n++;
+        return 0;
+    }
+    dlclose(p->dl);
+    return -1;
+}
+
+static inline void plugin_drop(PluginSlot *p, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(p->reason, sizeof(p->reason), fmt, ap);
+    va_end(ap);
+    __atomic_store_n(&p->dropped, 1, __ATOMIC_RELEASE);
+}
+
+static inline void *plugin_thread(void *arg) {
+    PluginSlot *p = arg;
+    PluginHost *h = p->host;
+    double window_start = plugin_now_ms(), window_cpu = 0;
+    for (;;) {
+        int finished = __atomic_load_n(&h->finished, __ATOMIC_ACQUIRE);
+        uint64_t head = __atomic_load_n(&h->head, __ATOMIC_ACQUIRE);
+        if (head == p->cursor) {
+            if (finished) break;
+            usleep(PLUGIN_POLL_US);
+            continue;
+        }
+        /* Slot cursor is rewritten once head reaches cursor + PLUGIN_RING */
+        if (!h->lossless && head - p->cursor >= PLUGIN_RING) {
+            plugin_drop(p, "fell %llu events behind (the ring holds %d)",
+                        (unsigned long long)(head - p->cursor), PLUGIN_RING);
+            break;
+        }
+
+        size_t off = (size_t)(p->cursor & (PLUGIN_RING - 1));
+        size_t n = (size_t)(head - p->cursor);
+        if (n > PLUGIN_BATCH_MAX) n = PLUGIN_BATCH_MAX;
+        if (off + n > PLUGIN_RING) n = PLUGIN_RING - off;
+        double c0 = plugin_cpu_ms();
+        p->api->batch(p->state, &h->ring[off], n);
+        double used = plugin_cpu_ms() - c0;
+        p->cpu_ms += used;
+        window_cpu += used;
+        p->delivered += n;
+        p->batches++;
+
+        /* Lapped while reading: the batch may have seen overwritten events */
+        if (!h->lossless && __atomic_load_n(&h->head, __ATOMIC_ACQUIRE) - p->cursor >= PLUGIN_RING) {
+            plugin_drop(p, "was overrun during a batch of %zu events", n);
+            break;
+        }
+        __atomic_store_n(&p->cursor, p->cursor + n, __ATOMIC_RELEASE);
+
+        double now = plugin_now_ms();
+        if (now - window_start >= PLUGIN_WINDOW_MS) {
+            double share = window_cpu / (now - window_start);
+            if (h->budget > 0 && share > h->budget) {
+                plugin_drop(p, "used %.0f%% of a core (budget %.0f%%)", share * 100, h->budget * 100);
+                break;
+            }
+            window_start = now;
+            window_cpu = 0;
+        }
+    }
+    if (p->api->close) p->api->close(p->state);
+    __atomic_store_n(&p->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static inline void plugin_host_start(PluginHost *h) {
+    for (int i = 0; i < h->n; i++) pthread_create(&h->plugins[i].tid, NULL, plugin_thread, &h->plugins[i]);
+}
+
+/* Publishes one event; called by the single producer */
+static inline void plugin_push(PluginHost *h, const KtEvent *e) {
+    uint64_t head = h->head;
+    if (h->lossless) {
+        for (int i = 0; i < h->n; i++) {
+            PluginSlot *p = &h->plugins[i];
+            while (!__atomic_load_n(&p->dropped, __ATOMIC_ACQUIRE) &&
+                   head - __atomic_load_n(&p->cursor, __ATOMIC_ACQUIRE) >= PLUGIN_RING) {
+                usleep(100);
+            }
+        }
+    }
+    h->ring[head & (PLUGIN_RING - 1)] = *e;
+    __atomic_store_n(&h->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Lets the plugins drain what is left, closes them and joins their
+ * threads. The libraries stay loaded, so names remain valid for reports.
+ * Live, a plugin still busy after PLUGIN_DRAIN_MS is detached and the
+ * host must not be reused; in lossless mode every thread is waited for,
+ * so the host can be initialized again for the next session.
+ */
+static inline void plugin_host_finish(PluginHost *h) {
+    __atomic_store_n(&h->finished, 1, __ATOMIC_RELEASE);
+    double deadline = plugin_now_ms() + PLUGIN_DRAIN_MS;
+    for (int i = 0; i < h->n; i++) {
+        PluginSlot *p = &h->plugins[i];
+        if (h->lossless) {
+            pthread_join(p->tid, NULL);
+            continue;
+        }
+        while (!__atomic_load_n(&p->done, __ATOMIC_ACQUIRE) && plugin_now_ms() < deadline) usleep(1000);
+        if (__atomic_load_n(&p->done, __ATOMIC_ACQUIRE)) {
+            pthread_join(p->tid, NULL);
+        } else {
+            pthread_detach(p->tid);
+            if (!p->dropped) plugin_drop(p, "still busy %.0f s after the last event", PLUGIN_DRAIN_MS / 1000);
+        }
+    }
+}
+
+static inline void plugin_host_report(const PluginHost *h, FILE *out) {
+    for (int i = 0; i < h->n; i++) {
+        const PluginSlot *p = &h->plugins[i];
+        fprintf(out, "Plugin %s: %llu events in %llu batches, %.1f ms CPU (%.2f us/event)",
+                p->api->name, (unsigned long long)p->delivered, (unsigned long long)p->batches, p->cpu_ms,
+                p->delivered ? p->cpu_ms * 1000.0 / (double)p->delivered : 0.0);
+        if (p->dropped) fprintf(out, "; dropped: %s", p->reason);
+        fputc('\n', out);
+    }
+}
+
+#endif /* PLUGIN_HOST_H */
@@ -0,0 +1,104 @@
+/*
+ * plugin_run.c - Replay recorded sessions through analyzer plugins (POSIX)
+ *
+ * Feeds each session to the plugins of plugin.h exactly as the recorder
+ * does live (--plugin): open() with the session's metadata, the events
+ * in ring-buffer batches on each plugin's own thread, then close().
+ * Nothing is lost: the reader waits for the slowest plugin instead of
+ * dropping it, so a detector can be developed against an archive first.
+ *
+ * What the plugins report is their own business (usually stdout). At the
+ * end, the CPU time each plugin used per event is printed to stderr:
+ * multiplied by a typist's event rate, that is what it will cost live
+ * against the recorder's budget. A session a plugin's open() refuses is
+ * skipped for that plugin and reported; the others still get it.
+ *
+ * Build: make plugin_run (see Makefile)
+ * Usage: ./plugin_run -p plugin.so[=args] [-p ...] session.csv [more.csv ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "session.h"
+#include "plugin_host.h"
+
+static PluginHost host;
+
+int main(int argc, char *argv[]) {
+    const char *specs[PLUGIN_MAX];
+    int nspecs = 0;
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "-p") && nspecs < PLUGIN_MAX) specs[nspecs++] = argv[argi + 1];
+        else break;
+        argi += 2;
+    }
+    if (nspecs == 0 || argi >= argc) {
+        fprintf(stderr, "Usage: %s -p plugin.so[=args] [-p ...] session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    uint64_t events[PLUGIN_MAX] = {0};
+    double cpu_ms[PLUGIN_MAX] = {0};
+    const char *names[PLUGIN_MAX] = {0};
+    int refused[PLUGIN_MAX] = {0};
+    int failures = 0;
+    for (; argi < argc; argi++) {
+        Session s;
+        if (session_load(argv[argi], &s) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", argv[argi]);
+            failures++;
+            continue;
+        }
+        /* A plugin that refuses this session sits it out; spec[] maps slots back */
+        plugin_host_init(&host, 0, 1);
+        int spec[PLUGIN_MAX];
+        for (int i = 0; i < nspecs; i++) {
+            char err[1200];
+            int rc = plugin_load(&host, specs[i], s.metadata, err, sizeof(err));
+            if (rc < 0) {
+                fprintf(stderr, "Error: %s\n", err);
+                return 1;
+            }
+            if (rc > 0) {
+                fprintf(stderr, "%s: %s, skipped\n", argv[argi], err);
+                refused[i]++;
+                continue;
+            }
+            spec[host.n - 1] = i;
+        }
+        plugin_host_start(&host);
+        for (size_t i = 0; i < s.count && host.n; i++) {
+            const SessionEvent *e = &s.events[i];
+            KtEvent k;
+            memset(&k, 0, sizeof(k));
+            k.seq = e->seq;
+            k.timestamp_ms = e->timestamp_ms;
+            k.event_timestamp_ms = e->event_timestamp_ms;
+            k.keycode = e->keycode;
+            k.scancode = e->scancode;
+            k.type = e->type;
+            k.is_repeat = e->is_repeat;
+            k.modifiers = e->modifiers;
+            memcpy(k.character, e->character, sizeof(k.character) - 1);
+            plugin_push(&host, &k);
+        }
+        plugin_host_finish(&host);
+        for (int i = 0; i < host.n; i++) {
+            names[spec[i]] = host.plugins[i].api->name;
+            events[spec[i]] += host.plugins[i].delivered;
+            cpu_ms[spec[i]] += host.plugins[i].cpu_ms;
+        }
+        session_free(&s);
+    }
+
+    for (int i = 0; i < nspecs; i++) {
+        fprintf(stderr, "Plugin %s: %llu events, %.1f ms CPU (%.3f us/event)", names[i] ? names[i] : specs[i],
+                (unsigned long long)events[i], cpu_ms[i],
+                events[i] ? cpu_ms[i] * 1000.0 / (double)events[i] : 0.0);
+        if (refused[i]) fprintf(stderr, "; refused %d sessions", refused[i]);
+        fputc('\n', stderr);
+    }
+    return failures ? 1 : 0;
+}
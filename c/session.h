@@ -0,0 +1,349 @@
+/*
+ * session.h - Load session CSVs written by write_csv() (POSIX)
+ *
+ * Maps the file and parses every data row into a compact SessionEvent.
+ * The metadata lines ("# key=value") are kept verbatim for lookups.
+ * timestamp_ms columns are parsed with a fixed-point fast path since
+ * every recorder writes them with "%.3f".
+ *
+ * Also shared by the analysis tools: an XXH64 content hash and a
+ * quickselect for percentiles.
+ *
+ * Used by the analysis tools (session_diff.c, session_stats.c, ...).
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum {
+    SESSION_KEY_DOWN = 0,
+    SESSION_KEY_UP = 1,
+    SESSION_OTHER = 2,
+};
+
+enum {
+    SESSION_MOD_SHIFT = 1,
+    SESSION_MOD_CTRL = 2,
+    SESSION_MOD_ALT = 4,
+    SESSION_MOD_CMD = 8,
+};
+
+typedef struct {
+    int64_t seq;
+    double timestamp_ms;
+    double event_timestamp_ms;
+    int32_t keycode;
+    int32_t scancode;
+    uint8_t type;
+    uint8_t is_repeat;
+    uint16_t modifiers;
+    char character[16];
+} SessionEvent;
+
+typedef struct {
+    char *metadata;         /* leading "# key=value" lines */
+    SessionEvent *events;
+    size_t count;
+} Session;
+
+/* Parses a decimal like "6713.312" and advances *p past it */
+static inline double session_parse_num(const char **p, const char *end) {
+    const char *s = *p;
+    int neg = 0;
+    if (s < end && *s == '-') {
+        neg = 1;
+        s++;
+    }
+    int64_t ip = 0;
+    while (s < end && *s >= '0' && *s <= '9') ip = ip * 10 + (*s++ - '0');
+    double v = (double)ip;
+    if (s < end && *s == '.') {
+        s++;
+        int64_t fp = 0, scale = 1;
+        while (s < end && *s >= '0' && *s <= '9') {
+            if (scale < 1000000000LL) {
+                fp = fp * 10 + (*s - '0');
+                scale *= 10;
+            }
+            s++;
+        }
+        v += (double)fp / (double)scale;
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        /* Not written by the recorders; defer to strtod */
+        char tmp[64];
+        size_t n = 0;
+        for (const char *q = *p; q < end && *q != ',' && n < sizeof(tmp) - 1; q++) tmp[n++] = *q;
+        tmp[n] = '\0';
+        while (s < end && *s != ',' && *s != '\n') s++;
+        *p = s;
+        return strtod(tmp, NULL);
+    }
+    *p = s;
+    return neg ? -v : v;
+}
+
+static inline uint16_t session_parse_modifiers(const char *s, const char *end) {
+    uint16_t m = 0;
+    while (s < end) {
+        const char *plus = memchr(s, '+', (size_t)(end - s));
+        const char *e = plus ? plus : end;
+        size_t n = (size_t)(e - s);
+        if (n == 5 && !memcmp(s, "shift", 5)) m |= SESSION_MOD_SHIFT;
+        else if (n == 4 && !memcmp(s, "ctrl", 4)) m |= SESSION_MOD_CTRL;
+        else if (n == 3 && !memcmp(s, "alt", 3)) m |= SESSION_MOD_ALT;
+        else if (n == 3 && !memcmp(s, "cmd", 3)) m |= SESSION_MOD_CMD;
+        s = plus ? plus + 1 : end;
+    }
+    return m;
+}
+
+/* Finds the end of the current field */
+static inline const char *session_field_end(const char *p, const char *end) {
+    while (p < end && *p != ',' && *p != '\n' && *p != '\r') p++;
+    return p;
+}
+
+static inline int session_parse_row(const char *p, const char *end, SessionEvent *e) {
+    const char *f;
+    memset(e, 0, sizeof(*e));
+
+    e->seq = (int64_t)session_parse_num(&p, end);
+    if (p >= end || *p++ != ',') return -1;
+    e->timestamp_ms = session_parse_num(&p, end);
+    if (p >= end || *p++ != ',') return -1;
+    e->event_timestamp_ms = session_parse_num(&p, end);
+    if (p >= end || *p++ != ',') return -1;
+
+    f = session_field_end(p, end);
+    if (f - p == 8 && !memcmp(p, "key_down", 8)) e->type = SESSION_KEY_DOWN;
+    else if (f - p == 6 && !memcmp(p, "key_up", 6)) e->type = SESSION_KEY_UP;
+    else e->type = SESSION_OTHER;
+    p = f;
+    if (p >= end || *p++ != ',') return -1;
+
+    e->keycode = (int32_t)session_parse_num(&p, end);
+    if (p >= end || *p++ != ',') return -1;
+    e->scancode = (int32_t)session_parse_num(&p, end);
+    if (p >= end || *p++ != ',') return -1;
+
+    f = session_field_end(p, end);
+    size_t n = (size_t)(f - p);
+    if (n >= sizeof(e->character)) n = sizeof(e->character) - 1;
+    memcpy(e->character, p, n);
+    p = f;
+    if (p >= end || *p++ != ',') return -1;
+
+    f = session_field_end(p, end);
+    e->modifiers = session_parse_modifiers(p, f);
+    p = f;
+    if (p >= end || *p++ != ',') return -1;
+
+    e->is_repeat = (uint8_t)(p < end && *p == '1');
+    return 0;
+}
+
+/* Loads a whole session. Returns 0 on success. */
+static inline int session_load(const char *path, Session *s) {
+    memset(s, 0, sizeof(*s));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+
+    /* ~60 bytes per row is a safe lower bound for the initial capacity */
+    size_t cap = size / 48 + 16;
+    s->events = malloc(cap * sizeof(SessionEvent));
+
+    const char *p = data, *end = data + size;
+    size_t meta_end = 0;
+    int header_seen = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *le = nl ? nl : end;
+        if (*p == '#') {
+            meta_end = (size_t)(le - data) + (nl ? 1 : 0);
+        } else if (!header_seen) {
+            header_seen = 1;
+        } else if (le > p) {
+            if (s->count == cap) {
+                cap *= 2;
+                s->events = realloc(s->events, cap * sizeof(SessionEvent));
+            }
+            if (session_parse_row(p, le, &s->events[s->count]) == 0) s->count++;
+        }
+        p = nl ? nl + 1 : end;
+    }
+
+    s->metadata = malloc(meta_end + 1);
+    memcpy(s->metadata, data, meta_end);
+    s->metadata[meta_end] = '\0';
+    munmap((void *)data, size);
+    return header_seen ? 0 : -1;
+}
+
+static inline void session_free(Session *s) {
+    free(s->metadata);
+    free(s->events);
+    memset(s, 0, sizeof(*s));
+}
+
+/* Copies the value of "# key=value" into buf; returns NULL if absent */
+static inline const char *session_meta(const Session *s, const char *key, char *buf, size_t len) {
+    size_t klen = strlen(key);
+    const char *p = s->metadata;
+    while (p && *p) {
+        if (p[0] == '#' && p[1] == ' ' && !strncmp(p + 2, key, klen) && p[2 + klen] == '=') {
+            const char *v = p + 3 + klen;
+            size_t n = strcspn(v, "\n");
+            if (n >= len) n = len - 1;
+            memcpy(buf, v, n);
+            buf[n] = '\0';
+            return buf;
+        }
+        p = strchr(p, '\n');
+        if (p) p++;
+    }
+    return NULL;
+}
+
+/* k-th smallest value (quickselect, reorders v) */
+static inline double session_select(double *v, size_t n, size_t k) {
+    long lo = 0, hi = (long)n - 1, kk = (long)k;
+    while (lo < hi) {
+        double pivot = v[lo + (hi - lo) / 2];
+        long i = lo, j = hi;
+        while (i <= j) {
+            while (v[i] < pivot) i++;
+            while (v[j] > pivot) j--;
+            if (i <= j) {
+                double t = v[i];
+                v[i++] = v[j];
+                v[j--] = t;
+            }
+        }
+        if (kk <= j) hi = j;
+        else if (kk >= i) lo = i;
+        else break;
+    }
+    return v[kk];
+}
+
+/* p-quantile (0..1) of n values, reorders v */
+static inline double session_quantile(double *v, size_t n, double p) {
+    if (n == 0) return 0;
+    size_t k = (size_t)(p * (double)n);
+    return session_select(v, n, k < n ? k : n - 1);
+}
+
+/* XXH64 */
+#define SESSION_P1 11400714785074694791ULL
+#define SESSION_P2 14029467366897019727ULL
+#define SESSION_P3 1609587929392839161ULL
+#define SESSION_P4 9650029242287828579ULL
+#define SESSION_P5 2870177450012600261ULL
+
+static inline uint64_t session_rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t session_read64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline uint64_t session_round(uint64_t acc, uint64_t in) {
+    acc += in * SESSION_P2;
+    return session_rotl(acc, 31) * SESSION_P1;
+}
+
+static inline uint64_t session_merge(uint64_t acc, uint64_t v) {
+    acc ^= session_round(0, v);
+    return acc * SESSION_P1 + SESSION_P4;
+}
+
+static inline uint64_t session_hash64(const void *data, size_t len, uint64_t seed) {
+    const unsigned char *p = data, *end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + SESSION_P1 + SESSION_P2, v2 = seed + SESSION_P2;
+        uint64_t v3 = seed, v4 = seed - SESSION_P1;
+        do {
+            v1 = session_round(v1, session_read64(p));
+            v2 = session_round(v2, session_read64(p + 8));
+            v3 = session_round(v3, session_read64(p + 16));
+            v4 = session_round(v4, session_read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+        h = session_rotl(v1, 1) + session_rotl(v2, 7) + session_rotl(v3, 12) + session_rotl(v4, 18);
+        h = session_merge(h, v1);
+        h = session_merge(h, v2);
+        h = session_merge(h, v3);
+        h = session_merge(h, v4);
+    } else {
+        h = seed + SESSION_P5;
+    }
+    h += (uint64_t)len;
+    for (; p + 8 <= end; p += 8) {
+        h ^= session_round(0, session_read64(p));
+        h = session_rotl(h, 27) * SESSION_P1 + SESSION_P4;
+    }
+    if (p + 4 <= end) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        h ^= (uint64_t)v * SESSION_P1;
+        h = session_rotl(h, 23) * SESSION_P2 + SESSION_P3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= (*p) * SESSION_P5;
+        h = session_rotl(h, 11) * SESSION_P1;
+    }
+    h ^= h >> 33;
+    h *= SESSION_P2;
+    h ^= h >> 29;
+    h *= SESSION_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+/* Hashes a file's whole content; returns 0 on success */
+static inline int session_hash_file(const char *path, uint64_t seed, uint64_t *hash) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        *hash = session_hash64("", 0, seed);
+        return 0;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    *hash = session_hash64(data, (size_t)st.st_size, seed);
+    munmap(data, (size_t)st.st_size);
+    return 0;
+}
+
+#endif /* SESSION_H */
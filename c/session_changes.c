@@ -0,0 +1,66 @@
+/*
+ * session_changes.c - Rhythm change points in recorded sessions (POSIX)
+ *
+ * Runs the online detector of changepoint.h over each session's flight
+ * times (key_up -> next key_down, auto-repeat ignored), exactly as the
+ * recorders do live, and prints one CSV row per change point:
+ *
+ *   session,seq,timestamp_ms,direction,before_ms,after_ms
+ *
+ * direction is "slower" or "faster"; before_ms and after_ms are the
+ * typical flight times on either side of the change.
+ *
+ * Build: make session_changes (see Makefile)
+ * Usage: ./session_changes [-k slack] [-h threshold] session.csv [more.csv ...]
+ *        -k and -h are in baseline standard deviations (default 0.5 and 10).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "session.h"
+#include "changepoint.h"
+
+int main(int argc, char *argv[]) {
+    double k = CHANGEPOINT_SLACK, h = CHANGEPOINT_THRESHOLD;
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "-k")) k = atof(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-h")) h = atof(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi >= argc) {
+        fprintf(stderr, "Usage: %s [-k slack] [-h threshold] session.csv [more.csv ...]\n", argv[0]);
+        return 1;
+    }
+
+    int failures = 0;
+    printf("session,seq,timestamp_ms,direction,before_ms,after_ms\n");
+    for (; argi < argc; argi++) {
+        Session s;
+        if (session_load(argv[argi], &s) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", argv[argi]);
+            failures++;
+            continue;
+        }
+        ChangeDetector d;
+        changepoint_init(&d, k, h);
+        double last_up = NAN;
+        for (size_t i = 0; i < s.count; i++) {
+            const SessionEvent *e = &s.events[i];
+            if (e->type == SESSION_KEY_UP) {
+                last_up = e->timestamp_ms;
+                continue;
+            }
+            if (e->type != SESSION_KEY_DOWN || e->is_repeat || isnan(last_up)) continue;
+            ChangePoint cp;
+            if (changepoint_add(&d, e->timestamp_ms - last_up, &cp)) {
+                printf("%s,%lld,%.3f,%s,%.1f,%.1f\n", argv[argi], (long long)e->seq, e->timestamp_ms,
+                       cp.direction > 0 ? "slower" : "faster", cp.before_ms, cp.after_ms);
+            }
+        }
+        session_free(&s);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,282 @@
+/*
+ * session_dedup.c - Find duplicate and near-duplicate sessions (POSIX)
+ *
+ * Each session is reduced to a set of shingles:
+ *   "c1 c2 c3"    character trigraphs of consecutive key presses
+ *   "c1 c2|b"     digraphs with a coarse press-to-press timing bucket
+ *                 (b = floor(log2(ms))), so re-exports and copies recorded
+ *                 by other variants match but different typists do not
+ * and then to a MinHash signature of SIGNATURE_SIZE minimums, whose
+ * agreement rate estimates the Jaccard similarity of two shingle sets.
+ * LSH splits the signature into BANDS bands of ROWS; sessions sharing any
+ * whole band become candidates (about a 0.7 similarity threshold), and
+ * candidates whose estimated similarity reaches -t are grouped with
+ * union-find. Within a bucket each session is checked against the first
+ * and the previous member only, so giant buckets stay linear.
+ *
+ * Signatures are computed by one worker thread per core. Output is one
+ * line per grouped session: "keep" for the largest session of each group,
+ * "dup" for the rest with their similarity to it, groups separated by a
+ * blank line. Sessions with no key presses are skipped.
+ *
+ * Build: make session_dedup (see Makefile)
+ * Usage: ./session_dedup [-t similarity] [-@ threads] session.csv [more.csv ...]
+ *        a "-" argument reads further paths from stdin, one per line
+ *        (find archive -name '*.csv' | ./session_dedup -).
+ *        -t defaults to 0.8, threads to the number of online CPUs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "session.h"
+
+#define BANDS 16
+#define ROWS 8
+#define SIGNATURE_SIZE (BANDS * ROWS)
+#define DIGRAPH_PAUSE_MS 1000.0
+
+typedef struct {
+    char *path;
+    uint64_t sig[SIGNATURE_SIZE];
+    size_t presses;
+    int ok;                     /* 1 = signature computed, 0 = empty, -1 = unreadable */
+} Entry;
+
+typedef struct {
+    Entry *entries;
+    size_t count;
+    size_t next;                /* claimed with __atomic_fetch_add */
+} Work;
+
+/* splitmix64 finalizer; permutation i is mix(x + i * golden ratio) */
+static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void signature(Entry *en) {
+    Session s;
+    if (session_load(en->path, &s) != 0) {
+        en->ok = -1;
+        return;
+    }
+    uint64_t *sh = malloc((2 * s.count + 1) * sizeof(uint64_t));
+    size_t n = 0;
+    const char *c1 = NULL, *c2 = NULL;
+    double t2 = 0;
+    char buf[64];
+
+    for (size_t i = 0; i < s.count; i++) {
+        const SessionEvent *e = &s.events[i];
+        if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+        en->presses++;
+        double dd = e->timestamp_ms - t2;
+        if (c2 && dd > DIGRAPH_PAUSE_MS) c1 = c2 = NULL;
+        if (c2) {
+            int bucket = dd < 1.0 ? 0 : (int)log2(dd);
+            int len = snprintf(buf, sizeof(buf), "%s %s|%d", c2, e->character, bucket);
+            sh[n++] = session_hash64(buf, (size_t)len, 0);
+        }
+        if (c1) {
+            int len = snprintf(buf, sizeof(buf), "%s %s %s", c1, c2, e->character);
+            sh[n++] = session_hash64(buf, (size_t)len, 0);
+        }
+        c1 = c2;
+        c2 = e->character;
+        t2 = e->timestamp_ms;
+    }
+    session_free(&s);
+
+    /* MinHash over the distinct shingles only */
+    qsort(sh, n, sizeof(uint64_t), cmp_u64);
+    for (int k = 0; k < SIGNATURE_SIZE; k++) en->sig[k] = UINT64_MAX;
+    for (size_t i = 0; i < n; i++) {
+        if (i && sh[i] == sh[i - 1]) continue;
+        for (int k = 0; k < SIGNATURE_SIZE; k++) {
+            uint64_t v = mix64(sh[i] + (uint64_t)(k + 1) * 0x9e3779b97f4a7c15ULL);
+            if (v < en->sig[k]) en->sig[k] = v;
+        }
+    }
+    en->ok = n > 0;
+    free(sh);
+}
+
+static void *worker(void *arg) {
+    Work *w = arg;
+    for (;;) {
+        size_t i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED);
+        if (i >= w->count) return NULL;
+        signature(&w->entries[i]);
+    }
+}
+
+static double similarity(const Entry *a, const Entry *b) {
+    int same = 0;
+    for (int k = 0; k < SIGNATURE_SIZE; k++) same += a->sig[k] == b->sig[k];
+    return (double)same / SIGNATURE_SIZE;
+}
+
+/* ---- Union-find ---- */
+
+static size_t *parent;
+
+static size_t find(size_t x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x = parent[x];
+    }
+    return x;
+}
+
+static void unite(size_t a, size_t b) {
+    a = find(a);
+    b = find(b);
+    if (a != b) parent[a < b ? b : a] = a < b ? a : b;
+}
+
+typedef struct {
+    uint64_t key;
+    size_t id;
+} BandKey;
+
+static int cmp_band(const void *a, const void *b) {
+    const BandKey *x = a, *y = b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static Entry *entries;
+
+static int cmp_group(const void *a, const void *b) {
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    size_t rx = find(x), ry = find(y);
+    if (rx != ry) return (rx > ry) - (rx < ry);
+    if (entries[x].presses != entries[y].presses) return entries[x].presses < entries[y].presses ? 1 : -1;
+    return (x > y) - (x < y);
+}
+
+static void add_path(Entry **list, size_t *count, size_t *cap, const char *path) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *list = realloc(*list, *cap * sizeof(Entry));
+    }
+    memset(&(*list)[*count], 0, sizeof(Entry));
+    (*list)[(*count)++].path = strdup(path);
+}
+
+int main(int argc, char *argv[]) {
+    double threshold = 0.8;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        if (!strcmp(argv[argi], "-t")) threshold = atof(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-@")) threads = atoi(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi >= argc || threads < 1) {
+        fprintf(stderr, "Usage: %s [-t similarity] [-@ threads] session.csv [more.csv ...]\n", argv[0]);
+        fprintf(stderr, "       a \"-\" argument reads paths from stdin\n");
+        return 1;
+    }
+
+    size_t count = 0, cap = 0;
+    for (; argi < argc; argi++) {
+        if (strcmp(argv[argi], "-") != 0) {
+            add_path(&entries, &count, &cap, argv[argi]);
+            continue;
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0]) add_path(&entries, &count, &cap, line);
+        }
+    }
+
+    /* Signatures, one worker per core */
+    Work work = { entries, count, 0 };
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, worker, &work);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+
+    size_t failures = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (entries[i].ok < 0) {
+            fprintf(stderr, "Error: cannot read %s\n", entries[i].path);
+            failures++;
+        }
+    }
+
+    /* LSH: sort each band's hashes and check sessions sharing one */
+    parent = malloc(count * sizeof(size_t));
+    for (size_t i = 0; i < count; i++) parent[i] = i;
+    BandKey *keys = malloc(count * sizeof(BandKey));
+    size_t candidates = 0;
+    for (int b = 0; b < BANDS; b++) {
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i].ok != 1) continue;
+            keys[n].key = session_hash64(&entries[i].sig[b * ROWS], ROWS * sizeof(uint64_t), (uint64_t)b);
+            keys[n++].id = i;
+        }
+        qsort(keys, n, sizeof(BandKey), cmp_band);
+        size_t first = 0;               /* start of the current bucket */
+        for (size_t i = 1; i < n; i++) {
+            if (keys[i].key != keys[i - 1].key) {
+                first = i;
+                continue;
+            }
+            size_t x = keys[i].id, prev = keys[i - 1].id, head = keys[first].id;
+            candidates++;
+            if (find(x) != find(prev) && similarity(&entries[x], &entries[prev]) >= threshold) unite(x, prev);
+            if (head != prev && find(x) != find(head) && similarity(&entries[x], &entries[head]) >= threshold)
+                unite(x, head);
+        }
+    }
+    free(keys);
+
+    /* Print groups, largest session first as the one to keep */
+    size_t *members = calloc(count, sizeof(size_t));
+    for (size_t i = 0; i < count; i++) members[find(i)]++;
+    size_t *order = malloc(count * sizeof(size_t));
+    size_t grouped = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (members[find(i)] > 1) order[grouped++] = i;
+    }
+    qsort(order, grouped, sizeof(size_t), cmp_group);
+
+    size_t groups = 0, dups = 0, keep = 0;
+    for (size_t i = 0; i < grouped; i++) {
+        const Entry *e = &entries[order[i]];
+        if (i == 0 || find(order[i]) != find(order[i - 1])) {
+            if (groups++) printf("\n");
+            printf("keep\t%s\n", e->path);
+            keep = order[i];
+            continue;
+        }
+        printf("dup\t%s\t%.2f\n", e->path, similarity(e, &entries[keep]));
+        dups++;
+    }
+    fprintf(stderr, "%zu sessions, %zu candidate pairs, %zu groups, %zu duplicates\n",
+            count, candidates, groups, dups);
+
+    for (size_t i = 0; i < count; i++) free(entries[i].path);
+    free(entries);
+    free(parent);
+    free(members);
+    free(order);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,358 @@
+/*
+ * session_diff.c - Event-by-event comparison of two recordings (POSIX)
+ *
+ * Aligns two sessions of the same physical input (e.g. the C terminal and
+ * Python GUI variants recording at once) and reports how their timestamps
+ * differ. Events are matched by key and event type within a tolerance
+ * window in a single forward pass: B events enter per-key FIFOs as the A
+ * cursor reaches them and expire once they fall behind the window, so
+ * the whole comparison is linear in the number of events.
+ *
+ * The two recorders start their clocks at different moments, so the
+ * offset between them is estimated by voting: every pair of same-key
+ * presses among the first events of each session casts its b - a, and
+ * the densest OFFSET_WINDOW_MS of votes wins. A dropped or extra event
+ * only spoils its own votes. The offset is then tracked as matches come
+ * in, which also absorbs slow clock drift, and after RESYNC_MISSES
+ * misses in a row it is voted again from the events at hand. A new vote
+ * only counts if its cluster holds OFFSET_MIN_SHARE of the A presses
+ * that voted, far beyond what unrelated keys pair up to by chance; each
+ * vote that does not move the offset doubles the misses before the next
+ * one, so a stretch that B simply lacks costs a few dozen votes.
+ * Reported deltas are b - a after removing that offset; dwell deltas
+ * compare key_down -> key_up durations and need no offset at all.
+ *
+ * Build: make session_diff (see Makefile)
+ * Usage: ./session_diff [options] a.csv b.csv
+ *        -t ms        match tolerance (default 50)
+ *        --offset ms  fixed offset b - a: neither estimated, tracked nor
+ *                     resynced
+ *        --by-char    match on the character column instead of keycode
+ *                     (keycodes differ between capture APIs)
+ *        -o pairs.csv write every matched, missing and extra event
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "session.h"
+
+#define KEY_SLOTS (1 << 16)
+#define OFFSET_PROBE 1024        /* A presses voting; B contributes twice as many */
+#define OFFSET_WINDOW_MS 10.0    /* width of the winning cluster of votes */
+#define OFFSET_MIN_VOTES 8
+#define OFFSET_MIN_SHARE 0.25    /* of the voting A presses, for a resync */
+#define OFFSET_GAIN 0.02         /* tracking gain per matched event */
+#define RESYNC_MISSES 32
+#define RESYNC_MISSES_MAX 32768  /* backoff limit between votes */
+#define RESYNC_LOOKBACK_MS 30000.0
+
+static int by_char = 0;
+
+/* Slot of the physical key, shared by its key_down and key_up */
+static uint32_t key_slot(const SessionEvent *e) {
+    uint32_t k;
+    if (by_char) {
+        /* FNV-1a over the character column */
+        k = 2166136261u;
+        for (const char *c = e->character; *c; c++) k = (k ^ (unsigned char)*c) * 16777619u;
+    } else {
+        k = (uint32_t)e->keycode * 2654435761u;
+    }
+    return ((k >> 16) ^ k) & (KEY_SLOTS - 1);
+}
+
+static uint32_t event_key(const SessionEvent *e) {
+    return (key_slot(e) + (uint32_t)e->type * 0x9E37u) & (KEY_SLOTS - 1);
+}
+
+static int same_key(const SessionEvent *a, const SessionEvent *b) {
+    if (a->type != b->type) return 0;
+    return by_char ? !strcmp(a->character, b->character) : a->keycode == b->keycode;
+}
+
+static int cmp_double(const void *x, const void *y) {
+    double a = *(const double *)x, b = *(const double *)y;
+    return (a > b) - (a < b);
+}
+
+/*
+ * Votes on the offset b - a with the presses of A from index a_from and
+ * of B from b_from: the median of the densest OFFSET_WINDOW_MS of
+ * same-key deltas. Returns the number of votes in that window (0 if no
+ * estimate), the offset in *offset and the number of A presses that
+ * voted in *voters.
+ */
+static size_t estimate_offset(const Session *a, size_t a_from, const Session *b, size_t b_from,
+                              double *offset, size_t *voters) {
+    size_t ia[OFFSET_PROBE], ib[2 * OFFSET_PROBE];
+    size_t na = 0, nb = 0;
+    for (size_t i = a_from; i < a->count && na < OFFSET_PROBE; i++) {
+        if (a->events[i].type == SESSION_KEY_DOWN && !a->events[i].is_repeat) ia[na++] = i;
+    }
+    for (size_t i = b_from; i < b->count && nb < 2 * OFFSET_PROBE; i++) {
+        if (b->events[i].type == SESSION_KEY_DOWN && !b->events[i].is_repeat) ib[nb++] = i;
+    }
+    *voters = na;
+
+    size_t n = 0, cap = 4096;
+    double *deltas = malloc(cap * sizeof(double));
+    for (size_t x = 0; x < na && deltas; x++) {
+        const SessionEvent *ea = &a->events[ia[x]];
+        for (size_t y = 0; y < nb; y++) {
+            const SessionEvent *eb = &b->events[ib[y]];
+            if (!same_key(ea, eb)) continue;
+            if (n == cap) {
+                double *grown = realloc(deltas, 2 * cap * sizeof(double));
+                if (!grown) break;
+                deltas = grown;
+                cap *= 2;
+            }
+            deltas[n++] = eb->timestamp_ms - ea->timestamp_ms;
+        }
+    }
+    if (!deltas) return 0;
+    qsort(deltas, n, sizeof(double), cmp_double);
+
+    size_t best = 0, best_lo = 0;
+    for (size_t lo = 0, hi = 0; hi < n; hi++) {
+        while (deltas[hi] - deltas[lo] > OFFSET_WINDOW_MS) lo++;
+        if (hi - lo + 1 > best) {
+            best = hi - lo + 1;
+            best_lo = lo;
+        }
+    }
+    if (best) *offset = deltas[best_lo + best / 2];
+    free(deltas);
+    return best;
+}
+
+typedef struct {
+    size_t n;
+    double sum, sumsq, min, max;
+    double *values;
+} Stats;
+
+static void stats_add(Stats *s, double v) {
+    if (s->n == 0 || v < s->min) s->min = v;
+    if (s->n == 0 || v > s->max) s->max = v;
+    s->sum += v;
+    s->sumsq += v * v;
+    s->values[s->n++] = v;
+}
+
+static void stats_print(const char *name, Stats *s) {
+    if (s->n == 0) {
+        printf("%s_n=0\n", name);
+        return;
+    }
+    double mean = s->sum / (double)s->n;
+    double var = s->sumsq / (double)s->n - mean * mean;
+    printf("%s_n=%zu\n", name, s->n);
+    printf("%s_mean_ms=%.3f\n", name, mean);
+    printf("%s_sd_ms=%.3f\n", name, var > 0 ? sqrt(var) : 0.0);
+    printf("%s_min_ms=%.3f\n", name, s->min);
+    printf("%s_p50_ms=%.3f\n", name, session_quantile(s->values, s->n, 0.50));
+    printf("%s_p90_ms=%.3f\n", name, session_quantile(s->values, s->n, 0.90));
+    printf("%s_p99_ms=%.3f\n", name, session_quantile(s->values, s->n, 0.99));
+    printf("%s_max_ms=%.3f\n", name, s->max);
+}
+
+int main(int argc, char *argv[]) {
+    double tolerance = 50.0;
+    double fixed_offset = NAN;
+    const char *pairs_path = NULL;
+    const char *paths[2];
+    int npaths = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--offset") && i + 1 < argc) {
+            fixed_offset = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--by-char")) {
+            by_char = 1;
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            pairs_path = argv[++i];
+        } else if (npaths < 2 && argv[i][0] != '-') {
+            paths[npaths++] = argv[i];
+        } else {
+            npaths = 0;
+            break;
+        }
+    }
+    if (npaths != 2) {
+        fprintf(stderr, "Usage: %s [-t ms] [--offset ms] [--by-char] [-o pairs.csv] a.csv b.csv\n",
+                argv[0]);
+        return 1;
+    }
+
+    Session a, b;
+    if (session_load(paths[0], &a) != 0) {
+        fprintf(stderr, "Error: cannot read %s\n", paths[0]);
+        return 1;
+    }
+    if (session_load(paths[1], &b) != 0) {
+        fprintf(stderr, "Error: cannot read %s\n", paths[1]);
+        return 1;
+    }
+
+    FILE *pairs = NULL;
+    if (pairs_path) {
+        pairs = fopen(pairs_path, "w");
+        if (!pairs) {
+            fprintf(stderr, "Error: cannot open %s for writing\n", pairs_path);
+            return 1;
+        }
+        fprintf(pairs, "status,a_seq,b_seq,event_type,keycode,character,a_ms,b_ms,delta_ms\n");
+    }
+
+    int fixed = !isnan(fixed_offset);
+    double offset0 = fixed ? fixed_offset : 0;
+    size_t voters;
+    if (!fixed) estimate_offset(&a, 0, &b, 0, &offset0, &voters);
+    double offset = offset0, tracked = 0;
+    size_t misses = 0, streak = 0, resyncs = 0, resync_after = RESYNC_MISSES;
+
+    /* Per-key FIFOs of unmatched B events, linked through `next` */
+    int32_t *head = malloc(KEY_SLOTS * sizeof(int32_t));
+    int32_t *tail = malloc(KEY_SLOTS * sizeof(int32_t));
+    int32_t *next = malloc((b.count + 1) * sizeof(int32_t));
+    uint8_t *matched = calloc(b.count + 1, 1);
+    size_t *down_a = calloc(KEY_SLOTS, sizeof(size_t));   /* A index + 1 of open key_down */
+    size_t *down_b = calloc(KEY_SLOTS, sizeof(size_t));
+    memset(head, -1, KEY_SLOTS * sizeof(int32_t));
+    memset(tail, -1, KEY_SLOTS * sizeof(int32_t));
+
+    Stats delta = { .values = malloc((a.count + 1) * sizeof(double)) };
+    Stats dwell = { .values = malloc((a.count + 1) * sizeof(double)) };
+    size_t missing = 0;
+    size_t j = 0;
+
+    for (size_t i = 0; i < a.count; i++) {
+        const SessionEvent *ea = &a.events[i];
+        double t = ea->timestamp_ms + offset;
+
+        /* Admit B events up to the end of the window */
+        while (j < b.count && b.events[j].timestamp_ms <= t + tolerance) {
+            uint32_t k = event_key(&b.events[j]);
+            next[j] = -1;
+            if (tail[k] >= 0) next[tail[k]] = (int32_t)j;
+            else head[k] = (int32_t)j;
+            tail[k] = (int32_t)j;
+            j++;
+        }
+
+        /* Drop candidates that fell behind the window or collide in the slot */
+        uint32_t k = event_key(ea);
+        int32_t prev = -1, c = head[k];
+        while (c >= 0 && b.events[c].timestamp_ms < t - tolerance) c = next[c];
+        head[k] = c;
+        if (c < 0) tail[k] = -1;
+        while (c >= 0 && !same_key(ea, &b.events[c])) {
+            prev = c;
+            c = next[c];
+        }
+
+        if (c < 0) {
+            missing++;
+            /* A run of misses means the alignment was lost: vote again from here */
+            streak = 0;
+            if (!fixed && ++misses >= resync_after) {
+                misses = 0;
+                double from = ea->timestamp_ms + offset - RESYNC_LOOKBACK_MS, voted;
+                size_t lo = 0, hi = b.count;
+                while (lo < hi) {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (b.events[mid].timestamp_ms < from) lo = mid + 1;
+                    else hi = mid;
+                }
+                size_t votes = estimate_offset(&a, i, &b, lo, &voted, &voters);
+                if (votes >= OFFSET_MIN_VOTES && votes >= OFFSET_MIN_SHARE * (double)voters &&
+                    fabs(voted - offset) > tolerance) {
+                    offset = voted;
+                    resyncs++;
+                    resync_after = RESYNC_MISSES;
+                } else if (resync_after < RESYNC_MISSES_MAX) {
+                    resync_after *= 2;
+                }
+            }
+            if (pairs)
+                fprintf(pairs, "missing,%lld,,%s,%d,%s,%.3f,,\n", (long long)ea->seq,
+                        ea->type == SESSION_KEY_DOWN ? "key_down" : "key_up",
+                        ea->keycode, ea->character, ea->timestamp_ms);
+            continue;
+        }
+
+        /* Unlink the match */
+        if (prev >= 0) next[prev] = next[c];
+        else head[k] = next[c];
+        if (tail[k] == c) tail[k] = prev;
+        matched[c] = 1;
+
+        const SessionEvent *eb = &b.events[c];
+        double d = eb->timestamp_ms - t;
+        stats_add(&delta, d);
+        misses = 0;
+        if (++streak == RESYNC_MISSES) resync_after = RESYNC_MISSES;
+        if (!fixed) {
+            offset += OFFSET_GAIN * d;
+            tracked += OFFSET_GAIN * d;
+        }
+
+        /* Dwell difference is independent of the clock offset */
+        uint32_t kk = key_slot(ea);
+        if (ea->type == SESSION_KEY_DOWN && !ea->is_repeat) {
+            down_a[kk] = i + 1;
+            down_b[kk] = (size_t)c + 1;
+        } else if (ea->type == SESSION_KEY_UP && down_a[kk]) {
+            double dwell_a = ea->timestamp_ms - a.events[down_a[kk] - 1].timestamp_ms;
+            double dwell_b = eb->timestamp_ms - b.events[down_b[kk] - 1].timestamp_ms;
+            stats_add(&dwell, dwell_b - dwell_a);
+            down_a[kk] = 0;
+        }
+
+        if (pairs)
+            fprintf(pairs, "matched,%lld,%lld,%s,%d,%s,%.3f,%.3f,%.3f\n", (long long)ea->seq,
+                    (long long)eb->seq, ea->type == SESSION_KEY_DOWN ? "key_down" : "key_up",
+                    ea->keycode, ea->character, ea->timestamp_ms, eb->timestamp_ms, d);
+    }
+
+    size_t extra = 0;
+    for (size_t m = 0; m < b.count; m++) {
+        if (matched[m]) continue;
+        extra++;
+        if (pairs)
+            fprintf(pairs, "extra,,%lld,%s,%d,%s,,%.3f,\n", (long long)b.events[m].seq,
+                    b.events[m].type == SESSION_KEY_DOWN ? "key_down" : "key_up",
+                    b.events[m].keycode, b.events[m].character, b.events[m].timestamp_ms);
+    }
+
+    double span = a.count ? a.events[a.count - 1].timestamp_ms - a.events[0].timestamp_ms : 0;
+    printf("a=%s\n", paths[0]);
+    printf("b=%s\n", paths[1]);
+    printf("a_events=%zu\n", a.count);
+    printf("b_events=%zu\n", b.count);
+    printf("matched=%zu\n", delta.n);
+    printf("missing_in_b=%zu\n", missing);
+    printf("extra_in_b=%zu\n", extra);
+    printf("offset_ms=%.3f\n", offset0);
+    printf("resyncs=%zu\n", resyncs);
+    printf("drift_ppm=%.3f\n", span > 0 ? tracked / span * 1e6 : 0.0);
+    stats_print("delta", &delta);
+    stats_print("dwell_delta", &dwell);
+
+    if (pairs) fclose(pairs);
+    free(head);
+    free(tail);
+    free(next);
+    free(matched);
+    free(down_a);
+    free(down_b);
+    free(delta.values);
+    free(dwell.values);
+    session_free(&a);
+    session_free(&b);
+    return 0;
+}
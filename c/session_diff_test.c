@@ -0,0 +1,146 @@
+/*
+ * session_diff_test.c - Alignment tests for session_diff (POSIX)
+ *
+ * Writes pairs of synthetic sessions of the same typing, runs
+ * ./session_diff on them and checks what it reports:
+ *   gap   B lacks a long stretch in the middle: every event B has must
+ *         still match, without a single resync
+ *   step  B's clock jumps mid-session: one resync must recover it
+ *
+ * Build: make test (see Makefile)
+ * Usage: ./session_diff_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#define PRESSES 100000
+
+static int failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                              \
+        }                                                                            \
+    } while (0)
+
+static uint64_t rng = 88172645463325252ULL;
+
+static double uniform(double lo, double hi) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return lo + (hi - lo) * (double)(rng >> 11) / 9007199254740992.0;
+}
+
+typedef struct {
+    double t;
+    int up;
+    char c;
+} Event;
+
+static int event_cmp(const void *x, const void *y) {
+    double a = ((const Event *)x)->t, b = ((const Event *)y)->t;
+    return (a > b) - (a < b);
+}
+
+/*
+ * Writes A and B: B skips events [skip_from, skip_to) of A and is
+ * shifted by offset, plus step from event step_at on.
+ */
+static void write_pair(const char *path_a, const char *path_b, long skip_from, long skip_to,
+                       double offset, long step_at, double step) {
+    static const char keys[] = "etaoinshrdlucmfwypvbgkqxz";
+    Event *ev = malloc(2 * PRESSES * sizeof(Event));
+    double t = 0;
+    for (long i = 0; i < PRESSES; i++) {
+        char c = keys[(int)uniform(0, sizeof(keys) - 1)];
+        t += uniform(60, 250);
+        ev[2 * i] = (Event){ t, 0, c };
+        ev[2 * i + 1] = (Event){ t + uniform(60, 120), 1, c };
+    }
+    qsort(ev, 2 * PRESSES, sizeof(Event), event_cmp);
+
+    static const char header[] =
+        "seq,timestamp_ms,event_timestamp_ms,event_type,keycode,scancode,character,modifiers,is_repeat\n";
+    FILE *a = fopen(path_a, "w"), *b = fopen(path_b, "w");
+    fputs(header, a);
+    fputs(header, b);
+    long seq_b = 0;
+    for (long i = 0; i < 2 * PRESSES; i++) {
+        const Event *e = &ev[i];
+        const char *type = e->up ? "key_up" : "key_down";
+        fprintf(a, "%ld,%.3f,%.3f,%s,%d,0,%c,none,0\n", i + 1, e->t, e->t, type, e->c, e->c);
+        if (i >= skip_from && i < skip_to) continue;
+        double tb = e->t + offset + (i >= step_at ? step : 0) + uniform(-2, 2);
+        fprintf(b, "%ld,%.3f,%.3f,%s,%d,0,%c,none,0\n", ++seq_b, tb, tb, type, e->c, e->c);
+    }
+    fclose(a);
+    fclose(b);
+    free(ev);
+}
+
+/* Runs session_diff and picks the key=value lines it prints */
+typedef struct {
+    long b_events, matched, resyncs;
+    double drift_ppm;
+} Report;
+
+static int run_diff(const char *path_a, const char *path_b, Report *r) {
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "./session_diff %s %s", path_a, path_b);
+    FILE *p = popen(cmd, "r");
+    if (!p) return -1;
+    memset(r, 0, sizeof(*r));
+    r->drift_ppm = NAN;
+    char line[256];
+    while (fgets(line, sizeof(line), p)) {
+        sscanf(line, "b_events=%ld", &r->b_events);
+        sscanf(line, "matched=%ld", &r->matched);
+        sscanf(line, "resyncs=%ld", &r->resyncs);
+        sscanf(line, "drift_ppm=%lf", &r->drift_ppm);
+    }
+    return pclose(p) == 0 ? 0 : -1;
+}
+
+int main(void) {
+    char dir[] = "/tmp/session_diff_test_XXXXXX";
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    char path_a[128], path_b[128];
+    snprintf(path_a, sizeof(path_a), "%s/a.csv", dir);
+    snprintf(path_b, sizeof(path_b), "%s/b.csv", dir);
+    Report r;
+
+    /* gap: B misses 60k events in the middle */
+    write_pair(path_a, path_b, 70000, 130000, 4000, 2 * PRESSES, 0);
+    CHECK(run_diff(path_a, path_b, &r) == 0);
+    CHECK(r.b_events == 2 * PRESSES - 60000);
+    CHECK(r.matched == r.b_events);
+    CHECK(r.resyncs == 0);
+    CHECK(fabs(r.drift_ppm) < 1.0);
+
+    /* step: B's clock jumps 700 ms halfway through */
+    write_pair(path_a, path_b, 0, 0, 4000, PRESSES, 700);
+    CHECK(run_diff(path_a, path_b, &r) == 0);
+    CHECK(r.resyncs == 1);
+    CHECK(r.matched > r.b_events - 200);
+
+    unlink(path_a);
+    unlink(path_b);
+    rmdir(dir);
+    if (failures) {
+        fprintf(stderr, "session_diff_test: %d checks failed\n", failures);
+        return 1;
+    }
+    fprintf(stderr, "session_diff_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,819 @@
+/*
+ * session_index.c - Archive-wide inverted index for session search (POSIX)
+ *
+ * Maps terms to the sessions containing them, so questions like "which
+ * sessions type 'th' faster than 80 ms" or "which use ctrl+shift chords"
+ * are answered from one small file without opening any session. Terms:
+ *
+ *   key:<char>             key pressed; latency = shortest dwell
+ *   digraph:<c1> <c2>      consecutive presses; latency = shortest
+ *                          press-to-press interval (pauses over 1 s break
+ *                          the chain, as in session_stats)
+ *   mods:<m1+m2..>         presses made with these modifiers held
+ *   chord:<m1+m2..>+<char> the same, per key
+ *
+ * Characters are the CSV's character column, modifiers in the order the
+ * recorders write them (shift+ctrl+alt+cmd).
+ *
+ * Posting lists are Roaring-style: session ids are split by their high 16
+ * bits into containers, each stored as a sorted u16 array when sparse or
+ * an 8 KB bitmap when dense. Every posting also carries the session's
+ * minimum latency for the term (0.1 ms units).
+ *
+ * Sessions are identified by content hash (kept in a hash set while
+ * adding), so "add" only indexes new files and the index can be updated
+ * as sessions arrive. The file is a sequence of segments: "add" indexes
+ * just the new sessions and appends them as one more segment, and queries
+ * visit every segment. Once there would be more than INDEX_MAX_SEGMENTS,
+ * the whole index is merged into one segment and rewritten atomically. A
+ * segment torn by a crash while appending is ignored and cut off by the
+ * next "add". Segment layout (little-endian, offsets from the segment):
+ *
+ *   "KTSI" | u32 version | u32 sessions | u32 terms
+ *   u64 sessions offset | u64 terms offset | u64 strings offset | u64 postings offset
+ *   u64 segment length
+ *   sessions x { u64 content hash | u32 path offset | u32 path length }
+ *   terms x { u32 name offset | u32 name length | u32 cardinality | u32 0 |
+ *             u64 postings offset | u64 postings length }   (sorted by name)
+ *   string pool
+ *   per term: u32 containers | u32 latency offset
+ *             containers x { u16 high bits | u16 type | u32 cardinality |
+ *                            u32 data offset | u32 rank of first posting }
+ *             container data (u16 array or 1024 x u64 bitmap)
+ *             u16 latency per posting, in session id order
+ *
+ * Build: make session_index (see Makefile)
+ * Usage: ./session_index add archive.ktsi session.csv [more.csv ...]
+ *        ./session_index query archive.ktsi [--under ms] TERM [TERM ...]
+ *        ./session_index terms archive.ktsi [prefix]
+ *        query prints the sessions containing every TERM, with the first
+ *        term's minimum latency; --under keeps postings below ms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "session.h"
+
+#define INDEX_MAGIC "KTSI"
+#define INDEX_VERSION 2         /* 1: a single segment, no length field */
+#define INDEX_HEADER 56
+#define INDEX_MAX_SEGMENTS 8
+#define SESSION_ENTRY 16
+#define TERM_ENTRY 32
+#define CONTAINER_ENTRY 16
+#define ARRAY_MAX 4096          /* larger containers become bitmaps */
+#define DIGRAPH_PAUSE_MS 1000.0
+#define NO_LATENCY 0xFFFF
+
+enum { CONTAINER_ARRAY = 0, CONTAINER_BITMAP = 1 };
+
+/* ---- Little-endian helpers ---- */
+
+static void put_le(unsigned char *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (unsigned char)(v >> (8 * i));
+}
+
+static uint64_t get_le(const unsigned char *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+typedef struct {
+    unsigned char *data;
+    size_t len, cap;
+} Buf;
+
+static void buf_put(Buf *b, const void *p, size_t n) {
+    if (b->len + n > b->cap) {
+        while (b->len + n > b->cap) b->cap = b->cap ? b->cap * 2 : 65536;
+        b->data = realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void buf_le(Buf *b, uint64_t v, int bytes) {
+    unsigned char tmp[8];
+    put_le(tmp, v, bytes);
+    buf_put(b, tmp, (size_t)bytes);
+}
+
+/* ---- In-memory index, used while adding sessions ---- */
+
+typedef struct {
+    uint32_t id;
+    uint16_t latency;
+} Posting;
+
+typedef struct {
+    char *name;
+    Posting *p;
+    uint32_t n, cap;
+} Term;
+
+typedef struct {
+    uint64_t hash;
+    char *path;
+} IndexedSession;
+
+typedef struct {
+    IndexedSession *sessions;
+    uint32_t nsessions, sessions_cap;
+    Term *terms;
+    uint32_t nterms, terms_cap;
+    uint32_t *slots;            /* term + 1, 0 = empty */
+    uint32_t nslots;
+} Index;
+
+static Term *term_get(Index *ix, const char *name) {
+    if ((ix->nterms + 1) * 2 > ix->nslots) {
+        uint32_t nslots = ix->nslots ? ix->nslots * 2 : 4096;
+        free(ix->slots);
+        ix->slots = calloc(nslots, sizeof(uint32_t));
+        ix->nslots = nslots;
+        for (uint32_t t = 0; t < ix->nterms; t++) {
+            const char *s = ix->terms[t].name;
+            uint32_t h = (uint32_t)session_hash64(s, strlen(s), 0) & (nslots - 1);
+            while (ix->slots[h]) h = (h + 1) & (nslots - 1);
+            ix->slots[h] = t + 1;
+        }
+    }
+    uint32_t h = (uint32_t)session_hash64(name, strlen(name), 0) & (ix->nslots - 1);
+    while (ix->slots[h]) {
+        Term *t = &ix->terms[ix->slots[h] - 1];
+        if (!strcmp(t->name, name)) return t;
+        h = (h + 1) & (ix->nslots - 1);
+    }
+    if (ix->nterms == ix->terms_cap) {
+        ix->terms_cap = ix->terms_cap ? ix->terms_cap * 2 : 1024;
+        ix->terms = realloc(ix->terms, ix->terms_cap * sizeof(Term));
+    }
+    Term *t = &ix->terms[ix->nterms];
+    memset(t, 0, sizeof(*t));
+    t->name = strdup(name);
+    ix->slots[h] = ++ix->nterms;
+    return t;
+}
+
+static void term_append(Term *t, uint32_t id, uint16_t latency) {
+    if (t->n == t->cap) {
+        t->cap = t->cap ? t->cap * 2 : 4;
+        t->p = realloc(t->p, t->cap * sizeof(Posting));
+    }
+    t->p[t->n].id = id;
+    t->p[t->n].latency = latency;
+    t->n++;
+}
+
+/* Records term for session id, keeping the smaller latency on repeats */
+static void index_hit(Index *ix, uint32_t id, const char *name, double ms) {
+    uint16_t lat = NO_LATENCY;
+    if (!isnan(ms)) lat = ms < 0 ? 0 : ms * 10.0 >= NO_LATENCY - 1 ? NO_LATENCY - 1
+                                                                  : (uint16_t)lround(ms * 10.0);
+    Term *t = term_get(ix, name);
+    if (t->n && t->p[t->n - 1].id == id) {
+        if (lat < t->p[t->n - 1].latency) t->p[t->n - 1].latency = lat;
+    } else {
+        term_append(t, id, lat);
+    }
+}
+
+static void format_mods(uint16_t m, char *buf, size_t len) {
+    snprintf(buf, len, "%s%s%s%s", m & SESSION_MOD_SHIFT ? "shift+" : "",
+             m & SESSION_MOD_CTRL ? "ctrl+" : "", m & SESSION_MOD_ALT ? "alt+" : "",
+             m & SESSION_MOD_CMD ? "cmd+" : "");
+    size_t n = strlen(buf);
+    if (n) buf[n - 1] = '\0';
+}
+
+static void index_session(Index *ix, uint32_t id, const Session *s) {
+    double *down_at = malloc(65536 * sizeof(double));
+    for (int k = 0; k < 65536; k++) down_at[k] = NAN;
+    const char *prev_c = NULL;
+    double prev_t = NAN;
+    char term[128], mods[32];
+
+    for (size_t i = 0; i < s->count; i++) {
+        const SessionEvent *e = &s->events[i];
+        int k = e->keycode & 0xFFFF;
+        if (e->type == SESSION_KEY_UP) {
+            if (!isnan(down_at[k])) {
+                snprintf(term, sizeof(term), "key:%s", e->character);
+                index_hit(ix, id, term, e->timestamp_ms - down_at[k]);
+                down_at[k] = NAN;
+            }
+            continue;
+        }
+        if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+
+        down_at[k] = e->timestamp_ms;
+        snprintf(term, sizeof(term), "key:%s", e->character);
+        index_hit(ix, id, term, NAN);
+
+        double dd = e->timestamp_ms - prev_t;
+        if (prev_c && dd <= DIGRAPH_PAUSE_MS) {
+            snprintf(term, sizeof(term), "digraph:%s %s", prev_c, e->character);
+            index_hit(ix, id, term, dd);
+        }
+        prev_c = e->character;
+        prev_t = e->timestamp_ms;
+
+        if (e->modifiers) {
+            format_mods(e->modifiers, mods, sizeof(mods));
+            snprintf(term, sizeof(term), "mods:%s", mods);
+            index_hit(ix, id, term, NAN);
+            snprintf(term, sizeof(term), "chord:%s+%s", mods, e->character);
+            index_hit(ix, id, term, NAN);
+        }
+    }
+    free(down_at);
+}
+
+/* ---- On-disk index ---- */
+
+/* One segment; session ids are local to it */
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    uint32_t nsessions, nterms;
+    const unsigned char *sessions, *terms, *strings, *postings;
+} IndexFile;
+
+typedef struct {
+    const unsigned char *data;
+    size_t size;
+    size_t valid;               /* bytes covered by complete segments */
+    int legacy;                 /* a version 1 file: one segment, nothing may follow */
+    int n;
+    IndexFile seg[INDEX_MAX_SEGMENTS];
+} IndexSet;
+
+/*
+ * Parses the segment at data; returns its length, or 0 if it is not
+ * whole. Version 1 files hold one segment without a length, so only the
+ * first may be one.
+ */
+static size_t segment_parse(const unsigned char *data, size_t avail, int first, IndexFile *f) {
+    if (avail < 48 || memcmp(data, INDEX_MAGIC, 4) != 0) return 0;
+    uint64_t version = get_le(data + 4, 4);
+    size_t size;
+    if (version == 1 && first) size = avail;
+    else if (version == INDEX_VERSION && avail >= INDEX_HEADER) size = (size_t)get_le(data + 48, 8);
+    else return 0;
+    if (size > avail || size < 48 || get_le(data + 40, 8) > size) return 0;
+    f->data = data;
+    f->size = size;
+    f->nsessions = (uint32_t)get_le(data + 8, 4);
+    f->nterms = (uint32_t)get_le(data + 12, 4);
+    f->sessions = data + get_le(data + 16, 8);
+    f->terms = data + get_le(data + 24, 8);
+    f->strings = data + get_le(data + 32, 8);
+    f->postings = data + get_le(data + 40, 8);
+    return size;
+}
+
+static int index_map(const char *path, IndexSet *x) {
+    memset(x, 0, sizeof(*x));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 48) {
+        close(fd);
+        return -1;
+    }
+    x->size = (size_t)st.st_size;
+    x->data = mmap(NULL, x->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (x->data == MAP_FAILED) return -1;
+    x->legacy = get_le(x->data + 4, 4) == 1;
+    while (x->n < INDEX_MAX_SEGMENTS) {
+        size_t len = segment_parse(x->data + x->valid, x->size - x->valid, x->n == 0, &x->seg[x->n]);
+        if (len == 0) break;
+        x->valid += len;
+        x->n++;
+    }
+    if (x->n == 0) {
+        munmap((void *)x->data, x->size);
+        return -1;
+    }
+    return 0;
+}
+
+static void index_unmap(IndexSet *x) {
+    if (x->data) munmap((void *)x->data, x->size);
+}
+
+static const char *session_path(const IndexFile *f, uint32_t id, size_t *len) {
+    const unsigned char *e = f->sessions + (size_t)id * SESSION_ENTRY;
+    *len = (size_t)get_le(e + 12, 4);
+    return (const char *)f->strings + get_le(e + 8, 4);
+}
+
+/* Binary search of the sorted term directory; NULL if absent */
+static const unsigned char *term_find(const IndexFile *f, const char *name) {
+    size_t n = strlen(name);
+    uint32_t lo = 0, hi = f->nterms;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        const unsigned char *e = f->terms + (size_t)mid * TERM_ENTRY;
+        size_t len = (size_t)get_le(e + 4, 4);
+        int c = memcmp(f->strings + get_le(e, 4), name, len < n ? len : n);
+        if (c == 0) c = (len > n) - (len < n);
+        if (c == 0) return e;
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+/* Decodes a posting list, calling fn for each (id, latency) in id order */
+static void postings_each(const IndexFile *f, const unsigned char *term,
+                          void (*fn)(void *, uint32_t, uint16_t), void *ctx) {
+    const unsigned char *p = f->postings + get_le(term + 16, 8);
+    uint32_t nc = (uint32_t)get_le(p, 4);
+    const unsigned char *lat = p + get_le(p + 4, 4);
+    for (uint32_t c = 0; c < nc; c++) {
+        const unsigned char *h = p + 8 + (size_t)c * CONTAINER_ENTRY;
+        uint32_t high = (uint32_t)get_le(h, 2) << 16;
+        uint32_t card = (uint32_t)get_le(h + 4, 4);
+        const unsigned char *d = p + get_le(h + 8, 4);
+        uint32_t rank = (uint32_t)get_le(h + 12, 4);
+        if (get_le(h + 2, 2) == CONTAINER_ARRAY) {
+            for (uint32_t i = 0; i < card; i++)
+                fn(ctx, high | (uint32_t)get_le(d + 2 * i, 2), (uint16_t)get_le(lat + 2 * (rank + i), 2));
+        } else {
+            for (uint32_t w = 0; w < 1024; w++) {
+                uint64_t bits = get_le(d + 8 * w, 8);
+                while (bits) {
+                    int b = __builtin_ctzll(bits);
+                    fn(ctx, high | (w << 6) | (uint32_t)b, (uint16_t)get_le(lat + 2 * rank++, 2));
+                    bits &= bits - 1;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Latency of session id in a posting list, or -1 if the id is absent.
+ * One binary search over containers, then one over the array or a bit
+ * test plus popcounts for the rank within a bitmap.
+ */
+static int postings_lookup(const IndexFile *f, const unsigned char *term, uint32_t id) {
+    const unsigned char *p = f->postings + get_le(term + 16, 8);
+    uint32_t nc = (uint32_t)get_le(p, 4);
+    const unsigned char *lat = p + get_le(p + 4, 4);
+    uint32_t lo = 0, hi = nc, high = id >> 16, low = id & 0xFFFF;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t key = (uint32_t)get_le(p + 8 + (size_t)mid * CONTAINER_ENTRY, 2);
+        if (key == high) {
+            const unsigned char *h = p + 8 + (size_t)mid * CONTAINER_ENTRY;
+            uint32_t card = (uint32_t)get_le(h + 4, 4);
+            const unsigned char *d = p + get_le(h + 8, 4);
+            uint32_t rank = (uint32_t)get_le(h + 12, 4);
+            if (get_le(h + 2, 2) == CONTAINER_ARRAY) {
+                uint32_t a = 0, b = card;
+                while (a < b) {
+                    uint32_t m = a + (b - a) / 2;
+                    uint32_t v = (uint32_t)get_le(d + 2 * m, 2);
+                    if (v == low) return (int)get_le(lat + 2 * (rank + m), 2);
+                    if (v < low) a = m + 1;
+                    else b = m;
+                }
+                return -1;
+            }
+            uint64_t word = get_le(d + 8 * (low >> 6), 8);
+            if (!((word >> (low & 63)) & 1)) return -1;
+            for (uint32_t w = 0; w < (low >> 6); w++) rank += (uint32_t)__builtin_popcountll(get_le(d + 8 * w, 8));
+            rank += (uint32_t)__builtin_popcountll(word & ((1ULL << (low & 63)) - 1));
+            return (int)get_le(lat + 2 * rank, 2);
+        }
+        if (key < high) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+typedef struct {
+    Term *term;
+    uint32_t base;              /* id of the segment's first session */
+} LoadCtx;
+
+static void load_posting(void *ctx, uint32_t id, uint16_t latency) {
+    LoadCtx *c = ctx;
+    term_append(c->term, c->base + id, latency);
+}
+
+/* Reads every segment back into memory, to merge them into one */
+static void index_load(const IndexSet *x, Index *ix) {
+    for (int g = 0; g < x->n; g++) {
+        const IndexFile *f = &x->seg[g];
+        uint32_t base = ix->nsessions;
+        for (uint32_t i = 0; i < f->nsessions; i++) {
+            size_t len;
+            const char *p = session_path(f, i, &len);
+            if (ix->nsessions == ix->sessions_cap) {
+                ix->sessions_cap = ix->sessions_cap ? ix->sessions_cap * 2 : 256;
+                ix->sessions = realloc(ix->sessions, ix->sessions_cap * sizeof(IndexedSession));
+            }
+            IndexedSession *s = &ix->sessions[ix->nsessions++];
+            s->hash = get_le(f->sessions + (size_t)i * SESSION_ENTRY, 8);
+            s->path = strndup(p, len);
+        }
+        for (uint32_t t = 0; t < f->nterms; t++) {
+            const unsigned char *e = f->terms + (size_t)t * TERM_ENTRY;
+            char *name = strndup((const char *)f->strings + get_le(e, 4), (size_t)get_le(e + 4, 4));
+            LoadCtx c = { term_get(ix, name), base };
+            postings_each(f, e, load_posting, &c);
+            free(name);
+        }
+    }
+}
+
+static void encode_postings(Buf *b, const Term *t) {
+    uint32_t nc = 0;
+    for (uint32_t i = 0; i < t->n; i++)
+        if (i == 0 || (t->p[i].id >> 16) != (t->p[i - 1].id >> 16)) nc++;
+
+    size_t start = b->len;
+    buf_le(b, nc, 4);
+    buf_le(b, 0, 4);    /* latency offset, patched below */
+    size_t headers = b->len;
+    for (uint32_t c = 0; c < nc; c++) buf_le(b, 0, CONTAINER_ENTRY / 2), buf_le(b, 0, CONTAINER_ENTRY / 2);
+
+    uint32_t i = 0;
+    for (uint32_t c = 0; c < nc; c++) {
+        uint32_t high = t->p[i].id >> 16, j = i;
+        while (j < t->n && (t->p[j].id >> 16) == high) j++;
+        uint32_t card = j - i;
+        int type = card > ARRAY_MAX ? CONTAINER_BITMAP : CONTAINER_ARRAY;
+        unsigned char *h = b->data + headers + (size_t)c * CONTAINER_ENTRY;
+        put_le(h, high, 2);
+        put_le(h + 2, (uint64_t)type, 2);
+        put_le(h + 4, card, 4);
+        put_le(h + 8, b->len - start, 4);
+        put_le(h + 12, i, 4);
+        if (type == CONTAINER_ARRAY) {
+            for (uint32_t k = i; k < j; k++) buf_le(b, t->p[k].id & 0xFFFF, 2);
+        } else {
+            uint64_t bits[1024] = {0};
+            for (uint32_t k = i; k < j; k++) bits[(t->p[k].id & 0xFFFF) >> 6] |= 1ULL << (t->p[k].id & 63);
+            for (int w = 0; w < 1024; w++) buf_le(b, bits[w], 8);
+        }
+        i = j;
+    }
+    put_le(b->data + start + 4, b->len - start, 4);
+    for (uint32_t k = 0; k < t->n; k++) buf_le(b, t->p[k].latency, 2);
+}
+
+static int cmp_term(const void *x, const void *y) {
+    return strcmp(((const Term *)x)->name, ((const Term *)y)->name);
+}
+
+/* Encodes ix as one segment */
+static void index_encode(Index *ix, Buf *out) {
+    qsort(ix->terms, ix->nterms, sizeof(Term), cmp_term);
+
+    Buf strings = {0}, postings = {0}, dir = {0}, sessions = {0};
+    for (uint32_t i = 0; i < ix->nsessions; i++) {
+        size_t n = strlen(ix->sessions[i].path);
+        buf_le(&sessions, ix->sessions[i].hash, 8);
+        buf_le(&sessions, strings.len, 4);
+        buf_le(&sessions, n, 4);
+        buf_put(&strings, ix->sessions[i].path, n);
+    }
+    for (uint32_t t = 0; t < ix->nterms; t++) {
+        const Term *term = &ix->terms[t];
+        size_t n = strlen(term->name);
+        size_t off = postings.len;
+        buf_le(&dir, strings.len, 4);
+        buf_le(&dir, n, 4);
+        buf_le(&dir, term->n, 4);
+        buf_le(&dir, 0, 4);
+        buf_put(&strings, term->name, n);
+        encode_postings(&postings, term);
+        buf_le(&dir, off, 8);
+        buf_le(&dir, postings.len - off, 8);
+    }
+
+    unsigned char hdr[INDEX_HEADER] = {0};
+    memcpy(hdr, INDEX_MAGIC, 4);
+    put_le(hdr + 4, INDEX_VERSION, 4);
+    put_le(hdr + 8, ix->nsessions, 4);
+    put_le(hdr + 12, ix->nterms, 4);
+    put_le(hdr + 16, INDEX_HEADER, 8);
+    put_le(hdr + 24, INDEX_HEADER + sessions.len, 8);
+    put_le(hdr + 32, INDEX_HEADER + sessions.len + dir.len, 8);
+    put_le(hdr + 40, INDEX_HEADER + sessions.len + dir.len + strings.len, 8);
+    put_le(hdr + 48, INDEX_HEADER + sessions.len + dir.len + strings.len + postings.len, 8);
+
+    buf_put(out, hdr, sizeof(hdr));
+    buf_put(out, sessions.data, sessions.len);
+    buf_put(out, dir.data, dir.len);
+    buf_put(out, strings.data, strings.len);
+    buf_put(out, postings.data, postings.len);
+    free(strings.data);
+    free(postings.data);
+    free(dir.data);
+    free(sessions.data);
+}
+
+/* Replaces the index with one segment: written beside it, renamed over it */
+static int index_write(Index *ix, const char *path) {
+    Buf seg = {0};
+    index_encode(ix, &seg);
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    int rc = -1;
+    if (f) {
+        fwrite(seg.data, 1, seg.len, f);
+        rc = (fclose(f) == 0 && rename(tmp, path) == 0) ? 0 : -1;
+    }
+    free(seg.data);
+    return rc;
+}
+
+/* Appends ix as a new segment after the first valid bytes of the file */
+static int index_append(Index *ix, const char *path, size_t valid) {
+    Buf seg = {0};
+    index_encode(ix, &seg);
+    int fd = open(path, O_WRONLY);
+    int rc = -1;
+    if (fd >= 0) {
+        if (ftruncate(fd, (off_t)valid) == 0 && lseek(fd, (off_t)valid, SEEK_SET) == (off_t)valid) {
+            size_t done = 0;
+            while (done < seg.len) {
+                ssize_t w = write(fd, seg.data + done, seg.len - done);
+                if (w <= 0) break;
+                done += (size_t)w;
+            }
+            rc = done == seg.len && fsync(fd) == 0 ? 0 : -1;
+        }
+        if (close(fd) != 0) rc = -1;
+    }
+    free(seg.data);
+    return rc;
+}
+
+/* Open-addressing set of session content hashes */
+typedef struct {
+    uint64_t *keys;
+    uint8_t *used;
+    size_t cap;
+} HashSet;
+
+static void hashset_init(HashSet *h, size_t n) {
+    h->cap = 1024;
+    while (h->cap < 2 * n) h->cap *= 2;
+    h->keys = malloc(h->cap * sizeof(uint64_t));
+    h->used = calloc(h->cap, 1);
+}
+
+/* Adds key; returns 0 if it was already present */
+static int hashset_add(HashSet *h, uint64_t key) {
+    size_t i = (size_t)(key ^ (key >> 29)) & (h->cap - 1);
+    while (h->used[i]) {
+        if (h->keys[i] == key) return 0;
+        i = (i + 1) & (h->cap - 1);
+    }
+    h->used[i] = 1;
+    h->keys[i] = key;
+    return 1;
+}
+
+/* ---- Commands ---- */
+
+static int cmd_add(int argc, char *argv[]) {
+    const char *path = argv[0];
+    IndexSet x = {0};
+    int exists = access(path, F_OK) == 0;
+    if (exists && index_map(path, &x) != 0) {
+        fprintf(stderr, "Error: %s is not a session index\n", path);
+        return 1;
+    }
+
+    /* Known sessions, across every segment */
+    uint32_t known = 0;
+    for (int g = 0; g < x.n; g++) known += x.seg[g].nsessions;
+    HashSet seen;
+    hashset_init(&seen, (size_t)known + (size_t)argc);
+    for (int g = 0; g < x.n; g++) {
+        for (uint32_t i = 0; i < x.seg[g].nsessions; i++)
+            hashset_add(&seen, get_le(x.seg[g].sessions + (size_t)i * SESSION_ENTRY, 8));
+    }
+
+    /* Either a new segment of just the new sessions, or everything merged */
+    int merge = x.n >= INDEX_MAX_SEGMENTS || x.legacy;
+    Index ix = {0};
+    if (merge) index_load(&x, &ix);
+
+    uint32_t added = 0, failures = 0;
+    for (int i = 1; i < argc; i++) {
+        uint64_t hash;
+        if (session_hash_file(argv[i], 0, &hash) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", argv[i]);
+            failures++;
+            continue;
+        }
+        if (!hashset_add(&seen, hash)) continue;
+
+        Session s;
+        if (session_load(argv[i], &s) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", argv[i]);
+            failures++;
+            continue;
+        }
+        if (ix.nsessions == ix.sessions_cap) {
+            ix.sessions_cap = ix.sessions_cap ? ix.sessions_cap * 2 : 256;
+            ix.sessions = realloc(ix.sessions, ix.sessions_cap * sizeof(IndexedSession));
+        }
+        ix.sessions[ix.nsessions].hash = hash;
+        ix.sessions[ix.nsessions].path = strdup(argv[i]);
+        index_session(&ix, ix.nsessions++, &s);
+        session_free(&s);
+        added++;
+    }
+
+    int rc = 0, segments = x.n;
+    if (merge || !exists) {
+        rc = index_write(&ix, path);
+        segments = 1;
+    } else if (added) {
+        rc = index_append(&ix, path, x.valid);
+        segments++;
+    }
+    index_unmap(&x);
+    if (rc != 0) {
+        fprintf(stderr, "Error: cannot write %s\n", path);
+        return 1;
+    }
+    fprintf(stderr, "%s: %u sessions (%u new) in %d segment%s\n", path,
+            merge ? ix.nsessions : known + added, added, segments, segments == 1 ? "" : "s");
+
+    for (uint32_t i = 0; i < ix.nsessions; i++) free(ix.sessions[i].path);
+    for (uint32_t t = 0; t < ix.nterms; t++) {
+        free(ix.terms[t].name);
+        free(ix.terms[t].p);
+    }
+    free(ix.sessions);
+    free(ix.terms);
+    free(ix.slots);
+    free(seen.keys);
+    free(seen.used);
+    return failures ? 1 : 0;
+}
+
+typedef struct {
+    const IndexFile *f;
+    const unsigned char **terms;
+    int nterms;
+    int under;                  /* latency limit in 0.1 ms, or -1 */
+    long matches;
+} Query;
+
+static int latency_ok(const Query *q, int latency) {
+    return q->under < 0 || latency == NO_LATENCY || latency < q->under;
+}
+
+static void query_candidate(void *ctx, uint32_t id, uint16_t latency) {
+    Query *q = ctx;
+    if (!latency_ok(q, latency)) return;
+    for (int t = 1; t < q->nterms; t++) {
+        int l = postings_lookup(q->f, q->terms[t], id);
+        if (l < 0 || !latency_ok(q, l)) return;
+    }
+    size_t len;
+    const char *path = session_path(q->f, id, &len);
+    if (latency == NO_LATENCY) printf("%.*s\n", (int)len, path);
+    else printf("%.*s\t%.1f\n", (int)len, path, latency / 10.0);
+    q->matches++;
+}
+
+static int cmd_query(int argc, char *argv[]) {
+    IndexSet x;
+    if (index_map(argv[0], &x) != 0) {
+        fprintf(stderr, "Error: cannot read index %s\n", argv[0]);
+        return 1;
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    Query q = { NULL, calloc((size_t)argc, sizeof(*q.terms)), 0, -1, 0 };
+    int under_given = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--under") && i + 1 < argc) {
+            q.under = (int)lround(atof(argv[++i]) * 10.0);
+            under_given++;
+        }
+    }
+    if (argc - 1 - 2 * under_given == 0) {
+        fprintf(stderr, "Usage: session_index query archive.ktsi [--under ms] TERM [TERM ...]\n");
+        free(q.terms);
+        index_unmap(&x);
+        return 1;
+    }
+
+    /* Sessions live in exactly one segment, so each is queried on its own */
+    for (int g = 0; g < x.n; g++) {
+        const IndexFile *f = &x.seg[g];
+        q.f = f;
+        q.nterms = 0;
+        uint32_t smallest = 0;
+        int missing = 0;
+        for (int i = 1; i < argc && !missing; i++) {
+            if (!strcmp(argv[i], "--under") && i + 1 < argc) {
+                i++;
+                continue;
+            }
+            const unsigned char *t = term_find(f, argv[i]);
+            if (!t) {
+                missing = 1;
+                break;
+            }
+            /* Drive the intersection from the shortest posting list */
+            q.terms[q.nterms++] = t;
+            if (q.nterms > 1 && get_le(t + 8, 4) < get_le(q.terms[smallest] + 8, 4)) smallest = q.nterms - 1;
+        }
+        if (missing) continue;
+        const unsigned char *first = q.terms[smallest];
+        q.terms[smallest] = q.terms[0];
+        q.terms[0] = first;
+        postings_each(f, first, query_candidate, &q);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    fprintf(stderr, "%ld sessions (%.3f ms)\n", q.matches,
+            (double)(t1.tv_sec - t0.tv_sec) * 1e3 + (double)(t1.tv_nsec - t0.tv_nsec) / 1e6);
+    free(q.terms);
+    index_unmap(&x);
+    return 0;
+}
+
+/* Name of a segment's t-th term */
+static const char *term_name(const IndexFile *f, uint32_t t, size_t *len) {
+    const unsigned char *e = f->terms + (size_t)t * TERM_ENTRY;
+    *len = (size_t)get_le(e + 4, 4);
+    return (const char *)f->strings + get_le(e, 4);
+}
+
+static int name_cmp(const char *a, size_t alen, const char *b, size_t blen) {
+    int c = memcmp(a, b, alen < blen ? alen : blen);
+    return c ? c : (alen > blen) - (alen < blen);
+}
+
+/* Merges the segments' sorted term directories, summing cardinalities */
+static int cmd_terms(int argc, char *argv[]) {
+    IndexSet x;
+    if (index_map(argv[0], &x) != 0) {
+        fprintf(stderr, "Error: cannot read index %s\n", argv[0]);
+        return 1;
+    }
+    const char *prefix = argc > 1 ? argv[1] : "";
+    size_t plen = strlen(prefix);
+    uint32_t next[INDEX_MAX_SEGMENTS] = {0};
+    for (;;) {
+        const char *name = NULL;
+        size_t len = 0;
+        for (int g = 0; g < x.n; g++) {
+            if (next[g] == x.seg[g].nterms) continue;
+            size_t l;
+            const char *n = term_name(&x.seg[g], next[g], &l);
+            if (!name || name_cmp(n, l, name, len) < 0) {
+                name = n;
+                len = l;
+            }
+        }
+        if (!name) break;
+        uint64_t count = 0;
+        for (int g = 0; g < x.n; g++) {
+            if (next[g] == x.seg[g].nterms) continue;
+            size_t l;
+            const char *n = term_name(&x.seg[g], next[g], &l);
+            if (name_cmp(n, l, name, len) == 0) {
+                count += get_le(x.seg[g].terms + (size_t)next[g] * TERM_ENTRY + 8, 4);
+                next[g]++;
+            }
+        }
+        if (len < plen || memcmp(name, prefix, plen) != 0) continue;
+        printf("%.*s\t%llu\n", (int)len, name, (unsigned long long)count);
+    }
+    index_unmap(&x);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 4 && !strcmp(argv[1], "add")) return cmd_add(argc - 2, argv + 2);
+    if (argc >= 4 && !strcmp(argv[1], "query")) return cmd_query(argc - 2, argv + 2);
+    if (argc >= 3 && !strcmp(argv[1], "terms")) return cmd_terms(argc - 2, argv + 2);
+
+    fprintf(stderr, "Usage: %s add archive.ktsi session.csv [more.csv ...]\n", argv[0]);
+    fprintf(stderr, "       %s query archive.ktsi [--under ms] TERM [TERM ...]\n", argv[0]);
+    fprintf(stderr, "       %s terms archive.ktsi [prefix]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,617 @@
+/*
+ * session_render.c - Keyboard heatmaps and key timelines as PNG or SVG (POSIX)
+ *
+ *   heatmap   the keyboard of keyboard_geometry.h, each key coloured by
+ *             its press count or mean dwell (-m count|dwell)
+ *   timeline  one strip per key that was pressed, time left to right;
+ *             each pixel column is a time bin coloured by how long the key
+ *             was held in it (square root, relative to the busiest bin)
+ *
+ * Nothing is drawn per event. The session file is mapped and cut into
+ * line-aligned chunks that worker threads parse in parallel straight into
+ * per-thread bins (presses and dwell per key, held time per key and
+ * timeline column), so memory is bounded by the image, not the session.
+ * A press whose key_down and key_up fall in different chunks is stitched
+ * together afterwards, in chunk order. The image is then rasterized in
+ * bands of TILE_ROWS rows, one worker per core; for PNG each band is
+ * deflated on its own and the raw deflate streams are concatenated into
+ * one zlib stream, with the Adler-32 checksums combined. SVG has key
+ * labels; PNG has none, to stay free of font data.
+ *
+ * Characters are placed on keys with the chosen layout; those it does not
+ * place share an "other" strip in the timeline.
+ *
+ * Build: make session_render (see Makefile)
+ * Usage: ./session_render heatmap [-m count|dwell] [-l layout] [-@ threads] session.csv out.png|out.svg
+ *        ./session_render timeline [-w width] [-l layout] [-@ threads] session.csv out.png|out.svg
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "session.h"
+#include "keyboard_geometry.h"
+
+#define ROWS (GK_COUNT + 1)         /* every key, then "other" */
+#define TILE_ROWS 32
+#define KEY_PX 56                   /* one key width in the heatmap */
+#define PAD_PX 16
+#define LEGEND_PX 12
+#define STRIP_PX 12                 /* timeline strip, 1 px gap included */
+#define LABEL_PX 96                 /* SVG timeline label column */
+
+enum { MODE_HEATMAP, MODE_TIMELINE };
+
+typedef struct {
+    uint64_t presses[ROWS];
+    double dwell_sum[ROWS];
+    uint64_t dwell_n[ROWS];
+    float *held;                    /* [ROWS][width], ms */
+} Bins;
+
+typedef struct {
+    int32_t keycode;
+    int16_t row;
+    double t;
+} Edge;
+
+/* What a chunk leaves to its neighbours */
+typedef struct {
+    Edge *orphans;                  /* key_ups before any key_down of the keycode */
+    Edge *opens;                    /* key_downs still held at the chunk end */
+    Edge *fresh;                    /* keycodes whose first event is a key_down */
+    size_t norphans, nopens, nfresh, cap_orphans, cap_opens, cap_fresh;
+} Boundary;
+
+typedef struct {
+    int mode;
+    const KeyboardLayout *layout;
+    int width;                      /* timeline columns */
+    double t0, bin_ms;
+    const char **starts;            /* chunk i is [starts[i], starts[i + 1]) */
+    size_t nchunks;
+    Boundary *boundaries;
+    Bins *bins;                     /* one per thread */
+    size_t next;                    /* claimed with __atomic_fetch_add */
+} Scan;
+
+static void edge_push(Edge **v, size_t *n, size_t *cap, int32_t keycode, int row, double t) {
+    if (*n == *cap) {
+        *cap = *cap ? *cap * 2 : 64;
+        *v = realloc(*v, *cap * sizeof(Edge));
+    }
+    (*v)[*n].keycode = keycode;
+    (*v)[*n].row = (int16_t)row;
+    (*v)[(*n)++].t = t;
+}
+
+/* One press, key_down to key_up: its dwell, and held time per column */
+static void add_press(const Scan *sc, Bins *b, int row, double down, double up) {
+    if (up < down) return;
+    b->dwell_sum[row] += up - down;
+    b->dwell_n[row]++;
+    if (!b->held) return;
+    float *h = b->held + (size_t)row * (size_t)sc->width;
+    double a = (down - sc->t0) / sc->bin_ms, z = (up - sc->t0) / sc->bin_ms;
+    double last = sc->width - 1e-9;
+    if (a < 0) a = 0;
+    if (z < 0) z = 0;
+    if (a > last) a = last;
+    if (z > last) z = last;
+    int i0 = (int)a, i1 = (int)z;
+    if (i0 == i1) {
+        h[i0] += (float)((z - a) * sc->bin_ms);
+        return;
+    }
+    h[i0] += (float)((i0 + 1 - a) * sc->bin_ms);
+    for (int i = i0 + 1; i < i1; i++) h[i] += (float)sc->bin_ms;
+    h[i1] += (float)((z - i1) * sc->bin_ms);
+}
+
+static void scan_chunk(const Scan *sc, size_t chunk, Bins *b, double *down_at, int16_t *down_row) {
+    Boundary *bd = &sc->boundaries[chunk];
+    for (int k = 0; k < 65536; k++) down_row[k] = -1;     /* -1 untouched, -2 seen and up */
+    const char *p = sc->starts[chunk], *end = sc->starts[chunk + 1];
+    while (p < end) {
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        const char *le = nl ? nl : end;
+        SessionEvent e;
+        if (le > p && session_parse_row(p, le, &e) == 0) {
+            int kc = e.keycode & 0xFFFF;
+            if (e.type == SESSION_KEY_UP) {
+                if (down_row[kc] >= 0) add_press(sc, b, down_row[kc], down_at[kc], e.timestamp_ms);
+                else if (down_row[kc] == -1)
+                    edge_push(&bd->orphans, &bd->norphans, &bd->cap_orphans, kc, -1, e.timestamp_ms);
+                down_row[kc] = -2;
+            } else if (e.type == SESSION_KEY_DOWN && !e.is_repeat) {
+                int key = geometry_lookup(sc->layout, e.character);
+                int row = key >= 0 ? key : GK_COUNT;
+                b->presses[row]++;
+                if (down_row[kc] == -1) edge_push(&bd->fresh, &bd->nfresh, &bd->cap_fresh, kc, row, e.timestamp_ms);
+                down_row[kc] = (int16_t)row;
+                down_at[kc] = e.timestamp_ms;
+            }
+        }
+        p = nl ? nl + 1 : end;
+    }
+    for (int k = 0; k < 65536; k++)
+        if (down_row[k] >= 0) edge_push(&bd->opens, &bd->nopens, &bd->cap_opens, k, down_row[k], down_at[k]);
+}
+
+typedef struct {
+    Scan *sc;
+    int thread;
+} ScanArg;
+
+static void *scan_worker(void *arg) {
+    ScanArg *a = arg;
+    Scan *sc = a->sc;
+    double *down_at = malloc(65536 * sizeof(double));
+    int16_t *down_row = malloc(65536 * sizeof(int16_t));
+    for (;;) {
+        size_t i = __atomic_fetch_add(&sc->next, 1, __ATOMIC_RELAXED);
+        if (i >= sc->nchunks) break;
+        scan_chunk(sc, i, &sc->bins[a->thread], down_at, down_row);
+    }
+    free(down_at);
+    free(down_row);
+    return NULL;
+}
+
+/* ---- colour ---- */
+
+typedef struct {
+    unsigned char r, g, b;
+} Rgb;
+
+static const Rgb BACKGROUND = { 28, 28, 28 };
+static const Rgb UNUSED_KEY = { 58, 58, 58 };
+
+/* Perceptually ordered dark-to-bright ramp (inferno-like), f in 0..1 */
+static Rgb ramp(double f) {
+    static const double stops[5][3] = {
+        { 0, 0, 4 }, { 87, 16, 110 }, { 188, 55, 84 }, { 249, 142, 9 }, { 252, 255, 164 },
+    };
+    if (!(f > 0)) f = 0;
+    if (f > 1) f = 1;
+    double pos = f * 4;
+    int i = pos >= 4 ? 3 : (int)pos;
+    double w = pos - i;
+    Rgb c;
+    c.r = (unsigned char)(stops[i][0] + w * (stops[i + 1][0] - stops[i][0]) + 0.5);
+    c.g = (unsigned char)(stops[i][1] + w * (stops[i + 1][1] - stops[i][1]) + 0.5);
+    c.b = (unsigned char)(stops[i][2] + w * (stops[i + 1][2] - stops[i][2]) + 0.5);
+    return c;
+}
+
+/* ---- what to draw ---- */
+
+typedef struct {
+    int mode;
+    int w, h;
+    /* heatmap */
+    double value[GK_COUNT];         /* NAN if never pressed */
+    double vmax;
+    /* timeline */
+    const Bins *bins;
+    int strips[ROWS], nstrips;
+    double held_max;                /* busiest cell, the top of the ramp */
+} Picture;
+
+static void key_rect(int k, double *x0, double *y0, double *x1, double *y1) {
+    const KeyGeometry *g = &geometry_keys[k];
+    *x0 = PAD_PX + (g->x - g->width / 2) * KEY_PX + 2;
+    *x1 = PAD_PX + (g->x + g->width / 2) * KEY_PX - 2;
+    *y0 = PAD_PX + g->row * KEY_PX + 2;
+    *y1 = PAD_PX + (g->row + 1) * KEY_PX - 2;
+}
+
+static void fill(unsigned char *px, int from, int to, Rgb c) {
+    for (int x = from; x < to; x++) {
+        px[3 * x] = c.r;
+        px[3 * x + 1] = c.g;
+        px[3 * x + 2] = c.b;
+    }
+}
+
+/* Square root, so brief presses in a wide column still show */
+static double held_level(const Picture *pic, float held) {
+    return sqrt(held / pic->held_max);
+}
+
+static void paint_row(const Picture *pic, int y, unsigned char *px) {
+    fill(px, 0, pic->w, BACKGROUND);
+    if (pic->mode == MODE_HEATMAP) {
+        int legend = PAD_PX + 5 * KEY_PX + PAD_PX / 2;
+        if (y >= legend && y < legend + LEGEND_PX) {
+            for (int x = PAD_PX; x < pic->w - PAD_PX; x++)
+                fill(px, x, x + 1, ramp((double)(x - PAD_PX) / (pic->w - 2 * PAD_PX - 1)));
+            return;
+        }
+        for (int k = 0; k < GK_COUNT; k++) {
+            double x0, y0, x1, y1;
+            key_rect(k, &x0, &y0, &x1, &y1);
+            if (y < y0 || y >= y1) continue;
+            Rgb c = isnan(pic->value[k]) ? UNUSED_KEY : ramp(pic->vmax > 0 ? pic->value[k] / pic->vmax : 0);
+            fill(px, (int)x0, (int)x1, c);
+        }
+        return;
+    }
+    int strip = y / STRIP_PX;
+    if (strip >= pic->nstrips || y % STRIP_PX == STRIP_PX - 1) return;
+    const float *h = pic->bins->held + (size_t)pic->strips[strip] * (size_t)pic->w;
+    for (int x = 0; x < pic->w; x++)
+        if (h[x] > 0) fill(px, x, x + 1, ramp(held_level(pic, h[x])));
+}
+
+/* ---- PNG: bands rasterized and deflated in parallel ---- */
+
+typedef struct {
+    unsigned char *z;
+    size_t zlen;
+    uLong adler;
+    size_t raw_len;
+} Band;
+
+typedef struct {
+    const Picture *pic;
+    Band *bands;
+    int nbands;
+    int next;                       /* claimed with __atomic_fetch_add */
+} Raster;
+
+static void *raster_worker(void *arg) {
+    Raster *r = arg;
+    const Picture *pic = r->pic;
+    size_t stride = 1 + 3 * (size_t)pic->w;
+    unsigned char *raw = malloc(stride * TILE_ROWS);
+    for (;;) {
+        int i = __atomic_fetch_add(&r->next, 1, __ATOMIC_RELAXED);
+        if (i >= r->nbands) break;
+        int y0 = i * TILE_ROWS, y1 = y0 + TILE_ROWS < pic->h ? y0 + TILE_ROWS : pic->h;
+        for (int y = y0; y < y1; y++) {
+            unsigned char *line = raw + (size_t)(y - y0) * stride;
+            line[0] = 0;            /* filter: none */
+            paint_row(pic, y, line + 1);
+        }
+        Band *b = &r->bands[i];
+        b->raw_len = (size_t)(y1 - y0) * stride;
+        b->adler = adler32(adler32(0, NULL, 0), raw, (uInt)b->raw_len);
+
+        /* Raw deflate; every band but the last ends byte-aligned with a sync flush */
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        size_t cap = deflateBound(&zs, (uLong)b->raw_len) + 64;
+        b->z = malloc(cap);
+        zs.next_in = raw;
+        zs.avail_in = (uInt)b->raw_len;
+        zs.next_out = b->z;
+        zs.avail_out = (uInt)cap;
+        deflate(&zs, i == r->nbands - 1 ? Z_FINISH : Z_SYNC_FLUSH);
+        b->zlen = cap - zs.avail_out;
+        deflateEnd(&zs);
+    }
+    free(raw);
+    return NULL;
+}
+
+static void put_be32(unsigned char *p, uint32_t v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static void png_chunk(FILE *f, const char *type, const unsigned char *data, size_t len) {
+    unsigned char head[8];
+    put_be32(head, (uint32_t)len);
+    memcpy(head + 4, type, 4);
+    fwrite(head, 1, 8, f);
+    if (len) fwrite(data, 1, len, f);
+    uLong crc = crc32(crc32(0, NULL, 0), (const Bytef *)type, 4);
+    if (len) crc = crc32(crc, data, (uInt)len);
+    put_be32(head, (uint32_t)crc);
+    fwrite(head, 1, 4, f);
+}
+
+static int write_png(const char *path, const Picture *pic, int threads) {
+    Raster r = { pic, NULL, (pic->h + TILE_ROWS - 1) / TILE_ROWS, 0 };
+    r.bands = calloc((size_t)r.nbands, sizeof(Band));
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, raster_worker, &r);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+
+    size_t total = 2 + 4;
+    uLong adler = adler32(0, NULL, 0);
+    for (int i = 0; i < r.nbands; i++) {
+        total += r.bands[i].zlen;
+        adler = adler32_combine(adler, r.bands[i].adler, (z_off_t)r.bands[i].raw_len);
+    }
+    unsigned char *idat = malloc(total), *p = idat;
+    *p++ = 0x78;                    /* zlib header: deflate, 32K window */
+    *p++ = 0x9c;
+    for (int i = 0; i < r.nbands; i++) {
+        memcpy(p, r.bands[i].z, r.bands[i].zlen);
+        p += r.bands[i].zlen;
+        free(r.bands[i].z);
+    }
+    put_be32(p, (uint32_t)adler);
+    free(r.bands);
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        free(idat);
+        return -1;
+    }
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    unsigned char ihdr[13];
+    put_be32(ihdr, (uint32_t)pic->w);
+    put_be32(ihdr + 4, (uint32_t)pic->h);
+    ihdr[8] = 8;                    /* bit depth */
+    ihdr[9] = 2;                    /* truecolour */
+    ihdr[10] = ihdr[11] = ihdr[12] = 0;
+    fwrite(signature, 1, 8, f);
+    png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    png_chunk(f, "IDAT", idat, total);
+    png_chunk(f, "IEND", NULL, 0);
+    free(idat);
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* ---- SVG ---- */
+
+static const char *key_label(int row, char *buf, size_t len) {
+    if (row == GK_COUNT) return "other";
+    const char *name = geometry_keys[row].name + 3;     /* past "GK_" */
+    size_t i = 0;
+    for (; name[i] && i + 1 < len; i++) buf[i] = (char)tolower((unsigned char)name[i]);
+    buf[i] = '\0';
+    return buf;
+}
+
+static int write_svg(const char *path, const Picture *pic, const char *what) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    char label[32];
+    int w = pic->mode == MODE_TIMELINE ? pic->w + LABEL_PX : pic->w;
+    fprintf(f, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+               "font-family=\"sans-serif\" font-size=\"11\">\n", w, pic->h);
+    fprintf(f, "<rect width=\"100%%\" height=\"100%%\" fill=\"#%02x%02x%02x\"/>\n",
+            BACKGROUND.r, BACKGROUND.g, BACKGROUND.b);
+    if (pic->mode == MODE_HEATMAP) {
+        for (int k = 0; k < GK_COUNT; k++) {
+            double x0, y0, x1, y1;
+            key_rect(k, &x0, &y0, &x1, &y1);
+            int unused = isnan(pic->value[k]);
+            Rgb c = unused ? UNUSED_KEY : ramp(pic->vmax > 0 ? pic->value[k] / pic->vmax : 0);
+            fprintf(f, "<g><title>%s: %.1f %s</title><rect x=\"%.0f\" y=\"%.0f\" width=\"%.0f\" height=\"%.0f\" "
+                       "rx=\"4\" fill=\"#%02x%02x%02x\"/>",
+                    key_label(k, label, sizeof(label)), unused ? 0.0 : pic->value[k], what, x0, y0, x1 - x0,
+                    y1 - y0, c.r, c.g, c.b);
+            fprintf(f, "<text x=\"%.0f\" y=\"%.0f\" fill=\"%s\">%s</text></g>\n", x0 + 4, y0 + 14,
+                    !unused && pic->value[k] > pic->vmax * 0.6 ? "#000" : "#ddd", key_label(k, label, sizeof(label)));
+        }
+        int legend = PAD_PX + 5 * KEY_PX + PAD_PX / 2;
+        fprintf(f, "<defs><linearGradient id=\"ramp\">");
+        for (int i = 0; i <= 8; i++) {
+            Rgb c = ramp(i / 8.0);
+            fprintf(f, "<stop offset=\"%d%%\" stop-color=\"#%02x%02x%02x\"/>", i * 100 / 8, c.r, c.g, c.b);
+        }
+        fprintf(f, "</linearGradient></defs>\n");
+        fprintf(f, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"url(#ramp)\"/>\n", PAD_PX, legend,
+                pic->w - 2 * PAD_PX, LEGEND_PX);
+        fprintf(f, "<text x=\"%d\" y=\"%d\" fill=\"#ddd\">0</text>\n", PAD_PX, legend + LEGEND_PX + 12);
+        fprintf(f, "<text x=\"%d\" y=\"%d\" fill=\"#ddd\" text-anchor=\"end\">%.1f %s</text>\n", pic->w - PAD_PX,
+                legend + LEGEND_PX + 12, pic->vmax, what);
+    } else {
+        /* Runs of columns in the same colour step become one rect */
+        for (int s = 0; s < pic->nstrips; s++) {
+            int y = s * STRIP_PX;
+            fprintf(f, "<text x=\"4\" y=\"%d\" fill=\"#ddd\">%s</text>\n", y + STRIP_PX - 2,
+                    key_label(pic->strips[s], label, sizeof(label)));
+            const float *h = pic->bins->held + (size_t)pic->strips[s] * (size_t)pic->w;
+            for (int x = 0; x < pic->w;) {
+                int level = h[x] > 0 ? 1 + (int)(held_level(pic, h[x]) * 31) : 0;
+                int run = x + 1;
+                while (run < pic->w && (h[run] > 0 ? 1 + (int)(held_level(pic, h[run]) * 31) : 0) == level) run++;
+                if (level) {
+                    Rgb c = ramp((level - 1) / 31.0);
+                    fprintf(f, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%02x%02x%02x\"/>\n",
+                            LABEL_PX + x, y, run - x, STRIP_PX - 1, c.r, c.g, c.b);
+                }
+                x = run;
+            }
+        }
+    }
+    fprintf(f, "</svg>\n");
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+/* ---- main ---- */
+
+static int has_suffix(const char *path, const char *suffix) {
+    size_t n = strlen(path), m = strlen(suffix);
+    return n >= m && !strcmp(path + n - m, suffix);
+}
+
+/* Timestamp of the data row starting at p, NAN if it does not parse */
+static double row_time(const char *p, const char *end) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    SessionEvent e;
+    return session_parse_row(p, nl ? nl : end, &e) == 0 ? e.timestamp_ms : NAN;
+}
+
+static int usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s heatmap [-m count|dwell] [-l layout] [-@ threads] session.csv out.png|out.svg\n",
+            argv0);
+    fprintf(stderr, "       %s timeline [-w width] [-l layout] [-@ threads] session.csv out.png|out.svg\n", argv0);
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) return usage(argv[0]);
+    int mode;
+    if (!strcmp(argv[1], "heatmap")) mode = MODE_HEATMAP;
+    else if (!strcmp(argv[1], "timeline")) mode = MODE_TIMELINE;
+    else return usage(argv[0]);
+
+    const KeyboardLayout *layout = &geometry_layouts[0];
+    int dwell = 0, width = 1600, threads = (int)sysconf(_SC_NPROCESSORS_ONLN), bad = 0;
+    int argi = 2;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        if (!strcmp(argv[argi], "-m") && mode == MODE_HEATMAP) {
+            dwell = !strcmp(argv[argi + 1], "dwell");
+            bad |= !dwell && strcmp(argv[argi + 1], "count");
+        } else if (!strcmp(argv[argi], "-w") && mode == MODE_TIMELINE) width = atoi(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-l")) layout = geometry_layout(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-@")) threads = atoi(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi + 2 != argc || bad || !layout || threads < 1 || width < 1 || width > 65536) return usage(argv[0]);
+    const char *in = argv[argi], *out = argv[argi + 1];
+    int svg = has_suffix(out, ".svg");
+    if (!svg && !has_suffix(out, ".png")) {
+        fprintf(stderr, "Error: %s: output must end in .png or .svg\n", out);
+        return 1;
+    }
+
+    int fd = open(in, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Error: cannot read %s\n", in);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    size_t size = (size_t)st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Error: cannot map %s\n", in);
+        return 1;
+    }
+    const char *end = data + size;
+
+    /* Data starts after the metadata and the header line */
+    const char *p = data;
+    int header_seen = 0;
+    while (p < end && (*p == '#' || !header_seen)) {
+        if (*p != '#') header_seen = 1;
+        const char *nl = memchr(p, '\n', (size_t)(end - p));
+        p = nl ? nl + 1 : end;
+    }
+    const char *last = end;
+    while (last > p && (last[-1] == '\n' || last[-1] == '\r')) last--;
+    while (last > p && last[-1] != '\n') last--;
+    double t0 = p < end ? row_time(p, end) : NAN, t1 = p < end ? row_time(last, end) : NAN;
+    if (isnan(t0) || isnan(t1)) {
+        fprintf(stderr, "Error: no events in %s\n", in);
+        munmap((void *)data, size);
+        return 1;
+    }
+
+    /* Line-aligned chunks, several per thread to even out the load */
+    size_t nchunks = (size_t)threads * 8, span = (size_t)(end - p);
+    if (nchunks > span / 4096 + 1) nchunks = span / 4096 + 1;
+    const char **starts = malloc((nchunks + 1) * sizeof(char *));
+    starts[0] = p;
+    for (size_t i = 1; i < nchunks; i++) {
+        const char *s = p + span / nchunks * i;
+        if (s < starts[i - 1]) s = starts[i - 1];
+        const char *nl = memchr(s, '\n', (size_t)(end - s));
+        starts[i] = nl ? nl + 1 : end;
+    }
+    starts[nchunks] = end;
+
+    Scan sc = { mode, layout, width, t0, t1 > t0 ? (t1 - t0) / width : 1.0, starts, nchunks,
+                calloc(nchunks, sizeof(Boundary)), calloc((size_t)threads, sizeof(Bins)), 0 };
+    size_t cells = (size_t)ROWS * (size_t)width;
+    for (int t = 0; t < threads; t++)
+        if (mode == MODE_TIMELINE) sc.bins[t].held = calloc(cells, sizeof(float));
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    ScanArg *args = malloc((size_t)threads * sizeof(ScanArg));
+    for (int t = 0; t < threads; t++) {
+        args[t] = (ScanArg){ &sc, t };
+        pthread_create(&tids[t], NULL, scan_worker, &args[t]);
+    }
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+    free(args);
+
+    /* Merge thread bins into the first, then stitch presses across chunks */
+    Bins *all = &sc.bins[0];
+    for (int t = 1; t < threads; t++) {
+        for (int r = 0; r < ROWS; r++) {
+            all->presses[r] += sc.bins[t].presses[r];
+            all->dwell_sum[r] += sc.bins[t].dwell_sum[r];
+            all->dwell_n[r] += sc.bins[t].dwell_n[r];
+        }
+        if (mode == MODE_TIMELINE)
+            for (size_t i = 0; i < cells; i++) all->held[i] += sc.bins[t].held[i];
+        free(sc.bins[t].held);
+    }
+    double *carried_at = malloc(65536 * sizeof(double));
+    int16_t *carried_row = malloc(65536 * sizeof(int16_t));
+    for (int k = 0; k < 65536; k++) carried_row[k] = -1;
+    for (size_t c = 0; c < nchunks; c++) {
+        Boundary *bd = &sc.boundaries[c];
+        for (size_t i = 0; i < bd->norphans; i++) {
+            int kc = bd->orphans[i].keycode;
+            if (carried_row[kc] >= 0) add_press(&sc, all, carried_row[kc], carried_at[kc], bd->orphans[i].t);
+            carried_row[kc] = -1;
+        }
+        /* Pressed again before any release here: the carried press never ended */
+        for (size_t i = 0; i < bd->nfresh; i++) carried_row[bd->fresh[i].keycode] = -1;
+        for (size_t i = 0; i < bd->nopens; i++) {
+            carried_row[bd->opens[i].keycode] = bd->opens[i].row;
+            carried_at[bd->opens[i].keycode] = bd->opens[i].t;
+        }
+        free(bd->orphans);
+        free(bd->opens);
+        free(bd->fresh);
+    }
+    free(carried_at);
+    free(carried_row);
+    free(sc.boundaries);
+    free(starts);
+    munmap((void *)data, size);
+
+    Picture pic = { .mode = mode, .bins = all };
+    uint64_t presses = 0;
+    for (int r = 0; r < ROWS; r++) presses += all->presses[r];
+    if (mode == MODE_HEATMAP) {
+        pic.w = (int)(15 * KEY_PX) + 2 * PAD_PX;
+        pic.h = 5 * KEY_PX + PAD_PX + PAD_PX / 2 + LEGEND_PX + PAD_PX + (svg ? 12 : 0);
+        for (int k = 0; k < GK_COUNT; k++) {
+            double v = dwell ? (all->dwell_n[k] ? all->dwell_sum[k] / (double)all->dwell_n[k] : NAN)
+                             : (all->presses[k] ? (double)all->presses[k] : NAN);
+            pic.value[k] = v;
+            if (!isnan(v) && v > pic.vmax) pic.vmax = v;
+        }
+    } else {
+        for (int r = 0; r < ROWS; r++)
+            if (all->presses[r]) pic.strips[pic.nstrips++] = r;
+        for (size_t i = 0; i < cells; i++)
+            if (all->held[i] > pic.held_max) pic.held_max = all->held[i];
+        pic.w = width;
+        pic.h = pic.nstrips ? pic.nstrips * STRIP_PX : 1;
+    }
+
+    int rc = svg ? write_svg(out, &pic, dwell ? "ms" : "presses") : write_png(out, &pic, threads);
+    free(all->held);
+    free(sc.bins);
+    if (rc != 0) {
+        fprintf(stderr, "Error: cannot write %s\n", out);
+        return 1;
+    }
+    fprintf(stderr, "Wrote %s (%dx%d) from %llu presses over %.1f s\n", out,
+            svg && mode == MODE_TIMELINE ? pic.w + LABEL_PX : pic.w, pic.h, (unsigned long long)presses,
+            (t1 - t0) / 1000.0);
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * session_rhythm.c - Spectral rhythm features of keystroke timing (POSIX)
+ *
+ * Resamples each session's key presses (auto-repeat ignored) into an
+ * onset train at -r Hz, cuts it into Hann-windowed frames of -n samples
+ * with 50% overlap, and takes each frame's power spectrum with a real
+ * FFT. Frames with fewer than MIN_ONSETS presses (idle) are skipped. Per
+ * session it reports one CSV row:
+ *
+ *   dominant_hz       median over frames of the strongest frequency in
+ *                     MIN_HZ..MAX_HZ (parabolic interpolation between bins)
+ *   dominant_iqr_hz   its interquartile range across frames
+ *   stability         share of frames whose peak lies within 10% of the
+ *                     median, 1 = perfectly steady rhythm
+ *   peak_ratio        median of peak power over mean in-band power
+ *   peak1..3_hz       the three largest local maxima of the frame-averaged
+ *                     spectrum
+ *
+ * The FFT is an iterative radix-2 transform on split real/imaginary
+ * arrays (which the compiler vectorizes), run at half length on the
+ * even/odd samples and untangled into the real spectrum. Its plan
+ * (twiddles, bit reversal) is built once and shared read-only; each
+ * worker thread owns its frame buffers and claims sessions from a shared
+ * counter.
+ *
+ * Build: make session_rhythm (see Makefile)
+ * Usage: ./session_rhythm [-r hz] [-n samples] [-@ threads] session.csv [more.csv ...]
+ *        -r defaults to 100 Hz, -n (a power of two) to 2048 (20.48 s),
+ *        threads to the number of online CPUs. A "-" argument reads
+ *        further paths from stdin, one per line.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include "session.h"
+
+#define MIN_HZ 0.5
+#define MAX_HZ 12.0
+#define MIN_ONSETS 20
+#define PEAKS 3
+
+/* ---- Real FFT ---- */
+
+typedef struct {
+    int n, m;                   /* real length, complex length n / 2 */
+    int *bitrev;                /* m */
+    float *tw_re, *tw_im;       /* m / 2, e^(-2 pi i k / m) */
+    float *rw_re, *rw_im;       /* m, e^(-2 pi i k / n) for untangling */
+    float *hann;                /* n */
+} FftPlan;
+
+static int fft_plan(FftPlan *p, int n) {
+    if (n < 4 || (n & (n - 1))) return -1;
+    p->n = n;
+    p->m = n / 2;
+    p->bitrev = malloc((size_t)p->m * sizeof(int));
+    p->tw_re = malloc((size_t)p->m / 2 * sizeof(float));
+    p->tw_im = malloc((size_t)p->m / 2 * sizeof(float));
+    p->rw_re = malloc((size_t)p->m * sizeof(float));
+    p->rw_im = malloc((size_t)p->m * sizeof(float));
+    p->hann = malloc((size_t)n * sizeof(float));
+    int bits = 0;
+    while ((1 << bits) < p->m) bits++;
+    for (int i = 0; i < p->m; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) r |= ((i >> b) & 1) << (bits - 1 - b);
+        p->bitrev[i] = r;
+    }
+    for (int k = 0; k < p->m / 2; k++) {
+        p->tw_re[k] = (float)cos(2 * M_PI * k / p->m);
+        p->tw_im[k] = (float)-sin(2 * M_PI * k / p->m);
+    }
+    for (int k = 0; k < p->m; k++) {
+        p->rw_re[k] = (float)cos(2 * M_PI * k / n);
+        p->rw_im[k] = (float)-sin(2 * M_PI * k / n);
+    }
+    for (int i = 0; i < n; i++) p->hann[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / n));
+    return 0;
+}
+
+static void fft_plan_free(FftPlan *p) {
+    free(p->bitrev);
+    free(p->tw_re);
+    free(p->tw_im);
+    free(p->rw_re);
+    free(p->rw_im);
+    free(p->hann);
+}
+
+/*
+ * Power spectrum of n real samples x into power[0..n/2]. re and im are
+ * scratch arrays of n / 2 floats.
+ */
+static void fft_power(const FftPlan *p, const float *x, float *re, float *im, float *power) {
+    int m = p->m;
+    for (int i = 0; i < m; i++) {
+        int j = p->bitrev[i];
+        re[j] = x[2 * i];
+        im[j] = x[2 * i + 1];
+    }
+    for (int len = 2; len <= m; len <<= 1) {
+        int half = len >> 1, step = m / len;
+        for (int start = 0; start < m; start += len) {
+            float *ar = re + start, *ai = im + start, *br = ar + half, *bi = ai + half;
+            for (int k = 0; k < half; k++) {
+                float wr = p->tw_re[k * step], wi = p->tw_im[k * step];
+                float tr = br[k] * wr - bi[k] * wi;
+                float ti = br[k] * wi + bi[k] * wr;
+                br[k] = ar[k] - tr;
+                bi[k] = ai[k] - ti;
+                ar[k] += tr;
+                ai[k] += ti;
+            }
+        }
+    }
+    /* X[k] = E[k] + W^k O[k], from Z = FFT(even + i odd) */
+    for (int k = 0; k <= m; k++) {
+        int a = k % m, b = (m - k) % m;
+        float er = 0.5f * (re[a] + re[b]), ei = 0.5f * (im[a] - im[b]);
+        float or_ = 0.5f * (im[a] + im[b]), oi = -0.5f * (re[a] - re[b]);
+        float wr = k < m ? p->rw_re[k] : -1.0f, wi = k < m ? p->rw_im[k] : 0.0f;
+        float xr = er + wr * or_ - wi * oi;
+        float xi = ei + wr * oi + wi * or_;
+        power[k] = xr * xr + xi * xi;
+    }
+}
+
+/* ---- Analysis ---- */
+
+typedef struct {
+    char *path;
+    int ok;                     /* 1 = analyzed, 0 = no active frames, -1 = unreadable */
+    int frames;
+    double dominant, iqr, stability, peak_ratio;
+    double peaks[PEAKS];
+} Result;
+
+typedef struct {
+    const FftPlan *plan;
+    double rate;
+    Result *results;
+    size_t count;
+    size_t next;                /* claimed with __atomic_fetch_add */
+} Work;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double quantile(double *v, int n, double q) {
+    double pos = q * (n - 1);
+    int i = (int)pos;
+    return i + 1 < n ? v[i] + (pos - i) * (v[i + 1] - v[i]) : v[i];
+}
+
+static void analyze(const FftPlan *p, double rate, Result *r, float *frame, float *re, float *im,
+                    float *power, double *avg) {
+    Session s;
+    if (session_load(r->path, &s) != 0) {
+        r->ok = -1;
+        return;
+    }
+
+    /* Onset train, spanning the earliest to the latest press whatever their order */
+    double t0 = NAN, t1 = NAN;
+    for (size_t i = 0; i < s.count; i++) {
+        const SessionEvent *e = &s.events[i];
+        if (e->type != SESSION_KEY_DOWN || e->is_repeat || !isfinite(e->timestamp_ms)) continue;
+        if (isnan(t0) || e->timestamp_ms < t0) t0 = e->timestamp_ms;
+        if (isnan(t1) || e->timestamp_ms > t1) t1 = e->timestamp_ms;
+    }
+    long len = isnan(t0) ? 0 : (long)((t1 - t0) * rate / 1000.0) + 1;
+    float *train = calloc((size_t)(len > p->n ? len : p->n), sizeof(float));
+    if (!train) {
+        session_free(&s);
+        r->ok = -1;
+        return;
+    }
+    for (size_t i = 0; i < s.count; i++) {
+        const SessionEvent *e = &s.events[i];
+        if (e->type != SESSION_KEY_DOWN || e->is_repeat || !isfinite(e->timestamp_ms)) continue;
+        train[(long)((e->timestamp_ms - t0) * rate / 1000.0)] += 1.0f;
+    }
+    session_free(&s);
+
+    int lo = (int)ceil(MIN_HZ * p->n / rate), hi = (int)floor(MAX_HZ * p->n / rate);
+    if (hi > p->m - 1) hi = p->m - 1;
+    int hop = p->n / 2, maxframes = len >= p->n ? (int)((len - p->n) / hop) + 1 : 1;
+    double *dom = malloc((size_t)maxframes * sizeof(double));
+    double *ratio = malloc((size_t)maxframes * sizeof(double));
+    memset(avg, 0, (size_t)(p->m + 1) * sizeof(double));
+    int frames = 0;
+
+    for (long start = 0; start + p->n <= (len > p->n ? len : p->n); start += hop) {
+        float sum = 0;
+        for (int i = 0; i < p->n; i++) sum += train[start + i];
+        if (sum < MIN_ONSETS) continue;
+        float mean = sum / (float)p->n;
+        for (int i = 0; i < p->n; i++) frame[i] = (train[start + i] - mean) * p->hann[i];
+        fft_power(p, frame, re, im, power);
+
+        int best = lo;
+        double band = 0;
+        for (int k = lo; k <= hi; k++) {
+            band += power[k];
+            if (power[k] > power[best]) best = k;
+            avg[k] += power[k];
+        }
+        double offset = 0;
+        if (best > lo && best < hi) {
+            double a = power[best - 1], b = power[best], c = power[best + 1];
+            double d = a - 2 * b + c;
+            if (d != 0) offset = 0.5 * (a - c) / d;
+        }
+        dom[frames] = (best + offset) * rate / p->n;
+        ratio[frames] = band > 0 ? power[best] / (band / (hi - lo + 1)) : 0;
+        frames++;
+    }
+    free(train);
+
+    r->frames = frames;
+    r->ok = frames > 0;
+    if (frames > 0) {
+        qsort(dom, (size_t)frames, sizeof(double), cmp_double);
+        qsort(ratio, (size_t)frames, sizeof(double), cmp_double);
+        r->dominant = quantile(dom, frames, 0.5);
+        r->iqr = quantile(dom, frames, 0.75) - quantile(dom, frames, 0.25);
+        int steady = 0;
+        for (int i = 0; i < frames; i++) steady += fabs(dom[i] - r->dominant) <= 0.1 * r->dominant;
+        r->stability = (double)steady / frames;
+        r->peak_ratio = quantile(ratio, frames, 0.5);
+
+        /* Largest local maxima of the averaged spectrum */
+        for (int j = 0; j < PEAKS; j++) r->peaks[j] = NAN;
+        double best[PEAKS] = {0};
+        for (int k = lo + 1; k < hi; k++) {
+            if (avg[k] <= avg[k - 1] || avg[k] < avg[k + 1]) continue;
+            for (int j = 0; j < PEAKS; j++) {
+                if (avg[k] <= best[j]) continue;
+                memmove(&best[j + 1], &best[j], (size_t)(PEAKS - 1 - j) * sizeof(double));
+                memmove(&r->peaks[j + 1], &r->peaks[j], (size_t)(PEAKS - 1 - j) * sizeof(double));
+                best[j] = avg[k];
+                r->peaks[j] = k * rate / p->n;
+                break;
+            }
+        }
+    }
+    free(dom);
+    free(ratio);
+}
+
+static void *worker(void *arg) {
+    Work *w = arg;
+    const FftPlan *p = w->plan;
+    float *frame = malloc((size_t)p->n * sizeof(float));
+    float *re = malloc((size_t)p->m * sizeof(float));
+    float *im = malloc((size_t)p->m * sizeof(float));
+    float *power = malloc((size_t)(p->m + 1) * sizeof(float));
+    double *avg = malloc((size_t)(p->m + 1) * sizeof(double));
+    for (;;) {
+        size_t i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED);
+        if (i >= w->count) break;
+        analyze(p, w->rate, &w->results[i], frame, re, im, power, avg);
+    }
+    free(frame);
+    free(re);
+    free(im);
+    free(power);
+    free(avg);
+    return NULL;
+}
+
+static void add_path(Result **list, size_t *count, size_t *cap, const char *path) {
+    if (*count == *cap) {
+        *cap = *cap ? *cap * 2 : 1024;
+        *list = realloc(*list, *cap * sizeof(Result));
+    }
+    memset(&(*list)[*count], 0, sizeof(Result));
+    (*list)[(*count)++].path = strdup(path);
+}
+
+int main(int argc, char *argv[]) {
+    double rate = 100.0;
+    int n = 2048;
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int argi = 1;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        if (!strcmp(argv[argi], "-r")) rate = atof(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-n")) n = atoi(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "-@")) threads = atoi(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    FftPlan plan;
+    if (argi >= argc || threads < 1 || rate < 2 * MAX_HZ || fft_plan(&plan, n) != 0) {
+        fprintf(stderr, "Usage: %s [-r hz] [-n samples] [-@ threads] session.csv [more.csv ...]\n", argv[0]);
+        fprintf(stderr, "       -n must be a power of two, -r at least %.0f Hz\n", 2 * MAX_HZ);
+        return 1;
+    }
+
+    Result *results = NULL;
+    size_t count = 0, cap = 0;
+    for (; argi < argc; argi++) {
+        if (strcmp(argv[argi], "-") != 0) {
+            add_path(&results, &count, &cap, argv[argi]);
+            continue;
+        }
+        char line[4096];
+        while (fgets(line, sizeof(line), stdin)) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0]) add_path(&results, &count, &cap, line);
+        }
+    }
+
+    Work work = { &plan, rate, results, count, 0 };
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, worker, &work);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+
+    int failures = 0;
+    printf("session,frames,dominant_hz,dominant_iqr_hz,stability,peak_ratio,peak1_hz,peak2_hz,peak3_hz\n");
+    for (size_t i = 0; i < count; i++) {
+        Result *r = &results[i];
+        if (r->ok < 0) {
+            fprintf(stderr, "Error: cannot read %s\n", r->path);
+            failures++;
+        } else if (r->ok == 0) {
+            printf("%s,0,,,,,,,\n", r->path);
+        } else {
+            printf("%s,%d,%.3f,%.3f,%.2f,%.2f", r->path, r->frames, r->dominant, r->iqr,
+                   r->stability, r->peak_ratio);
+            for (int j = 0; j < PEAKS; j++) {
+                if (isnan(r->peaks[j])) printf(",");
+                else printf(",%.3f", r->peaks[j]);
+            }
+            printf("\n");
+        }
+        free(r->path);
+    }
+    free(results);
+    fft_plan_free(&plan);
+    return failures ? 1 : 0;
+}
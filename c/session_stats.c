@@ -0,0 +1,450 @@
+/*
+ * session_stats.c - Per-session dwell/flight, n-graph and burst statistics
+ *
+ * Prints one block of key=value lines per session:
+ *   dwell    key_down -> key_up of the same key
+ *   flight   previous key_up -> key_down (negative under rollover)
+ *   digraph  key_down -> next key_down, also per character pair
+ *   trigraph key_down -> second next key_down, per character triple
+ *   bursts   runs of keystrokes separated by pauses longer than -p ms
+ * Auto-repeated key_downs are ignored throughout.
+ *
+ * With --cache, results are stored under DIR keyed by the XXH64 of the
+ * session file's content seeded with the analyzer version and options, so
+ * unchanged sessions are never recomputed, wherever they live. Hits
+ * refresh the entry's mtime; once the cache grows past --cache-max-mb the
+ * least recently used entries are evicted. DIR/size keeps a running total
+ * of the entries' bytes, so the directories are only scanned when that
+ * crosses the limit. A file that cannot be hashed is not cached.
+ *
+ * Build: make session_stats (see Makefile)
+ * Usage: ./session_stats [options] session.csv [more.csv ...]
+ *        -p ms             burst pause threshold (default 1000)
+ *        -g n              top n-graphs to list (default 10)
+ *        --cache DIR       reuse results cached in DIR
+ *        --cache-max-mb n  cache size limit (default 256)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include "session.h"
+
+#define ANALYZER_VERSION "session_stats-1"
+#define MAX_CHARS 4096
+
+/* Character column values interned to small ids */
+typedef struct {
+    char names[MAX_CHARS][16];
+    uint32_t slots[MAX_CHARS * 2];  /* id + 1, 0 = empty */
+    int count;
+} CharTable;
+
+static int intern_char(CharTable *t, const char *s) {
+    uint32_t h = (uint32_t)session_hash64(s, strlen(s), 0);
+    for (uint32_t i = h & (MAX_CHARS * 2 - 1);; i = (i + 1) & (MAX_CHARS * 2 - 1)) {
+        uint32_t v = t->slots[i];
+        if (v == 0) {
+            if (t->count == MAX_CHARS) return 0;
+            snprintf(t->names[t->count], sizeof(t->names[0]), "%s", s);
+            t->slots[i] = (uint32_t)++t->count;
+            return t->count - 1;
+        }
+        if (!strcmp(t->names[v - 1], s)) return (int)v - 1;
+    }
+}
+
+/* N-gram counts and latency sums keyed by packed character ids */
+typedef struct {
+    uint64_t key;
+    long count;
+    double sum;
+} Ngram;
+
+typedef struct {
+    Ngram *slots;
+    size_t cap, used;
+} NgramTable;
+
+static void ngram_add(NgramTable *t, uint64_t key, double v) {
+    if (t->used * 2 >= t->cap) {
+        NgramTable grown = { calloc(t->cap ? t->cap * 2 : 1024, sizeof(Ngram)),
+                             t->cap ? t->cap * 2 : 1024, 0 };
+        for (size_t i = 0; i < t->cap; i++)
+            if (t->slots[i].count) {
+                Ngram *g = &t->slots[i];
+                size_t j = (size_t)session_hash64(&g->key, 8, 0) & (grown.cap - 1);
+                while (grown.slots[j].count) j = (j + 1) & (grown.cap - 1);
+                grown.slots[j] = *g;
+                grown.used++;
+            }
+        free(t->slots);
+        *t = grown;
+    }
+    size_t j = (size_t)session_hash64(&key, 8, 0) & (t->cap - 1);
+    while (t->slots[j].count && t->slots[j].key != key) j = (j + 1) & (t->cap - 1);
+    if (!t->slots[j].count) {
+        t->slots[j].key = key;
+        t->used++;
+    }
+    t->slots[j].count++;
+    t->slots[j].sum += v;
+}
+
+static int cmp_ngram(const void *x, const void *y) {
+    const Ngram *a = x, *b = y;
+    if (a->count != b->count) return a->count < b->count ? 1 : -1;
+    return (a->key > b->key) - (a->key < b->key);
+}
+
+typedef struct {
+    double *v;
+    size_t n;
+} Series;
+
+static void print_series(FILE *out, const char *name, Series *s) {
+    double sum = 0, sumsq = 0;
+    for (size_t i = 0; i < s->n; i++) {
+        sum += s->v[i];
+        sumsq += s->v[i] * s->v[i];
+    }
+    double mean = s->n ? sum / (double)s->n : 0;
+    double var = s->n ? sumsq / (double)s->n - mean * mean : 0;
+    fprintf(out, "%s_n=%zu\n", name, s->n);
+    fprintf(out, "%s_mean_ms=%.3f\n", name, mean);
+    fprintf(out, "%s_sd_ms=%.3f\n", name, var > 0 ? sqrt(var) : 0.0);
+    fprintf(out, "%s_p10_ms=%.3f\n", name, session_quantile(s->v, s->n, 0.10));
+    fprintf(out, "%s_p50_ms=%.3f\n", name, session_quantile(s->v, s->n, 0.50));
+    fprintf(out, "%s_p90_ms=%.3f\n", name, session_quantile(s->v, s->n, 0.90));
+}
+
+static void print_top(FILE *out, const char *name, NgramTable *t, const CharTable *chars,
+                      int n, int order) {
+    Ngram *all = malloc((t->used + 1) * sizeof(Ngram));
+    size_t m = 0;
+    for (size_t i = 0; i < t->cap; i++)
+        if (t->slots[i].count) all[m++] = t->slots[i];
+    qsort(all, m, sizeof(Ngram), cmp_ngram);
+
+    for (size_t i = 0; i < m && (int)i < n; i++) {
+        fprintf(out, "%s.%zu=", name, i + 1);
+        for (int k = order - 1; k >= 0; k--)
+            fprintf(out, "%s%s", chars->names[(all[i].key >> (16 * k)) & 0xFFFF], k ? " " : "");
+        fprintf(out, " n=%ld mean_ms=%.3f\n", all[i].count, all[i].sum / (double)all[i].count);
+    }
+    free(all);
+}
+
+static void analyze(const Session *s, double pause_ms, int top, FILE *out) {
+    static CharTable chars;
+    memset(&chars, 0, sizeof(chars));
+    NgramTable digraphs = {0}, trigraphs = {0};
+
+    size_t n = s->count;
+    Series dwell = { malloc((n + 1) * sizeof(double)), 0 };
+    Series flight = { malloc((n + 1) * sizeof(double)), 0 };
+    Series digraph = { malloc((n + 1) * sizeof(double)), 0 };
+    Series burst_keys = { malloc((n + 1) * sizeof(double)), 0 };
+
+    double *down_at = malloc(65536 * sizeof(double));
+    for (int k = 0; k < 65536; k++) down_at[k] = NAN;
+
+    double last_up = NAN, prev_t = NAN, prev2_t = NAN;
+    int prev_c = -1, prev2_c = -1;
+    size_t keystrokes = 0, burst_len = 0, bursts = 0;
+    double burst_start = 0, burst_time = 0;
+    double first_t = n ? s->events[0].timestamp_ms : 0;
+    double last_t = n ? s->events[n - 1].timestamp_ms : 0;
+
+    for (size_t i = 0; i < n; i++) {
+        const SessionEvent *e = &s->events[i];
+        int k = e->keycode & 0xFFFF;
+        double t = e->timestamp_ms;
+
+        if (e->type == SESSION_KEY_UP) {
+            if (!isnan(down_at[k])) {
+                dwell.v[dwell.n++] = t - down_at[k];
+                down_at[k] = NAN;
+            }
+            last_up = t;
+            continue;
+        }
+        if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+
+        keystrokes++;
+        down_at[k] = t;
+        if (!isnan(last_up)) flight.v[flight.n++] = t - last_up;
+
+        int c = intern_char(&chars, e->character);
+        double dd = isnan(prev_t) ? INFINITY : t - prev_t;
+        if (dd > pause_ms) {
+            /* A pause ends the burst and breaks n-gram chains */
+            if (burst_len) {
+                burst_keys.v[burst_keys.n++] = (double)burst_len;
+                burst_time += prev_t - burst_start;
+                bursts++;
+            }
+            burst_len = 0;
+            burst_start = t;
+            prev_c = prev2_c = -1;
+        } else {
+            digraph.v[digraph.n++] = dd;
+            ngram_add(&digraphs, ((uint64_t)prev_c << 16) | (uint64_t)c, dd);
+            if (prev2_c >= 0)
+                ngram_add(&trigraphs, ((uint64_t)prev2_c << 32) | ((uint64_t)prev_c << 16) | (uint64_t)c,
+                          t - prev2_t);
+        }
+        burst_len++;
+        prev2_c = prev_c;
+        prev2_t = prev_t;
+        prev_c = c;
+        prev_t = t;
+    }
+    if (burst_len) {
+        burst_keys.v[burst_keys.n++] = (double)burst_len;
+        burst_time += prev_t - burst_start;
+        bursts++;
+    }
+
+    double duration = last_t - first_t;
+    fprintf(out, "events=%zu\n", n);
+    fprintf(out, "keystrokes=%zu\n", keystrokes);
+    fprintf(out, "duration_ms=%.3f\n", duration);
+    fprintf(out, "kpm=%.2f\n", duration > 0 ? keystrokes * 60000.0 / duration : 0.0);
+    print_series(out, "dwell", &dwell);
+    print_series(out, "flight", &flight);
+    print_series(out, "digraph", &digraph);
+
+    double key_sum = 0;
+    for (size_t i = 0; i < burst_keys.n; i++) key_sum += burst_keys.v[i];
+    fprintf(out, "bursts=%zu\n", bursts);
+    fprintf(out, "burst_mean_keys=%.2f\n", bursts ? key_sum / (double)bursts : 0.0);
+    fprintf(out, "burst_p50_keys=%.0f\n", session_quantile(burst_keys.v, burst_keys.n, 0.50));
+    fprintf(out, "burst_mean_ms=%.3f\n", bursts ? burst_time / (double)bursts : 0.0);
+    fprintf(out, "burst_kpm=%.2f\n", burst_time > 0 ? (key_sum - (double)bursts) * 60000.0 / burst_time : 0.0);
+
+    print_top(out, "digraph", &digraphs, &chars, top, 2);
+    print_top(out, "trigraph", &trigraphs, &chars, top, 3);
+
+    free(dwell.v);
+    free(flight.v);
+    free(digraph.v);
+    free(burst_keys.v);
+    free(down_at);
+    free(digraphs.slots);
+    free(trigraphs.slots);
+}
+
+/* Cache: DIR/<first two hex digits>/<hash>.txt */
+static void cache_path(const char *dir, uint64_t key, char *buf, size_t len) {
+    snprintf(buf, len, "%s/%02x/%016llx.txt", dir, (unsigned)(key >> 56), (unsigned long long)key);
+}
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buf = malloc((size_t)size + 1);
+    if (fread(buf, 1, (size_t)size, f) != (size_t)size) {
+        free(buf);
+        fclose(f);
+        return NULL;
+    }
+    buf[size] = '\0';
+    fclose(f);
+    return buf;
+}
+
+/* Writes path atomically through a temporary file */
+static void cache_put_file(const char *path, const char *text, size_t len) {
+    char tmp[1100];
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return;
+    fwrite(text, 1, len, f);
+    if (fclose(f) == 0) rename(tmp, path);
+    else remove(tmp);
+}
+
+static void cache_put(const char *dir, uint64_t key, const char *text, size_t len) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%02x", dir, (unsigned)(key >> 56));
+    mkdir(path, 0755);
+    cache_path(dir, key, path, sizeof(path));
+    cache_put_file(path, text, len);
+}
+
+typedef struct {
+    time_t mtime;
+    off_t size;
+    char path[64];
+} CacheEntry;
+
+static int cmp_entry(const void *x, const void *y) {
+    const CacheEntry *a = x, *b = y;
+    return (a->mtime > b->mtime) - (a->mtime < b->mtime);
+}
+
+/* Running total of entry bytes in DIR/size; -1 if unknown */
+static off_t cache_size_read(const char *dir) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/size", dir);
+    char *text = read_file(path);
+    if (!text) return -1;
+    char *end;
+    long long size = strtoll(text, &end, 10);
+    off_t result = end != text && size >= 0 ? (off_t)size : -1;
+    free(text);
+    return result;
+}
+
+static void cache_size_write(const char *dir, off_t size) {
+    char path[1024], text[32];
+    snprintf(path, sizeof(path), "%s/size", dir);
+    int len = snprintf(text, sizeof(text), "%lld\n", (long long)size);
+    cache_put_file(path, text, (size_t)len);
+}
+
+/*
+ * Deletes least recently used entries until the cache fits max_bytes;
+ * returns the bytes left
+ */
+static off_t cache_evict(const char *dir, off_t max_bytes) {
+    size_t cap = 1024, n = 0;
+    CacheEntry *all = malloc(cap * sizeof(CacheEntry));
+    off_t total = 0;
+
+    for (int b = 0; b < 256; b++) {
+        char sub[1024];
+        snprintf(sub, sizeof(sub), "%s/%02x", dir, b);
+        DIR *d = opendir(sub);
+        if (!d) continue;
+        struct dirent *de;
+        while ((de = readdir(d))) {
+            if (strlen(de->d_name) != 20 || strcmp(de->d_name + 16, ".txt")) continue;
+            char path[1100];
+            struct stat st;
+            snprintf(path, sizeof(path), "%s/%s", sub, de->d_name);
+            if (stat(path, &st) != 0) continue;
+            if (n == cap) {
+                cap *= 2;
+                all = realloc(all, cap * sizeof(CacheEntry));
+            }
+            all[n].mtime = st.st_mtime;
+            all[n].size = st.st_size;
+            snprintf(all[n].path, sizeof(all[n].path), "%02x/%s", b, de->d_name);
+            total += st.st_size;
+            n++;
+        }
+        closedir(d);
+    }
+
+    if (total > max_bytes) {
+        qsort(all, n, sizeof(CacheEntry), cmp_entry);
+        size_t removed = 0;
+        for (size_t i = 0; i < n && total > max_bytes; i++) {
+            char path[1100];
+            snprintf(path, sizeof(path), "%s/%s", dir, all[i].path);
+            if (remove(path) == 0) {
+                total -= all[i].size;
+                removed++;
+            }
+        }
+        fprintf(stderr, "Cache: evicted %zu entries\n", removed);
+    }
+    free(all);
+    return total;
+}
+
+int main(int argc, char *argv[]) {
+    double pause_ms = 1000.0;
+    int top = 10;
+    const char *cache_dir = NULL;
+    long cache_max_mb = 256;
+    int argi = 1;
+
+    for (; argi < argc && argv[argi][0] == '-'; argi++) {
+        if (!strcmp(argv[argi], "-p") && argi + 1 < argc) {
+            pause_ms = atof(argv[++argi]);
+        } else if (!strcmp(argv[argi], "-g") && argi + 1 < argc) {
+            top = atoi(argv[++argi]);
+        } else if (!strcmp(argv[argi], "--cache") && argi + 1 < argc) {
+            cache_dir = argv[++argi];
+        } else if (!strcmp(argv[argi], "--cache-max-mb") && argi + 1 < argc) {
+            cache_max_mb = atol(argv[++argi]);
+        } else {
+            argi = argc;
+        }
+    }
+    if (argi >= argc) {
+        fprintf(stderr, "Usage: %s [-p ms] [-g n] [--cache DIR] [--cache-max-mb n] session.csv [...]\n",
+                argv[0]);
+        return 1;
+    }
+
+    /* Results depend on the content, the analyzer version and the options */
+    char params[256];
+    snprintf(params, sizeof(params), "%s;pause_ms=%.3f;top=%d", ANALYZER_VERSION, pause_ms, top);
+    uint64_t seed = session_hash64(params, strlen(params), 0);
+    if (cache_dir) mkdir(cache_dir, 0755);
+
+    long hits = 0, misses = 0, failures = 0;
+    off_t added = 0;
+    for (; argi < argc; argi++) {
+        const char *path = argv[argi];
+        uint64_t key = 0;
+        char entry[1024];
+
+        int cacheable = cache_dir && session_hash_file(path, seed, &key) == 0;
+        if (cacheable) {
+            cache_path(cache_dir, key, entry, sizeof(entry));
+            char *cached = read_file(entry);
+            if (cached) {
+                utimes(entry, NULL);  /* mark as recently used */
+                printf("session=%s\n%s\n", path, cached);
+                free(cached);
+                hits++;
+                continue;
+            }
+        }
+
+        Session s;
+        if (session_load(path, &s) != 0) {
+            fprintf(stderr, "Error: cannot read %s\n", path);
+            failures++;
+            continue;
+        }
+
+        char *text = NULL;
+        size_t len = 0;
+        FILE *out = open_memstream(&text, &len);
+        analyze(&s, pause_ms, top, out);
+        fclose(out);
+        session_free(&s);
+
+        printf("session=%s\n%s\n", path, text);
+        if (cacheable) {
+            cache_put(cache_dir, key, text, len);
+            added += (off_t)len;
+        }
+        free(text);
+        misses++;
+    }
+
+    if (cache_dir) {
+        if (added) {
+            off_t max_bytes = (off_t)cache_max_mb << 20, size = cache_size_read(cache_dir);
+            if (size < 0 || size + added > max_bytes) size = cache_evict(cache_dir, max_bytes);
+            else size += added;
+            cache_size_write(cache_dir, size);
+        }
+        fprintf(stderr, "Cache: %ld hits, %ld computed\n", hits, misses);
+    }
+    return failures ? 1 : 0;
+}
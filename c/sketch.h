@@ -0,0 +1,341 @@
+/*
+ * sketch.h - Fixed-memory streaming summary of typing n-grams (POSIX)
+ *
+ * Counts keys, digraphs, trigraphs and modifier chords in about 80 KB no
+ * matter how long the session runs:
+ *
+ *   count-min sketch   SKETCH_DEPTH rows of SKETCH_WIDTH counters with
+ *                      conservative update; an estimate never undercounts
+ *                      and overcounts by at most e * total / SKETCH_WIDTH
+ *                      with probability 1 - e^-SKETCH_DEPTH
+ *   top-K              the SKETCH_TOPK items with the highest estimates,
+ *                      a min-heap on count
+ *   HyperLogLog        2^SKETCH_HLL_BITS registers, about 1.6% error on
+ *                      the number of distinct items
+ *
+ * Items are named like session_index terms: "key:e", "digraph:t h",
+ * "trigraph:t h e", "chord:ctrl+c". Summaries merge exactly for the
+ * sketch and HyperLogLog (add counters, max registers), so per-session or
+ * per-machine files combine into one; the merged top-K is re-ranked from
+ * the merged counters over both candidate lists.
+ *
+ * Summary file layout (.kts, little-endian):
+ *
+ *   "KTSK" | u32 version | u32 depth | u32 width | u32 hll bits | u32 top count
+ *   u64 total | depth x width x u32 counters | 2^bits x u8 registers
+ *   top count x { u8 length | item | u64 count }
+ *
+ * Used by terminal_macos.c (.kts output) and heavy_hitters.c.
+ */
+
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#define SKETCH_DEPTH 4
+#define SKETCH_WIDTH 4096
+#define SKETCH_HLL_BITS 12
+#define SKETCH_TOPK 64
+#define SKETCH_ITEM_MAX 48
+#define SKETCH_PAUSE_MS 1000.0      /* longer gaps end an n-gram, as in session_stats */
+#define SKETCH_MAGIC "KTSK"
+#define SKETCH_VERSION 1
+
+typedef struct {
+    char item[SKETCH_ITEM_MAX];
+    uint64_t hash;
+    uint64_t count;
+} SketchHeavy;
+
+typedef struct {
+    uint64_t total;
+    uint32_t cm[SKETCH_DEPTH][SKETCH_WIDTH];
+    uint8_t hll[1 << SKETCH_HLL_BITS];
+    SketchHeavy top[SKETCH_TOPK];
+    int ntop;
+
+    /* n-gram state for sketch_key_down() */
+    char prev[2][16];
+    int nprev;
+    double prev_ms;
+} Sketch;
+
+static inline void sketch_init(Sketch *s) {
+    memset(s, 0, sizeof(*s));
+}
+
+/* FNV-1a with a murmur3 finalizer: cheap, and good enough for all three structures */
+static inline uint64_t sketch_hash(const char *item) {
+    uint64_t h = 1469598103934665603ULL;
+    for (const unsigned char *p = (const unsigned char *)item; *p; p++) {
+        h ^= *p;
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* Row i uses h1 + i * h2 (Kirsch-Mitzenmacher), so one hash serves every row */
+static inline uint32_t sketch_cell(uint64_t hash, int row) {
+    uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1;
+    return (h1 + (uint32_t)row * h2) % SKETCH_WIDTH;
+}
+
+static inline uint64_t sketch_estimate_hash(const Sketch *s, uint64_t hash) {
+    uint32_t est = UINT32_MAX;
+    for (int r = 0; r < SKETCH_DEPTH; r++) {
+        uint32_t c = s->cm[r][sketch_cell(hash, r)];
+        if (c < est) est = c;
+    }
+    return est;
+}
+
+static inline uint64_t sketch_estimate(const Sketch *s, const char *item) {
+    return sketch_estimate_hash(s, sketch_hash(item));
+}
+
+static inline void sketch_sift_down(Sketch *s, int i) {
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, m = i;
+        if (l < s->ntop && s->top[l].count < s->top[m].count) m = l;
+        if (r < s->ntop && s->top[r].count < s->top[m].count) m = r;
+        if (m == i) return;
+        SketchHeavy t = s->top[i];
+        s->top[i] = s->top[m];
+        s->top[m] = t;
+        i = m;
+    }
+}
+
+static inline void sketch_sift_up(Sketch *s, int i) {
+    while (i > 0 && s->top[(i - 1) / 2].count > s->top[i].count) {
+        SketchHeavy t = s->top[i];
+        s->top[i] = s->top[(i - 1) / 2];
+        s->top[(i - 1) / 2] = t;
+        i = (i - 1) / 2;
+    }
+}
+
+/* Offers an item with its current estimate to the top-K heap */
+static inline void sketch_offer(Sketch *s, const char *item, uint64_t hash, uint64_t count) {
+    for (int i = 0; i < s->ntop; i++) {
+        if (s->top[i].hash == hash && !strcmp(s->top[i].item, item)) {
+            s->top[i].count = count;    /* estimates only grow */
+            sketch_sift_down(s, i);
+            return;
+        }
+    }
+    int i;
+    if (s->ntop < SKETCH_TOPK) {
+        i = s->ntop++;
+    } else if (count > s->top[0].count) {
+        i = 0;
+    } else {
+        return;
+    }
+    snprintf(s->top[i].item, SKETCH_ITEM_MAX, "%s", item);
+    s->top[i].hash = hash;
+    s->top[i].count = count;
+    if (i == 0) sketch_sift_down(s, 0);
+    else sketch_sift_up(s, i);
+}
+
+static inline void sketch_add(Sketch *s, const char *item) {
+    uint64_t hash = sketch_hash(item);
+    uint32_t *cells[SKETCH_DEPTH];
+    uint32_t est = UINT32_MAX;
+    for (int r = 0; r < SKETCH_DEPTH; r++) {
+        cells[r] = &s->cm[r][sketch_cell(hash, r)];
+        if (*cells[r] < est) est = *cells[r];
+    }
+    /* Conservative update: only raise the counters that set the minimum */
+    if (est < UINT32_MAX) {
+        est++;
+        for (int r = 0; r < SKETCH_DEPTH; r++)
+            if (*cells[r] < est) *cells[r] = est;
+    }
+    s->total++;
+
+    uint32_t reg = (uint32_t)(hash >> (64 - SKETCH_HLL_BITS));
+    uint64_t rest = (hash << SKETCH_HLL_BITS) | (1ULL << (SKETCH_HLL_BITS - 1));
+    uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+    if (rank > s->hll[reg]) s->hll[reg] = rank;
+
+    sketch_offer(s, item, hash, est);
+}
+
+/*
+ * Feeds one non-repeat key press. character and modifiers are the CSV
+ * column values ("none" or "" for no modifiers).
+ */
+static inline void sketch_key_down(Sketch *s, const char *character, const char *modifiers, double ms) {
+    char item[SKETCH_ITEM_MAX];
+    if (s->nprev && ms - s->prev_ms > SKETCH_PAUSE_MS) s->nprev = 0;
+
+    snprintf(item, sizeof(item), "key:%s", character);
+    sketch_add(s, item);
+    if (s->nprev >= 1) {
+        snprintf(item, sizeof(item), "digraph:%s %s", s->prev[1], character);
+        sketch_add(s, item);
+    }
+    if (s->nprev >= 2) {
+        snprintf(item, sizeof(item), "trigraph:%s %s %s", s->prev[0], s->prev[1], character);
+        sketch_add(s, item);
+    }
+    if (modifiers[0] && strcmp(modifiers, "none") != 0) {
+        snprintf(item, sizeof(item), "chord:%s+%s", modifiers, character);
+        sketch_add(s, item);
+    }
+
+    memcpy(s->prev[0], s->prev[1], sizeof(s->prev[0]));
+    snprintf(s->prev[1], sizeof(s->prev[1]), "%s", character);
+    if (s->nprev < 2) s->nprev++;
+    s->prev_ms = ms;
+}
+
+/* HyperLogLog estimate with the small-range (linear counting) correction */
+static inline double sketch_distinct(const Sketch *s) {
+    const int m = 1 << SKETCH_HLL_BITS;
+    double sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < m; i++) {
+        sum += ldexp(1.0, -s->hll[i]);
+        if (s->hll[i] == 0) zeros++;
+    }
+    double e = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros) e = m * log((double)m / zeros);
+    return e;
+}
+
+static inline int sketch_cmp_count(const void *a, const void *b) {
+    uint64_t x = ((const SketchHeavy *)a)->count, y = ((const SketchHeavy *)b)->count;
+    return (x > y) - (x < y);
+}
+
+/* Adds src into dst; the n-gram state of dst is left as is */
+static inline void sketch_merge(Sketch *dst, const Sketch *src) {
+    for (int r = 0; r < SKETCH_DEPTH; r++) {
+        for (int c = 0; c < SKETCH_WIDTH; c++) {
+            uint64_t v = (uint64_t)dst->cm[r][c] + src->cm[r][c];
+            dst->cm[r][c] = v > UINT32_MAX ? UINT32_MAX : (uint32_t)v;
+        }
+    }
+    for (int i = 0; i < (1 << SKETCH_HLL_BITS); i++)
+        if (src->hll[i] > dst->hll[i]) dst->hll[i] = src->hll[i];
+    dst->total += src->total;
+
+    /* Re-rank both candidate lists against the merged counters */
+    SketchHeavy cand[2 * SKETCH_TOPK];
+    int n = 0;
+    for (int i = 0; i < dst->ntop; i++) cand[n++] = dst->top[i];
+    for (int i = 0; i < src->ntop; i++) {
+        int dup = 0;
+        for (int j = 0; j < dst->ntop && !dup; j++)
+            dup = cand[j].hash == src->top[i].hash && !strcmp(cand[j].item, src->top[i].item);
+        if (!dup) cand[n++] = src->top[i];
+    }
+    for (int i = 0; i < n; i++) cand[i].count = sketch_estimate_hash(dst, cand[i].hash);
+    qsort(cand, (size_t)n, sizeof(cand[0]), sketch_cmp_count);
+
+    /* The K largest in ascending order already form a valid min-heap */
+    int keep = n < SKETCH_TOPK ? n : SKETCH_TOPK;
+    memcpy(dst->top, cand + (n - keep), (size_t)keep * sizeof(cand[0]));
+    dst->ntop = keep;
+}
+
+/* Copies the top-K into out (at least SKETCH_TOPK entries), largest first */
+static inline int sketch_top(const Sketch *s, SketchHeavy *out) {
+    memcpy(out, s->top, (size_t)s->ntop * sizeof(out[0]));
+    qsort(out, (size_t)s->ntop, sizeof(out[0]), sketch_cmp_count);
+    for (int i = 0, j = s->ntop - 1; i < j; i++, j--) {
+        SketchHeavy t = out[i];
+        out[i] = out[j];
+        out[j] = t;
+    }
+    return s->ntop;
+}
+
+static inline void sketch_put_le(FILE *f, uint64_t v, int bytes) {
+    unsigned char b[8];
+    for (int i = 0; i < bytes; i++) b[i] = (unsigned char)(v >> (8 * i));
+    fwrite(b, 1, (size_t)bytes, f);
+}
+
+static inline int sketch_get_le(FILE *f, uint64_t *v, int bytes) {
+    unsigned char b[8];
+    if (fread(b, 1, (size_t)bytes, f) != (size_t)bytes) return -1;
+    *v = 0;
+    for (int i = bytes - 1; i >= 0; i--) *v = (*v << 8) | b[i];
+    return 0;
+}
+
+/* Writes the summary next to path and renames it into place */
+static inline int sketch_save(const Sketch *s, const char *path) {
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    fwrite(SKETCH_MAGIC, 1, 4, f);
+    sketch_put_le(f, SKETCH_VERSION, 4);
+    sketch_put_le(f, SKETCH_DEPTH, 4);
+    sketch_put_le(f, SKETCH_WIDTH, 4);
+    sketch_put_le(f, SKETCH_HLL_BITS, 4);
+    sketch_put_le(f, (uint64_t)s->ntop, 4);
+    sketch_put_le(f, s->total, 8);
+    for (int r = 0; r < SKETCH_DEPTH; r++)
+        for (int c = 0; c < SKETCH_WIDTH; c++) sketch_put_le(f, s->cm[r][c], 4);
+    fwrite(s->hll, 1, sizeof(s->hll), f);
+    for (int i = 0; i < s->ntop; i++) {
+        size_t n = strlen(s->top[i].item);
+        sketch_put_le(f, n, 1);
+        fwrite(s->top[i].item, 1, n, f);
+        sketch_put_le(f, s->top[i].count, 8);
+    }
+    if (fclose(f) != 0) return -1;
+    return rename(tmp, path);
+}
+
+static inline int sketch_load(Sketch *s, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    sketch_init(s);
+    char magic[4];
+    uint64_t version, depth, width, bits, ntop, v = 0;
+    int ok = fread(magic, 1, 4, f) == 4 && !memcmp(magic, SKETCH_MAGIC, 4) &&
+             sketch_get_le(f, &version, 4) == 0 && version == SKETCH_VERSION &&
+             sketch_get_le(f, &depth, 4) == 0 && depth == SKETCH_DEPTH &&
+             sketch_get_le(f, &width, 4) == 0 && width == SKETCH_WIDTH &&
+             sketch_get_le(f, &bits, 4) == 0 && bits == SKETCH_HLL_BITS &&
+             sketch_get_le(f, &ntop, 4) == 0 && ntop <= SKETCH_TOPK &&
+             sketch_get_le(f, &s->total, 8) == 0;
+    for (int r = 0; ok && r < SKETCH_DEPTH; r++) {
+        for (int c = 0; ok && c < SKETCH_WIDTH; c++) {
+            ok = sketch_get_le(f, &v, 4) == 0;
+            s->cm[r][c] = (uint32_t)v;
+        }
+    }
+    ok = ok && fread(s->hll, 1, sizeof(s->hll), f) == sizeof(s->hll);
+    for (int i = 0; ok && i < (int)ntop; i++) {
+        SketchHeavy *h = &s->top[i];
+        ok = sketch_get_le(f, &v, 1) == 0 && v < SKETCH_ITEM_MAX &&
+             fread(h->item, 1, (size_t)v, f) == (size_t)v;
+        if (!ok) break;
+        h->item[v] = '\0';
+        h->hash = sketch_hash(h->item);
+        ok = sketch_get_le(f, &h->count, 8) == 0;
+        s->ntop = i + 1;
+    }
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+#endif /* SKETCH_H */
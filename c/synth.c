@@ -0,0 +1,723 @@
+/*
+ * synth.c - Train a keystroke timing model and generate synthetic sessions (POSIX)
+ *
+ * "train" fits a model to recorded sessions:
+ *   - a first-order Markov chain over symbols (character column plus
+ *     modifiers), with the symbol frequencies as its start distribution
+ *   - per digraph, a table of SYNTH_QUANTILES quantiles of the
+ *     press-to-press time; digraphs seen fewer than SYNTH_MIN_SAMPLES
+ *     times borrow the table of their second key, then the global one
+ *   - per symbol, quantiles of dwell (key_down -> key_up)
+ *   - a pause model: the share of gaps longer than -p ms, and their
+ *     quantiles
+ * "generate" draws sessions from it. Times are sampled by inverse CDF,
+ * interpolating linearly between quantiles; a key_up whose dwell outlasts
+ * the next press is held back and written in timestamp order, so rollover
+ * looks as it does in real recordings. Sessions are written in the
+ * recorders' own formats, chosen by -f: csv, csv.gz (BGZF, as bgzf.c) or
+ * parquet (as parquet.h).
+ *
+ * Every session draws from its own random stream, derived from -s and its
+ * index, so the output is the same whatever the thread count. Sessions
+ * are generated on one worker thread per core.
+ *
+ * Model file layout (native byte order, like baseline.h):
+ *
+ *   "KTSM" | u32 version | u32 symbols | u32 quantiles | f64 pause share |
+ *   u64 presses | u64 sessions
+ *   symbols x { char character[16] | char modifiers[24] | i32 keycode | i32 scancode }
+ *   u32 start[symbols] | u32 transitions[symbols][symbols]
+ *   f32 flight[symbols][symbols][quantiles] | f32 dwell[symbols][quantiles] |
+ *   f32 pause[quantiles]                              (milliseconds)
+ *
+ * Build: make synth (see Makefile)
+ * Usage: ./synth train [-p ms] model.ktsm session.csv [more.csv ...]
+ *        ./synth generate [-n sessions] [-k presses] [-s seed] [-f csv|csv.gz|parquet] [-@ threads]
+ *                model.ktsm outdir
+ *        train reads further paths from stdin for a "-" argument.
+ *        generate writes outdir/synth_NNNNNN.<format>, two events per press.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "session.h"
+#include "bgzf.h"
+#include "parquet.h"
+
+#define SYNTH_MAGIC "KTSM"
+#define SYNTH_VERSION 1
+#define SYNTH_MAX_SYMBOLS 256
+#define SYNTH_QUANTILES 17          /* p = 0, 1/16, ..., 1 */
+#define SYNTH_MIN_SAMPLES 8
+#define SYNTH_PAUSE_MS 1000.0       /* longer gaps are pauses, as in session_stats */
+#define SYNTH_HELD 16               /* key_ups waiting for their timestamp */
+
+typedef struct {
+    char character[16];
+    char modifiers[24];
+    int32_t keycode;
+    int32_t scancode;
+} SynthSymbol;
+
+typedef struct {
+    uint32_t symbols;
+    double pause_share;
+    uint64_t presses;
+    uint64_t sessions;
+    SynthSymbol *sym;
+    uint32_t *start;            /* [symbols] */
+    uint32_t *trans;            /* [symbols][symbols] */
+    float *flight;              /* [symbols][symbols][SYNTH_QUANTILES] */
+    float *dwell;               /* [symbols][SYNTH_QUANTILES] */
+    float pause[SYNTH_QUANTILES];
+} SynthModel;
+
+static void model_alloc(SynthModel *m, uint32_t n) {
+    m->symbols = n;
+    m->sym = calloc(n ? n : 1, sizeof(SynthSymbol));
+    m->start = calloc(n ? n : 1, sizeof(uint32_t));
+    m->trans = calloc((size_t)n * n + 1, sizeof(uint32_t));
+    m->flight = calloc((size_t)n * n * SYNTH_QUANTILES + 1, sizeof(float));
+    m->dwell = calloc((size_t)n * SYNTH_QUANTILES + 1, sizeof(float));
+}
+
+static void model_free(SynthModel *m) {
+    free(m->sym);
+    free(m->start);
+    free(m->trans);
+    free(m->flight);
+    free(m->dwell);
+}
+
+static int model_save(const SynthModel *m, const char *path) {
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) return -1;
+    size_t n = m->symbols;
+    uint32_t head[3] = { SYNTH_VERSION, m->symbols, SYNTH_QUANTILES };
+    fwrite(SYNTH_MAGIC, 1, 4, f);
+    fwrite(head, sizeof(head), 1, f);
+    fwrite(&m->pause_share, sizeof(double), 1, f);
+    fwrite(&m->presses, sizeof(uint64_t), 1, f);
+    fwrite(&m->sessions, sizeof(uint64_t), 1, f);
+    fwrite(m->sym, sizeof(SynthSymbol), n, f);
+    fwrite(m->start, sizeof(uint32_t), n, f);
+    fwrite(m->trans, sizeof(uint32_t), n * n, f);
+    fwrite(m->flight, sizeof(float), n * n * SYNTH_QUANTILES, f);
+    fwrite(m->dwell, sizeof(float), n * SYNTH_QUANTILES, f);
+    fwrite(m->pause, sizeof(float), SYNTH_QUANTILES, f);
+    return (fclose(f) == 0 && rename(tmp, path) == 0) ? 0 : -1;
+}
+
+static int model_load(SynthModel *m, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+    char magic[4];
+    uint32_t head[3];
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, SYNTH_MAGIC, 4) != 0 ||
+        fread(head, sizeof(head), 1, f) != 1 || head[0] != SYNTH_VERSION ||
+        head[1] == 0 || head[1] > SYNTH_MAX_SYMBOLS || head[2] != SYNTH_QUANTILES) {
+        fclose(f);
+        return -1;
+    }
+    model_alloc(m, head[1]);
+    size_t n = m->symbols;
+    int ok = fread(&m->pause_share, sizeof(double), 1, f) == 1 &&
+             fread(&m->presses, sizeof(uint64_t), 1, f) == 1 &&
+             fread(&m->sessions, sizeof(uint64_t), 1, f) == 1 &&
+             fread(m->sym, sizeof(SynthSymbol), n, f) == n &&
+             fread(m->start, sizeof(uint32_t), n, f) == n &&
+             fread(m->trans, sizeof(uint32_t), n * n, f) == n * n &&
+             fread(m->flight, sizeof(float), n * n * SYNTH_QUANTILES, f) == n * n * SYNTH_QUANTILES &&
+             fread(m->dwell, sizeof(float), n * SYNTH_QUANTILES, f) == n * SYNTH_QUANTILES &&
+             fread(m->pause, sizeof(float), SYNTH_QUANTILES, f) == SYNTH_QUANTILES;
+    fclose(f);
+    if (!ok) {
+        model_free(m);
+        return -1;
+    }
+    return 0;
+}
+
+/* ---- train ---- */
+
+typedef struct {
+    uint32_t cell;
+    float ms;
+} Sample;
+
+typedef struct {
+    Sample *v;
+    size_t n, cap;
+} Samples;
+
+static void samples_add(Samples *s, uint32_t cell, double ms) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 65536;
+        s->v = realloc(s->v, s->cap * sizeof(Sample));
+    }
+    s->v[s->n].cell = cell;
+    s->v[s->n++].ms = (float)ms;
+}
+
+static int sample_cmp(const void *a, const void *b) {
+    const Sample *x = a, *y = b;
+    if (x->cell != y->cell) return x->cell < y->cell ? -1 : 1;
+    return (x->ms > y->ms) - (x->ms < y->ms);
+}
+
+/* Quantiles of one cell's sorted samples */
+static void fill_quantiles(const Sample *v, size_t n, float *q) {
+    for (int k = 0; k < SYNTH_QUANTILES; k++) {
+        double pos = (double)k / (SYNTH_QUANTILES - 1) * (double)(n - 1);
+        size_t i = (size_t)pos;
+        double frac = pos - (double)i;
+        q[k] = i + 1 < n ? (float)(v[i].ms + frac * (v[i + 1].ms - v[i].ms)) : v[n - 1].ms;
+    }
+}
+
+static void format_modifiers(uint16_t m, char *buf, size_t len) {
+    static const char *const names[] = { "shift", "ctrl", "alt", "cmd" };
+    size_t n = 0;
+    buf[0] = '\0';
+    for (int i = 0; i < 4; i++)
+        if (m & (1u << i)) n += (size_t)snprintf(buf + n, len - n, "%s%s", n ? "+" : "", names[i]);
+    if (!n) snprintf(buf, len, "none");
+}
+
+typedef struct {
+    SynthModel *m;
+    uint32_t table[1024];       /* open addressing, symbol + 1 */
+} SymbolTable;
+
+/* Symbol of an event, adding it if new; -1 once the table is full */
+static int symbol_of(SymbolTable *t, const SessionEvent *e, uint32_t *count) {
+    char mods[24];
+    format_modifiers(e->modifiers, mods, sizeof(mods));
+    uint64_t h = session_hash64(e->character, strlen(e->character), e->modifiers);
+    for (uint32_t i = (uint32_t)h & 1023;; i = (i + 1) & 1023) {
+        uint32_t s = t->table[i];
+        if (!s) break;
+        SynthSymbol *y = &t->m->sym[s - 1];
+        if (!strcmp(y->character, e->character) && !strcmp(y->modifiers, mods)) return (int)s - 1;
+    }
+    if (*count >= SYNTH_MAX_SYMBOLS) return -1;
+    SynthSymbol *y = &t->m->sym[*count];
+    snprintf(y->character, sizeof(y->character), "%s", e->character);
+    snprintf(y->modifiers, sizeof(y->modifiers), "%s", mods);
+    y->keycode = e->keycode;
+    y->scancode = e->scancode;
+    for (uint32_t i = (uint32_t)h & 1023;; i = (i + 1) & 1023) {
+        if (!t->table[i]) {
+            t->table[i] = ++*count;
+            break;
+        }
+    }
+    return (int)*count - 1;
+}
+
+static int cmd_train(int argc, char *argv[]) {
+    double pause_ms = SYNTH_PAUSE_MS;
+    int argi = 0;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        if (!strcmp(argv[argi], "-p")) pause_ms = atof(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi + 1 >= argc) {
+        fprintf(stderr, "Usage: synth train [-p ms] model.ktsm session.csv [more.csv ...]\n");
+        return 1;
+    }
+    const char *model_path = argv[argi++];
+
+    /* Symbols are numbered as they are first seen, so size for the maximum */
+    SynthModel m = {0};
+    model_alloc(&m, SYNTH_MAX_SYMBOLS);
+    SymbolTable table = { &m, {0} };
+    uint32_t nsym = 0;
+    Samples flight = {0}, dwell = {0}, pause = {0};
+    uint64_t gaps = 0;
+    int *down_sym = malloc(65536 * sizeof(int));
+    double *down_at = malloc(65536 * sizeof(double));
+    int failures = 0;
+
+    for (; argi < argc; argi++) {
+        char line[4096];
+        const char *path = argv[argi];
+        int from_stdin = !strcmp(path, "-");
+        while (!from_stdin || (fgets(line, sizeof(line), stdin) && (line[strcspn(line, "\r\n")] = '\0', 1))) {
+            if (from_stdin) path = line;
+            Session s;
+            if (session_load(path, &s) != 0) {
+                fprintf(stderr, "Error: cannot read %s\n", path);
+                failures++;
+                if (!from_stdin) break;
+                continue;
+            }
+            for (int k = 0; k < 65536; k++) down_sym[k] = -1;
+            int prev = -1;
+            double prev_t = 0;
+            for (size_t i = 0; i < s.count; i++) {
+                const SessionEvent *e = &s.events[i];
+                int kc = e->keycode & 0xFFFF;
+                if (e->type == SESSION_KEY_UP) {
+                    if (down_sym[kc] >= 0 && e->timestamp_ms >= down_at[kc])
+                        samples_add(&dwell, (uint32_t)down_sym[kc], e->timestamp_ms - down_at[kc]);
+                    down_sym[kc] = -1;
+                    continue;
+                }
+                if (e->type != SESSION_KEY_DOWN || e->is_repeat) continue;
+                int c = symbol_of(&table, e, &nsym);
+                down_sym[kc] = c;
+                down_at[kc] = e->timestamp_ms;
+                if (c < 0) {
+                    prev = -1;
+                    continue;
+                }
+                m.start[c]++;
+                m.presses++;
+                double gap = e->timestamp_ms - prev_t;
+                if (prev >= 0 && gap >= 0) {
+                    gaps++;
+                    if (gap > pause_ms) {
+                        samples_add(&pause, 0, gap);
+                    } else {
+                        m.trans[(size_t)prev * SYNTH_MAX_SYMBOLS + (size_t)c]++;
+                        samples_add(&flight, (uint32_t)(prev * SYNTH_MAX_SYMBOLS + c), gap);
+                    }
+                }
+                prev = c;
+                prev_t = e->timestamp_ms;
+            }
+            session_free(&s);
+            m.sessions++;
+            if (!from_stdin) break;
+        }
+    }
+    free(down_sym);
+    free(down_at);
+    if (flight.n == 0 || dwell.n == 0) {
+        fprintf(stderr, "Error: no digraphs in the input\n");
+        return 1;
+    }
+
+    /* Global tables are the fallback of last resort */
+    qsort(flight.v, flight.n, sizeof(Sample), sample_cmp);
+    qsort(dwell.v, dwell.n, sizeof(Sample), sample_cmp);
+    Sample *all = malloc((flight.n > dwell.n ? flight.n : dwell.n) * sizeof(Sample));
+    memcpy(all, flight.v, flight.n * sizeof(Sample));
+    for (size_t i = 0; i < flight.n; i++) all[i].cell = 0;
+    qsort(all, flight.n, sizeof(Sample), sample_cmp);
+    float global_flight[SYNTH_QUANTILES], global_dwell[SYNTH_QUANTILES];
+    fill_quantiles(all, flight.n, global_flight);
+    memcpy(all, dwell.v, dwell.n * sizeof(Sample));
+    for (size_t i = 0; i < dwell.n; i++) all[i].cell = 0;
+    qsort(all, dwell.n, sizeof(Sample), sample_cmp);
+    fill_quantiles(all, dwell.n, global_dwell);
+
+    /* Per second key: every flight into it, for sparse digraphs */
+    for (size_t i = 0; i < flight.n; i++) all[i] = (Sample){ flight.v[i].cell % SYNTH_MAX_SYMBOLS, flight.v[i].ms };
+    qsort(all, flight.n, sizeof(Sample), sample_cmp);
+    float *into = malloc((size_t)SYNTH_MAX_SYMBOLS * SYNTH_QUANTILES * sizeof(float));
+    for (uint32_t c = 0; c < SYNTH_MAX_SYMBOLS; c++)
+        memcpy(into + (size_t)c * SYNTH_QUANTILES, global_flight, sizeof(global_flight));
+    for (size_t i = 0, j; i < flight.n; i = j) {
+        for (j = i; j < flight.n && all[j].cell == all[i].cell; j++) {}
+        if (j - i >= SYNTH_MIN_SAMPLES) fill_quantiles(all + i, j - i, into + (size_t)all[i].cell * SYNTH_QUANTILES);
+    }
+    free(all);
+
+    /* Compact to the symbols seen */
+    SynthModel out = {0};
+    model_alloc(&out, nsym);
+    memcpy(out.sym, m.sym, nsym * sizeof(SynthSymbol));
+    memcpy(out.start, m.start, nsym * sizeof(uint32_t));
+    out.presses = m.presses;
+    out.sessions = m.sessions;
+    out.pause_share = gaps ? (double)pause.n / (double)gaps : 0.0;
+    for (uint32_t a = 0; a < nsym; a++) {
+        memcpy(out.trans + (size_t)a * nsym, m.trans + (size_t)a * SYNTH_MAX_SYMBOLS, nsym * sizeof(uint32_t));
+        for (uint32_t b = 0; b < nsym; b++)
+            memcpy(out.flight + ((size_t)a * nsym + b) * SYNTH_QUANTILES, into + (size_t)b * SYNTH_QUANTILES,
+                   sizeof(global_flight));
+        memcpy(out.dwell + (size_t)a * SYNTH_QUANTILES, global_dwell, sizeof(global_dwell));
+    }
+    size_t cells = 0;
+    for (size_t i = 0, j; i < flight.n; i = j) {
+        for (j = i; j < flight.n && flight.v[j].cell == flight.v[i].cell; j++) {}
+        if (j - i < SYNTH_MIN_SAMPLES) continue;
+        uint32_t a = flight.v[i].cell / SYNTH_MAX_SYMBOLS, b = flight.v[i].cell % SYNTH_MAX_SYMBOLS;
+        fill_quantiles(flight.v + i, j - i, out.flight + ((size_t)a * nsym + b) * SYNTH_QUANTILES);
+        cells++;
+    }
+    for (size_t i = 0, j; i < dwell.n; i = j) {
+        for (j = i; j < dwell.n && dwell.v[j].cell == dwell.v[i].cell; j++) {}
+        if (j - i >= SYNTH_MIN_SAMPLES) fill_quantiles(dwell.v + i, j - i, out.dwell + (size_t)dwell.v[i].cell * SYNTH_QUANTILES);
+    }
+    if (pause.n) {
+        qsort(pause.v, pause.n, sizeof(Sample), sample_cmp);
+        fill_quantiles(pause.v, pause.n, out.pause);
+    } else {
+        for (int k = 0; k < SYNTH_QUANTILES; k++) out.pause[k] = (float)pause_ms;
+    }
+    free(into);
+    free(flight.v);
+    free(dwell.v);
+    free(pause.v);
+    model_free(&m);
+
+    int rc = model_save(&out, model_path);
+    if (rc != 0) fprintf(stderr, "Error: cannot write %s\n", model_path);
+    else fprintf(stderr, "%llu sessions, %llu presses, %u symbols, %zu digraphs with their own timing, "
+                 "%.2f%% pauses -> %s\n", (unsigned long long)out.sessions, (unsigned long long)out.presses,
+                 nsym, cells, 100.0 * out.pause_share, model_path);
+    model_free(&out);
+    return rc != 0 || failures ? 1 : 0;
+}
+
+/* ---- generate ---- */
+
+/* Alias tables (Vose) for the Markov rows; row `symbols` is the start distribution */
+typedef struct {
+    float *prob;
+    uint16_t *alias;
+} AliasTables;
+
+static void alias_build(const uint32_t *w, uint32_t n, float *prob, uint16_t *alias, uint32_t *small,
+                        uint32_t *large, double *p) {
+    double total = 0;
+    for (uint32_t i = 0; i < n; i++) total += w[i];
+    uint32_t ns = 0, nl = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        p[i] = (double)w[i] * n / total;
+        if (p[i] < 1.0) small[ns++] = i;
+        else large[nl++] = i;
+    }
+    while (ns && nl) {
+        uint32_t s = small[--ns], l = large[--nl];
+        prob[s] = (float)p[s];
+        alias[s] = (uint16_t)l;
+        p[l] -= 1.0 - p[s];
+        if (p[l] < 1.0) small[ns++] = l;
+        else large[nl++] = l;
+    }
+    while (nl) prob[large[--nl]] = 1.0f;
+    while (ns) prob[small[--ns]] = 1.0f;
+}
+
+typedef struct {
+    const SynthModel *m;
+    AliasTables at;
+    const char *outdir;
+    const char *format;
+    uint64_t seed;
+    uint64_t presses;
+    uint64_t sessions;
+    uint64_t next;              /* claimed with __atomic_fetch_add */
+    int failures;
+} Work;
+
+/* splitmix64: one multiply-xorshift step per draw, any seed is fine */
+static inline uint64_t next_random(uint64_t *s) {
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline double uniform(uint64_t *s) {
+    return (double)(next_random(s) >> 11) * 0x1p-53;
+}
+
+static inline uint32_t draw_symbol(const AliasTables *at, uint32_t row, uint32_t n, uint64_t *rng) {
+    double u = uniform(rng) * n;
+    uint32_t i = (uint32_t)u;
+    if (i >= n) i = n - 1;
+    size_t k = (size_t)row * n + i;
+    return u - i < at->prob[k] ? i : at->alias[k];
+}
+
+/* Inverse CDF through the quantile table, in microseconds */
+static inline int64_t draw_time(const float *q, uint64_t *rng) {
+    double u = uniform(rng) * (SYNTH_QUANTILES - 1);
+    int i = (int)u;
+    double ms = q[i] + (u - i) * (q[i + 1] - q[i]);
+    return (int64_t)(ms * 1000.0 + 0.5);
+}
+
+typedef struct {
+    FILE *f;                    /* csv / csv.gz */
+    ParquetWriter pq;
+    int parquet;
+    char buf[1 << 16];
+    size_t len;
+    int64_t seq;
+    char (*tail)[64];           /* per symbol ",keycode,scancode,character,modifiers,0\n" */
+    uint8_t *tail_len;
+} Sink;
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static char *put_uint(char *p, uint64_t v) {
+    char tmp[24];
+    char *e = tmp + sizeof(tmp), *q = e;
+    while (v >= 100) {
+        q -= 2;
+        memcpy(q, digit_pairs + v % 100 * 2, 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        q -= 2;
+        memcpy(q, digit_pairs + v * 2, 2);
+    } else {
+        *--q = (char)('0' + v);
+    }
+    memcpy(p, q, (size_t)(e - q));
+    return p + (e - q);
+}
+
+/* Microseconds as the recorders' "%.3f" milliseconds */
+static char *put_ms(char *p, int64_t us) {
+    p = put_uint(p, (uint64_t)(us / 1000));
+    int frac = (int)(us % 1000);
+    p[0] = '.';
+    p[1] = (char)('0' + frac / 100);
+    memcpy(p + 2, digit_pairs + frac % 100 * 2, 2);
+    return p + 4;
+}
+
+static void sink_event(Sink *k, const SynthModel *m, uint32_t symbol, int64_t us, int up) {
+    const SynthSymbol *y = &m->sym[symbol];
+    k->seq++;
+    if (k->parquet) {
+        ParquetEvent pe = {
+            .seq = k->seq,
+            .timestamp_us = us,
+            .event_timestamp_us = us,
+            .event_type = up ? "key_up" : "key_down",
+            .keycode = y->keycode,
+            .scancode = y->scancode,
+            .character = y->character,
+            .modifiers = y->modifiers,
+            .is_repeat = 0,
+        };
+        parquet_add(&k->pq, &pe);
+        return;
+    }
+    if (k->len + 128 > sizeof(k->buf)) {
+        fwrite(k->buf, 1, k->len, k->f);
+        k->len = 0;
+    }
+    char *p = k->buf + k->len;
+    p = put_uint(p, (uint64_t)k->seq);
+    *p++ = ',';
+    char *ts = p;
+    p = put_ms(p, us);
+    *p++ = ',';
+    memcpy(p, ts, (size_t)(p - 1 - ts));    /* event_timestamp_ms is the same clock here */
+    p += p - 1 - ts;
+    memcpy(p, up ? ",key_up," : ",key_down,", up ? 8 : 10);
+    p += up ? 8 : 10;
+    memcpy(p, k->tail[symbol], k->tail_len[symbol]);
+    p += k->tail_len[symbol];
+    k->len = (size_t)(p - k->buf);
+}
+
+typedef struct {
+    int64_t at;
+    uint32_t symbol;
+} Held;
+
+/* One session: presses key_down/key_up pairs in timestamp order */
+static void generate(const Work *w, uint64_t index, Sink *k) {
+    const SynthModel *m = w->m;
+    uint32_t n = m->symbols;
+    uint64_t rng = w->seed ^ (index + 1) * 0xD1B54A32D192ED03ULL;
+    Held held[SYNTH_HELD];
+    int nheld = 0;
+    int64_t t = draw_time(m->pause, &rng);
+    uint32_t prev = n;
+
+    for (uint64_t i = 0; i < w->presses; i++) {
+        int pause = prev == n || uniform(&rng) < m->pause_share;
+        uint32_t c = draw_symbol(&w->at, pause ? n : prev, n, &rng);
+        if (!pause && m->trans[(size_t)prev * n + c] == 0) pause = 1;    /* only via the start row */
+        if (i > 0) t += draw_time(pause ? m->pause : m->flight + ((size_t)prev * n + c) * SYNTH_QUANTILES, &rng);
+
+        /* Release what is due, and the same key if it is still down */
+        for (int pass = 1; pass;) {
+            pass = 0;
+            int first = -1;
+            for (int h = 0; h < nheld; h++)
+                if ((held[h].at <= t || held[h].symbol == c || nheld == SYNTH_HELD) &&
+                    (first < 0 || held[h].at < held[first].at)) first = h;
+            if (first >= 0) {
+                sink_event(k, m, held[first].symbol, held[first].at < t ? held[first].at : t, 1);
+                held[first] = held[--nheld];
+                pass = 1;
+            }
+        }
+        sink_event(k, m, c, t, 0);
+        held[nheld].at = t + draw_time(m->dwell + (size_t)c * SYNTH_QUANTILES, &rng);
+        held[nheld++].symbol = c;
+        prev = c;
+    }
+    while (nheld) {
+        int first = 0;
+        for (int h = 1; h < nheld; h++)
+            if (held[h].at < held[first].at) first = h;
+        sink_event(k, m, held[first].symbol, held[first].at, 1);
+        held[first] = held[--nheld];
+    }
+}
+
+static void *worker(void *arg) {
+    Work *w = arg;
+    Sink *k = malloc(sizeof(Sink));
+    k->tail = malloc(w->m->symbols * sizeof(*k->tail));
+    k->tail_len = malloc(w->m->symbols);
+    for (uint32_t c = 0; c < w->m->symbols; c++) {
+        const SynthSymbol *y = &w->m->sym[c];
+        int n = snprintf(k->tail[c], sizeof(k->tail[c]), "%d,%d,%s,%s,0\n", y->keycode,
+                         y->scancode, y->character, y->modifiers);
+        if (n < 0) n = snprintf(k->tail[c], sizeof(k->tail[c]), "0,0,,,0\n");
+        /* Long names can overflow the slot: keep what fits, still one row */
+        if (n >= (int)sizeof(k->tail[c])) {
+            n = (int)sizeof(k->tail[c]) - 1;
+            k->tail[c][n - 1] = '\n';
+        }
+        k->tail_len[c] = (uint8_t)n;
+    }
+    for (;;) {
+        uint64_t i = __atomic_fetch_add(&w->next, 1, __ATOMIC_RELAXED);
+        if (i >= w->sessions) break;
+        char path[4096], metadata[512];
+        snprintf(path, sizeof(path), "%s/synth_%06llu.%s", w->outdir, (unsigned long long)i, w->format);
+        snprintf(metadata, sizeof(metadata),
+                 "# platform=synthetic\n"
+                 "# language=c\n"
+                 "# mode=synth\n"
+                 "# clock_source=synthetic\n"
+                 "# start_time_utc=1970-01-01T00:00:00.000000Z\n"
+                 "# synth_seed=%llu\n"
+                 "# synth_index=%llu\n",
+                 (unsigned long long)w->seed, (unsigned long long)i);
+        k->parquet = !strcmp(w->format, "parquet");
+        k->len = 0;
+        k->seq = 0;
+        if (k->parquet) {
+            if (parquet_open(&k->pq, path, metadata, 0) != 0) k->parquet = -1;
+        } else {
+            k->f = !strcmp(w->format, "csv.gz") ? bgzf_open(path, 1, Z_DEFAULT_COMPRESSION) : fopen(path, "w");
+            if (k->f) fprintf(k->f, "%sseq,timestamp_ms,event_timestamp_ms,event_type,keycode,scancode,"
+                                    "character,modifiers,is_repeat\n", metadata);
+        }
+        if (k->parquet < 0 || (!k->parquet && !k->f)) {
+            fprintf(stderr, "Error: cannot open %s for writing\n", path);
+            __atomic_fetch_add(&w->failures, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+        generate(w, i, k);
+        int rc;
+        if (k->parquet) {
+            rc = parquet_close(&k->pq);
+        } else {
+            fwrite(k->buf, 1, k->len, k->f);
+            rc = fclose(k->f);
+        }
+        if (rc != 0) {
+            fprintf(stderr, "Error: failed writing %s\n", path);
+            __atomic_fetch_add(&w->failures, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(k->tail);
+    free(k->tail_len);
+    free(k);
+    return NULL;
+}
+
+static int cmd_generate(int argc, char *argv[]) {
+    uint64_t sessions = 1, presses = 10000, seed = 1;
+    const char *format = "csv";
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int argi = 0;
+    while (argi + 1 < argc && argv[argi][0] == '-' && argv[argi][1]) {
+        if (!strcmp(argv[argi], "-n")) sessions = strtoull(argv[argi + 1], NULL, 10);
+        else if (!strcmp(argv[argi], "-k")) presses = strtoull(argv[argi + 1], NULL, 10);
+        else if (!strcmp(argv[argi], "-s")) seed = strtoull(argv[argi + 1], NULL, 10);
+        else if (!strcmp(argv[argi], "-f")) format = argv[argi + 1];
+        else if (!strcmp(argv[argi], "-@")) threads = atoi(argv[argi + 1]);
+        else break;
+        argi += 2;
+    }
+    if (argi + 2 != argc || threads < 1 ||
+        (strcmp(format, "csv") && strcmp(format, "csv.gz") && strcmp(format, "parquet"))) {
+        fprintf(stderr, "Usage: synth generate [-n sessions] [-k presses] [-s seed] [-f csv|csv.gz|parquet] "
+                        "[-@ threads] model.ktsm outdir\n");
+        return 1;
+    }
+    SynthModel m;
+    if (model_load(&m, argv[argi]) != 0) {
+        fprintf(stderr, "Error: cannot read model %s\n", argv[argi]);
+        return 1;
+    }
+    const char *outdir = argv[argi + 1];
+    if (mkdir(outdir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: cannot create %s\n", outdir);
+        model_free(&m);
+        return 1;
+    }
+
+    uint32_t n = m.symbols;
+    AliasTables at = { malloc((size_t)(n + 1) * n * sizeof(float)), malloc((size_t)(n + 1) * n * sizeof(uint16_t)) };
+    uint32_t *small = malloc(n * sizeof(uint32_t)), *large = malloc(n * sizeof(uint32_t));
+    double *p = malloc(n * sizeof(double));
+    for (uint32_t r = 0; r <= n; r++) {
+        const uint32_t *row = r < n ? m.trans + (size_t)r * n : m.start;
+        uint64_t total = 0;
+        for (uint32_t c = 0; c < n; c++) total += row[c];
+        alias_build(total ? row : m.start, n, at.prob + (size_t)r * n, at.alias + (size_t)r * n, small, large, p);
+    }
+    free(small);
+    free(large);
+    free(p);
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    Work work = { &m, at, outdir, format, seed, presses, sessions, 0, 0 };
+    pthread_t *tids = malloc((size_t)threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, worker, &work);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double secs = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) / 1e9;
+    double events = 2.0 * (double)presses * (double)sessions;
+    fprintf(stderr, "%llu sessions, %.0f events in %.2f s (%.1f M events/s)\n", (unsigned long long)sessions,
+            events, secs, events / secs / 1e6);
+
+    free(tids);
+    free(at.prob);
+    free(at.alias);
+    model_free(&m);
+    return work.failures ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 4 && !strcmp(argv[1], "train")) return cmd_train(argc - 2, argv + 2);
+    if (argc >= 4 && !strcmp(argv[1], "generate")) return cmd_generate(argc - 2, argv + 2);
+
+    fprintf(stderr, "Usage: %s train [-p ms] model.ktsm session.csv [more.csv ...]\n", argv[0]);
+    fprintf(stderr, "       %s generate [-n sessions] [-k presses] [-s seed] [-f csv|csv.gz|parquet] "
+                    "[-@ threads] model.ktsm outdir\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,200 @@
+/*
+ * sysctx.h - What the machine was doing while we recorded (POSIX)
+ *
+ * A recorder samples a few system conditions once per SYSCTX_INTERVAL_MS
+ * on a thread of its own and appends them to <output>.sysctx.csv,
+ * stamped with the session clock so they line up with timestamp_ms:
+ *
+ *   timestamp_ms    end of the interval the row describes
+ *   cpu_mhz         mean current CPU frequency
+ *   load1           1-minute load average
+ *   runq_ms         time the capture thread spent runnable but waiting
+ *                   for a CPU during the interval (Linux schedstat)
+ *   major_faults    major page faults of the recorder in the interval
+ *   mem_pressure    share of the last 10 s some task stalled on memory,
+ *                   in % (Linux PSI); on macOS 0, 50 or 100 for the
+ *                   kernel's normal, warning and critical levels
+ *
+ * A condition the platform does not expose is left empty: macOS has no
+ * current CPU frequency or run-queue delay without root. Reading it all
+ * costs a few small file reads or sysctls per second.
+ *
+ * latency_context.c reads the file back to explain delivery latency
+ * spikes in the session.
+ *
+ * Used by terminal_macos.c (--sysctx) and latency_context.c.
+ */
+
+#ifndef SYSCTX_H
+#define SYSCTX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+#define SYSCTX_INTERVAL_MS 1000
+#define SYSCTX_FIELDS 5
+#define SYSCTX_CSV_HEADER "timestamp_ms,cpu_mhz,load1,runq_ms,major_faults,mem_pressure\n"
+
+/* One row; NAN where the platform does not say */
+typedef struct {
+    double timestamp_ms;
+    double v[SYSCTX_FIELDS];        /* in SYSCTX_CSV_HEADER order */
+} SysSample;
+
+enum { SYSCTX_CPU_MHZ, SYSCTX_LOAD1, SYSCTX_RUNQ_MS, SYSCTX_MAJOR_FAULTS, SYSCTX_MEM_PRESSURE };
+
+static const char *const sysctx_names[SYSCTX_FIELDS] = {
+    "cpu_mhz", "load1", "runq_ms", "major_faults", "mem_pressure",
+};
+
+typedef struct {
+    char schedstat[64];             /* the capture thread's, Linux only */
+    double last_wait_ns;
+    long last_majflt;
+} SysSampler;
+
+#ifdef __linux__
+/* Mean of the "cpu MHz" lines of /proc/cpuinfo */
+static inline double sysctx_cpu_mhz(void) {
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (!f) return NAN;
+    char line[256];
+    double sum = 0;
+    int n = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char *colon = strchr(line, ':');
+        double mhz;
+        if (!strncmp(line, "cpu MHz", 7) && colon && sscanf(colon + 1, "%lf", &mhz) == 1) {
+            sum += mhz;
+            n++;
+        }
+    }
+    fclose(f);
+    return n ? sum / n : NAN;
+}
+
+/* Nanoseconds the thread has spent waiting on a run queue */
+static inline double sysctx_wait_ns(const SysSampler *s) {
+    FILE *f = fopen(s->schedstat, "r");
+    if (!f) return NAN;
+    unsigned long long run, wait;
+    int ok = fscanf(f, "%llu %llu", &run, &wait) == 2;
+    fclose(f);
+    return ok ? (double)wait : NAN;
+}
+
+static inline double sysctx_mem_pressure(void) {
+    FILE *f = fopen("/proc/pressure/memory", "r");
+    if (!f) return NAN;
+    double avg10;
+    int ok = fscanf(f, "some avg10=%lf", &avg10) == 1;
+    fclose(f);
+    return ok ? avg10 : NAN;
+}
+#endif
+
+static inline long sysctx_majflt(void) {
+    struct rusage ru;
+    return getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_majflt : -1;
+}
+
+/*
+ * Call on the capture thread: on Linux its run-queue delay is the one
+ * sampled. The first sysctx_sample() then covers the time since this.
+ */
+static inline void sysctx_init(SysSampler *s) {
+    memset(s, 0, sizeof(*s));
+#ifdef __linux__
+    snprintf(s->schedstat, sizeof(s->schedstat), "/proc/self/task/%ld/schedstat", (long)syscall(SYS_gettid));
+    s->last_wait_ns = sysctx_wait_ns(s);
+#else
+    s->last_wait_ns = NAN;
+#endif
+    s->last_majflt = sysctx_majflt();
+}
+
+static inline void sysctx_sample(SysSampler *s, double now_ms, SysSample *out) {
+    out->timestamp_ms = now_ms;
+    for (int i = 0; i < SYSCTX_FIELDS; i++) out->v[i] = NAN;
+
+    double load[1];
+    if (getloadavg(load, 1) == 1) out->v[SYSCTX_LOAD1] = load[0];
+    long majflt = sysctx_majflt();
+    if (majflt >= 0 && s->last_majflt >= 0) out->v[SYSCTX_MAJOR_FAULTS] = (double)(majflt - s->last_majflt);
+    s->last_majflt = majflt;
+
+#ifdef __linux__
+    out->v[SYSCTX_CPU_MHZ] = sysctx_cpu_mhz();
+    double wait = sysctx_wait_ns(s);
+    out->v[SYSCTX_RUNQ_MS] = (wait - s->last_wait_ns) / 1e6;    /* NAN if either is */
+    s->last_wait_ns = wait;
+    out->v[SYSCTX_MEM_PRESSURE] = sysctx_mem_pressure();
+#endif
+#ifdef __APPLE__
+    int level = 0;
+    size_t len = sizeof(level);
+    if (sysctlbyname("kern.memorystatus_vm_pressure_level", &level, &len, NULL, 0) == 0) {
+        out->v[SYSCTX_MEM_PRESSURE] = level >= 4 ? 100 : level >= 2 ? 50 : 0;
+    }
+#endif
+}
+
+/* Formats one CSV row, leaving unknown fields empty */
+static inline int sysctx_format(const SysSample *s, char *buf, size_t len) {
+    int n = snprintf(buf, len, "%.3f", s->timestamp_ms);
+    for (int i = 0; i < SYSCTX_FIELDS && n > 0 && (size_t)n < len; i++) {
+        n += isnan(s->v[i]) ? snprintf(buf + n, len - n, ",")
+                            : snprintf(buf + n, len - n, ",%.2f", s->v[i]);
+    }
+    if (n > 0 && (size_t)n < len) n += snprintf(buf + n, len - n, "\n");
+    return n;
+}
+
+/*
+ * Loads a .sysctx.csv file. Returns the number of samples, in *out
+ * (free() it), or -1 if the file cannot be read.
+ */
+static inline long sysctx_load(const char *path, SysSample **out) {
+    FILE *f = fopen(path, "r");
+    if (!f) return -1;
+    size_t n = 0, cap = 256;
+    SysSample *v = malloc(cap * sizeof(*v));
+    char line[512];
+    while (v && fgets(line, sizeof(line), f)) {
+        if (line[0] < '0' || line[0] > '9') continue;   /* header */
+        if (n == cap) {
+            SysSample *grown = realloc(v, 2 * cap * sizeof(*v));
+            if (!grown) break;
+            v = grown;
+            cap *= 2;
+        }
+        SysSample *s = &v[n];
+        char *p = line, *end;
+        s->timestamp_ms = strtod(p, &end);
+        for (int i = 0; i < SYSCTX_FIELDS; i++) s->v[i] = NAN;
+        for (int i = 0; i < SYSCTX_FIELDS; i++) {
+            p = strchr(end, ',');
+            if (!p) break;
+            p++;
+            double x = strtod(p, &end);
+            if (end != p) s->v[i] = x;
+        }
+        n++;
+    }
+    fclose(f);
+    if (!v) return -1;
+    *out = v;
+    return (long)n;
+}
+
+#endif /* SYSCTX_H */
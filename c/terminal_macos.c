@@ -5,23 +5,64 @@
  * Requires Accessibility permissions in System Settings.
  *
  * Build: make terminal_macos (see Makefile)
- * Usage: ./terminal_macos [output.csv]
+ * Usage: ./terminal_macos [--agent host[:port]] [--baseline model.ktb]
+ *                         [--dashboard port] [--tui] [--plugin lib.so[=args]]...
+ *                         [--focus] [--sysctx]
+ *                         [output.csv|output.csv.gz|output.parquet|output.kts]
  *        Press Ctrl+C to stop and save.
+ *        A .gz output path writes seekable block-gzip CSV (bgzf.h), a
+ *        .parquet one writes Parquet instead of CSV (parquet.h). A .kts
+ *        path keeps no events, only the fixed-size n-gram summary of
+ *        sketch.h, rewritten every few seconds while recording.
+ *        Rhythm changes (changepoint.h) are reported as they happen and
+ *        logged to <output>.changes.csv.
+ *        --baseline scores each window of digraphs against the typist's
+ *        model (baseline.h) as it completes and learns the normal ones.
+ *        --agent also streams events to a collector while recording and
+ *        records the clock offset against it in the metadata header.
+ *        --dashboard serves live KPM, dwell/flight percentiles, held keys
+ *        and dropped events on http://127.0.0.1:port/ (dashboard.h).
+ *        --tui replaces the one-line status with a full-screen dashboard
+ *        (tui.h); rhythm and baseline notices are then only counted.
+ *        --plugin loads an analyzer built against plugin.h and feeds it
+ *        every event on its own thread (plugin_host.h), within a CPU
+ *        budget of PLUGIN_BUDGET of a core; repeat for more plugins.
+ *        --focus notes which application each key went to, from the
+ *        target pid an annotated tap reports, and writes the changes to
+ *        <output>.focus.csv (focus.h); not with a .kts output.
+ *        --sysctx samples load, memory pressure and page faults once a
+ *        second into <output>.sysctx.csv (sysctx.h), for
+ *        latency_context to explain delivery latency spikes.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <signal.h>
 #include <time.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <libproc.h>
 #include <sys/sysctl.h>
 #include <mach/mach_time.h>
 #include <CoreGraphics/CoreGraphics.h>
 #include <Carbon/Carbon.h>
+#include "fleet.h"
+#include "bgzf.h"
+#include "parquet.h"
+#include "sketch.h"
+#include "changepoint.h"
+#include "baseline.h"
+#include "dashboard.h"
+#include "tui.h"
+#include "plugin_host.h"
+#include "focus.h"
+#include "sysctx.h"
 
 #define MAX_EVENTS 100000
 #define DEFAULT_OUTPUT "output/c_terminal_macos.csv"
+#define SUMMARY_SAVE_S 5
 
 typedef struct {
     int seq;
@@ -33,12 +74,16 @@ typedef struct {
     char character[8];
     char modifiers[64];
     int is_repeat;
+    int32_t pid;                    /* target process (--focus), 0 if unknown */
 } KeyEvent;
 
 static KeyEvent events[MAX_EVENTS];
 static int event_count = 0;
 static volatile sig_atomic_t running = 1;
 
+/* Summary-only recording reuses events[] as a ring the summary thread drains */
+static int summary_only = 0;
+
 static mach_timebase_info_data_t timebase;
 static uint64_t start_time_abs;
 
@@ -104,12 +149,114 @@ static const char *keycode_to_char(int64_t keycode) {
 /* Track which keys are currently pressed for flags-changed events */
 static int modifier_key_down[256] = {0};
 
+/*
+ * Rhythm change points, appended to <output>.changes.csv as they happen.
+ * The tap callback only queues them; changes_thread does the I/O.
+ */
+#define CHANGE_QUEUE 256
+
+typedef struct {
+    int seq;
+    double timestamp_ms;
+    ChangePoint cp;
+} ChangeRow;
+
+static ChangeDetector rhythm;
+static double last_key_up_ms = NAN;
+static char changes_path[1024];
+static FILE *changes_file = NULL;
+static int change_count = 0;
+static ChangeRow change_queue[CHANGE_QUEUE];
+static long change_head = 0;            /* written by the tap callback */
+static long change_tail = 0;            /* written by changes_thread */
+static long changes_dropped = 0;
+
+/*
+ * Per-user baseline (--baseline), scored live by baseline_thread from the
+ * published events, so the tap never touches the model's mapping
+ */
+static Baseline baseline;
+static int use_baseline = 0;
+static long baseline_windows = 0, baseline_anomalous = 0;
+static long baseline_next = 0;              /* next event baseline_thread scores */
+
+/* Live metrics (--dashboard, --tui), aggregated here, shown by other threads */
+static Metrics live;
+static int use_live = 0, use_dashboard = 0, use_tui = 0;
+
+/* Analyzer plugins (--plugin), fed through plugin_host.h's ring */
+static PluginHost plugins;
+
+/*
+ * Focus attribution (--focus): the tap only stamps the target pid;
+ * focus_thread names it, once per pid, into focus_log
+ */
+static int use_focus = 0;
+static FocusTable focus;
+static FocusLog focus_log;
+static long focus_next = 0;                 /* next event focus_thread follows */
+
+static int focus_resolve(int32_t pid, char *name, size_t len) {
+    return proc_name(pid, name, (uint32_t)len) > 0 ? 0 : -1;
+}
+
+/* Called from the tap: a full queue drops the change rather than wait */
+static void record_change(const KeyEvent *e, const ChangePoint *cp) {
+    long head = change_head;
+    if (head - __atomic_load_n(&change_tail, __ATOMIC_ACQUIRE) >= CHANGE_QUEUE) {
+        changes_dropped++;
+        return;
+    }
+    ChangeRow *r = &change_queue[head % CHANGE_QUEUE];
+    r->seq = e->seq;
+    r->timestamp_ms = e->timestamp_ms;
+    r->cp = *cp;
+    __atomic_store_n(&change_head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void write_changes(void) {
+    long head = __atomic_load_n(&change_head, __ATOMIC_ACQUIRE);
+    for (long tail = change_tail; tail < head; tail++) {
+        const ChangeRow *r = &change_queue[tail % CHANGE_QUEUE];
+        const char *direction = r->cp.direction > 0 ? "slower" : "faster";
+        if (!use_tui) {
+            fprintf(stderr, "\n[rhythm] %s at seq %d: flight %.0f -> %.0f ms\n",
+                    direction, r->seq, r->cp.before_ms, r->cp.after_ms);
+        }
+        if (!changes_file) {
+            changes_file = fopen(changes_path, "w");
+            if (changes_file) fputs(CHANGEPOINT_CSV_HEADER, changes_file);
+        }
+        if (changes_file) {
+            fprintf(changes_file, "%d,%.3f,%s,%.1f,%.1f\n",
+                    r->seq, r->timestamp_ms, direction, r->cp.before_ms, r->cp.after_ms);
+        }
+        change_count++;
+        __atomic_store_n(&change_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+    if (changes_file) fflush(changes_file);
+}
+
+static void *changes_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        int done = !running;
+        write_changes();
+        if (done) break;
+        usleep(100000);
+    }
+    return NULL;
+}
+
 static CGEventRef event_callback(CGEventTapProxy proxy, CGEventType type,
                                   CGEventRef event, void *refcon) {
     (void)proxy;
     (void)refcon;
 
-    if (event_count >= MAX_EVENTS) return event;
+    if (!summary_only && event_count >= MAX_EVENTS) {
+        if (use_live) metrics_drop(&live);
+        return event;
+    }
 
     uint64_t now = mach_absolute_time();
     double ts_ms = abs_to_ms(now - start_time_abs);
@@ -144,7 +291,7 @@ static CGEventRef event_callback(CGEventTapProxy proxy, CGEventType type,
         return event;
     }
 
-    KeyEvent *e = &events[event_count];
+    KeyEvent *e = &events[event_count % MAX_EVENTS];
     e->seq = event_count + 1;
     e->timestamp_ms = ts_ms;
     e->event_timestamp_ms = event_ts_ms;
@@ -155,29 +302,64 @@ static CGEventRef event_callback(CGEventTapProxy proxy, CGEventType type,
     e->character[sizeof(e->character) - 1] = '\0';
     build_modifier_string(flags, e->modifiers, sizeof(e->modifiers));
     e->is_repeat = (int)autorepeat;
+    e->pid = use_focus ? (int32_t)CGEventGetIntegerValueField(event, kCGEventTargetUnixProcessID) : 0;
+
+    /* Publish the filled slot to the agent thread */
+    __atomic_store_n(&event_count, event_count + 1, __ATOMIC_RELEASE);
+
+    if (plugins.n) {
+        KtEvent k;
+        memset(&k, 0, sizeof(k));
+        k.seq = e->seq;
+        k.timestamp_ms = ts_ms;
+        k.event_timestamp_ms = event_ts_ms;
+        k.keycode = e->keycode;
+        k.scancode = 0;
+        k.type = !strcmp(event_type_str, "key_down") ? KT_KEY_DOWN
+               : !strcmp(event_type_str, "key_up") ? KT_KEY_UP : KT_OTHER;
+        k.is_repeat = (uint8_t)autorepeat;
+        k.modifiers = (uint16_t)(((flags & kCGEventFlagMaskShift) ? KT_MOD_SHIFT : 0) |
+                                 ((flags & kCGEventFlagMaskControl) ? KT_MOD_CTRL : 0) |
+                                 ((flags & kCGEventFlagMaskAlternate) ? KT_MOD_ALT : 0) |
+                                 ((flags & kCGEventFlagMaskCommand) ? KT_MOD_CMD : 0));
+        memcpy(k.character, e->character, sizeof(e->character));    /* 8 of 12 bytes, NUL included */
+        plugin_push(&plugins, &k);
+    }
+
+    if (use_live && !strcmp(event_type_str, "key_down")) {
+        metrics_key_down(&live, e->keycode, e->character, ts_ms, e->is_repeat);
+    } else if (use_live && !strcmp(event_type_str, "key_up")) {
+        metrics_key_up(&live, e->keycode, ts_ms);
+    }
 
-    event_count++;
+    ChangePoint cp;
+    if (type == kCGEventKeyUp) {
+        last_key_up_ms = ts_ms;
+    } else if (type == kCGEventKeyDown && !autorepeat && !isnan(last_key_up_ms) &&
+               changepoint_add(&rhythm, ts_ms - last_key_up_ms, &cp)) {
+        record_change(e, &cp);
+    }
 
-    fprintf(stderr, "\r[%d] %s %s (keycode=%d) t=%.3fms",
-            e->seq, event_type_str, e->character, e->keycode, ts_ms);
+    if (!use_tui) {
+        fprintf(stderr, "\r[%d] %s %s (keycode=%d) t=%.3fms",
+                e->seq, event_type_str, e->character, e->keycode, ts_ms);
+    }
 
     return event;
 }
 
+static void *dashboard_thread(void *arg) {
+    dashboard_run(arg);
+    return NULL;
+}
+
 static void signal_handler(int sig) {
     (void)sig;
     running = 0;
     CFRunLoopStop(CFRunLoopGetMain());
 }
 
-static void write_csv(const char *path) {
-    FILE *f = fopen(path, "w");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open %s for writing\n", path);
-        return;
-    }
-
-    /* Metadata header */
+static void format_metadata(char *buf, size_t len) {
     char platform[256];
     size_t plen = sizeof(platform);
     sysctlbyname("kern.osproductversion", platform, &plen, NULL, 0);
@@ -191,33 +373,328 @@ static void write_csv(const char *path) {
     char time_str[64];
     strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%S.000000Z", utc);
 
-    fprintf(f, "# platform=macOS-%s-%s\n", platform, machine);
-    fprintf(f, "# language=c\n");
-    fprintf(f, "# mode=terminal\n");
-    fprintf(f, "# clock_source=mach_absolute_time\n");
-    fprintf(f, "# start_time_utc=%s\n", time_str);
+    snprintf(buf, len,
+             "# platform=macOS-%s-%s\n"
+             "# language=c\n"
+             "# mode=terminal\n"
+             "# clock_source=mach_absolute_time\n"
+             "# start_time_utc=%s\n",
+             platform, machine, time_str);
+}
+
+static int format_row(const KeyEvent *e, char *buf, size_t len) {
+    return snprintf(buf, len, "%d,%.3f,%.3f,%s,%d,%d,%s,%s,%d\n",
+                    e->seq, e->timestamp_ms, e->event_timestamp_ms,
+                    e->event_type, e->keycode, e->scancode,
+                    e->character, e->modifiers, e->is_repeat);
+}
+
+static const FleetAgent *clock_agent = NULL;
+
+static double session_clock_ms(void) {
+    return abs_to_ms(mach_absolute_time() - start_time_abs);
+}
+
+static int has_suffix(const char *path, const char *suffix) {
+    size_t n = strlen(path), m = strlen(suffix);
+    return n >= m && !strcmp(path + n - m, suffix);
+}
+
+static void write_csv(const char *path) {
+    FILE *f = has_suffix(path, ".gz")
+        ? bgzf_open(path, (int)sysconf(_SC_NPROCESSORS_ONLN), Z_DEFAULT_COMPRESSION)
+        : fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", path);
+        return;
+    }
+
+    /* Metadata header */
+    char metadata[1024];
+    format_metadata(metadata, sizeof(metadata));
+    fputs(metadata, f);
+    if (clock_agent && clock_agent->clock.samples > 0) {
+        fleet_format_clock(&clock_agent->clock, clock_agent->addr, metadata, sizeof(metadata));
+        fputs(metadata, f);
+    }
 
     /* CSV header */
     fprintf(f, "seq,timestamp_ms,event_timestamp_ms,event_type,keycode,scancode,character,modifiers,is_repeat\n");
 
+    char row[FLEET_ROW_MAX];
     for (int i = 0; i < event_count; i++) {
-        KeyEvent *e = &events[i];
-        fprintf(f, "%d,%.3f,%.3f,%s,%d,%d,%s,%s,%d\n",
-                e->seq, e->timestamp_ms, e->event_timestamp_ms,
-                e->event_type, e->keycode, e->scancode,
-                e->character, e->modifiers, e->is_repeat);
+        format_row(&events[i], row, sizeof(row));
+        fputs(row, f);
     }
 
+    if (fclose(f) != 0) {
+        fprintf(stderr, "\nError: failed writing %s\n", path);
+        return;
+    }
+    fprintf(stderr, "\nWrote %d events to %s\n", event_count, path);
+}
+
+/* <output>.focus.csv: the context table and the seq of each focus change */
+static void write_focus(const char *output) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s.focus.csv", output);
+    FILE *f = focus_open(path, &focus);
+    if (!f) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", path);
+        return;
+    }
+    for (size_t i = 0; i < focus_log.n; i++) fprintf(f, "%d,%d\n", focus_log.seq[i], focus_log.contexts[i]);
     fclose(f);
+    fprintf(stderr, "Wrote %d applications, %zu focus changes to %s\n", focus.count, focus_log.n, path);
+}
+
+static void follow_focus(void) {
+    long n = __atomic_load_n(&event_count, __ATOMIC_ACQUIRE);
+    for (; focus_next < n; focus_next++) {
+        const KeyEvent *e = &events[focus_next];
+        focus_log_event(&focus, &focus_log, e->seq, e->pid, focus_resolve);
+    }
+}
+
+/* Focus mode: names the process of each published event, off the tap */
+static void *focus_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        int done = !running;
+        follow_focus();
+        if (done) break;
+        usleep(10000);
+    }
+    return NULL;
+}
+
+static void write_parquet(const char *path) {
+    char metadata[2048];
+    format_metadata(metadata, sizeof(metadata));
+    if (clock_agent && clock_agent->clock.samples > 0) {
+        size_t n = strlen(metadata);
+        fleet_format_clock(&clock_agent->clock, clock_agent->addr, metadata + n, sizeof(metadata) - n);
+    }
+
+    ParquetWriter w;
+    if (parquet_open(&w, path, metadata, 0) != 0) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", path);
+        return;
+    }
+    for (int i = 0; i < event_count; i++) {
+        const KeyEvent *e = &events[i];
+        ParquetEvent pe = {
+            .seq = e->seq,
+            .timestamp_us = llround(e->timestamp_ms * 1000.0),
+            .event_timestamp_us = llround(e->event_timestamp_ms * 1000.0),
+            .event_type = e->event_type,
+            .keycode = e->keycode,
+            .scancode = e->scancode,
+            .character = e->character,
+            .modifiers = e->modifiers,
+            .is_repeat = e->is_repeat,
+        };
+        parquet_add(&w, &pe);
+    }
+    if (parquet_close(&w) != 0) {
+        fprintf(stderr, "\nError: failed writing %s\n", path);
+        return;
+    }
     fprintf(stderr, "\nWrote %d events to %s\n", event_count, path);
 }
 
+/* Agent mode: the events array is the agent's source of sealed blocks */
+static long agent_available(void *ctx) {
+    (void)ctx;
+    return __atomic_load_n(&event_count, __ATOMIC_ACQUIRE);
+}
+
+static long agent_format(void *ctx, long first, long count, char *buf, size_t cap, size_t *len) {
+    (void)ctx;
+    size_t used = 0;
+    long i;
+    for (i = 0; i < count && cap - used >= FLEET_ROW_MAX; i++) {
+        used += (size_t)format_row(&events[(first + i) % MAX_EVENTS], buf + used, cap - used);
+    }
+    *len = used;
+    return i;
+}
+
+static int agent_finished(void *ctx) {
+    (void)ctx;
+    return !running;
+}
+
+static void *agent_thread(void *arg) {
+    FleetAgent *a = arg;
+    if (fleet_agent_run(a) == 0) {
+        fprintf(stderr, "\nagent: %ld events acknowledged by %s\n", a->acked, a->addr);
+    } else {
+        fprintf(stderr, "\nagent: gave up at seq %ld; events remain in the local CSV\n", a->acked);
+    }
+    if (a->lost) fprintf(stderr, "agent: %ld events were overwritten before they could be sent\n", a->lost);
+    return NULL;
+}
+
+/* Summary mode: folds events into the sketch as they are published */
+static Sketch summary;
+
+static void *summary_thread(void *arg) {
+    const char *path = arg;
+    long next = 0;
+    time_t saved = time(NULL);
+    for (;;) {
+        int done = !running;
+        long n = __atomic_load_n(&event_count, __ATOMIC_ACQUIRE);
+        if (n - next >= MAX_EVENTS) {
+            /* Lapped: the oldest unread events are already overwritten */
+            fprintf(stderr, "\nsummary: fell behind, skipped %ld events\n", n - MAX_EVENTS + 1 - next);
+            next = n - MAX_EVENTS + 1;
+        }
+        for (; next < n; next++) {
+            const KeyEvent *e = &events[next % MAX_EVENTS];
+            if (e->is_repeat || strcmp(e->event_type, "key_down") != 0) continue;
+            sketch_key_down(&summary, e->character, e->modifiers, e->timestamp_ms);
+        }
+        if (done) break;
+        if (time(NULL) - saved >= SUMMARY_SAVE_S) {
+            sketch_save(&summary, path);
+            saved = time(NULL);
+        }
+        usleep(50000);
+    }
+    return NULL;
+}
+
+static void follow_baseline(void) {
+    long n = __atomic_load_n(&event_count, __ATOMIC_ACQUIRE);
+    if (n - baseline_next >= MAX_EVENTS) {
+        /* Lapped (summary-only ring): the next digraph starts after the gap */
+        fprintf(stderr, "\nbaseline: fell behind, skipped %ld events\n", n - MAX_EVENTS + 1 - baseline_next);
+        baseline_next = n - MAX_EVENTS + 1;
+        baseline.have_prev = 0;
+    }
+    for (; baseline_next < n; baseline_next++) {
+        const KeyEvent *e = &events[baseline_next % MAX_EVENTS];
+        BaselineWindow w;
+        if (e->is_repeat || strcmp(e->event_type, "key_down") != 0 ||
+            !baseline_key_down(&baseline, e->character, e->timestamp_ms, &w))
+            continue;
+        baseline_windows++;
+        baseline_anomalous += w.anomalous;
+        if (use_tui) {
+            /* counted in the dashboard's status line */
+        } else if (isnan(w.score)) {
+            fprintf(stderr, "\n[baseline] window %ld: learning\n", baseline_windows);
+        } else {
+            fprintf(stderr, "\n[baseline] window %ld: score %.2f%s\n", baseline_windows, w.score,
+                    w.anomalous ? " ANOMALOUS" : "");
+        }
+    }
+}
+
+/* Baseline mode: scores the key presses of each published event, off the tap */
+static void *baseline_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        int done = !running;
+        follow_baseline();
+        if (done) break;
+        usleep(50000);
+    }
+    return NULL;
+}
+
+static void *tui_thread(void *arg) {
+    Tui *t = arg;
+    char status[256];
+    while (running) {
+        int n;
+        if (summary_only) {
+            n = snprintf(status, sizeof(status), "summary only    rhythm changes %d", change_count);
+        } else {
+            n = snprintf(status, sizeof(status), "buffer %d%% of %d events    rhythm changes %d",
+                         event_count * 100 / MAX_EVENTS, MAX_EVENTS, change_count);
+        }
+        if (use_baseline) {
+            n += snprintf(status + n, sizeof(status) - (size_t)n, "    baseline windows %ld, %ld anomalous",
+                          baseline_windows, baseline_anomalous);
+        }
+        if (plugins.n) {
+            int dropped = 0;
+            for (int i = 0; i < plugins.n; i++) dropped += __atomic_load_n(&plugins.plugins[i].dropped, __ATOMIC_RELAXED);
+            snprintf(status + n, sizeof(status) - (size_t)n, "    plugins %d, %d dropped", plugins.n, dropped);
+        }
+        tui_draw(t, &live, session_clock_ms(), status);
+        usleep(1000000 / TUI_FPS);
+    }
+    tui_end(t);
+    return NULL;
+}
+
+/* System context (--sysctx), sampled on its own thread */
+static int use_sysctx = 0;
+static SysSampler sampler;
+static FILE *sysctx_file = NULL;
+static int sysctx_count = 0;
+
+static void *sysctx_thread(void *arg) {
+    (void)arg;
+    double next = session_clock_ms() + SYSCTX_INTERVAL_MS;
+    while (running) {
+        usleep(100000);
+        double now = session_clock_ms();
+        if (now < next) continue;
+        SysSample sample;
+        char row[256];
+        sysctx_sample(&sampler, now, &sample);
+        sysctx_format(&sample, row, sizeof(row));
+        fputs(row, sysctx_file);
+        fflush(sysctx_file);
+        sysctx_count++;
+        next += SYSCTX_INTERVAL_MS;
+        if (next < now) next = now + SYSCTX_INTERVAL_MS;
+    }
+    return NULL;
+}
+
 static const char *resolved_output = NULL;
 
 int main(int argc, char *argv[]) {
     const char *output_path;
-    if (argc > 1) {
-        output_path = argv[1];
+    const char *agent_addr = NULL;
+    const char *baseline_path = NULL;
+    const char *plugin_specs[PLUGIN_MAX];
+    int nplugins = 0;
+    int dashboard_port = 0;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "--tui")) {
+            use_tui = use_live = 1;
+            argi++;
+            continue;
+        }
+        if (!strcmp(argv[argi], "--focus")) {
+            use_focus = 1;
+            argi++;
+            continue;
+        }
+        if (!strcmp(argv[argi], "--sysctx")) {
+            use_sysctx = 1;
+            argi++;
+            continue;
+        }
+        if (argi + 1 >= argc) break;
+        if (!strcmp(argv[argi], "--agent")) agent_addr = argv[argi + 1];
+        else if (!strcmp(argv[argi], "--baseline")) baseline_path = argv[argi + 1];
+        else if (!strcmp(argv[argi], "--dashboard")) dashboard_port = atoi(argv[argi + 1]);
+        else if (!strcmp(argv[argi], "--plugin") && nplugins < PLUGIN_MAX) plugin_specs[nplugins++] = argv[argi + 1];
+        else break;
+        argi += 2;
+    }
+
+    if (argi < argc) {
+        output_path = argv[argi];
     } else {
         static char resolved[1024];
         char *dir = dirname(argv[0]);
@@ -225,19 +702,71 @@ int main(int argc, char *argv[]) {
         output_path = resolved;
     }
     resolved_output = output_path;
+    summary_only = has_suffix(output_path, ".kts");
+    if (use_focus && summary_only) {
+        fprintf(stderr, "Error: --focus needs the events; a .kts output keeps none\n");
+        return 1;
+    }
+    focus_init(&focus);
+    focus_log_init(&focus_log);
+    static char sysctx_path[1100];
+    if (use_sysctx) {
+        snprintf(sysctx_path, sizeof(sysctx_path), "%s.sysctx.csv", output_path);
+        sysctx_file = fopen(sysctx_path, "w");
+        if (!sysctx_file) {
+            fprintf(stderr, "Error: cannot open %s for writing\n", sysctx_path);
+            return 1;
+        }
+        fputs(SYSCTX_CSV_HEADER, sysctx_file);
+    }
+    snprintf(changes_path, sizeof(changes_path), "%s.changes.csv", output_path);
+    changepoint_init(&rhythm, CHANGEPOINT_SLACK, CHANGEPOINT_THRESHOLD);
+    if (baseline_path) {
+        if (baseline_open(&baseline, baseline_path, 0) != 0) {
+            fprintf(stderr, "Error: cannot open baseline model %s\n", baseline_path);
+            return 1;
+        }
+        use_baseline = 1;
+    }
+    metrics_init(&live);
+    static Dashboard dashboard;
+    if (dashboard_port > 0) {
+        dashboard.port = dashboard_port;
+        dashboard.metrics = &live;
+        dashboard.clock_ms = session_clock_ms;
+        if (dashboard_open(&dashboard) != 0) {
+            fprintf(stderr, "Error: cannot serve dashboard on 127.0.0.1:%d: %s\n",
+                    dashboard_port, strerror(errno));
+            return 1;
+        }
+        use_dashboard = use_live = 1;
+    }
+    plugin_host_init(&plugins, PLUGIN_BUDGET, 0);
+    if (nplugins > 0) {
+        char plugin_metadata[1024], err[1200];
+        format_metadata(plugin_metadata, sizeof(plugin_metadata));
+        for (int i = 0; i < nplugins; i++) {
+            if (plugin_load(&plugins, plugin_specs[i], plugin_metadata, err, sizeof(err)) != 0) {
+                fprintf(stderr, "Error: cannot load plugin: %s\n", err);
+                return 1;
+            }
+        }
+    }
 
     mach_timebase_info(&timebase);
     start_time_abs = mach_absolute_time();
 
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
+    signal(SIGPIPE, SIG_IGN);
 
     CGEventMask mask = (1 << kCGEventKeyDown) |
                        (1 << kCGEventKeyUp) |
                        (1 << kCGEventFlagsChanged);
 
+    /* Only an annotated tap's events carry the target pid */
     CFMachPortRef tap = CGEventTapCreate(
-        kCGSessionEventTap,
+        use_focus ? kCGAnnotatedSessionEventTap : kCGSessionEventTap,
         kCGHeadInsertEventTap,
         kCGEventTapOptionListenOnly,
         mask,
@@ -258,11 +787,140 @@ int main(int argc, char *argv[]) {
     fprintf(stderr, "Keyboard timing (C/terminal/macOS) - Press keys, Ctrl+C to stop\n");
     fprintf(stderr, "Output: %s\n", output_path);
 
+    /* Session name: output basename plus start time, unique per recording */
+    static char agent_id[256], session[256], metadata[1024];
+    static FleetAgent agent;
+    pthread_t agent_tid;
+    if (agent_addr) {
+        if (gethostname(agent_id, sizeof(agent_id)) != 0) strcpy(agent_id, "agent");
+        agent_id[sizeof(agent_id) - 1] = '\0';
+        char *dot = strchr(agent_id, '.');
+        if (dot) *dot = '\0';
+
+        char pathcopy[1024], stamp[32];
+        snprintf(pathcopy, sizeof(pathcopy), "%s", output_path);
+        time_t t = time(NULL);
+        strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", gmtime(&t));
+        snprintf(session, sizeof(session), "%s", basename(pathcopy));
+        char *ext = strrchr(session, '.');
+        if (ext) *ext = '\0';
+        snprintf(session + strlen(session), sizeof(session) - strlen(session), "-%s", stamp);
+        format_metadata(metadata, sizeof(metadata));
+
+        agent.addr = agent_addr;
+        agent.agent_id = agent_id;
+        agent.session = session;
+        agent.metadata = metadata;
+        agent.src.available = agent_available;
+        agent.src.format = agent_format;
+        agent.src.finished = agent_finished;
+        agent.src.ring = summary_only ? MAX_EVENTS : 0;
+        agent.clock_ms = session_clock_ms;
+        agent.drain_ms = FLEET_DRAIN_MS;
+        agent.quiet = use_tui;
+        pthread_create(&agent_tid, NULL, agent_thread, &agent);
+        fprintf(stderr, "Agent: streaming to %s as %s/%s\n", agent_addr, agent_id, session);
+    }
+
+    pthread_t dashboard_tid;
+    if (use_dashboard) {
+        pthread_create(&dashboard_tid, NULL, dashboard_thread, &dashboard);
+        fprintf(stderr, "Dashboard: http://127.0.0.1:%d/\n", dashboard_port);
+    }
+
+    pthread_t summary_tid;
+    if (summary_only) {
+        sketch_init(&summary);
+        pthread_create(&summary_tid, NULL, summary_thread, (void *)output_path);
+    }
+
+    plugin_host_start(&plugins);
+
+    pthread_t changes_tid;
+    pthread_create(&changes_tid, NULL, changes_thread, NULL);
+
+    pthread_t focus_tid;
+    if (use_focus) pthread_create(&focus_tid, NULL, focus_thread, NULL);
+
+    pthread_t baseline_tid;
+    if (use_baseline) pthread_create(&baseline_tid, NULL, baseline_thread, NULL);
+
+    /* The tap callback runs on this thread, the one sysctx.h watches */
+    pthread_t sysctx_tid;
+    if (use_sysctx) {
+        sysctx_init(&sampler);
+        pthread_create(&sysctx_tid, NULL, sysctx_thread, NULL);
+    }
+
+    static Tui tui;
+    pthread_t tui_tid;
+    if (use_tui) {
+        static char title[1200];
+        snprintf(title, sizeof(title), "Keyboard timing (C/terminal/macOS) - %s", output_path);
+        tui_begin(&tui, stdout, title);
+        pthread_create(&tui_tid, NULL, tui_thread, &tui);
+    }
+
     while (running) {
         CFRunLoopRunInMode(kCFRunLoopDefaultMode, 1.0, true);
     }
 
-    write_csv(output_path);
+    if (use_tui) pthread_join(tui_tid, NULL);
+    if (use_sysctx) pthread_join(sysctx_tid, NULL);
+    pthread_join(changes_tid, NULL);
+    write_changes();    /* whatever the tap queued after the thread's last pass */
+    if (use_focus) {
+        pthread_join(focus_tid, NULL);
+        follow_focus();
+    }
+    if (use_baseline) {
+        pthread_join(baseline_tid, NULL);
+        follow_baseline();
+    }
+    plugin_host_finish(&plugins);
+    plugin_host_report(&plugins, stderr);
+
+    if (use_dashboard) {
+        dashboard.stop = 1;
+        pthread_join(dashboard_tid, NULL);
+    }
+
+    /* The agent drains first so the final clock estimate makes the header */
+    if (agent_addr) {
+        pthread_join(agent_tid, NULL);
+        clock_agent = &agent;
+    }
+
+    if (summary_only) {
+        pthread_join(summary_tid, NULL);
+        if (sketch_save(&summary, output_path) != 0) {
+            fprintf(stderr, "\nError: cannot write %s\n", output_path);
+        } else {
+            fprintf(stderr, "\nWrote summary of %d events to %s\n", event_count, output_path);
+        }
+    } else if (has_suffix(output_path, ".parquet")) {
+        write_parquet(output_path);
+    } else {
+        write_csv(output_path);
+    }
+    if (use_focus) {
+        write_focus(output_path);
+        focus_log_free(&focus_log);
+    }
+    if (sysctx_file) {
+        fclose(sysctx_file);
+        fprintf(stderr, "Wrote %d system samples to %s\n", sysctx_count, sysctx_path);
+    }
+    if (changes_file) {
+        fclose(changes_file);
+        fprintf(stderr, "Wrote %d rhythm changes to %s\n", change_count, changes_path);
+    }
+    if (changes_dropped) fprintf(stderr, "Dropped %ld rhythm changes (queue full)\n", changes_dropped);
+    if (use_baseline) {
+        fprintf(stderr, "Baseline: %ld windows, %ld anomalous; %s updated\n",
+                baseline_windows, baseline_anomalous, baseline_path);
+        baseline_close(&baseline);
+    }
 
     CFRelease(source);
     CFRelease(tap);
@@ -5,13 +5,26 @@
  * No special permissions needed (but must run in same session).
  *
  * Build: cl /O2 /W4 /Fe:terminal_windows.exe terminal_windows.c user32.lib kernel32.lib
- * Usage: terminal_windows.exe [output.csv]
+ * Usage: terminal_windows.exe [--tui] [--focus] [output.csv|output.parquet]
  *        Press Ctrl+C to stop and save.
+ *        A .parquet output path writes Parquet instead of CSV (parquet.h).
+ *        Rhythm changes (changepoint.h) are reported as they happen and
+ *        logged to <output>.changes.csv.
+ *        --tui replaces the one-line status with a full-screen dashboard
+ *        (tui.h); rhythm changes are then only counted.
+ *        --focus notes which application each key went to, as told by a
+ *        foreground-change hook, and writes the changes to
+ *        <output>.focus.csv (focus.h).
  */
 
 #include <windows.h>
 #include <stdio.h>
+#include <math.h>
 #include <time.h>
+#include "parquet.h"
+#include "changepoint.h"
+#include "tui.h"
+#include "focus.h"
 
 #define MAX_EVENTS 100000
 #define DEFAULT_OUTPUT "output\\c_terminal_windows.csv"
@@ -26,6 +39,7 @@ typedef struct {
     char character[16];
     char modifiers[64];
     int is_repeat;
+    DWORD pid;                      /* foreground process (--focus), 0 if unknown */
 } KeyEvent;
 
 static KeyEvent events[MAX_EVENTS];
@@ -109,8 +123,127 @@ static const char *vk_to_char(DWORD vk, DWORD scancode) {
     return buf;
 }
 
+/*
+ * Rhythm change points, appended to <output>.changes.csv as they happen.
+ * The hook only queues them; changes_thread does the I/O.
+ */
+#define CHANGE_QUEUE 256
+
+typedef struct {
+    int seq;
+    double timestamp_ms;
+    ChangePoint cp;
+} ChangeRow;
+
+static ChangeDetector rhythm;
+static double last_key_up_ms = -1.0;
+static unsigned char key_held[256];     /* the hook reports auto-repeat as fresh key_downs */
+static char changes_path[1024];
+static FILE *changes_file = NULL;
+static int change_count = 0;
+static ChangeRow change_queue[CHANGE_QUEUE];
+static volatile LONG change_head = 0;   /* written by the hook */
+static volatile LONG change_tail = 0;   /* written by changes_thread */
+static long changes_dropped = 0;
+
+/* Live metrics for the full-screen dashboard (--tui) */
+static Metrics live;
+static int use_tui = 0;
+
+/*
+ * Focus attribution (--focus). The foreground hook runs on the message
+ * loop's thread like the keyboard hook, so it only notes the pid and the
+ * keyboard hook stamps it; focus_thread names it, once per pid, into
+ * focus_log
+ */
+static int use_focus = 0;
+static FocusTable focus;
+static FocusLog focus_log;
+static volatile LONG focus_pid = 0;         /* written by the foreground hook */
+static int focus_next = 0;                  /* next event focus_thread follows */
+
+static int focus_resolve(int32_t pid, char *name, size_t len) {
+    HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+    if (!process) return -1;
+    char image[1024];
+    DWORD n = sizeof(image);
+    BOOL ok = QueryFullProcessImageNameA(process, 0, image, &n);
+    CloseHandle(process);
+    if (!ok) return -1;
+    const char *base = strrchr(image, '\\');
+    snprintf(name, len, "%s", base ? base + 1 : image);
+    return 0;
+}
+
+static void focus_window(HWND window) {
+    DWORD pid = 0;
+    if (window) GetWindowThreadProcessId(window, &pid);
+    focus_pid = (LONG)pid;
+}
+
+static void CALLBACK foreground_hook(HWINEVENTHOOK hook_, DWORD event, HWND window,
+                                     LONG object, LONG child, DWORD thread, DWORD time_ms) {
+    (void)hook_; (void)event; (void)object; (void)child; (void)thread; (void)time_ms;
+    focus_window(window);
+}
+
+/* Called from the hook: a full queue drops the change rather than wait */
+static void record_change(const KeyEvent *e, const ChangePoint *cp) {
+    LONG head = change_head;
+    LONG tail = change_tail;
+    MemoryBarrier();
+    if (head - tail >= CHANGE_QUEUE) {
+        changes_dropped++;
+        return;
+    }
+    ChangeRow *r = &change_queue[head % CHANGE_QUEUE];
+    r->seq = e->seq;
+    r->timestamp_ms = e->timestamp_ms;
+    r->cp = *cp;
+    MemoryBarrier();
+    change_head = head + 1;
+}
+
+static void write_changes(void) {
+    LONG head = change_head;
+    MemoryBarrier();
+    for (LONG tail = change_tail; tail < head; tail++) {
+        const ChangeRow *r = &change_queue[tail % CHANGE_QUEUE];
+        const char *direction = r->cp.direction > 0 ? "slower" : "faster";
+        if (!use_tui) fprintf(stderr, "\n[rhythm] %s at seq %d: flight %.0f -> %.0f ms\n",
+                direction, r->seq, r->cp.before_ms, r->cp.after_ms);
+        if (!changes_file) {
+            changes_file = fopen(changes_path, "w");
+            if (changes_file) fputs(CHANGEPOINT_CSV_HEADER, changes_file);
+        }
+        if (changes_file) {
+            fprintf(changes_file, "%d,%.3f,%s,%.1f,%.1f\n",
+                    r->seq, r->timestamp_ms, direction, r->cp.before_ms, r->cp.after_ms);
+        }
+        change_count++;
+        MemoryBarrier();
+        change_tail = tail + 1;
+    }
+    if (changes_file) fflush(changes_file);
+}
+
+static DWORD WINAPI changes_thread(LPVOID arg) {
+    (void)arg;
+    for (;;) {
+        int done = !running;
+        write_changes();
+        if (done) break;
+        Sleep(100);
+    }
+    return 0;
+}
+
 static LRESULT CALLBACK keyboard_hook(int nCode, WPARAM wParam, LPARAM lParam) {
-    if (nCode < 0 || event_count >= MAX_EVENTS) {
+    if (nCode < 0) {
+        return CallNextHookEx(hook, nCode, wParam, lParam);
+    }
+    if (event_count >= MAX_EVENTS) {
+        if (use_tui) metrics_drop(&live);
         return CallNextHookEx(hook, nCode, wParam, lParam);
     }
 
@@ -147,16 +280,52 @@ static LRESULT CALLBACK keyboard_hook(int nCode, WPARAM wParam, LPARAM lParam) {
     e->character[sizeof(e->character) - 1] = '\0';
     build_modifier_string(e->modifiers, sizeof(e->modifiers));
     e->is_repeat = is_repeat;
+    e->pid = (DWORD)focus_pid;
 
+    MemoryBarrier();    /* the event is whole before focus_thread sees it */
     event_count++;
 
-    fprintf(stderr, "\r[%d] %s %s (vk=0x%02lx sc=%ld) t=%.3fms",
-            e->seq, event_type_str, e->character,
-            (unsigned long)kb->vkCode, (long)kb->scanCode, ts_ms);
+    ChangePoint cp;
+    DWORD vk = kb->vkCode & 0xFF;
+    if (use_tui && event_type_str[4] == 'u') {
+        metrics_key_up(&live, e->keycode, ts_ms);
+    } else if (use_tui) {
+        metrics_key_down(&live, e->keycode, e->character, ts_ms, key_held[vk]);
+    }
+    if (event_type_str[4] == 'u') {
+        key_held[vk] = 0;
+        last_key_up_ms = ts_ms;
+    } else if (!key_held[vk]) {
+        key_held[vk] = 1;
+        if (last_key_up_ms >= 0 && changepoint_add(&rhythm, ts_ms - last_key_up_ms, &cp)) {
+            record_change(e, &cp);
+        }
+    }
+
+    if (!use_tui) {
+        fprintf(stderr, "\r[%d] %s %s (vk=0x%02lx sc=%ld) t=%.3fms",
+                e->seq, event_type_str, e->character,
+                (unsigned long)kb->vkCode, (long)kb->scanCode, ts_ms);
+    }
 
     return CallNextHookEx(hook, nCode, wParam, lParam);
 }
 
+static DWORD WINAPI tui_thread(LPVOID arg) {
+    Tui *t = arg;
+    char status[256];
+    while (running) {
+        snprintf(status, sizeof(status), "buffer %d%% of %d events    rhythm changes %d",
+                 event_count * 100 / MAX_EVENTS, MAX_EVENTS, change_count);
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        tui_draw(t, &live, qpc_to_ms(now), status);
+        Sleep(1000 / TUI_FPS);
+    }
+    tui_end(t);
+    return 0;
+}
+
 static BOOL WINAPI console_handler(DWORD type) {
     if (type == CTRL_C_EVENT || type == CTRL_CLOSE_EVENT) {
         running = 0;
@@ -166,17 +335,7 @@ static BOOL WINAPI console_handler(DWORD type) {
     return FALSE;
 }
 
-static void write_csv(const char *path) {
-    FILE *f = fopen(path, "w");
-    if (!f) {
-        fprintf(stderr, "Error: cannot open %s for writing\n", path);
-        return;
-    }
-
-    OSVERSIONINFOA osvi;
-    ZeroMemory(&osvi, sizeof(osvi));
-    osvi.dwOSVersionInfoSize = sizeof(osvi);
-
+static void format_metadata(char *buf, size_t len) {
     SYSTEM_INFO si;
     GetSystemInfo(&si);
     const char *arch = "unknown";
@@ -192,11 +351,25 @@ static void write_csv(const char *path) {
     char time_str[64];
     strftime(time_str, sizeof(time_str), "%Y-%m-%dT%H:%M:%S.000000Z", utc);
 
-    fprintf(f, "# platform=Windows-%s\n", arch);
-    fprintf(f, "# language=c\n");
-    fprintf(f, "# mode=terminal\n");
-    fprintf(f, "# clock_source=QueryPerformanceCounter\n");
-    fprintf(f, "# start_time_utc=%s\n", time_str);
+    snprintf(buf, len,
+             "# platform=Windows-%s\n"
+             "# language=c\n"
+             "# mode=terminal\n"
+             "# clock_source=QueryPerformanceCounter\n"
+             "# start_time_utc=%s\n",
+             arch, time_str);
+}
+
+static void write_csv(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", path);
+        return;
+    }
+
+    char metadata[1024];
+    format_metadata(metadata, sizeof(metadata));
+    fputs(metadata, f);
 
     fprintf(f, "seq,timestamp_ms,event_timestamp_ms,event_type,keycode,scancode,character,modifiers,is_repeat\n");
 
@@ -212,11 +385,90 @@ static void write_csv(const char *path) {
     fprintf(stderr, "\nWrote %d events to %s\n", event_count, path);
 }
 
+static void write_parquet(const char *path) {
+    char metadata[1024];
+    format_metadata(metadata, sizeof(metadata));
+
+    ParquetWriter w;
+    if (parquet_open(&w, path, metadata, 0) != 0) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", path);
+        return;
+    }
+    for (int i = 0; i < event_count; i++) {
+        const KeyEvent *e = &events[i];
+        ParquetEvent pe;
+        pe.seq = e->seq;
+        pe.timestamp_us = llround(e->timestamp_ms * 1000.0);
+        pe.event_timestamp_us = llround(e->event_timestamp_ms * 1000.0);
+        pe.event_type = e->event_type;
+        pe.keycode = e->keycode;
+        pe.scancode = e->scancode;
+        pe.character = e->character;
+        pe.modifiers = e->modifiers;
+        pe.is_repeat = e->is_repeat;
+        parquet_add(&w, &pe);
+    }
+    if (parquet_close(&w) != 0) {
+        fprintf(stderr, "\nError: failed writing %s\n", path);
+        return;
+    }
+    fprintf(stderr, "\nWrote %d events to %s\n", event_count, path);
+}
+
+/* <output>.focus.csv: the context table and the seq of each focus change */
+static void write_focus(const char *output) {
+    char path[1100];
+    snprintf(path, sizeof(path), "%s.focus.csv", output);
+    FILE *f = focus_open(path, &focus);
+    if (!f) {
+        fprintf(stderr, "Error: cannot open %s for writing\n", path);
+        return;
+    }
+    for (size_t i = 0; i < focus_log.n; i++) fprintf(f, "%d,%d\n", focus_log.seq[i], focus_log.contexts[i]);
+    fclose(f);
+    fprintf(stderr, "Wrote %d applications, %zu focus changes to %s\n", focus.count, focus_log.n, path);
+}
+
+static void follow_focus(void) {
+    int n = event_count;
+    MemoryBarrier();
+    for (; focus_next < n; focus_next++) {
+        const KeyEvent *e = &events[focus_next];
+        focus_log_event(&focus, &focus_log, e->seq, (int32_t)e->pid, focus_resolve);
+    }
+}
+
+/* Focus mode: names the process of each recorded event, off the hooks */
+static DWORD WINAPI focus_thread(LPVOID arg) {
+    (void)arg;
+    for (;;) {
+        int done = !running;
+        follow_focus();
+        if (done) break;
+        Sleep(10);
+    }
+    return 0;
+}
+
+static int is_parquet_path(const char *path) {
+    size_t n = strlen(path);
+    return n >= 8 && !strcmp(path + n - 8, ".parquet");
+}
+
 int main(int argc, char *argv[]) {
-    const char *output_path = (argc > 1) ? argv[1] : DEFAULT_OUTPUT;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-') {
+        if (!strcmp(argv[argi], "--tui")) use_tui = 1;
+        else if (!strcmp(argv[argi], "--focus")) use_focus = 1;
+        else break;
+        argi++;
+    }
+    const char *output_path = (argi < argc) ? argv[argi] : DEFAULT_OUTPUT;
 
     QueryPerformanceFrequency(&qpc_freq);
     QueryPerformanceCounter(&qpc_start);
+    snprintf(changes_path, sizeof(changes_path), "%s.changes.csv", output_path);
+    changepoint_init(&rhythm, CHANGEPOINT_SLACK, CHANGEPOINT_THRESHOLD);
 
     SetConsoleCtrlHandler(console_handler, TRUE);
 
@@ -226,17 +478,70 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    HWINEVENTHOOK foreground = NULL;
+    if (use_focus) {
+        focus_init(&focus);
+        focus_log_init(&focus_log);
+        foreground = SetWinEventHook(EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, NULL,
+                                     foreground_hook, 0, 0, WINEVENT_OUTOFCONTEXT);
+        if (!foreground) {
+            fprintf(stderr, "Error: Failed to set foreground hook (error %lu)\n", GetLastError());
+            UnhookWindowsHookEx(hook);
+            return 1;
+        }
+        focus_window(GetForegroundWindow());
+    }
+
     fprintf(stderr, "Keyboard timing (C/terminal/Windows) - Press keys, Ctrl+C to stop\n");
     fprintf(stderr, "Output: %s\n", output_path);
 
+    static Tui tui;
+    HANDLE tui_handle = NULL;
+    if (use_tui) {
+        static char title[1200];
+        snprintf(title, sizeof(title), "Keyboard timing (C/terminal/Windows) - %s", output_path);
+        metrics_init(&live);
+        tui_begin(&tui, stdout, title);
+        tui_handle = CreateThread(NULL, 0, tui_thread, &tui, 0, NULL);
+    }
+
+    HANDLE changes_handle = CreateThread(NULL, 0, changes_thread, NULL, 0, NULL);
+    HANDLE focus_handle = use_focus ? CreateThread(NULL, 0, focus_thread, NULL, 0, NULL) : NULL;
+
     MSG msg;
     while (running && GetMessage(&msg, NULL, 0, 0)) {
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
 
+    if (tui_handle) {
+        running = 0;
+        WaitForSingleObject(tui_handle, INFINITE);
+        CloseHandle(tui_handle);
+    }
+
     UnhookWindowsHookEx(hook);
-    write_csv(output_path);
+    if (foreground) UnhookWinEvent(foreground);
+    running = 0;
+    WaitForSingleObject(changes_handle, INFINITE);
+    CloseHandle(changes_handle);
+    write_changes();    /* whatever the hook queued after the thread's last pass */
+    if (focus_handle) {
+        WaitForSingleObject(focus_handle, INFINITE);
+        CloseHandle(focus_handle);
+    }
+    if (use_focus) follow_focus();
+    if (is_parquet_path(output_path)) write_parquet(output_path);
+    else write_csv(output_path);
+    if (use_focus) {
+        write_focus(output_path);
+        focus_log_free(&focus_log);
+    }
+    if (changes_file) {
+        fclose(changes_file);
+        fprintf(stderr, "Wrote %d rhythm changes to %s\n", change_count, changes_path);
+    }
+    if (changes_dropped) fprintf(stderr, "Dropped %ld rhythm changes (queue full)\n", changes_dropped);
 
     return 0;
 }
@@ -0,0 +1,328 @@
+/*
+ * tui.h - Full-screen ANSI dashboard for the terminal recorders
+ *
+ * tui_draw() lays out metrics.h state in a cell buffer, compares it with
+ * what the terminal already shows and writes only the cells that changed,
+ * as cursor moves, SGR attributes and UTF-8, in one write per frame. A
+ * recorder calls it from its own thread at TUI_FPS, so the capture
+ * callback never formats or prints anything while the dashboard is up.
+ *
+ *   keys per minute, with a sparkline of each second of the last minute
+ *   flight-time histogram of the last minute, with p50/p90/p99
+ *   dwell count and mean of the most pressed keys
+ *   capture health: events, drops, held keys and the recorder's status
+ *
+ * The layout is clipped, not reflowed, on terminals smaller than 80x24.
+ *
+ * Used by terminal_macos.c and terminal_windows.c (--tui).
+ */
+
+#ifndef TUI_H
+#define TUI_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include "metrics.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/ioctl.h>
+#endif
+
+#define TUI_FPS 10
+#define TUI_MAX_ROWS 120
+#define TUI_MAX_COLS 320
+#define TUI_FLIGHT_BINS 12          /* histogram rows */
+#define TUI_FLIGHT_BIN_MS 25.0      /* the last row holds everything above */
+#define TUI_KEYS_WIDTH 26           /* dwell table on the right */
+
+enum { TUI_PLAIN, TUI_BOLD, TUI_DIM, TUI_BAR, TUI_ALERT, TUI_ATTRS };
+
+static const char *const TUI_SGR[TUI_ATTRS] = {
+    "\x1b[0m", "\x1b[0;1m", "\x1b[0;2m", "\x1b[0;36m", "\x1b[0;1;31m",
+};
+
+typedef struct {
+    uint32_t ch;                    /* code point; 0 in front = unknown */
+    uint8_t attr;
+} TuiCell;
+
+typedef struct {
+    FILE *out;
+    const char *title;
+    int rows, cols;
+    TuiCell back[TUI_MAX_ROWS * TUI_MAX_COLS];   /* frame being drawn */
+    TuiCell front[TUI_MAX_ROWS * TUI_MAX_COLS];  /* what the terminal shows */
+    char buf[1 << 16];
+    size_t len;
+    size_t frame_bytes;             /* written by the previous tui_draw */
+} Tui;
+
+static inline void tui_size(int *rows, int *cols) {
+    *rows = 24;
+    *cols = 80;
+#ifdef _WIN32
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+        *rows = info.srWindow.Bottom - info.srWindow.Top + 1;
+        *cols = info.srWindow.Right - info.srWindow.Left + 1;
+    }
+#else
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        *rows = ws.ws_row;
+        *cols = ws.ws_col;
+    }
+#endif
+    if (*rows > TUI_MAX_ROWS) *rows = TUI_MAX_ROWS;
+    if (*cols > TUI_MAX_COLS) *cols = TUI_MAX_COLS;
+}
+
+static inline void tui_emit(Tui *t, const char *s, size_t n) {
+    if (t->len + n > sizeof(t->buf)) {
+        fwrite(t->buf, 1, t->len, t->out);
+        t->frame_bytes += t->len;
+        t->len = 0;
+    }
+    memcpy(t->buf + t->len, s, n);
+    t->len += n;
+}
+
+static inline void tui_emit_str(Tui *t, const char *s) {
+    tui_emit(t, s, strlen(s));
+}
+
+/* Switches to the alternate screen and hides the cursor */
+static inline void tui_begin(Tui *t, FILE *out, const char *title) {
+    t->out = out;
+    t->title = title;
+    t->rows = t->cols = 0;
+    t->len = 0;
+#ifdef _WIN32
+    HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    if (GetConsoleMode(h, &mode)) SetConsoleMode(h, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+    fputs("\x1b[?1049h\x1b[?25l", out);
+    fflush(out);
+}
+
+static inline void tui_end(Tui *t) {
+    fputs("\x1b[0m\x1b[?25h\x1b[?1049l", t->out);
+    fflush(t->out);
+}
+
+/* Writes UTF-8 text at row r, column c, clipped to the screen */
+static inline void tui_text(Tui *t, int r, int c, int attr, const char *s) {
+    if (r < 0 || r >= t->rows) return;
+    const unsigned char *p = (const unsigned char *)s;
+    while (*p && c < t->cols) {
+        uint32_t ch = *p++;
+        int extra = ch >= 0xF0 ? 3 : ch >= 0xE0 ? 2 : ch >= 0xC0 ? 1 : 0;
+        if (extra) ch &= 0x3F >> extra;
+        for (; extra > 0 && (*p & 0xC0) == 0x80; extra--) ch = (ch << 6) | (*p++ & 0x3F);
+        if (c >= 0) {
+            TuiCell *cell = &t->back[r * TUI_MAX_COLS + c];
+            cell->ch = ch < 0x20 ? ' ' : ch;
+            cell->attr = (uint8_t)attr;
+        }
+        c++;
+    }
+}
+
+static inline void tui_printf(Tui *t, int r, int c, int attr, const char *fmt, ...) {
+    char line[TUI_MAX_COLS * 4 + 1];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    tui_text(t, r, c, attr, line);
+}
+
+static inline void tui_fill(Tui *t, int r, int c, int n, uint32_t ch, int attr) {
+    if (r < 0 || r >= t->rows) return;
+    for (int i = c; i < c + n && i < t->cols; i++) {
+        if (i < 0) continue;
+        t->back[r * TUI_MAX_COLS + i].ch = ch;
+        t->back[r * TUI_MAX_COLS + i].attr = (uint8_t)attr;
+    }
+}
+
+/* A bar of value/max over width cells, in eighths of a cell */
+static inline void tui_bar(Tui *t, int r, int c, int width, double value, double max, int attr) {
+    int eighths = max > 0 ? (int)(value / max * width * 8 + 0.5) : 0;
+    if (value > 0 && eighths == 0) eighths = 1;
+    tui_fill(t, r, c, eighths / 8, 0x2588, attr);
+    if (eighths % 8) tui_fill(t, r, c + eighths / 8, 1, 0x2590 - (uint32_t)(eighths % 8), attr);
+}
+
+/* Writes the cells that differ from the terminal, then flushes */
+static inline void tui_flush(Tui *t) {
+    int cur_r = -1, cur_c = -1, cur_attr = -1;
+    char seq[32];
+    for (int r = 0; r < t->rows; r++) {
+        for (int c = 0; c < t->cols; c++) {
+            TuiCell *b = &t->back[r * TUI_MAX_COLS + c], *f = &t->front[r * TUI_MAX_COLS + c];
+            if (b->ch == f->ch && b->attr == f->attr) continue;
+            if (r != cur_r || c != cur_c) {
+                tui_emit(t, seq, (size_t)snprintf(seq, sizeof(seq), "\x1b[%d;%dH", r + 1, c + 1));
+            }
+            if (b->attr != cur_attr) {
+                tui_emit_str(t, TUI_SGR[b->attr]);
+                cur_attr = b->attr;
+            }
+            uint32_t ch = b->ch;
+            size_t n;
+            if (ch < 0x80) {
+                seq[0] = (char)ch;
+                n = 1;
+            } else if (ch < 0x800) {
+                seq[0] = (char)(0xC0 | (ch >> 6));
+                seq[1] = (char)(0x80 | (ch & 0x3F));
+                n = 2;
+            } else if (ch < 0x10000) {
+                seq[0] = (char)(0xE0 | (ch >> 12));
+                seq[1] = (char)(0x80 | ((ch >> 6) & 0x3F));
+                seq[2] = (char)(0x80 | (ch & 0x3F));
+                n = 3;
+            } else {
+                seq[0] = (char)(0xF0 | (ch >> 18));
+                seq[1] = (char)(0x80 | ((ch >> 12) & 0x3F));
+                seq[2] = (char)(0x80 | ((ch >> 6) & 0x3F));
+                seq[3] = (char)(0x80 | (ch & 0x3F));
+                n = 4;
+            }
+            tui_emit(t, seq, n);
+            *f = *b;
+            cur_r = r;
+            cur_c = c + 1;
+        }
+    }
+    if (t->len) fwrite(t->buf, 1, t->len, t->out);
+    t->frame_bytes += t->len;
+    t->len = 0;
+    fflush(t->out);
+}
+
+static inline void tui_draw_flight(Tui *t, const uint32_t *flight, int top, int width) {
+    static const double ps[3] = { 0.50, 0.90, 0.99 };
+    double q[3];
+    uint64_t n;
+    metrics_percentiles(flight, ps, q, 3, &n);
+    tui_text(t, top, 0, TUI_BOLD, "Flight, last minute");
+    if (n && width >= 48) tui_printf(t, top, 21, TUI_DIM, "p50 %.0f p90 %.0f p99 %.0f ms", q[0], q[1], q[2]);
+
+    uint64_t bins[TUI_FLIGHT_BINS] = {0}, max = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        if (!flight[b]) continue;
+        int i = (int)(metrics_bucket_ms(b) / TUI_FLIGHT_BIN_MS);
+        bins[i < TUI_FLIGHT_BINS ? i : TUI_FLIGHT_BINS - 1] += flight[b];
+    }
+    for (int i = 0; i < TUI_FLIGHT_BINS; i++) {
+        if (bins[i] > max) max = bins[i];
+    }
+    int rows = t->rows - top - 7 < TUI_FLIGHT_BINS ? t->rows - top - 7 : TUI_FLIGHT_BINS;
+    int bar = width - 19;
+    for (int i = 0; i < rows; i++) {
+        int r = top + 1 + i, lo = (int)(i * TUI_FLIGHT_BIN_MS);
+        if (i == TUI_FLIGHT_BINS - 1) tui_printf(t, r, 1, TUI_DIM, "%4d+    ms", lo);
+        else tui_printf(t, r, 1, TUI_DIM, "%4d-%-3d ms", lo, (int)((i + 1) * TUI_FLIGHT_BIN_MS));
+        if (bar > 0) tui_bar(t, r, 13, bar, (double)bins[i], (double)max, TUI_BAR);
+        tui_printf(t, r, width - 6, TUI_PLAIN, "%6llu", (unsigned long long)bins[i]);
+    }
+}
+
+static inline void tui_draw_keys(Tui *t, Metrics *m, int top, int left) {
+    int order[METRICS_KEYS], count = 0;
+    uint32_t n[METRICS_KEYS];
+    for (int k = 0; k < METRICS_KEYS; k++) {
+        n[k] = METRICS_GET(&m->dwell_n[k]);
+        if (n[k]) order[count++] = k;
+    }
+    /* Most pressed first; insertion sort of at most METRICS_KEYS entries */
+    for (int i = 1; i < count; i++) {
+        int k = order[i], j = i;
+        for (; j > 0 && n[order[j - 1]] < n[k]; j--) order[j] = order[j - 1];
+        order[j] = k;
+    }
+    tui_text(t, top, left, TUI_BOLD, "Dwell by key");
+    tui_text(t, top + 1, left, TUI_DIM, "key          n  mean ms");
+    int rows = t->rows - top - 8;  /* down to a blank line above Capture */
+    for (int i = 0; i < count && i < rows; i++) {
+        int k = order[i];
+        char name[sizeof(m->names[k])];
+        memcpy(name, m->names[k], sizeof(name));
+        name[sizeof(name) - 1] = '\0';
+        double mean = (double)METRICS_GET(&m->dwell_us[k]) / 1000.0 / n[k];
+        tui_printf(t, top + 2 + i, left, TUI_PLAIN, "%-8s %6u %8.1f", name, n[k], mean);
+    }
+}
+
+/*
+ * Draws one frame for time now_ms. status is the recorder's own line for
+ * the capture section (buffer use, rhythm changes and the like).
+ */
+static inline void tui_draw(Tui *t, Metrics *m, double now_ms, const char *status) {
+    int rows, cols;
+    tui_size(&rows, &cols);
+    if (rows != t->rows || cols != t->cols) {
+        /* Resized: the terminal content is unknown, repaint everything */
+        t->rows = rows;
+        t->cols = cols;
+        memset(t->front, 0, sizeof(t->front));
+        tui_emit_str(t, "\x1b[0m\x1b[2J");
+    }
+    for (int r = 0; r < rows; r++) tui_fill(t, r, 0, cols, ' ', TUI_PLAIN);
+
+    long s = (long)(now_ms / 1000.0);
+    tui_text(t, 0, 0, TUI_BOLD, t->title);
+    tui_printf(t, 0, cols - 8, TUI_DIM, "%02ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+
+    uint32_t per_second[METRICS_KPM_S];
+    uint64_t kpm = metrics_kpm(m, now_ms, per_second), peak = 0;
+    tui_text(t, 2, 0, TUI_BOLD, "KPM");
+    tui_printf(t, 2, 4, TUI_PLAIN, "%5llu", (unsigned long long)kpm);
+    int spark = cols - 12 < METRICS_KPM_S ? cols - 12 : METRICS_KPM_S;
+    for (int i = 0; i < METRICS_KPM_S; i++) {
+        if (per_second[i] > peak) peak = per_second[i];
+    }
+    for (int i = 0; i < spark; i++) {
+        uint32_t c = per_second[METRICS_KPM_S - spark + i];
+        uint32_t level = peak ? (uint32_t)((c * 8 + peak - 1) / peak) : 0;
+        tui_fill(t, 2, 11 + i, 1, level ? 0x2580 + level : ' ', TUI_BAR);
+    }
+
+    uint32_t dwell[METRICS_BUCKETS], flight[METRICS_BUCKETS];
+    metrics_window(m, now_ms, dwell, flight);
+    int wide = cols >= 80;
+    tui_draw_flight(t, flight, 4, wide ? cols - TUI_KEYS_WIDTH - 2 : cols);
+    if (wide) tui_draw_keys(t, m, 4, cols - TUI_KEYS_WIDTH);
+
+    uint64_t dropped = METRICS_GET(&m->dropped);
+    tui_text(t, rows - 5, 0, TUI_BOLD, "Capture");
+    tui_printf(t, rows - 4, 1, TUI_PLAIN, "events %llu",
+               (unsigned long long)METRICS_GET(&m->events));
+    tui_printf(t, rows - 4, 22, dropped ? TUI_ALERT : TUI_PLAIN, "dropped %llu", (unsigned long long)dropped);
+    tui_text(t, rows - 4, 42, TUI_PLAIN, "held");
+    int c = 47;
+    for (int k = 0; k < METRICS_KEYS; k++) {
+        if (METRICS_GET(&m->down_us[k]) == METRICS_UP) continue;
+        char name[sizeof(m->names[k])];
+        memcpy(name, m->names[k], sizeof(name));
+        name[sizeof(name) - 1] = '\0';
+        tui_text(t, rows - 4, c, TUI_BOLD, name);
+        c += (int)strlen(name) + 1;
+    }
+    tui_text(t, rows - 3, 1, TUI_PLAIN, status);
+    tui_printf(t, rows - 1, 0, TUI_DIM, "Ctrl+C stops and saves    last frame %zu bytes", t->frame_bytes);
+
+    t->frame_bytes = 0;
+    tui_flush(t);
+}
+
+#endif /* TUI_H */
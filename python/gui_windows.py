@@ -7,6 +7,11 @@ No special permissions needed.
 
 Usage: python gui_windows.py [output.csv]
        Press Escape to stop and save.
+
+Key handlers only take the timestamp and store the raw event fields in
+a preallocated buffer; characters and modifiers are formatted when the
+CSV is written. The window is refreshed by a fixed-rate after() tick,
+so fast typing never waits on widget updates in the Tk loop.
 """
 
 import sys
@@ -17,12 +22,16 @@ import tkinter as tk
 from datetime import datetime, timezone
 
 DEFAULT_OUTPUT = "output/python_gui_windows.csv"
+EVENT_CHUNK = 65536  # buffer slots added at a time
+DISPLAY_INTERVAL_MS = 100
 
 
 class KeyboardTimerGUI:
     def __init__(self, output_path):
         self.output_path = output_path
-        self.events = []
+        self.events = [None] * EVENT_CHUNK
+        self.count = 0
+        self.shown = 0
         self.start_ns = time.perf_counter_ns()
         self.keys_down = set()
 
@@ -47,9 +56,7 @@ class KeyboardTimerGUI:
         self.root.bind("<KeyPress>", self._on_key_down)
         self.root.bind("<KeyRelease>", self._on_key_up)
         self.root.focus_force()
-
-    def _timestamp_ms(self):
-        return (time.perf_counter_ns() - self.start_ns) / 1e6
+        self.root.after(DISPLAY_INTERVAL_MS, self._tick)
 
     @staticmethod
     def _modifier_string(state):
@@ -62,19 +69,26 @@ class KeyboardTimerGUI:
             parts.append("alt")
         return "+".join(parts) if parts else "none"
 
-    def _get_character(self, event):
-        if event.char and event.char.isprintable():
-            return event.char
-        keysym = event.keysym.lower()
+    @staticmethod
+    def _get_character(char, keysym, keycode):
+        if char and char.isprintable():
+            return char
+        keysym = keysym.lower()
         if keysym in ("return", "tab", "space", "backspace", "escape",
                        "shift_l", "shift_r", "control_l", "control_r",
                        "alt_l", "alt_r"):
             return keysym
-        return f"0x{event.keycode:02x}"
+        return f"0x{keycode:02x}"
+
+    def _record(self, now_ns, event, event_type, is_repeat):
+        if self.count == len(self.events):
+            self.events.extend([None] * EVENT_CHUNK)
+        self.events[self.count] = (now_ns, event.time, event_type, event.keycode,
+                                   event.char, event.keysym, event.state, is_repeat)
+        self.count += 1
 
     def _on_key_down(self, event):
-        ts_ms = self._timestamp_ms()
-        event_ts_ms = float(event.time) if event.time else 0.0
+        now_ns = time.perf_counter_ns()
 
         is_repeat = 1 if event.keycode in self.keys_down else 0
         self.keys_down.add(event.keycode)
@@ -83,53 +97,29 @@ class KeyboardTimerGUI:
             self._save_and_quit()
             return
 
-        character = self._get_character(event)
-        record = {
-            "seq": len(self.events) + 1,
-            "timestamp_ms": ts_ms,
-            "event_timestamp_ms": event_ts_ms,
-            "event_type": "key_down",
-            "keycode": event.keycode,
-            "scancode": 0,
-            "character": character,
-            "modifiers": self._modifier_string(event.state),
-            "is_repeat": is_repeat,
-        }
-        self.events.append(record)
-        self._update_display(record)
+        self._record(now_ns, event, "key_down", is_repeat)
 
     def _on_key_up(self, event):
-        ts_ms = self._timestamp_ms()
-        event_ts_ms = float(event.time) if event.time else 0.0
-
+        now_ns = time.perf_counter_ns()
         self.keys_down.discard(event.keycode)
-
-        character = self._get_character(event)
-        record = {
-            "seq": len(self.events) + 1,
-            "timestamp_ms": ts_ms,
-            "event_timestamp_ms": event_ts_ms,
-            "event_type": "key_up",
-            "keycode": event.keycode,
-            "scancode": 0,
-            "character": character,
-            "modifiers": self._modifier_string(event.state),
-            "is_repeat": 0,
-        }
-        self.events.append(record)
-        self._update_display(record)
-
-    def _update_display(self, record):
-        self.label.config(
-            text=(
-                "Keyboard Timing (Python/GUI/Windows)\n\n"
-                "Press keys to record timing.\n"
-                "Press Escape to stop and save.\n\n"
-                f"Events: {len(self.events)}\n"
-                f"Last: [{record['seq']}] {record['event_type']} "
-                f"{record['character']} t={record['timestamp_ms']:.3f}ms"
+        self._record(now_ns, event, "key_up", 0)
+
+    def _tick(self):
+        if self.count != self.shown:
+            self.shown = self.count
+            now_ns, _, event_type, keycode, char, keysym, _, _ = self.events[self.count - 1]
+            self.label.config(
+                text=(
+                    "Keyboard Timing (Python/GUI/Windows)\n\n"
+                    "Press keys to record timing.\n"
+                    "Press Escape to stop and save.\n\n"
+                    f"Events: {self.count}\n"
+                    f"Last: [{self.count}] {event_type} "
+                    f"{self._get_character(char, keysym, keycode)} "
+                    f"t={(now_ns - self.start_ns) / 1e6:.3f}ms"
+                )
             )
-        )
+        self.root.after(DISPLAY_INTERVAL_MS, self._tick)
 
     def _save_and_quit(self):
         self.write_csv()
@@ -148,14 +138,15 @@ class KeyboardTimerGUI:
 
             f.write("seq,timestamp_ms,event_timestamp_ms,event_type,keycode,scancode,character,modifiers,is_repeat\n")
 
-            for e in self.events:
+            for seq in range(1, self.count + 1):
+                now_ns, event_time, event_type, keycode, char, keysym, state, is_repeat = self.events[seq - 1]
                 f.write(
-                    f"{e['seq']},{e['timestamp_ms']:.3f},{e['event_timestamp_ms']:.3f},"
-                    f"{e['event_type']},{e['keycode']},{e['scancode']},"
-                    f"{e['character']},{e['modifiers']},{e['is_repeat']}\n"
+                    f"{seq},{(now_ns - self.start_ns) / 1e6:.3f},{float(event_time or 0):.3f},"
+                    f"{event_type},{keycode},0,"
+                    f"{self._get_character(char, keysym, keycode)},{self._modifier_string(state)},{is_repeat}\n"
                 )
 
-        print(f"Wrote {len(self.events)} events to {self.output_path}", file=sys.stderr)
+        print(f"Wrote {self.count} events to {self.output_path}", file=sys.stderr)
 
     def run(self):
         print("Keyboard timing (Python/GUI/Windows) - Press keys, Escape to stop", file=sys.stderr)